@@ -37,6 +37,7 @@ $(LLAMA_CPP_OBJS): private				\
 		CCFLAGS +=				\
 			-DGGML_MULTIPLATFORM		\
 			-DGGML_USE_LLAMAFILE		\
+			-DGGML_USE_RPC			\
 
 o/$(MODE)/llama.cpp/ggml.o \
 o/$(MODE)/llama.cpp/ggml-vector-amd-avx2.o \
@@ -85,6 +86,20 @@ o/$(MODE)/llama.cpp/ggml-vector-arm82.o: private TARGET_ARCH += -Xaarch64-march=
 
 $(LLAMA_CPP_OBJS): llama.cpp/BUILD.mk
 
+o/$(MODE)/llama.cpp/kv_cache_test:			\
+		o/$(MODE)/llama.cpp/kv_cache_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/llama.cpp/kv_cache_test.runs:			\
+		models/TinyLLama-v0.1-5M-F16.gguf	\
+
+o/$(MODE)/llama.cpp/sampling_test:			\
+		o/$(MODE)/llama.cpp/sampling_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/llama.cpp/sampling_test.runs:			\
+		models/TinyLLama-v0.1-5M-F16.gguf	\
+
 .PHONY: o/$(MODE)/llama.cpp
 o/$(MODE)/llama.cpp: 					\
 		o/$(MODE)/llama.cpp/main		\
@@ -93,4 +108,6 @@ o/$(MODE)/llama.cpp: 					\
 		o/$(MODE)/llama.cpp/imatrix		\
 		o/$(MODE)/llama.cpp/quantize		\
 		o/$(MODE)/llama.cpp/perplexity		\
-		o/$(MODE)/llama.cpp/llama-bench
+		o/$(MODE)/llama.cpp/llama-bench		\
+		o/$(MODE)/llama.cpp/kv_cache_test.runs	\
+		o/$(MODE)/llama.cpp/sampling_test.runs
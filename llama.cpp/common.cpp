@@ -167,7 +167,11 @@ bool gpt_params_parse_ex(int argc, char ** argv, gpt_params & params) {
     }
 
     FLAGS_READY = true;
-    params.n_gpu_layers = llamafile_gpu_layers(params.n_gpu_layers);
+    if (!params.rpc_servers.empty() && params.n_gpu_layers > 0 && !llamafile_has_gpu()) {
+        FLAG_gpu = LLAMAFILE_GPU_DISABLE; // [jart] offload to rpc workers
+    } else {
+        params.n_gpu_layers = llamafile_gpu_layers(params.n_gpu_layers);
+    }
     FLAG_threads = params.n_threads; // [jart]
     FLAG_threads_batch = params.n_threads_batch; // [jart]
 
@@ -208,6 +212,9 @@ bool gpt_params_find_arg(int argc, char ** argv, const std::string & arg, gpt_pa
     if (arg == "--server") {
         return true;
     }
+    if (arg == "--rpc-server") {
+        return true;
+    }
     if (arg == "--trace") {
         FLAG_trace = true;
         FLAG_unsecure = true;
@@ -233,6 +240,18 @@ bool gpt_params_find_arg(int argc, char ** argv, const std::string & arg, gpt_pa
         FLAG_precise = true;
         return true;
     }
+    if (arg == "--no-fuse") {
+        FLAG_nofuse = true;
+        return true;
+    }
+    if (arg == "--fuse-weights") {
+        FLAG_fuse_weights = true;
+        return true;
+    }
+    if (arg == "--moe-residency") {
+        FLAG_moe_residency = true;
+        return true;
+    }
     if (arg == "--trap") {
         FLAG_trap = true;
         FLAG_unsecure = true; // for better backtraces
@@ -798,6 +817,7 @@ bool gpt_params_find_arg(int argc, char ** argv, const std::string & arg, gpt_pa
     }
     if (arg == "--mlock") {
         params.use_mlock = true;
+        FLAG_mlock = true;
         return true;
     }
     if (arg == "-ngl" || arg == "--gpu-layers" || arg == "--n-gpu-layers") {
@@ -1559,6 +1579,7 @@ void gpt_params_print_usage(int /*argc*/, char ** argv, const gpt_params & param
 
     options.push_back({ "backend" });
     options.push_back({ "*",           "       --rpc SERVERS",          "comma separated list of RPC servers" });
+    options.push_back({ "*",           "       --rpc-server",           "serve as an RPC worker on --host and --port (default: 50052)" });
 
     if (llama_supports_mlock()) {
         options.push_back({ "*",           "       --mlock",                "force system to keep model in RAM rather than swapping or compressing" });
@@ -13,6 +13,7 @@
 #include <stdio.h>  // for GGML_ASSERT
 
 #include "ggml-aarch64.h"
+#include "llamafile/sgemm.h"
 
 #if defined(__GNUC__)
 #pragma GCC diagnostic ignored "-Woverlength-strings"
@@ -76,6 +77,27 @@ static block_q4_0x8 make_block_q4_0x8(block_q4_0 * in, unsigned int blck_size_in
     return out;
 }
 
+// [jart] rewrites q4_0 rows as q4_0_8_8 in place, without requantizing
+void ggml_repack_q4_0_8x8(void * restrict data, int64_t nrow, int64_t n_per_row) {
+    assert(nrow % 8 == 0);
+    assert(n_per_row % QK4_0 == 0);
+    const int64_t nb = n_per_row / QK4_0;
+    block_q4_0 * src = (block_q4_0 *) malloc(8 * nb * sizeof(block_q4_0));
+    GGML_ASSERT(src);
+    block_q4_0x8 * dst = (block_q4_0x8 *) data;
+    for (int64_t y = 0; y < nrow; y += 8) {
+        memcpy(src, (block_q4_0 *) data + y * nb, 8 * nb * sizeof(block_q4_0));
+        for (int64_t x = 0; x < nb; x++) {
+            block_q4_0 in[8];
+            for (int i = 0; i < 8; i++) {
+                in[i] = src[i * nb + x];
+            }
+            *dst++ = make_block_q4_0x8(in, 8, 0x88);
+        }
+    }
+    free(src);
+}
+
 void quantize_q8_0_4x4(const float * restrict x, void * restrict vy, int64_t k) {
     assert(QK8_0 == 32);
     assert(k % QK8_0 == 0);
@@ -605,6 +627,11 @@ void ggml_gemv_q4_0_8x8_q8_0(int n, float * restrict s, size_t bs, const void *
     assert (n % qk == 0);
     assert (nc % ncols_interleaved == 0);
 
+#if GGML_USE_LLAMAFILE
+    if (llamafile_gemv_q4_0_8x8(n, s, bs, vx, vy, nr, nc)) // [jart]
+        return;
+#endif
+
     UNUSED(s);
     UNUSED(bs);
     UNUSED(vx);
@@ -1719,6 +1746,11 @@ void ggml_gemm_q4_0_8x8_q8_0(int n, float * restrict s, size_t bs, const void *
     assert (nr % 4 == 0);
     assert (nc % ncols_interleaved == 0);
 
+#if GGML_USE_LLAMAFILE
+    if (llamafile_gemm_q4_0_8x8(n, s, bs, vx, vy, nr, nc)) // [jart]
+        return;
+#endif
+
     UNUSED(s);
     UNUSED(bs);
     UNUSED(vx);
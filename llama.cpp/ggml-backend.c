@@ -14,6 +14,7 @@
 #include <cosmo.h>
 
 #include "llamafile/log.h"
+#include "llamafile/experts.h"
 
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
@@ -572,6 +573,7 @@ GGML_CALL static void * ggml_backend_cpu_buffer_get_base(ggml_backend_buffer_t b
 }
 
 GGML_CALL static void ggml_backend_cpu_buffer_free_buffer(ggml_backend_buffer_t buffer) {
+    llamafile_experts_forget(buffer->context, buffer->size);
     free(buffer->context);
 }
 
@@ -1620,6 +1622,33 @@ static void ggml_backend_sched_split_graph(ggml_backend_sched_t sched, struct gg
         sched->n_splits = i_split + 1;
     }
 
+    // [jart] flag tensors that are read by another split so the cpu
+    //        backend won't fuse them away when computing their split
+    {
+        const int32_t in_split = 1 << 28;
+        for (int i = 0; i < graph->n_nodes; i++) {
+            graph->nodes[i]->flags &= ~GGML_TENSOR_FLAG_SHARED;
+        }
+        for (int i = 0; sched->n_splits > 1 && i < sched->n_splits; i++) {
+            struct ggml_backend_sched_split * split = &sched->splits[i];
+            for (int j = split->i_start; j < split->i_end; j++) {
+                graph->nodes[j]->flags |= in_split;
+            }
+            for (int j = split->i_start; j < split->i_end; j++) {
+                struct ggml_tensor * node = graph->nodes[j];
+                for (int k = 0; k < GGML_MAX_SRC; k++) {
+                    struct ggml_tensor * src = node->src[k];
+                    if (src && !(src->flags & in_split)) {
+                        src->flags |= GGML_TENSOR_FLAG_SHARED;
+                    }
+                }
+            }
+            for (int j = split->i_start; j < split->i_end; j++) {
+                graph->nodes[j]->flags &= ~in_split;
+            }
+        }
+    }
+
     if (sched->debug) {
         ggml_backend_sched_print_assignments(sched, graph);
     }
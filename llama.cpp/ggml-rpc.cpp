@@ -0,0 +1,1152 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+
+#include "ggml-rpc.h"
+#include "ggml.h"
+#include "ggml-backend-impl.h"
+
+#include <cinttypes>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//
+// remote procedure call backend
+//
+// this backend lets llama.cpp offload layers to other llamafile
+// processes that were started with --rpc-server, so a model can be
+// split by layer across several machines. each worker holds its share
+// of the weights in memory, and only activations travel over the wire
+// when one graph split hands off to the next.
+//
+// tensor uploads don't wait for a reply, and graph compute replies are
+// only read when the backend is synchronized or the next command that
+// needs an answer is issued. that way handing activations to a worker
+// costs no round trips, and when pipeline parallelism is enabled the
+// scheduler can start the next micro-batch on the local cpu while the
+// workers are still busy with the previous one.
+//
+// the server checks that all buffer and tensor references which come
+// off the wire point into memory it allocated, and refuses ops whose
+// parameters hold function pointers. it otherwise trusts the graphs it
+// is sent, so it should only be reachable from trusted networks.
+//
+
+#define RPC_PROTOCOL_VERSION 1
+#define RPC_MAX_MESSAGE (256 * 1024 * 1024)
+
+// all integers travel in host byte order, which is little endian on
+// every platform llamafile supports
+#pragma pack(push, 1)
+struct rpc_tensor {
+    uint64_t id;
+    uint32_t type;
+    uint64_t buffer;
+    int64_t  ne[GGML_MAX_DIMS];
+    uint64_t nb[GGML_MAX_DIMS];
+    uint32_t op;
+    int32_t  op_params[GGML_MAX_OP_PARAMS / sizeof(int32_t)];
+    int32_t  flags;
+    uint64_t src[GGML_MAX_SRC];
+    uint64_t view_src;
+    uint64_t view_offs;
+    uint64_t data;
+    char     name[GGML_MAX_NAME];
+};
+
+struct rpc_msg_alloc_buffer_rsp {
+    uint64_t remote_ptr;
+    uint64_t remote_size;
+    uint64_t remote_base;
+};
+
+struct rpc_msg_buffer_clear_req {
+    uint64_t remote_ptr;
+    uint8_t  value;
+};
+
+struct rpc_msg_set_tensor_req {
+    rpc_tensor tensor;
+    uint64_t   offset;
+    // followed by data
+};
+
+struct rpc_msg_get_tensor_req {
+    rpc_tensor tensor;
+    uint64_t   offset;
+    uint64_t   size;
+};
+
+struct rpc_msg_copy_tensor_req {
+    rpc_tensor src;
+    rpc_tensor dst;
+};
+
+struct rpc_msg_get_device_memory_rsp {
+    uint64_t free_mem;
+    uint64_t total_mem;
+};
+#pragma pack(pop)
+
+// a request is a command byte, a 64-bit payload size, then payload
+// a reply is a 64-bit payload size, then payload
+enum rpc_cmd {
+    RPC_CMD_HELLO = 0,          // -> u32 version
+    RPC_CMD_ALLOC_BUFFER,       // u64 size -> rpc_msg_alloc_buffer_rsp
+    RPC_CMD_GET_ALIGNMENT,      // -> u64 alignment
+    RPC_CMD_GET_MAX_SIZE,       // -> u64 max_size
+    RPC_CMD_FREE_BUFFER,        // u64 remote_ptr (no reply)
+    RPC_CMD_BUFFER_CLEAR,       // rpc_msg_buffer_clear_req (no reply)
+    RPC_CMD_SET_TENSOR,         // rpc_msg_set_tensor_req (no reply)
+    RPC_CMD_GET_TENSOR,         // rpc_msg_get_tensor_req -> data
+    RPC_CMD_COPY_TENSOR,        // rpc_msg_copy_tensor_req -> u8 ok
+    RPC_CMD_GRAPH_COMPUTE,      // graph -> u8 status (read lazily)
+    RPC_CMD_GET_DEVICE_MEMORY,  // -> rpc_msg_get_device_memory_rsp
+};
+
+static bool rpc_is_unsafe_op(enum ggml_op op) {
+    switch (op) {
+        case GGML_OP_MAP_UNARY:
+        case GGML_OP_MAP_BINARY:
+        case GGML_OP_MAP_CUSTOM1_F32:
+        case GGML_OP_MAP_CUSTOM2_F32:
+        case GGML_OP_MAP_CUSTOM3_F32:
+        case GGML_OP_MAP_CUSTOM1:
+        case GGML_OP_MAP_CUSTOM2:
+        case GGML_OP_MAP_CUSTOM3:
+            return true; // op_params hold function pointers
+        default:
+            return false;
+    }
+}
+
+//
+// sockets
+//
+
+struct rpc_socket {
+    int fd;
+    std::mutex lock;
+    bool pending = false; // graph compute reply hasn't been read yet
+    bool failed = false;  // graph compute failed and wasn't reported yet
+
+    explicit rpc_socket(int fd) : fd(fd) {}
+    ~rpc_socket() { close(fd); }
+};
+
+static bool send_data(int fd, const void * data, size_t size) {
+    size_t bytes_sent = 0;
+    while (bytes_sent < size) {
+        ssize_t n = send(fd, (const char *)data + bytes_sent, size - bytes_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes_sent += n;
+    }
+    return true;
+}
+
+static bool recv_data(int fd, void * data, size_t size) {
+    size_t bytes_recv = 0;
+    while (bytes_recv < size) {
+        ssize_t n = recv(fd, (char *)data + bytes_recv, size - bytes_recv, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes_recv += n;
+    }
+    return true;
+}
+
+static void set_nodelay(int fd) {
+    // activations are small and latency bound so don't let nagle hold them
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
+
+static bool parse_endpoint(const std::string & endpoint, std::string & host, std::string & port) {
+    size_t pos = endpoint.rfind(':');
+    if (pos == std::string::npos || pos + 1 == endpoint.size()) {
+        return false;
+    }
+    host = endpoint.substr(0, pos);
+    port = endpoint.substr(pos + 1);
+    return true;
+}
+
+static int socket_open(const std::string & endpoint, bool listening) {
+    std::string host;
+    std::string port;
+    if (!parse_endpoint(endpoint, host, port)) {
+        fprintf(stderr, "%s: endpoint must be HOST:PORT: %s\n", __func__, endpoint.c_str());
+        return -1;
+    }
+    struct addrinfo hints = {};
+    struct addrinfo * ai;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &ai);
+    if (rc) {
+        fprintf(stderr, "%s: %s: %s\n", __func__, endpoint.c_str(), gai_strerror(rc));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo * p = ai; p; p = p->ai_next) {
+        if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
+            continue;
+        }
+        if (listening) {
+            int flag = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+            if (!bind(fd, p->ai_addr, p->ai_addrlen) && !listen(fd, 1)) {
+                break;
+            }
+        } else if (!connect(fd, p->ai_addr, p->ai_addrlen)) {
+            set_nodelay(fd);
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (fd == -1) {
+        fprintf(stderr, "%s: %s: %s\n", __func__, endpoint.c_str(), strerror(errno));
+    }
+    return fd;
+}
+
+//
+// client
+//
+
+// reads the status of the graph compute that was sent last, if any.
+// returns false only if the connection broke; a failed graph is noted
+// so it can be reported by whoever waits on the backend next
+static bool rpc_drain(rpc_socket * sock) {
+    if (!sock->pending) {
+        return true;
+    }
+    sock->pending = false;
+    uint64_t size;
+    uint8_t status;
+    if (!recv_data(sock->fd, &size, sizeof(size)) || size != 1 ||
+        !recv_data(sock->fd, &status, 1)) {
+        return false;
+    }
+    if (status != GGML_STATUS_SUCCESS) {
+        fprintf(stderr, "%s: remote graph compute failed with status %d\n", __func__, status);
+        sock->failed = true;
+    }
+    return true;
+}
+
+// waits for the graph compute that was sent last, if any, and returns
+// false if the connection broke or any unreported graph failed remotely
+static bool rpc_finish(rpc_socket * sock) {
+    if (!rpc_drain(sock)) {
+        return false;
+    }
+    if (sock->failed) {
+        sock->failed = false;
+        return false;
+    }
+    return true;
+}
+
+// sends request, where extra bytes are appended without being copied
+static bool rpc_send(rpc_socket * sock, enum rpc_cmd cmd, const void * input, size_t input_size,
+                     const void * extra = nullptr, size_t extra_size = 0) {
+    if (!rpc_drain(sock)) {
+        return false;
+    }
+    uint64_t size = input_size + extra_size;
+    std::vector<uint8_t> msg(1 + sizeof(size) + input_size);
+    msg[0] = cmd;
+    memcpy(msg.data() + 1, &size, sizeof(size));
+    if (input_size) {
+        memcpy(msg.data() + 1 + sizeof(size), input, input_size);
+    }
+    return send_data(sock->fd, msg.data(), msg.size()) &&
+           send_data(sock->fd, extra, extra_size);
+}
+
+static bool rpc_recv(rpc_socket * sock, void * output, size_t output_size) {
+    uint64_t size;
+    return recv_data(sock->fd, &size, sizeof(size)) && size == output_size &&
+           recv_data(sock->fd, output, output_size);
+}
+
+static bool rpc_call(rpc_socket * sock, enum rpc_cmd cmd, const void * input, size_t input_size,
+                     void * output, size_t output_size) {
+    std::lock_guard<std::mutex> lock(sock->lock);
+    return rpc_send(sock, cmd, input, input_size) && rpc_recv(sock, output, output_size);
+}
+
+static bool rpc_cast(rpc_socket * sock, enum rpc_cmd cmd, const void * input, size_t input_size,
+                     const void * extra = nullptr, size_t extra_size = 0) {
+    std::lock_guard<std::mutex> lock(sock->lock);
+    return rpc_send(sock, cmd, input, input_size, extra, extra_size);
+}
+
+// returns connection to endpoint, which is shared by its buffers and backends
+static std::shared_ptr<rpc_socket> get_socket(const std::string & endpoint) {
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::weak_ptr<rpc_socket>> sockets;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sockets.find(endpoint);
+    if (it != sockets.end()) {
+        if (auto sock = it->second.lock()) {
+            return sock;
+        }
+    }
+    int fd = socket_open(endpoint, false);
+    if (fd == -1) {
+        return nullptr;
+    }
+    auto sock = std::make_shared<rpc_socket>(fd);
+    uint32_t version;
+    if (!rpc_call(sock.get(), RPC_CMD_HELLO, nullptr, 0, &version, sizeof(version)) ||
+        version != RPC_PROTOCOL_VERSION) {
+        fprintf(stderr, "%s: %s isn't a compatible llamafile rpc server\n", __func__, endpoint.c_str());
+        return nullptr;
+    }
+    sockets[endpoint] = sock;
+    return sock;
+}
+
+struct ggml_backend_rpc_buffer_type_context {
+    std::string endpoint;
+    std::string name;
+    size_t alignment;
+    size_t max_size;
+};
+
+struct ggml_backend_rpc_buffer_context {
+    std::shared_ptr<rpc_socket> sock;
+    void * base_ptr;
+    uint64_t remote_ptr;
+    std::string name;
+};
+
+struct ggml_backend_rpc_context {
+    std::string endpoint;
+    std::string name;
+    std::shared_ptr<rpc_socket> sock;
+};
+
+GGML_CALL static const char * ggml_backend_rpc_buffer_get_name(ggml_backend_buffer_t buffer) {
+    ggml_backend_rpc_buffer_context * ctx = (ggml_backend_rpc_buffer_context *)buffer->context;
+    return ctx->name.c_str();
+}
+
+static rpc_tensor serialize_tensor(const ggml_tensor * tensor) {
+    rpc_tensor result;
+    memset(&result, 0, sizeof(result));
+    result.id = reinterpret_cast<uint64_t>(tensor);
+    result.type = tensor->type;
+    if (tensor->buffer && tensor->buffer->iface.get_name == ggml_backend_rpc_buffer_get_name) {
+        ggml_backend_rpc_buffer_context * ctx = (ggml_backend_rpc_buffer_context *)tensor->buffer->context;
+        result.buffer = ctx->remote_ptr;
+    }
+    for (int i = 0; i < GGML_MAX_DIMS; i++) {
+        result.ne[i] = tensor->ne[i];
+        result.nb[i] = tensor->nb[i];
+    }
+    result.op = tensor->op;
+    memcpy(result.op_params, tensor->op_params, sizeof(result.op_params));
+    result.flags = tensor->flags;
+    for (int i = 0; i < GGML_MAX_SRC; i++) {
+        result.src[i] = reinterpret_cast<uint64_t>(tensor->src[i]);
+    }
+    result.view_src = reinterpret_cast<uint64_t>(tensor->view_src);
+    result.view_offs = tensor->view_offs;
+    result.data = reinterpret_cast<uint64_t>(tensor->data);
+    memcpy(result.name, tensor->name, GGML_MAX_NAME);
+    return result;
+}
+
+GGML_CALL static void ggml_backend_rpc_buffer_free_buffer(ggml_backend_buffer_t buffer) {
+    ggml_backend_rpc_buffer_context * ctx = (ggml_backend_rpc_buffer_context *)buffer->context;
+    bool ok = rpc_cast(ctx->sock.get(), RPC_CMD_FREE_BUFFER, &ctx->remote_ptr, sizeof(ctx->remote_ptr));
+    GGML_ASSERT(ok);
+    delete ctx;
+}
+
+GGML_CALL static void * ggml_backend_rpc_buffer_get_base(ggml_backend_buffer_t buffer) {
+    ggml_backend_rpc_buffer_context * ctx = (ggml_backend_rpc_buffer_context *)buffer->context;
+    return ctx->base_ptr;
+}
+
+GGML_CALL static void ggml_backend_rpc_buffer_set_tensor(ggml_backend_buffer_t buffer, ggml_tensor * tensor, const void * data, size_t offset, size_t size) {
+    ggml_backend_rpc_buffer_context * ctx = (ggml_backend_rpc_buffer_context *)buffer->context;
+    rpc_msg_set_tensor_req req;
+    req.tensor = serialize_tensor(tensor);
+    req.offset = offset;
+    bool ok = rpc_cast(ctx->sock.get(), RPC_CMD_SET_TENSOR, &req, sizeof(req), data, size);
+    GGML_ASSERT(ok);
+}
+
+GGML_CALL static void ggml_backend_rpc_buffer_get_tensor(ggml_backend_buffer_t buffer, const ggml_tensor * tensor, void * data, size_t offset, size_t size) {
+    ggml_backend_rpc_buffer_context * ctx = (ggml_backend_rpc_buffer_context *)buffer->context;
+    rpc_msg_get_tensor_req req;
+    req.tensor = serialize_tensor(tensor);
+    req.offset = offset;
+    req.size = size;
+    bool ok = rpc_call(ctx->sock.get(), RPC_CMD_GET_TENSOR, &req, sizeof(req), data, size);
+    GGML_ASSERT(ok);
+}
+
+GGML_CALL static bool ggml_backend_rpc_buffer_cpy_tensor(ggml_backend_buffer_t buffer, const ggml_tensor * src, ggml_tensor * dst) {
+    ggml_backend_rpc_buffer_context * dst_ctx = (ggml_backend_rpc_buffer_context *)buffer->context;
+    ggml_backend_buffer_t src_buffer = src->view_src ? src->view_src->buffer : src->buffer;
+    if (!src_buffer || src_buffer->iface.get_name != ggml_backend_rpc_buffer_get_name) {
+        return false;
+    }
+    ggml_backend_rpc_buffer_context * src_ctx = (ggml_backend_rpc_buffer_context *)src_buffer->context;
+    if (src_ctx->sock != dst_ctx->sock) {
+        return false; // tensors live on different servers
+    }
+    rpc_msg_copy_tensor_req req;
+    req.src = serialize_tensor(src);
+    req.dst = serialize_tensor(dst);
+    uint8_t result;
+    bool ok = rpc_call(dst_ctx->sock.get(), RPC_CMD_COPY_TENSOR, &req, sizeof(req), &result, sizeof(result));
+    GGML_ASSERT(ok);
+    return result;
+}
+
+GGML_CALL static void ggml_backend_rpc_buffer_clear(ggml_backend_buffer_t buffer, uint8_t value) {
+    ggml_backend_rpc_buffer_context * ctx = (ggml_backend_rpc_buffer_context *)buffer->context;
+    rpc_msg_buffer_clear_req req = {ctx->remote_ptr, value};
+    bool ok = rpc_cast(ctx->sock.get(), RPC_CMD_BUFFER_CLEAR, &req, sizeof(req));
+    GGML_ASSERT(ok);
+}
+
+static ggml_backend_buffer_i ggml_backend_rpc_buffer_interface = {
+    /* .get_name        = */ ggml_backend_rpc_buffer_get_name,
+    /* .free_buffer     = */ ggml_backend_rpc_buffer_free_buffer,
+    /* .get_base        = */ ggml_backend_rpc_buffer_get_base,
+    /* .init_tensor     = */ NULL,
+    /* .set_tensor      = */ ggml_backend_rpc_buffer_set_tensor,
+    /* .get_tensor      = */ ggml_backend_rpc_buffer_get_tensor,
+    /* .cpy_tensor      = */ ggml_backend_rpc_buffer_cpy_tensor,
+    /* .clear           = */ ggml_backend_rpc_buffer_clear,
+    /* .reset           = */ NULL,
+};
+
+GGML_CALL static const char * ggml_backend_rpc_buffer_type_name(ggml_backend_buffer_type_t buft) {
+    ggml_backend_rpc_buffer_type_context * buft_ctx = (ggml_backend_rpc_buffer_type_context *)buft->context;
+    return buft_ctx->name.c_str();
+}
+
+GGML_CALL static ggml_backend_buffer_t ggml_backend_rpc_buffer_type_alloc_buffer(ggml_backend_buffer_type_t buft, size_t size) {
+    ggml_backend_rpc_buffer_type_context * buft_ctx = (ggml_backend_rpc_buffer_type_context *)buft->context;
+    auto sock = get_socket(buft_ctx->endpoint);
+    if (!sock) {
+        return nullptr;
+    }
+    uint64_t req = size;
+    rpc_msg_alloc_buffer_rsp rsp;
+    bool ok = rpc_call(sock.get(), RPC_CMD_ALLOC_BUFFER, &req, sizeof(req), &rsp, sizeof(rsp));
+    GGML_ASSERT(ok);
+    if (!rsp.remote_ptr) {
+        return nullptr;
+    }
+    ggml_backend_rpc_buffer_context * ctx = new ggml_backend_rpc_buffer_context{
+        sock, reinterpret_cast<void *>(rsp.remote_base), rsp.remote_ptr, "RPC[" + buft_ctx->endpoint + "]"};
+    return ggml_backend_buffer_init(buft, ggml_backend_rpc_buffer_interface, ctx, rsp.remote_size);
+}
+
+GGML_CALL static size_t ggml_backend_rpc_buffer_type_get_alignment(ggml_backend_buffer_type_t buft) {
+    ggml_backend_rpc_buffer_type_context * buft_ctx = (ggml_backend_rpc_buffer_type_context *)buft->context;
+    return buft_ctx->alignment;
+}
+
+GGML_CALL static size_t ggml_backend_rpc_buffer_type_get_max_size(ggml_backend_buffer_type_t buft) {
+    ggml_backend_rpc_buffer_type_context * buft_ctx = (ggml_backend_rpc_buffer_type_context *)buft->context;
+    return buft_ctx->max_size;
+}
+
+GGML_CALL static size_t ggml_backend_rpc_buffer_type_get_alloc_size(ggml_backend_buffer_type_t buft, const ggml_tensor * tensor) {
+    return ggml_nbytes(tensor);
+    GGML_UNUSED(buft);
+}
+
+static ggml_backend_buffer_type_i ggml_backend_rpc_buffer_type_interface = {
+    /* .get_name         = */ ggml_backend_rpc_buffer_type_name,
+    /* .alloc_buffer     = */ ggml_backend_rpc_buffer_type_alloc_buffer,
+    /* .get_alignment    = */ ggml_backend_rpc_buffer_type_get_alignment,
+    /* .get_max_size     = */ ggml_backend_rpc_buffer_type_get_max_size,
+    /* .get_alloc_size   = */ ggml_backend_rpc_buffer_type_get_alloc_size,
+    /* .is_host          = */ NULL,
+};
+
+GGML_CALL static const char * ggml_backend_rpc_name(ggml_backend_t backend) {
+    ggml_backend_rpc_context * rpc_ctx = (ggml_backend_rpc_context *)backend->context;
+    return rpc_ctx->name.c_str();
+}
+
+// there's no way to return an error from here, so a failure is kept
+// until ggml_backend_rpc_failed() or the next graph compute reports it
+GGML_CALL static void ggml_backend_rpc_synchronize(ggml_backend_t backend) {
+    ggml_backend_rpc_context * rpc_ctx = (ggml_backend_rpc_context *)backend->context;
+    std::lock_guard<std::mutex> lock(rpc_ctx->sock->lock);
+    if (!rpc_drain(rpc_ctx->sock.get())) {
+        fprintf(stderr, "%s: lost connection to %s\n", __func__, rpc_ctx->name.c_str());
+        rpc_ctx->sock->failed = true;
+    }
+}
+
+GGML_CALL static void ggml_backend_rpc_free(ggml_backend_t backend) {
+    ggml_backend_rpc_context * rpc_ctx = (ggml_backend_rpc_context *)backend->context;
+    {
+        std::lock_guard<std::mutex> lock(rpc_ctx->sock->lock);
+        rpc_drain(rpc_ctx->sock.get());
+    }
+    delete rpc_ctx;
+    delete backend;
+}
+
+GGML_CALL static ggml_backend_buffer_type_t ggml_backend_rpc_get_default_buffer_type(ggml_backend_t backend) {
+    ggml_backend_rpc_context * ctx = (ggml_backend_rpc_context *)backend->context;
+    return ggml_backend_rpc_buffer_type(ctx->endpoint.c_str());
+}
+
+static void add_tensor(ggml_tensor * tensor, std::vector<rpc_tensor> & tensors, std::unordered_set<ggml_tensor *> & visited) {
+    if (tensor == nullptr || !visited.insert(tensor).second) {
+        return;
+    }
+    for (int i = 0; i < GGML_MAX_SRC; i++) {
+        add_tensor(tensor->src[i], tensors, visited);
+    }
+    add_tensor(tensor->view_src, tensors, visited);
+    tensors.push_back(serialize_tensor(tensor));
+}
+
+// | n_nodes (4 bytes) | node ids (n_nodes * 8 bytes) | n_tensors (4 bytes) | tensors (n_tensors * sizeof(rpc_tensor)) |
+static void serialize_graph(const ggml_cgraph * cgraph, std::vector<uint8_t> & output) {
+    uint32_t n_nodes = cgraph->n_nodes;
+    std::vector<rpc_tensor> tensors;
+    std::unordered_set<ggml_tensor *> visited;
+    for (uint32_t i = 0; i < n_nodes; i++) {
+        add_tensor(cgraph->nodes[i], tensors, visited);
+    }
+    uint32_t n_tensors = tensors.size();
+    output.resize(sizeof(uint32_t) + n_nodes * sizeof(uint64_t) + sizeof(uint32_t) + n_tensors * sizeof(rpc_tensor));
+    uint8_t * p = output.data();
+    memcpy(p, &n_nodes, sizeof(n_nodes));
+    p += sizeof(n_nodes);
+    for (uint32_t i = 0; i < n_nodes; i++) {
+        uint64_t id = reinterpret_cast<uint64_t>(cgraph->nodes[i]);
+        memcpy(p, &id, sizeof(id));
+        p += sizeof(id);
+    }
+    memcpy(p, &n_tensors, sizeof(n_tensors));
+    p += sizeof(n_tensors);
+    memcpy(p, tensors.data(), n_tensors * sizeof(rpc_tensor));
+}
+
+GGML_CALL static enum ggml_status ggml_backend_rpc_graph_compute(ggml_backend_t backend, ggml_cgraph * cgraph) {
+    ggml_backend_rpc_context * rpc_ctx = (ggml_backend_rpc_context *)backend->context;
+    std::vector<uint8_t> input;
+    serialize_graph(cgraph, input);
+    rpc_socket * sock = rpc_ctx->sock.get();
+    std::lock_guard<std::mutex> lock(sock->lock);
+    if (!rpc_finish(sock)) {
+        return GGML_STATUS_FAILED;
+    }
+    bool ok = rpc_send(sock, RPC_CMD_GRAPH_COMPUTE, input.data(), input.size());
+    GGML_ASSERT(ok);
+    sock->pending = true;
+    return GGML_STATUS_SUCCESS;
+}
+
+GGML_CALL static bool ggml_backend_rpc_supports_op(ggml_backend_t backend, const ggml_tensor * op) {
+    return !rpc_is_unsafe_op(op->op);
+    GGML_UNUSED(backend);
+}
+
+GGML_CALL static bool ggml_backend_rpc_supports_buft(ggml_backend_t backend, ggml_backend_buffer_type_t buft) {
+    if (buft->iface.get_name != ggml_backend_rpc_buffer_type_name) {
+        return false;
+    }
+    ggml_backend_rpc_buffer_type_context * buft_ctx = (ggml_backend_rpc_buffer_type_context *)buft->context;
+    ggml_backend_rpc_context * rpc_ctx = (ggml_backend_rpc_context *)backend->context;
+    return buft_ctx->endpoint == rpc_ctx->endpoint;
+}
+
+static ggml_backend_i ggml_backend_rpc_interface = {
+    /* .get_name                = */ ggml_backend_rpc_name,
+    /* .free                    = */ ggml_backend_rpc_free,
+    /* .get_default_buffer_type = */ ggml_backend_rpc_get_default_buffer_type,
+    /* .set_tensor_async        = */ NULL,
+    /* .get_tensor_async        = */ NULL,
+    /* .cpy_tensor_async        = */ NULL,
+    /* .synchronize             = */ ggml_backend_rpc_synchronize,
+    /* .graph_plan_create       = */ NULL,
+    /* .graph_plan_free         = */ NULL,
+    /* .graph_plan_update       = */ NULL,
+    /* .graph_plan_compute      = */ NULL,
+    /* .graph_compute           = */ ggml_backend_rpc_graph_compute,
+    /* .supports_op             = */ ggml_backend_rpc_supports_op,
+    /* .supports_buft           = */ ggml_backend_rpc_supports_buft,
+    /* .offload_op              = */ NULL,
+    /* .event_new               = */ NULL,
+    /* .event_free              = */ NULL,
+    /* .event_record            = */ NULL,
+    /* .event_wait              = */ NULL,
+    /* .event_synchronize       = */ NULL,
+};
+
+GGML_API GGML_CALL ggml_backend_buffer_type_t ggml_backend_rpc_buffer_type(const char * endpoint) {
+    static std::mutex mutex;
+    static std::unordered_map<std::string, ggml_backend_buffer_type_t> buft_map;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = buft_map.find(endpoint);
+    if (it != buft_map.end()) {
+        return it->second;
+    }
+    auto sock = get_socket(endpoint);
+    if (!sock) {
+        return nullptr;
+    }
+    uint64_t alignment;
+    uint64_t max_size;
+    if (!rpc_call(sock.get(), RPC_CMD_GET_ALIGNMENT, nullptr, 0, &alignment, sizeof(alignment)) ||
+        !rpc_call(sock.get(), RPC_CMD_GET_MAX_SIZE, nullptr, 0, &max_size, sizeof(max_size))) {
+        return nullptr;
+    }
+    ggml_backend_rpc_buffer_type_context * buft_ctx = new ggml_backend_rpc_buffer_type_context{
+        endpoint, "RPC[" + std::string(endpoint) + "]", alignment, max_size};
+    ggml_backend_buffer_type_t buft = new ggml_backend_buffer_type{
+        /* .iface   = */ ggml_backend_rpc_buffer_type_interface,
+        /* .context = */ buft_ctx};
+    buft_map[endpoint] = buft;
+    return buft;
+}
+
+static ggml_guid_t ggml_backend_rpc_guid(void) {
+    static ggml_guid guid = {0x99, 0x68, 0x5b, 0x6c, 0xd2, 0x83, 0x3d, 0x24, 0x25, 0x36, 0x72, 0xe1, 0x5b, 0x0e, 0x14, 0x03};
+    return &guid;
+}
+
+GGML_CALL ggml_backend_t ggml_backend_rpc_init(const char * endpoint) {
+    auto sock = get_socket(endpoint);
+    if (!sock) {
+        return nullptr;
+    }
+    ggml_backend_rpc_context * ctx = new ggml_backend_rpc_context{
+        endpoint, "RPC[" + std::string(endpoint) + "]", sock};
+    return new ggml_backend{
+        /* .guid      = */ ggml_backend_rpc_guid(),
+        /* .interface = */ ggml_backend_rpc_interface,
+        /* .context   = */ ctx};
+}
+
+GGML_API GGML_CALL bool ggml_backend_is_rpc(ggml_backend_t backend) {
+    return backend != NULL && ggml_guid_matches(backend->guid, ggml_backend_rpc_guid());
+}
+
+GGML_API GGML_CALL bool ggml_backend_rpc_failed(ggml_backend_t backend) {
+    ggml_backend_rpc_context * rpc_ctx = (ggml_backend_rpc_context *)backend->context;
+    std::lock_guard<std::mutex> lock(rpc_ctx->sock->lock);
+    return !rpc_finish(rpc_ctx->sock.get());
+}
+
+GGML_API GGML_CALL void ggml_backend_rpc_get_device_memory(const char * endpoint, size_t * free, size_t * total) {
+    auto sock = get_socket(endpoint);
+    rpc_msg_get_device_memory_rsp rsp;
+    if (!sock || !rpc_call(sock.get(), RPC_CMD_GET_DEVICE_MEMORY, nullptr, 0, &rsp, sizeof(rsp))) {
+        *free = 0;
+        *total = 0;
+        return;
+    }
+    *free = rsp.free_mem;
+    *total = rsp.total_mem;
+}
+
+GGML_API GGML_CALL void ggml_backend_rpc_get_host_memory(size_t * free, size_t * total) {
+    long pagesize = sysconf(_SC_PAGESIZE);
+    long avphys = sysconf(_SC_AVPHYS_PAGES);
+    long phys = sysconf(_SC_PHYS_PAGES);
+    *free = avphys > 0 && pagesize > 0 ? (size_t)avphys * pagesize : 0;
+    *total = phys > 0 && pagesize > 0 ? (size_t)phys * pagesize : 0;
+}
+
+//
+// server
+//
+
+class rpc_server {
+public:
+    explicit rpc_server(ggml_backend_t backend) : backend(backend) {}
+    ~rpc_server();
+
+    bool alloc_buffer(const std::vector<uint8_t> & input, std::vector<uint8_t> & output);
+    void get_alignment(std::vector<uint8_t> & output);
+    void get_max_size(std::vector<uint8_t> & output);
+    bool free_buffer(const std::vector<uint8_t> & input);
+    bool buffer_clear(const std::vector<uint8_t> & input);
+    bool set_tensor(int fd, uint64_t size);
+    bool get_tensor(int fd, const std::vector<uint8_t> & input);
+    bool copy_tensor(const std::vector<uint8_t> & input, std::vector<uint8_t> & output);
+    bool graph_compute(const std::vector<uint8_t> & input, std::vector<uint8_t> & output);
+
+private:
+    bool graph_compute_impl(const std::vector<uint8_t> & input, std::vector<uint8_t> & output);
+    char * resolve(const rpc_tensor * tensor, uint64_t offset, uint64_t size);
+    ggml_tensor * deserialize_tensor(struct ggml_context * ctx, const rpc_tensor * tensor);
+    ggml_tensor * create_node(uint64_t id,
+                              struct ggml_context * ctx,
+                              const std::unordered_map<uint64_t, const rpc_tensor *> & tensor_ptrs,
+                              std::unordered_map<uint64_t, struct ggml_tensor *> & tensor_map,
+                              bool & ok);
+
+    ggml_backend_t backend;
+    std::unordered_set<ggml_backend_buffer_t> buffers;
+};
+
+rpc_server::~rpc_server() {
+    for (auto buffer : buffers) {
+        ggml_backend_buffer_free(buffer);
+    }
+}
+
+template <typename T>
+static void reply(std::vector<uint8_t> & output, const T & value) {
+    output.insert(output.end(), (const uint8_t *)&value, (const uint8_t *)&value + sizeof(value));
+}
+
+template <typename T>
+static bool request(const std::vector<uint8_t> & input, T & value) {
+    if (input.size() != sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, input.data(), sizeof(value));
+    return true;
+}
+
+// returns pointer to [offset, offset+size) of tensor data, or null if
+// that isn't inside a buffer we allocated. the worker only allocates
+// cpu buffers so the memory can be read from and written to directly.
+char * rpc_server::resolve(const rpc_tensor * tensor, uint64_t offset, uint64_t size) {
+    ggml_backend_buffer_t buffer = reinterpret_cast<ggml_backend_buffer_t>(tensor->buffer);
+    if (!buffers.count(buffer) || !ggml_backend_buffer_is_host(buffer)) {
+        return nullptr;
+    }
+    uint64_t start = reinterpret_cast<uint64_t>(ggml_backend_buffer_get_base(buffer));
+    uint64_t end = start + ggml_backend_buffer_get_size(buffer);
+    uint64_t p = tensor->data + offset;
+    if (p < tensor->data || p < start || p > end || size > end - p) {
+        return nullptr;
+    }
+    return reinterpret_cast<char *>(p);
+}
+
+// computes ggml_nbytes() without trusting shape not to overflow
+static bool rpc_tensor_nbytes(const rpc_tensor * tensor, uint64_t * out_nbytes) {
+    enum ggml_type type = (enum ggml_type)tensor->type;
+    unsigned __int128 nbytes;
+    size_t blck_size = ggml_blck_size(type);
+    for (int i = 0; i < GGML_MAX_DIMS; i++) {
+        if (tensor->ne[i] <= 0) {
+            *out_nbytes = 0;
+            return true;
+        }
+    }
+    if (blck_size == 1) {
+        nbytes = ggml_type_size(type);
+        for (int i = 0; i < GGML_MAX_DIMS; i++) {
+            nbytes += (unsigned __int128)(tensor->ne[i] - 1) * tensor->nb[i];
+        }
+    } else {
+        nbytes = (unsigned __int128)tensor->ne[0] * tensor->nb[0] / blck_size;
+        for (int i = 1; i < GGML_MAX_DIMS; i++) {
+            nbytes += (unsigned __int128)(tensor->ne[i] - 1) * tensor->nb[i];
+        }
+    }
+    if (nbytes > UINT64_MAX) {
+        return false;
+    }
+    *out_nbytes = nbytes;
+    return true;
+}
+
+ggml_tensor * rpc_server::deserialize_tensor(struct ggml_context * ctx, const rpc_tensor * tensor) {
+    if (tensor->type >= GGML_TYPE_COUNT || !ggml_blck_size((enum ggml_type)tensor->type) ||
+        !ggml_type_size((enum ggml_type)tensor->type)) {
+        return nullptr;
+    }
+    if (tensor->op >= GGML_OP_COUNT || rpc_is_unsafe_op((enum ggml_op)tensor->op)) {
+        return nullptr;
+    }
+    for (int i = 0; i < GGML_MAX_DIMS; i++) {
+        if (tensor->ne[i] < 0) {
+            return nullptr;
+        }
+    }
+    if (tensor->ne[0] % ggml_blck_size((enum ggml_type)tensor->type)) {
+        return nullptr;
+    }
+    uint64_t nbytes;
+    if (!rpc_tensor_nbytes(tensor, &nbytes)) {
+        return nullptr;
+    }
+    if (tensor->data ? !resolve(tensor, 0, nbytes) : nbytes != 0) {
+        return nullptr; // tensor must fit in a buffer we allocated
+    }
+    if (tensor->buffer && !buffers.count(reinterpret_cast<ggml_backend_buffer_t>(tensor->buffer))) {
+        return nullptr;
+    }
+    ggml_tensor * result = ggml_new_tensor_4d(ctx, (enum ggml_type)tensor->type,
+                                              tensor->ne[0], tensor->ne[1], tensor->ne[2], tensor->ne[3]);
+    for (int i = 0; i < GGML_MAX_DIMS; i++) {
+        result->nb[i] = tensor->nb[i];
+    }
+    result->buffer = reinterpret_cast<ggml_backend_buffer_t>(tensor->buffer);
+    result->op = (enum ggml_op)tensor->op;
+    memcpy(result->op_params, tensor->op_params, sizeof(result->op_params));
+    result->flags = tensor->flags & (GGML_TENSOR_FLAG_INPUT |
+                                     GGML_TENSOR_FLAG_OUTPUT |
+                                     GGML_TENSOR_FLAG_PARAM |
+                                     GGML_TENSOR_FLAG_SHARED);
+    result->data = reinterpret_cast<void *>(tensor->data);
+    char name[GGML_MAX_NAME];
+    memcpy(name, tensor->name, GGML_MAX_NAME);
+    name[GGML_MAX_NAME - 1] = 0;
+    ggml_set_name(result, name);
+    return result;
+}
+
+bool rpc_server::alloc_buffer(const std::vector<uint8_t> & input, std::vector<uint8_t> & output) {
+    uint64_t size;
+    if (!request(input, size)) {
+        return false;
+    }
+    ggml_backend_buffer_type_t buft = ggml_backend_get_default_buffer_type(backend);
+    ggml_backend_buffer_t buffer = ggml_backend_buft_alloc_buffer(buft, size);
+    rpc_msg_alloc_buffer_rsp rsp = {};
+    if (buffer) {
+        buffers.insert(buffer);
+        rsp.remote_ptr = reinterpret_cast<uint64_t>(buffer);
+        rsp.remote_size = ggml_backend_buffer_get_size(buffer);
+        rsp.remote_base = reinterpret_cast<uint64_t>(ggml_backend_buffer_get_base(buffer));
+    } else {
+        fprintf(stderr, "%s: failed to allocate %" PRIu64 " byte buffer\n", __func__, size);
+    }
+    reply(output, rsp);
+    return true;
+}
+
+void rpc_server::get_alignment(std::vector<uint8_t> & output) {
+    uint64_t alignment = ggml_backend_get_alignment(backend);
+    reply(output, alignment);
+}
+
+void rpc_server::get_max_size(std::vector<uint8_t> & output) {
+    uint64_t max_size = ggml_backend_get_max_size(backend);
+    reply(output, max_size);
+}
+
+bool rpc_server::free_buffer(const std::vector<uint8_t> & input) {
+    uint64_t remote_ptr;
+    if (!request(input, remote_ptr)) {
+        return false;
+    }
+    ggml_backend_buffer_t buffer = reinterpret_cast<ggml_backend_buffer_t>(remote_ptr);
+    if (!buffers.erase(buffer)) {
+        return false;
+    }
+    ggml_backend_buffer_free(buffer);
+    return true;
+}
+
+bool rpc_server::buffer_clear(const std::vector<uint8_t> & input) {
+    rpc_msg_buffer_clear_req req;
+    if (!request(input, req)) {
+        return false;
+    }
+    ggml_backend_buffer_t buffer = reinterpret_cast<ggml_backend_buffer_t>(req.remote_ptr);
+    if (!buffers.count(buffer)) {
+        return false;
+    }
+    ggml_backend_buffer_clear(buffer, req.value);
+    return true;
+}
+
+// receives tensor data straight into place, since it's usually weights
+bool rpc_server::set_tensor(int fd, uint64_t size) {
+    rpc_msg_set_tensor_req req;
+    if (size < sizeof(req) || !recv_data(fd, &req, sizeof(req))) {
+        return false;
+    }
+    size -= sizeof(req);
+    char * p = resolve(&req.tensor, req.offset, size);
+    if (!p) {
+        fprintf(stderr, "%s: tensor data out of bounds\n", __func__);
+        return false;
+    }
+    return recv_data(fd, p, size);
+}
+
+// sends tensor data straight from where it lives
+bool rpc_server::get_tensor(int fd, const std::vector<uint8_t> & input) {
+    rpc_msg_get_tensor_req req;
+    if (!request(input, req)) {
+        return false;
+    }
+    char * p = resolve(&req.tensor, req.offset, req.size);
+    if (!p) {
+        fprintf(stderr, "%s: tensor data out of bounds\n", __func__);
+        return false;
+    }
+    return send_data(fd, &req.size, sizeof(req.size)) && send_data(fd, p, req.size);
+}
+
+bool rpc_server::copy_tensor(const std::vector<uint8_t> & input, std::vector<uint8_t> & output) {
+    rpc_msg_copy_tensor_req req;
+    if (!request(input, req)) {
+        return false;
+    }
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 2 * ggml_tensor_overhead(),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true,
+    };
+    struct ggml_context * ctx = ggml_init(params);
+    ggml_tensor * src = deserialize_tensor(ctx, &req.src);
+    ggml_tensor * dst = deserialize_tensor(ctx, &req.dst);
+    bool ok = src && dst && resolve(&req.dst, 0, ggml_nbytes(src)) &&
+              ggml_backend_buffer_copy_tensor(src, dst);
+    ggml_free(ctx);
+    reply(output, (uint8_t)ok);
+    return true;
+}
+
+ggml_tensor * rpc_server::create_node(uint64_t id,
+                                      struct ggml_context * ctx,
+                                      const std::unordered_map<uint64_t, const rpc_tensor *> & tensor_ptrs,
+                                      std::unordered_map<uint64_t, struct ggml_tensor *> & tensor_map,
+                                      bool & ok) {
+    if (id == 0 || !ok) {
+        return nullptr;
+    }
+    auto it = tensor_map.find(id);
+    if (it != tensor_map.end()) {
+        return it->second;
+    }
+    auto it_ptr = tensor_ptrs.find(id);
+    if (it_ptr == tensor_ptrs.end()) {
+        ok = false;
+        return nullptr;
+    }
+    const rpc_tensor * tensor = it_ptr->second;
+    struct ggml_tensor * result = deserialize_tensor(ctx, tensor);
+    if (result == nullptr) {
+        ok = false;
+        return nullptr;
+    }
+    tensor_map[id] = result;
+    for (int i = 0; i < GGML_MAX_SRC; i++) {
+        result->src[i] = create_node(tensor->src[i], ctx, tensor_ptrs, tensor_map, ok);
+    }
+    result->view_src = create_node(tensor->view_src, ctx, tensor_ptrs, tensor_map, ok);
+    result->view_offs = tensor->view_offs;
+    return result;
+}
+
+// graphs that fail validation get a failed status rather than dropping
+// the connection, since the message framing is still intact
+bool rpc_server::graph_compute(const std::vector<uint8_t> & input, std::vector<uint8_t> & output) {
+    if (!graph_compute_impl(input, output)) {
+        fprintf(stderr, "%s: received invalid graph\n", __func__);
+        reply(output, (uint8_t)GGML_STATUS_FAILED);
+    }
+    return true;
+}
+
+bool rpc_server::graph_compute_impl(const std::vector<uint8_t> & input, std::vector<uint8_t> & output) {
+    const uint8_t * p = input.data();
+    const uint8_t * e = p + input.size();
+    uint32_t n_nodes;
+    uint32_t n_tensors;
+    if (e - p < (ptrdiff_t)sizeof(n_nodes)) {
+        return false;
+    }
+    memcpy(&n_nodes, p, sizeof(n_nodes));
+    p += sizeof(n_nodes);
+    if ((uint64_t)(e - p) < (uint64_t)n_nodes * sizeof(uint64_t) + sizeof(n_tensors)) {
+        return false;
+    }
+    std::vector<uint64_t> nodes(n_nodes);
+    memcpy(nodes.data(), p, n_nodes * sizeof(uint64_t));
+    p += n_nodes * sizeof(uint64_t);
+    memcpy(&n_tensors, p, sizeof(n_tensors));
+    p += sizeof(n_tensors);
+    if ((uint64_t)(e - p) != (uint64_t)n_tensors * sizeof(rpc_tensor) || n_nodes > n_tensors) {
+        return false;
+    }
+    std::vector<rpc_tensor> tensors(n_tensors);
+    memcpy(tensors.data(), p, n_tensors * sizeof(rpc_tensor));
+
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ n_tensors * ggml_tensor_overhead() + ggml_graph_overhead_custom(n_nodes, false),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true,
+    };
+    struct ggml_context * ctx = ggml_init(params);
+    struct ggml_cgraph * graph = ggml_new_graph_custom(ctx, n_nodes, false);
+    graph->n_nodes = n_nodes;
+    std::unordered_map<uint64_t, const rpc_tensor *> tensor_ptrs;
+    for (uint32_t i = 0; i < n_tensors; i++) {
+        tensor_ptrs[tensors[i].id] = &tensors[i];
+    }
+    std::unordered_map<uint64_t, struct ggml_tensor *> tensor_map;
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < n_nodes; i++) {
+        graph->nodes[i] = create_node(nodes[i], ctx, tensor_ptrs, tensor_map, ok);
+        if (!graph->nodes[i]) {
+            ok = false;
+        }
+    }
+    if (ok) {
+        enum ggml_status status = ggml_backend_graph_compute(backend, graph);
+        reply(output, (uint8_t)status);
+    }
+    ggml_free(ctx);
+    return ok;
+}
+
+static void rpc_serve_client(ggml_backend_t backend, int fd, size_t free_mem, size_t total_mem) {
+    rpc_server server(backend);
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+    uint8_t cmd;
+    uint64_t size;
+
+    // the first command must be hello, so version mismatches are caught
+    if (!recv_data(fd, &cmd, 1) || cmd != RPC_CMD_HELLO ||
+        !recv_data(fd, &size, sizeof(size)) || size != 0) {
+        return;
+    }
+    output.resize(sizeof(uint64_t));
+    reply(output, (uint32_t)RPC_PROTOCOL_VERSION);
+
+    for (;;) {
+        if (output.size()) {
+            uint64_t n = output.size() - sizeof(uint64_t);
+            memcpy(output.data(), &n, sizeof(n));
+            if (!send_data(fd, output.data(), output.size())) {
+                break;
+            }
+        }
+        if (!recv_data(fd, &cmd, 1) || !recv_data(fd, &size, sizeof(size))) {
+            break;
+        }
+        output.clear();
+        if (cmd == RPC_CMD_SET_TENSOR) {
+            if (!server.set_tensor(fd, size)) {
+                break;
+            }
+            continue;
+        }
+        if (size > RPC_MAX_MESSAGE) {
+            fprintf(stderr, "%s: request too large\n", __func__);
+            break;
+        }
+        input.resize(size);
+        if (!recv_data(fd, input.data(), size)) {
+            break;
+        }
+        bool ok = true;
+        size_t n = sizeof(uint64_t); // reserved for reply size
+        switch (cmd) {
+            case RPC_CMD_ALLOC_BUFFER:
+                output.resize(n);
+                ok = server.alloc_buffer(input, output);
+                break;
+            case RPC_CMD_GET_ALIGNMENT:
+                output.resize(n);
+                server.get_alignment(output);
+                break;
+            case RPC_CMD_GET_MAX_SIZE:
+                output.resize(n);
+                server.get_max_size(output);
+                break;
+            case RPC_CMD_FREE_BUFFER:
+                ok = server.free_buffer(input);
+                break;
+            case RPC_CMD_BUFFER_CLEAR:
+                ok = server.buffer_clear(input);
+                break;
+            case RPC_CMD_GET_TENSOR:
+                ok = server.get_tensor(fd, input);
+                break;
+            case RPC_CMD_COPY_TENSOR:
+                output.resize(n);
+                ok = server.copy_tensor(input, output);
+                break;
+            case RPC_CMD_GRAPH_COMPUTE:
+                output.resize(n);
+                ok = server.graph_compute(input, output);
+                break;
+            case RPC_CMD_GET_DEVICE_MEMORY: {
+                rpc_msg_get_device_memory_rsp rsp = {free_mem, total_mem};
+                output.resize(n);
+                reply(output, rsp);
+                break;
+            }
+            default:
+                ok = false;
+                break;
+        }
+        if (!ok) {
+            break;
+        }
+    }
+}
+
+GGML_API GGML_CALL void ggml_backend_rpc_start_server(ggml_backend_t backend, const char * endpoint, size_t free_mem, size_t total_mem) {
+    int server = socket_open(endpoint, true);
+    if (server == -1) {
+        return;
+    }
+    fprintf(stderr, "%s: listening on %s (free_mem=%zu MiB, total_mem=%zu MiB)\n",
+            __func__, endpoint, free_mem / 1024 / 1024, total_mem / 1024 / 1024);
+    for (;;) {
+        int client = accept(server, NULL, NULL);
+        if (client == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            break;
+        }
+        set_nodelay(client);
+        fprintf(stderr, "%s: accepted client connection\n", __func__);
+        rpc_serve_client(backend, client, free_mem, total_mem);
+        close(client);
+        fprintf(stderr, "%s: client connection closed\n", __func__);
+    }
+    close(server);
+}
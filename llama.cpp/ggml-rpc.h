@@ -0,0 +1,32 @@
+#pragma once
+
+#include "ggml.h"
+#include "ggml-backend.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#define GGML_RPC_MAX_SERVERS       16
+
+// backend API
+GGML_API GGML_CALL ggml_backend_t ggml_backend_rpc_init(const char * endpoint);
+GGML_API GGML_CALL bool ggml_backend_is_rpc(ggml_backend_t backend);
+
+// [jart] waits for the backend and returns true if a graph it computed
+//        failed since the last call, e.g. because the connection broke
+GGML_API GGML_CALL bool ggml_backend_rpc_failed(ggml_backend_t backend);
+
+GGML_API GGML_CALL ggml_backend_buffer_type_t ggml_backend_rpc_buffer_type(const char * endpoint);
+
+GGML_API GGML_CALL void ggml_backend_rpc_get_device_memory(const char * endpoint, size_t * free, size_t * total);
+
+// [jart] memory of this host, for splitting layers between it and workers
+GGML_API GGML_CALL void ggml_backend_rpc_get_host_memory(size_t * free, size_t * total);
+
+// serves clients one at a time until an error happens
+GGML_API GGML_CALL void ggml_backend_rpc_start_server(ggml_backend_t backend, const char * endpoint, size_t free_mem, size_t total_mem);
+
+#ifdef  __cplusplus
+}
+#endif
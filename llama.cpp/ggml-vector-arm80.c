@@ -28,6 +28,7 @@
 #define ggml_vec_scale_f16 ggml_vec_scale_f16_arm80
 #define ggml_vec_mad_f32 ggml_vec_mad_f32_arm80
 #define ggml_vec_mad_f16 ggml_vec_mad_f16_arm80
+#define ggml_vec_mad_bf16 ggml_vec_mad_bf16_arm80
 #define ggml_vec_norm_f32 ggml_vec_norm_f32_arm80
 #define ggml_vec_sqr_f32 ggml_vec_sqr_f32_arm80
 #define ggml_vec_sqrt_f32 ggml_vec_sqrt_f32_arm80
@@ -44,6 +45,8 @@
 #define ggml_vec_gelu_f32 ggml_vec_gelu_f32_arm80
 #define ggml_vec_gelu_quick_f32 ggml_vec_gelu_quick_f32_arm80
 #define ggml_vec_silu_f32 ggml_vec_silu_f32_arm80
+#define ggml_vec_swiglu_f32 ggml_vec_swiglu_f32_arm80
+#define ggml_vec_mul_scale_f32 ggml_vec_mul_scale_f32_arm80
 #define ggml_silu_backward_f32 ggml_silu_backward_f32_arm80
 #define ggml_vec_silu_backward_f32 ggml_vec_silu_backward_f32_arm80
 #define ggml_vec_sum_f32 ggml_vec_sum_f32_arm80
@@ -52,6 +55,7 @@
 #define ggml_vec_sum_bf16_ggf ggml_vec_sum_bf16_ggf_arm80
 #define ggml_vec_max_f32 ggml_vec_max_f32_arm80
 #define ggml_vec_argmax_f32 ggml_vec_argmax_f32_arm80
+#define ggml_vec_select_ge_f32 ggml_vec_select_ge_f32_arm80
 #define ggml_vec_soft_max_f32 ggml_vec_soft_max_f32_arm80
 #define ggml_vec_norm_inv_f32 ggml_vec_norm_inv_f32_arm80
 #define ggml_vec_sigmoid_f32 ggml_vec_sigmoid_f32_arm80
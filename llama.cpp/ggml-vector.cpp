@@ -351,6 +351,18 @@ extern "C" void ggml_vec_mad_f16_amd_k8(const int n, ggml_fp16_t * y, const ggml
 extern "C" void ggml_vec_mad_f16_arm82(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
 extern "C" void ggml_vec_mad_f16_arm80(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
 
+extern "C" void ggml_vec_mad_bf16_amd_avx512bf16(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_amd_avx512vl(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_amd_avx512(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_amd_avx2(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_amd_f16c(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_amd_fma(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_amd_avx(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_amd_ssse3(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_amd_k8(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_arm82(const int n, float * y, const ggml_bf16_t * x, const float v);
+extern "C" void ggml_vec_mad_bf16_arm80(const int n, float * y, const ggml_bf16_t * x, const float v);
+
 extern "C" void ggml_vec_norm_f32_amd_avx512bf16 (const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_f32_amd_avx512vl (const int n, float * s, const float * x);
 extern "C" void ggml_vec_norm_f32_amd_avx512 (const int n, float * s, const float * x);
@@ -543,6 +555,30 @@ extern "C" void ggml_vec_silu_f32_amd_k8(const int n, float * y, const float * x
 extern "C" void ggml_vec_silu_f32_arm82(const int n, float * y, const float * x);
 extern "C" void ggml_vec_silu_f32_arm80(const int n, float * y, const float * x);
 
+extern "C" void ggml_vec_swiglu_f32_amd_avx512bf16(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_amd_avx512vl(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_amd_avx512(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_amd_avx2(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_amd_f16c(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_amd_fma(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_amd_avx(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_amd_ssse3(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_amd_k8(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_arm82(const int n, float * z, const float * x, const float * g);
+extern "C" void ggml_vec_swiglu_f32_arm80(const int n, float * z, const float * x, const float * g);
+
+extern "C" void ggml_vec_mul_scale_f32_amd_avx512bf16(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_amd_avx512vl(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_amd_avx512(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_amd_avx2(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_amd_f16c(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_amd_fma(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_amd_avx(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_amd_ssse3(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_amd_k8(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_arm82(const int n, float * z, const float * x, const float * y, const float v);
+extern "C" void ggml_vec_mul_scale_f32_arm80(const int n, float * z, const float * x, const float * y, const float v);
+
 extern "C" float ggml_silu_backward_f32_amd_avx512bf16(float x, float dy);
 extern "C" float ggml_silu_backward_f32_amd_avx512vl(float x, float dy);
 extern "C" float ggml_silu_backward_f32_amd_avx512(float x, float dy);
@@ -639,6 +675,18 @@ extern "C" void ggml_vec_argmax_f32_amd_k8(const int n, int * s, const float * x
 extern "C" void ggml_vec_argmax_f32_arm82(const int n, int * s, const float * x);
 extern "C" void ggml_vec_argmax_f32_arm80(const int n, int * s, const float * x);
 
+extern "C" int ggml_vec_select_ge_f32_amd_avx512bf16(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_amd_avx512vl(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_amd_avx512(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_amd_avx2(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_amd_f16c(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_amd_fma(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_amd_avx(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_amd_ssse3(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_amd_k8(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_arm82(const int n, int * ids, const float * x, const float t);
+extern "C" int ggml_vec_select_ge_f32_arm80(const int n, int * ids, const float * x, const float t);
+
 extern "C" ggml_float ggml_vec_soft_max_f32_amd_avx512bf16(const int n, float * y, const float * x, float max);
 extern "C" ggml_float ggml_vec_soft_max_f32_amd_avx512vl(const int n, float * y, const float * x, float max);
 extern "C" ggml_float ggml_vec_soft_max_f32_amd_avx512(const int n, float * y, const float * x, float max);
@@ -705,6 +753,7 @@ static const struct VectorFuncs {
     typeof(ggml_vec_scale_f16) *ptr_ggml_vec_scale_f16;
     typeof(ggml_vec_mad_f32) *ptr_ggml_vec_mad_f32;
     typeof(ggml_vec_mad_f16) *ptr_ggml_vec_mad_f16;
+    typeof(ggml_vec_mad_bf16) *ptr_ggml_vec_mad_bf16;
     typeof(ggml_vec_norm_f32) *ptr_ggml_vec_norm_f32;
     typeof(ggml_vec_sqr_f32) *ptr_ggml_vec_sqr_f32;
     typeof(ggml_vec_sqrt_f32) *ptr_ggml_vec_sqrt_f32;
@@ -721,6 +770,8 @@ static const struct VectorFuncs {
     typeof(ggml_vec_gelu_f32) *ptr_ggml_vec_gelu_f32;
     typeof(ggml_vec_gelu_quick_f32) *ptr_ggml_vec_gelu_quick_f32;
     typeof(ggml_vec_silu_f32) *ptr_ggml_vec_silu_f32;
+    typeof(ggml_vec_swiglu_f32) *ptr_ggml_vec_swiglu_f32;
+    typeof(ggml_vec_mul_scale_f32) *ptr_ggml_vec_mul_scale_f32;
     typeof(ggml_silu_backward_f32) *ptr_ggml_silu_backward_f32;
     typeof(ggml_vec_silu_backward_f32) *ptr_ggml_vec_silu_backward_f32;
     typeof(ggml_vec_sum_f32) *ptr_ggml_vec_sum_f32;
@@ -729,6 +780,7 @@ static const struct VectorFuncs {
     typeof(ggml_vec_sum_bf16_ggf) *ptr_ggml_vec_sum_bf16_ggf;
     typeof(ggml_vec_max_f32) *ptr_ggml_vec_max_f32;
     typeof(ggml_vec_argmax_f32) *ptr_ggml_vec_argmax_f32;
+    typeof(ggml_vec_select_ge_f32) *ptr_ggml_vec_select_ge_f32;
     typeof(ggml_vec_soft_max_f32) *ptr_ggml_vec_soft_max_f32;
     typeof(ggml_vec_norm_inv_f32) *ptr_ggml_vec_norm_inv_f32;
     typeof(ggml_vec_sigmoid_f32) *ptr_ggml_vec_sigmoid_f32;
@@ -765,6 +817,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx512bf16;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx512bf16;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx512bf16;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_amd_avx512bf16;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx512bf16;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx512bf16;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx512bf16;
@@ -781,6 +834,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_amd_avx512bf16;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_amd_avx512bf16;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_amd_avx512bf16;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_amd_avx512bf16;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_amd_avx512bf16;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_amd_avx512bf16;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_amd_avx512bf16;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_amd_avx512bf16;
@@ -789,6 +844,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx512bf16;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx512bf16;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx512bf16;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_amd_avx512bf16;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx512bf16;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx512bf16;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx512bf16;
@@ -826,6 +882,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx512vl;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx512vl;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx512vl;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_amd_avx512vl;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx512vl;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx512vl;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx512vl;
@@ -842,6 +899,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_amd_avx512vl;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_amd_avx512vl;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_amd_avx512vl;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_amd_avx512vl;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_amd_avx512vl;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_amd_avx512vl;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_amd_avx512vl;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_amd_avx512vl;
@@ -850,6 +909,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx512vl;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx512vl;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx512vl;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_amd_avx512vl;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx512vl;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx512vl;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx512vl;
@@ -887,6 +947,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx512;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx512;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx512;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_amd_avx512;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx512;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx512;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx512;
@@ -903,6 +964,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_amd_avx512;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_amd_avx512;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_amd_avx512;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_amd_avx512;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_amd_avx512;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_amd_avx512;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_amd_avx512;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_amd_avx512;
@@ -911,6 +974,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx512;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx512;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx512;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_amd_avx512;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx512;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx512;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx512;
@@ -948,6 +1012,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx2;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx2;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx2;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_amd_avx2;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx2;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx2;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx2;
@@ -964,6 +1029,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_amd_avx2;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_amd_avx2;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_amd_avx2;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_amd_avx2;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_amd_avx2;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_amd_avx2;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_amd_avx2;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_amd_avx2;
@@ -972,6 +1039,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx2;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx2;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx2;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_amd_avx2;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx2;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx2;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx2;
@@ -1009,6 +1077,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_f16c;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_f16c;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_f16c;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_amd_f16c;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_f16c;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_f16c;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_f16c;
@@ -1025,6 +1094,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_amd_f16c;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_amd_f16c;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_amd_f16c;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_amd_f16c;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_amd_f16c;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_amd_f16c;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_amd_f16c;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_amd_f16c;
@@ -1033,6 +1104,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_f16c;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_f16c;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_f16c;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_amd_f16c;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_f16c;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_f16c;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_f16c;
@@ -1070,6 +1142,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_fma;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_fma;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_fma;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_amd_fma;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_fma;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_fma;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_fma;
@@ -1086,6 +1159,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_amd_fma;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_amd_fma;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_amd_fma;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_amd_fma;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_amd_fma;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_amd_fma;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_amd_fma;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_amd_fma;
@@ -1094,6 +1169,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_fma;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_fma;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_fma;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_amd_fma;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_fma;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_fma;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_fma;
@@ -1131,6 +1207,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_avx;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_avx;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_avx;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_amd_avx;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_avx;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_avx;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_avx;
@@ -1147,6 +1224,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_amd_avx;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_amd_avx;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_amd_avx;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_amd_avx;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_amd_avx;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_amd_avx;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_amd_avx;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_amd_avx;
@@ -1155,6 +1234,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_avx;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_avx;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_avx;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_amd_avx;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_avx;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_avx;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_avx;
@@ -1192,6 +1272,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_ssse3;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_ssse3;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_ssse3;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_amd_ssse3;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_ssse3;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_ssse3;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_ssse3;
@@ -1208,6 +1289,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_amd_ssse3;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_amd_ssse3;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_amd_ssse3;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_amd_ssse3;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_amd_ssse3;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_amd_ssse3;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_amd_ssse3;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_amd_ssse3;
@@ -1216,6 +1299,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_ssse3;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_ssse3;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_ssse3;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_amd_ssse3;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_ssse3;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_ssse3;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_ssse3;
@@ -1253,6 +1337,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_amd_k8;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_amd_k8;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_amd_k8;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_amd_k8;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_amd_k8;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_amd_k8;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_amd_k8;
@@ -1269,6 +1354,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_amd_k8;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_amd_k8;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_amd_k8;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_amd_k8;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_amd_k8;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_amd_k8;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_amd_k8;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_amd_k8;
@@ -1277,6 +1364,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_amd_k8;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_amd_k8;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_amd_k8;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_amd_k8;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_amd_k8;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_amd_k8;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_amd_k8;
@@ -1314,6 +1402,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_arm82;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_arm82;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_arm82;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_arm82;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_arm82;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_arm82;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_arm82;
@@ -1330,6 +1419,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_arm82;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_arm82;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_arm82;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_arm82;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_arm82;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_arm82;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_arm82;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_arm82;
@@ -1338,6 +1429,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_arm82;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_arm82;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_arm82;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_arm82;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_arm82;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_arm82;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_arm82;
@@ -1375,6 +1467,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_scale_f16 = ggml_vec_scale_f16_arm80;
             ptr_ggml_vec_mad_f32 = ggml_vec_mad_f32_arm80;
             ptr_ggml_vec_mad_f16 = ggml_vec_mad_f16_arm80;
+            ptr_ggml_vec_mad_bf16 = ggml_vec_mad_bf16_arm80;
             ptr_ggml_vec_norm_f32 = ggml_vec_norm_f32_arm80;
             ptr_ggml_vec_sqr_f32 = ggml_vec_sqr_f32_arm80;
             ptr_ggml_vec_sqrt_f32 = ggml_vec_sqrt_f32_arm80;
@@ -1391,6 +1484,8 @@ static const struct VectorFuncs {
             ptr_ggml_vec_gelu_f32 = ggml_vec_gelu_f32_arm80;
             ptr_ggml_vec_gelu_quick_f32 = ggml_vec_gelu_quick_f32_arm80;
             ptr_ggml_vec_silu_f32 = ggml_vec_silu_f32_arm80;
+            ptr_ggml_vec_swiglu_f32 = ggml_vec_swiglu_f32_arm80;
+            ptr_ggml_vec_mul_scale_f32 = ggml_vec_mul_scale_f32_arm80;
             ptr_ggml_silu_backward_f32 = ggml_silu_backward_f32_arm80;
             ptr_ggml_vec_silu_backward_f32 = ggml_vec_silu_backward_f32_arm80;
             ptr_ggml_vec_sum_f32 = ggml_vec_sum_f32_arm80;
@@ -1399,6 +1494,7 @@ static const struct VectorFuncs {
             ptr_ggml_vec_sum_bf16_ggf = ggml_vec_sum_bf16_ggf_arm80;
             ptr_ggml_vec_max_f32 = ggml_vec_max_f32_arm80;
             ptr_ggml_vec_argmax_f32 = ggml_vec_argmax_f32_arm80;
+            ptr_ggml_vec_select_ge_f32 = ggml_vec_select_ge_f32_arm80;
             ptr_ggml_vec_soft_max_f32 = ggml_vec_soft_max_f32_arm80;
             ptr_ggml_vec_norm_inv_f32 = ggml_vec_norm_inv_f32_arm80;
             ptr_ggml_vec_sigmoid_f32 = ggml_vec_sigmoid_f32_arm80;
@@ -1524,6 +1620,10 @@ void ggml_vec_mad_f16(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const
   return funcs.ptr_ggml_vec_mad_f16(n, y, x, v);
 }
 
+void ggml_vec_mad_bf16(const int n, float * y, const ggml_bf16_t * x, const float v) {
+  return funcs.ptr_ggml_vec_mad_bf16(n, y, x, v);
+}
+
 void ggml_vec_norm_f32 (const int n, float * s, const float * x) {
   return funcs.ptr_ggml_vec_norm_f32(n, s, x);
 }
@@ -1588,6 +1688,14 @@ void ggml_vec_silu_f32(const int n, float * y, const float * x) {
   return funcs.ptr_ggml_vec_silu_f32(n, y, x);
 }
 
+void ggml_vec_swiglu_f32(const int n, float * z, const float * x, const float * g) {
+  return funcs.ptr_ggml_vec_swiglu_f32(n, z, x, g);
+}
+
+void ggml_vec_mul_scale_f32(const int n, float * z, const float * x, const float * y, const float v) {
+  return funcs.ptr_ggml_vec_mul_scale_f32(n, z, x, y, v);
+}
+
 float ggml_silu_backward_f32(float x, float dy) {
   return funcs.ptr_ggml_silu_backward_f32(x, dy);
 }
@@ -1620,6 +1728,10 @@ void ggml_vec_argmax_f32(const int n, int * s, const float * x) {
   return funcs.ptr_ggml_vec_argmax_f32(n, s, x);
 }
 
+int ggml_vec_select_ge_f32(const int n, int * ids, const float * x, const float t) {
+  return funcs.ptr_ggml_vec_select_ge_f32(n, ids, x, t);
+}
+
 ggml_float ggml_vec_soft_max_f32(const int n, float * y, const float * x, float max) {
   return funcs.ptr_ggml_vec_soft_max_f32(n, y, x, max);
 }
@@ -35,6 +35,7 @@ void ggml_vec_scale_f32(const int n, float * y, const float   v);
 void ggml_vec_scale_f16(const int n, ggml_fp16_t * y, const float v);
 void ggml_vec_mad_f32(const int n, float * y, const float * x, const float v);
 void ggml_vec_mad_f16(const int n, ggml_fp16_t * y, const ggml_fp16_t * x, const float v);
+void ggml_vec_mad_bf16(const int n, float * y, const ggml_bf16_t * x, const float v);
 void ggml_vec_norm_f32 (const int n, float * s, const float * x);
 void ggml_vec_sqr_f32  (const int n, float * y, const float * x);
 void ggml_vec_sqrt_f32 (const int n, float * y, const float * x);
@@ -51,6 +52,8 @@ void ggml_vec_hardsigmoid_f32 (const int n, float * y, const float * x);
 void ggml_vec_gelu_f32(const int n, float * y, const float * x);
 void ggml_vec_gelu_quick_f32(const int n, float * y, const float * x);
 void ggml_vec_silu_f32(const int n, float * y, const float * x);
+void ggml_vec_swiglu_f32(const int n, float * z, const float * x, const float * g);
+void ggml_vec_mul_scale_f32(const int n, float * z, const float * x, const float * y, const float v);
 float ggml_silu_backward_f32(float x, float dy);
 void ggml_vec_silu_backward_f32(const int n, float * dx, const float * x, const float * dy);
 void ggml_vec_sum_f32(const int n, float * s, const float * x);
@@ -59,6 +62,7 @@ void ggml_vec_sum_f16_ggf(const int n, float * s, const ggml_fp16_t * x);
 void ggml_vec_sum_bf16_ggf(const int n, float * s, const ggml_bf16_t * x);
 void ggml_vec_max_f32(const int n, float * s, const float * x);
 void ggml_vec_argmax_f32(const int n, int * s, const float * x);
+int ggml_vec_select_ge_f32(const int n, int * ids, const float * x, const float t);
 ggml_float ggml_vec_soft_max_f32(const int n, float * y, const float * x, float max);
 void ggml_vec_norm_inv_f32(const int n, float * s, const float * x);
 void ggml_vec_sigmoid_f32 (const int n, float * y, const float * x);
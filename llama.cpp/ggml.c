@@ -44,6 +44,7 @@ SOFTWARE.");
 #include "llamafile/thread.h"
 #include "llamafile/crash.h"
 #include "llamafile/trace.h"
+#include "llamafile/experts.h"
 #include "llamafile/pool.h"
 
 #include <alloca.h>
@@ -67,6 +68,7 @@ SOFTWARE.");
 #include <cosmo.h>
 #include <sys/stat.h>
 #include <sys/auxv.h>
+#include <sys/mman.h>
 #include <alloca.h>
 
 typedef void * thread_ret_t;
@@ -1536,6 +1538,9 @@ struct ggml_phaser {
 struct ggml_compute_state_shared {
     const struct ggml_cgraph * cgraph;
     const struct ggml_cplan * cplan;
+    const uint8_t * fuse; // [jart] one ggml_fuse_type per node
+    void * share;         // [jart] quantized src1 shared by mul_mat nodes
+    size_t share_size;
 
     int n_threads;
 
@@ -1547,6 +1552,7 @@ struct ggml_compute_state_shared {
     void * abort_callback_data;
 
     atomic_int current_chunk; // currently processing chunk during mul_mat, shared between all the threads
+    atomic_int n_chunk; // [jart] next chunk to steal in ggml_chunks_next(), reset by ggml_barrier()
 
     enum ggml_status ec;
 };
@@ -1816,14 +1822,18 @@ void ggml_barrier(const struct ggml_compute_params * params) {
     unsigned i = atomic_load_explicit(phase, memory_order_relaxed);
     if (atomic_fetch_add_explicit(count, 1, memory_order_acq_rel) == n - 1) {
         atomic_store_explicit(count, 0, memory_order_relaxed);
+        atomic_store_explicit(&params->shared->n_chunk, 0, memory_order_relaxed);
         for (int j = 0; j < n; ++j)
             atomic_store_explicit(&params->shared->n_barrier_passed[j].i,
                                   i + 1, memory_order_relaxed);
         atomic_thread_fence(memory_order_release);
     } else {
+        unsigned long long t = FLAG_trace ? llamafile_trace_now() : 0;
         while (atomic_load_explicit(phase, memory_order_relaxed) == i)
             pthread_pause_np();
         atomic_thread_fence(memory_order_acquire);
+        if (t)
+            llamafile_trace_wait("barrier", t);
     }
 }
 
@@ -1833,6 +1843,65 @@ inline static void ggml_critical_section_end(void) {
     atomic_flag_clear(&g_state_critical);
 }
 
+// [jart] distributes rows [0,nr) of a row-parallel op to threads
+//
+// each thread starts on the chunk matching its index, and then steals
+// whatever chunks remain. that way a thread that's stuck on an energy
+// efficient core, or preempted by a noisy neighbor, ends up doing fewer
+// rows, rather than making every other thread wait for it at the next
+// barrier. chunks are sized so each one is roughly GGML_CHUNK_WORK units
+// of work (as estimated by the caller's row_cost) so cheap ops don't pay
+// much for atomics, while still leaving a few chunks per thread to steal
+//
+// this may only be used once between barriers, since ggml_barrier() is
+// what resets the shared counter. work that's too small to be worth the
+// trouble, or runs on numa systems, where mul_mat found static splitting
+// to be faster, is split evenly in contiguous blocks without stealing.
+
+#define GGML_CHUNK_WORK 16384
+
+struct ggml_chunks {
+    int64_t nr;
+    int64_t dr;
+    int64_t nchunk;
+    int64_t chunk;
+    int nth;
+    atomic_int * next;
+};
+
+static void ggml_chunks_init(struct ggml_chunks * c, const struct ggml_compute_params * params,
+                             int64_t nr, int64_t row_cost) {
+    const int nth = params->nth;
+    row_cost = MAX(row_cost, 1);
+    c->nr    = nr;
+    c->nth   = nth;
+    c->chunk = -1 - params->ith;
+    if (nth == 1 || nr <= nth || nr*row_cost <= (int64_t)GGML_CHUNK_WORK*nth || ggml_is_numa()) {
+        c->dr   = (nr + nth - 1)/nth;
+        c->next = NULL;
+    } else {
+        c->dr   = MAX(1, MIN(GGML_CHUNK_WORK/row_cost, (nr + nth*4 - 1)/(nth*4)));
+        c->next = &params->shared->n_chunk;
+    }
+    c->nchunk = c->dr ? (nr + c->dr - 1)/c->dr : 0;
+}
+
+static bool ggml_chunks_next(struct ggml_chunks * c, int64_t * ir0, int64_t * ir1) {
+    if (c->chunk < 0) {
+        c->chunk = -1 - c->chunk;
+    } else if (c->next) {
+        c->chunk = c->nth + atomic_fetch_add_explicit(c->next, 1, memory_order_relaxed);
+    } else {
+        return false;
+    }
+    if (c->chunk >= c->nchunk) {
+        return false;
+    }
+    *ir0 = c->chunk*c->dr;
+    *ir1 = MIN(*ir0 + c->dr, c->nr);
+    return true;
+}
+
 static cpu_set_t ggml_get_numa_affinity(void) {
     cpu_set_t cpuset;
     pthread_t thread;
@@ -7400,14 +7469,17 @@ static void ggml_compute_forward_dup_f32(
         nb00 == ggml_type_size(src0->type) && nb0 == ggml_type_size(dst->type)) {
         // copy by rows
         const size_t rs = ne00*nb00;
-        for (int64_t i03 = 0; i03 < ne03; i03++) {
-            for (int64_t i02 = 0; i02 < ne02; i02++) {
-                for (int64_t i01 = ir0; i01 < ir1; i01++) {
-                    memcpy(
-                        ((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3),
-                        ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03),
-                        rs);
-                }
+        struct ggml_chunks chunks;
+        ggml_chunks_init(&chunks, params, ne01*ne02*ne03, ne00);
+        for (int64_t ir_start, ir_end; ggml_chunks_next(&chunks, &ir_start, &ir_end);) {
+            for (int64_t ir = ir_start; ir < ir_end; ir++) {
+                const int64_t i03 = ir/(ne02*ne01);
+                const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+                const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
+                memcpy(
+                    ((char *)  dst->data + i01*nb1  + i02*nb2  + i03*nb3),
+                    ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03),
+                    rs);
             }
         }
         return;
@@ -7416,38 +7488,25 @@ static void ggml_compute_forward_dup_f32(
     if (ggml_is_contiguous(dst)) {
         // TODO: simplify
         if (nb00 == sizeof(float)) {
-            if (dst->type == GGML_TYPE_F32) {
-                size_t id = 0;
-                const size_t rs = ne00 * nb00;
-                char * dst_ptr = (char *) dst->data;
-
-                for (int i03 = 0; i03 < ne03; i03++) {
-                    for (int i02 = 0; i02 < ne02; i02++) {
-                        id += rs * ir0;
-                        for (int i01 = ir0; i01 < ir1; i01++) {
-                            const char * src0_ptr = (char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03;
-                            memcpy(dst_ptr + id, src0_ptr, rs);
-                            id += rs;
-                        }
-                        id += rs * (ne01 - ir1);
-                    }
-                }
-            } else if (type_traits[dst->type].from_float) {
-                ggml_from_float_t const quantize_row_q = type_traits[dst->type].from_float;
-
-                size_t id = 0;
-                size_t rs = nb0 * (ne00 / ggml_blck_size(dst->type));
-                char * dst_ptr = (char *) dst->data;
-
-                for (int i03 = 0; i03 < ne03; i03++) {
-                    for (int i02 = 0; i02 < ne02; i02++) {
-                        id += rs * ir0;
-                        for (int i01 = ir0; i01 < ir1; i01++) {
-                            const float * src0_ptr = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
-                            quantize_row_q(src0_ptr, dst_ptr + id, ne00);
-                            id += rs;
+            // [jart] dst rows are contiguous, so the row index is the offset
+            const size_t rs = ggml_row_size(dst->type, ne00);
+            ggml_from_float_t const quantize_row_q = type_traits[dst->type].from_float;
+            char * dst_ptr = (char *) dst->data;
+
+            if (dst->type == GGML_TYPE_F32 || quantize_row_q) {
+                struct ggml_chunks chunks;
+                ggml_chunks_init(&chunks, params, ne01*ne02*ne03, ne00);
+                for (int64_t ir_start, ir_end; ggml_chunks_next(&chunks, &ir_start, &ir_end);) {
+                    for (int64_t ir = ir_start; ir < ir_end; ir++) {
+                        const int64_t i03 = ir/(ne02*ne01);
+                        const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+                        const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
+                        const float * src0_ptr = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+                        if (dst->type == GGML_TYPE_F32) {
+                            memcpy(dst_ptr + ir*rs, src0_ptr, rs);
+                        } else {
+                            quantize_row_q(src0_ptr, dst_ptr + ir*rs, ne00);
                         }
-                        id += rs * (ne01 - ir1);
                     }
                 }
             } else {
@@ -10539,9 +10598,6 @@ static void ggml_compute_forward_norm_f32(
 
     GGML_ASSERT(src0->nb[0] == sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     GGML_TENSOR_UNARY_OP_LOCALS
 
     float eps;
@@ -10549,33 +10605,37 @@ static void ggml_compute_forward_norm_f32(
 
     GGML_ASSERT(eps > 0.0f);
 
-    // TODO: optimize
-    for (int64_t i03 = 0; i03 < ne03; i03++) {
-        for (int64_t i02 = 0; i02 < ne02; i02++) {
-            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
-                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, ne01*ne02*ne03, ne00);
 
-                ggml_float sum = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    sum += (ggml_float)x[i00];
-                }
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        for (int64_t ir = ir0; ir < ir1; ir++) {
+            const int64_t i03 = ir/(ne02*ne01);
+            const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+            const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
 
-                float mean = sum/ne00;
+            const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
 
-                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+            ggml_float sum = 0.0;
+            for (int64_t i00 = 0; i00 < ne00; i00++) {
+                sum += (ggml_float)x[i00];
+            }
 
-                ggml_float sum2 = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    float v = x[i00] - mean;
-                    y[i00] = v;
-                    sum2 += (ggml_float)(v*v);
-                }
+            float mean = sum/ne00;
 
-                float variance = sum2/ne00;
-                const float scale = 1.0f/sqrtf(variance + eps);
+            float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
 
-                ggml_vec_scale_f32(ne00, y, scale);
+            ggml_float sum2 = 0.0;
+            for (int64_t i00 = 0; i00 < ne00; i00++) {
+                float v = x[i00] - mean;
+                y[i00] = v;
+                sum2 += (ggml_float)(v*v);
             }
+
+            float variance = sum2/ne00;
+            const float scale = 1.0f/sqrtf(variance + eps);
+
+            ggml_vec_scale_f32(ne00, y, scale);
         }
     }
 }
@@ -10610,9 +10670,6 @@ static void ggml_compute_forward_rms_norm_f32(
 
     GGML_ASSERT(src0->nb[0] == sizeof(float));
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
     GGML_TENSOR_UNARY_OP_LOCALS
 
     float eps;
@@ -10620,30 +10677,34 @@ static void ggml_compute_forward_rms_norm_f32(
 
     GGML_ASSERT(eps > 0.0f);
 
-    // TODO: optimize
-    for (int64_t i03 = 0; i03 < ne03; i03++) {
-        for (int64_t i02 = 0; i02 < ne02; i02++) {
-            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
-                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, ne01*ne02*ne03, ne00);
 
-                ggml_float sum = 0.0;
-                for (int64_t i00 = 0; i00 < ne00; i00++) {
-                    sum += (ggml_float)(x[i00] * x[i00]);
-                }
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        for (int64_t ir = ir0; ir < ir1; ir++) {
+            const int64_t i03 = ir/(ne02*ne01);
+            const int64_t i02 = (ir - i03*ne02*ne01)/ne01;
+            const int64_t i01 = (ir - i03*ne02*ne01 - i02*ne01);
 
-                const float mean = sum/ne00;
+            const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+
+            ggml_float sum = 0.0;
+            for (int64_t i00 = 0; i00 < ne00; i00++) {
+                sum += (ggml_float)(x[i00] * x[i00]);
+            }
 
-                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+            const float mean = sum/ne00;
 
-                memcpy(y, x, ne00 * sizeof(float));
-                // for (int i00 = 0; i00 < ne00; i00++) {
-                //     y[i00] = x[i00];
-                // }
+            float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
 
-                const float scale = 1.0f/sqrtf(mean + eps);
+            memcpy(y, x, ne00 * sizeof(float));
+            // for (int i00 = 0; i00 < ne00; i00++) {
+            //     y[i00] = x[i00];
+            // }
 
-                ggml_vec_scale_f32(ne00, y, scale);
-            }
+            const float scale = 1.0f/sqrtf(mean + eps);
+
+            ggml_vec_scale_f32(ne00, y, scale);
         }
     }
 }
@@ -11027,9 +11088,13 @@ static void ggml_compute_forward_mul_mat_one_chunk(
     }
 }
 
-static void ggml_compute_forward_mul_mat(
+// [jart] when shared is true, src1 is always quantized into wdata, and
+//        when reuse is true, an earlier mul_mat already put it there
+static void ggml_compute_forward_mul_mat_impl(
         const struct ggml_compute_params * params,
-              struct ggml_tensor * dst) {
+              struct ggml_tensor * dst,
+              bool shared,
+              bool reuse) {
 
     const struct ggml_tensor * src0 = dst->src[0];
     const struct ggml_tensor * src1 = dst->src[1];
@@ -11075,7 +11140,7 @@ static void ggml_compute_forward_mul_mat(
 
     const bool src1_cont = ggml_is_contiguous(src1);
 
-    if (src1_cont) {
+    if (src1_cont && !shared) {
         for (int64_t i13 = 0; i13 < ne13; i13++)
             for (int64_t i12 = 0; i12 < ne12; i12++)
                 if (!llamafile_sgemm(ne01, ne11, ne00/ggml_blck_size(src0->type),
@@ -11095,7 +11160,7 @@ static void ggml_compute_forward_mul_mat(
 UseGgmlGemm1:;
 #endif
 
-    if (src1->type != vec_dot_type) {
+    if (src1->type != vec_dot_type && !reuse) {
         char * wdata = params->wdata;
 
         const size_t nbw1 = ggml_row_size(vec_dot_type, ne10);
@@ -11207,11 +11272,12 @@ UseGgmlGemm2:;
         if (src0_start >= src0_end) return;
 
         // If there are more than three rows in src1, use gemm; otherwise, use gemv.
-        if (gemm && (ne11 > 3)) {
+        // [jart] gemm needs src1 to have been interleaved by from_float_to_mat
+        if (gemm && (ne11 > 3) && src1->type != vec_dot_type) {
             gemm(ne00, (float *)((char *) dst->data) + src0_start, ne01, (const char *) src0->data + src0_start * nb01,
                  (const char *) src1_wdata, ne11 - ne11 % 4, src0_end - src0_start);
         }
-        for (int iter = gemm ? ne11 - ne11 % 4 : 0; iter < ne11; iter++) {
+        for (int iter = gemm && src1->type != vec_dot_type ? ne11 - ne11 % 4 : 0; iter < ne11; iter++) {
             gemv(ne00, (float *)((char *) dst->data + (iter * nb1)) + src0_start, ne01,
                  (const char *) src0->data + src0_start * nb01, (const char *) src1_wdata + (src1_col_stride * iter), 1,
                  src0_end - src0_start);
@@ -11242,6 +11308,12 @@ UseGgmlGemm2:;
     }
 }
 
+static void ggml_compute_forward_mul_mat(
+        const struct ggml_compute_params * params,
+              struct ggml_tensor * dst) {
+    ggml_compute_forward_mul_mat_impl(params, dst, false, false);
+}
+
 // ggml_compute_forward_mul_mat_id
 
 static void ggml_compute_forward_mul_mat_id(
@@ -11338,7 +11410,12 @@ static void ggml_compute_forward_mul_mat_id(
 
     ggml_barrier(params);
 
-    // compute each matrix multiplication in sequence
+    // [jart] schedule experts across threads by load
+    //        each thread only works on the experts that overlap its share
+    //        of the total rows, so cold experts don't stall hot ones
+    const int64_t n_work = ids->ne[1]*n_ids;
+    int64_t n_done = 0;
+
     for (int cur_a = 0; cur_a < n_as; ++cur_a) {
         const int64_t cne1 = matrix_row_counts[cur_a];
 
@@ -11346,6 +11423,17 @@ static void ggml_compute_forward_mul_mat_id(
             continue;
         }
 
+        const int64_t th0 = n_done*nth/n_work;
+        const int64_t th1 = ((n_done + cne1)*nth + n_work - 1)/n_work;
+        n_done += cne1;
+
+        if (ith < th0 || ith >= th1) {
+            continue;
+        }
+
+        const int jth = ith - th0;
+        const int mth = th1 - th0;
+
         const char * src0_cur = (const char *) src0->data + cur_a*nb02;
 
         const void * wdata    = (src1->type == vec_dot_type) ? src1->data : params->wdata;
@@ -11362,7 +11450,7 @@ static void ggml_compute_forward_mul_mat_id(
                              (const char *)wdata,
                              (float *)dst->data, nb1, nb2,
                              matrix_rows + cur_a*ne12,
-                             ith, nth)) goto IQK_MulMat_Not_Available;
+                             jth, mth)) goto IQK_MulMat_Not_Available;
                 continue;
             }
         }
@@ -11370,11 +11458,11 @@ IQK_MulMat_Not_Available:;
 
         // distribute the thread work across the inner or outer loop based on which one is larger
 
-        const int64_t nth0 = nr0 > nr1 ? nth : 1; // parallelize by src0 rows
-        const int64_t nth1 = nr0 > nr1 ? 1 : nth; // parallelize by src1 rows
+        const int64_t nth0 = nr0 > nr1 ? mth : 1; // parallelize by src0 rows
+        const int64_t nth1 = nr0 > nr1 ? 1 : mth; // parallelize by src1 rows
 
-        const int64_t ith0 = ith % nth0;
-        const int64_t ith1 = ith / nth0;
+        const int64_t ith0 = jth % nth0;
+        const int64_t ith1 = jth / nth0;
 
         const int64_t dr0 = (nr0 + nth0 - 1)/nth0;
         const int64_t dr1 = (nr1 + nth1 - 1)/nth1;
@@ -11947,27 +12035,22 @@ static void ggml_compute_forward_get_rows_q(
     assert(nb00 == ggml_type_size(type));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, nr, nc);
 
-    for (int64_t i = ir0; i < ir1; ++i) {
-        const int64_t i12 = i/(ne11*ne10);
-        const int64_t i11 = (i - i12*ne11*ne10)/ne10;
-        const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
-        const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        for (int64_t i = ir0; i < ir1; ++i) {
+            const int64_t i12 = i/(ne11*ne10);
+            const int64_t i11 = (i - i12*ne11*ne10)/ne10;
+            const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
+            const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
 
-        assert(i01 >= 0 && i01 < ne01);
+            assert(i01 >= 0 && i01 < ne01);
 
-        dequantize_row_q(
-                (const void *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
-                     (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+            dequantize_row_q(
+                    (const void *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
+                         (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+        }
     }
 }
 
@@ -11988,27 +12071,22 @@ static void ggml_compute_forward_get_rows_f16(
     assert(nb00 == sizeof(ggml_fp16_t));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, nr, nc);
 
-    for (int64_t i = ir0; i < ir1; ++i) {
-        const int64_t i12 = i/(ne11*ne10);
-        const int64_t i11 = (i - i12*ne11*ne10)/ne10;
-        const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
-        const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        for (int64_t i = ir0; i < ir1; ++i) {
+            const int64_t i12 = i/(ne11*ne10);
+            const int64_t i11 = (i - i12*ne11*ne10)/ne10;
+            const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
+            const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
 
-        assert(i01 >= 0 && i01 < ne01);
+            assert(i01 >= 0 && i01 < ne01);
 
-        ggml_fp16_to_fp32_row(
-                (const void *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
-                     (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+            ggml_fp16_to_fp32_row(
+                    (const void *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
+                         (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+        }
     }
 }
 
@@ -12029,27 +12107,22 @@ static void ggml_compute_forward_get_rows_bf16(
     assert(nb00 == sizeof(ggml_bf16_t));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, nr, nc);
 
-    for (int64_t i = ir0; i < ir1; ++i) {
-        const int64_t i12 = i/(ne11*ne10);
-        const int64_t i11 = (i - i12*ne11*ne10)/ne10;
-        const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
-        const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        for (int64_t i = ir0; i < ir1; ++i) {
+            const int64_t i12 = i/(ne11*ne10);
+            const int64_t i11 = (i - i12*ne11*ne10)/ne10;
+            const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
+            const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
 
-        assert(i01 >= 0 && i01 < ne01);
+            assert(i01 >= 0 && i01 < ne01);
 
-        ggml_bf16_to_fp32_row(
-                (const void *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
-                     (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+            ggml_bf16_to_fp32_row(
+                    (const void *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03),
+                         (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3), nc);
+        }
     }
 }
 
@@ -12070,27 +12143,22 @@ static void ggml_compute_forward_get_rows_f32(
     assert(nb00 == sizeof(float));
     assert(ggml_nrows(dst) == nr);
 
-    const int ith = params->ith;
-    const int nth = params->nth;
-
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, nr, nc);
 
-    for (int64_t i = ir0; i < ir1; ++i) {
-        const int64_t i12 = i/(ne11*ne10);
-        const int64_t i11 = (i - i12*ne11*ne10)/ne10;
-        const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
-        const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        for (int64_t i = ir0; i < ir1; ++i) {
+            const int64_t i12 = i/(ne11*ne10);
+            const int64_t i11 = (i - i12*ne11*ne10)/ne10;
+            const int64_t i10 = (i - i12*ne11*ne10 - i11*ne10);
+            const int64_t i01 = *(int32_t *) ((char *) src1->data + i10*nb10 + i11*nb11 + i12*nb12);
 
-        assert(i01 >= 0 && i01 < ne01);
+            assert(i01 >= 0 && i01 < ne01);
 
-        ggml_vec_cpy_f32(nc,
-                (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3),
-                (float *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03));
+            ggml_vec_cpy_f32(nc,
+                    (float *) ((char *)  dst->data + i10*nb1  + i11*nb2  + i12*nb3),
+                    (float *) ((char *) src0->data + i01*nb01 + i11*nb02 + i12*nb03));
+        }
     }
 }
 
@@ -12445,7 +12513,6 @@ static void ggml_compute_forward_soft_max_f32(
     // TODO: handle transposed/permuted matrices
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     GGML_TENSOR_UNARY_OP_LOCALS
 
@@ -12462,65 +12529,63 @@ static void ggml_compute_forward_soft_max_f32(
     const int nc = src0->ne[0];
     const int nr = ggml_nrows(src0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
     float * wp = (float *) params->wdata + (nc + CACHE_LINE_SIZE_F32) * ith;
 
     const bool use_f16 = (src1 && src1->type == GGML_TYPE_F16);
 
-    for (int i1 = ir0; i1 < ir1; i1++) {
-        // ALiBi
-        const uint32_t h = (i1/ne01)%ne02; // head
-        const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
-
-        float * sp = (float *)((char *) src0->data + i1*src0->nb[1]);
-        float * dp = (float *)((char *)  dst->data +  i1*dst->nb[1]);
-
-        // broadcast the mask across rows
-        ggml_fp16_t * mp_f16 = src1 ? (ggml_fp16_t *)((char *) src1->data) + (i1%ne01)*ne00 : NULL;
-        float       * mp_f32 = src1 ? (float       *)((char *) src1->data) + (i1%ne01)*ne00 : NULL;
-
-        ggml_vec_cpy_f32  (nc, wp, sp);
-        ggml_vec_scale_f32(nc, wp, scale);
-        if (mp_f32) {
-            if (use_f16) {
-                for (int i = 0; i < nc; ++i) {
-                    wp[i] += slope*GGML_FP16_TO_FP32(mp_f16[i]);
-                }
-            } else {
-                for (int i = 0; i < nc; ++i) {
-                    wp[i] += slope*mp_f32[i];
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, nr, nc);
+
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        for (int64_t i1 = ir0; i1 < ir1; i1++) {
+            // ALiBi
+            const uint32_t h = (i1/ne01)%ne02; // head
+            const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+            float * sp = (float *)((char *) src0->data + i1*src0->nb[1]);
+            float * dp = (float *)((char *)  dst->data +  i1*dst->nb[1]);
+
+            // broadcast the mask across rows
+            ggml_fp16_t * mp_f16 = src1 ? (ggml_fp16_t *)((char *) src1->data) + (i1%ne01)*ne00 : NULL;
+            float       * mp_f32 = src1 ? (float       *)((char *) src1->data) + (i1%ne01)*ne00 : NULL;
+
+            ggml_vec_cpy_f32  (nc, wp, sp);
+            ggml_vec_scale_f32(nc, wp, scale);
+            if (mp_f32) {
+                if (use_f16) {
+                    for (int i = 0; i < nc; ++i) {
+                        wp[i] += slope*GGML_FP16_TO_FP32(mp_f16[i]);
+                    }
+                } else {
+                    for (int i = 0; i < nc; ++i) {
+                        wp[i] += slope*mp_f32[i];
+                    }
                 }
             }
-        }
 
 #ifndef NDEBUG
-        for (int i = 0; i < nc; ++i) {
-            //printf("p[%d] = %f\n", i, p[i]);
-            assert(!isnan(wp[i]));
-        }
+            for (int i = 0; i < nc; ++i) {
+                //printf("p[%d] = %f\n", i, p[i]);
+                assert(!isnan(wp[i]));
+            }
 #endif
 
-        float max = -INFINITY;
-        ggml_vec_max_f32(nc, &max, wp);
+            float max = -INFINITY;
+            ggml_vec_max_f32(nc, &max, wp);
 
-        ggml_float sum = ggml_vec_soft_max_f32(nc, dp, wp, max);
-        assert(sum > 0.0);
+            ggml_float sum = ggml_vec_soft_max_f32(nc, dp, wp, max);
+            assert(sum > 0.0);
 
-        sum = 1.0/sum;
-        ggml_vec_scale_f32(nc, dp, sum);
+            sum = 1.0/sum;
+            ggml_vec_scale_f32(nc, dp, sum);
 
 #ifndef NDEBUG
-        for (int i = 0; i < nc; ++i) {
-            assert(!isnan(dp[i]));
-            assert(!isinf(dp[i]));
-        }
+            for (int i = 0; i < nc; ++i) {
+                assert(!isnan(dp[i]));
+                assert(!isinf(dp[i]));
+            }
 #endif
+        }
     }
 }
 
@@ -12819,23 +12884,12 @@ static void ggml_compute_forward_rope_f32(
     GGML_ASSERT(nb00 == sizeof(float));
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int nr = ggml_nrows(dst);
 
     GGML_ASSERT(n_dims <= ne0);
     GGML_ASSERT(n_dims % 2 == 0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
-    // row index used to determine which thread to use
-    int ir = 0;
-
     const float theta_scale = powf(freq_base, -2.0f/n_dims);
 
     float corr_dims[2];
@@ -12857,56 +12911,62 @@ static void ggml_compute_forward_rope_f32(
 
     const int32_t * pos = (const int32_t *) src1->data;
 
-    for (int64_t i3 = 0; i3 < ne3; i3++) {
-        for (int64_t i2 = 0; i2 < ne2; i2++) {
-            const int64_t p = pos[i2];
+    float * cache = (float *) params->wdata + (ne0 + CACHE_LINE_SIZE_F32)*ith;
 
-            float * cache = (float *) params->wdata + (ne0 + CACHE_LINE_SIZE_F32)*ith;
-            ggml_rope_cache_init(p, freq_scale, freq_factors, corr_dims, ne0, ext_factor, attn_factor, cache, sin_sign, theta_scale);
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, nr, ne0);
 
-            for (int64_t i1 = 0; i1 < ne1; i1++) {
-                if (ir++ < ir0) continue;
-                if (ir   > ir1) break;
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        int64_t cached = -1;
+        for (int64_t ir = ir0; ir < ir1; ir++) {
+            const int64_t i3 = ir/(ne2*ne1);
+            const int64_t i2 = (ir - i3*ne2*ne1)/ne1;
+            const int64_t i1 = (ir - i3*ne2*ne1 - i2*ne1);
 
-                if (!is_neox) {
-                    for (int64_t i0 = 0; i0 < n_dims; i0 += 2) {
-                        const float cos_theta = cache[i0 + 0];
-                        const float sin_theta = cache[i0 + 1];
+            if (i2 != cached) {
+                const int64_t p = pos[i2];
+                ggml_rope_cache_init(p, freq_scale, freq_factors, corr_dims, ne0, ext_factor, attn_factor, cache, sin_sign, theta_scale);
+                cached = i2;
+            }
 
-                        const float * const src = (float *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + i0*nb00);
-                              float * dst_data  = (float *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + i0*nb0);
+            if (!is_neox) {
+                for (int64_t i0 = 0; i0 < n_dims; i0 += 2) {
+                    const float cos_theta = cache[i0 + 0];
+                    const float sin_theta = cache[i0 + 1];
 
-                        const float x0 = src[0];
-                        const float x1 = src[1];
+                    const float * const src = (float *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + i0*nb00);
+                          float * dst_data  = (float *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + i0*nb0);
 
-                        dst_data[0] = x0*cos_theta - x1*sin_theta;
-                        dst_data[1] = x0*sin_theta + x1*cos_theta;
-                    }
-                } else {
-                    for (int64_t i0 = 0; i0 < n_dims; i0 += 2) {
-                        const int64_t ic = i0/2;
+                    const float x0 = src[0];
+                    const float x1 = src[1];
 
-                        const float cos_theta = cache[i0 + 0];
-                        const float sin_theta = cache[i0 + 1];
+                    dst_data[0] = x0*cos_theta - x1*sin_theta;
+                    dst_data[1] = x0*sin_theta + x1*cos_theta;
+                }
+            } else {
+                for (int64_t i0 = 0; i0 < n_dims; i0 += 2) {
+                    const int64_t ic = i0/2;
 
-                        const float * const src = (float *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + ic*nb00);
-                        float * dst_data  = (float *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + ic*nb0);
+                    const float cos_theta = cache[i0 + 0];
+                    const float sin_theta = cache[i0 + 1];
 
-                        const float x0 = src[0];
-                        const float x1 = src[n_dims/2];
+                    const float * const src = (float *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + ic*nb00);
+                    float * dst_data  = (float *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + ic*nb0);
 
-                        dst_data[0]        = x0*cos_theta - x1*sin_theta;
-                        dst_data[n_dims/2] = x0*sin_theta + x1*cos_theta;
-                    }
+                    const float x0 = src[0];
+                    const float x1 = src[n_dims/2];
+
+                    dst_data[0]        = x0*cos_theta - x1*sin_theta;
+                    dst_data[n_dims/2] = x0*sin_theta + x1*cos_theta;
                 }
+            }
 
-                for (int64_t i0 = n_dims; i0 < ne0; i0 += 2) {
-                    const float * const src = (float *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + i0*nb00);
-                    float * dst_data  = (float *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + i0*nb0);
+            for (int64_t i0 = n_dims; i0 < ne0; i0 += 2) {
+                const float * const src = (float *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + i0*nb00);
+                float * dst_data  = (float *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + i0*nb0);
 
-                    dst_data[0] = src[0];
-                    dst_data[1] = src[1];
-                }
+                dst_data[0] = src[0];
+                dst_data[1] = src[1];
             }
         }
     }
@@ -12944,23 +13004,12 @@ static void ggml_compute_forward_rope_f16(
     GGML_ASSERT(nb0 == sizeof(ggml_fp16_t));
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int nr = ggml_nrows(dst);
 
     GGML_ASSERT(n_dims <= ne0);
     GGML_ASSERT(n_dims % 2 == 0);
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
-    // row index used to determine which thread to use
-    int ir = 0;
-
     const float theta_scale = powf(freq_base, -2.0f/n_dims);
 
     float corr_dims[2];
@@ -12982,56 +13031,62 @@ static void ggml_compute_forward_rope_f16(
 
     const int32_t * pos = (const int32_t *) src1->data;
 
-    for (int64_t i3 = 0; i3 < ne3; i3++) {
-        for (int64_t i2 = 0; i2 < ne2; i2++) {
-            const int64_t p = pos[i2];
+    float * cache = (float *) params->wdata + (ne0 + CACHE_LINE_SIZE_F32)*ith;
 
-            float * cache = (float *) params->wdata + (ne0 + CACHE_LINE_SIZE_F32)*ith;
-            ggml_rope_cache_init(p, freq_scale, freq_factors, corr_dims, ne0, ext_factor, attn_factor, cache, sin_sign, theta_scale);
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, nr, ne0);
 
-            for (int64_t i1 = 0; i1 < ne1; i1++) {
-                if (ir++ < ir0) continue;
-                if (ir   > ir1) break;
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        int64_t cached = -1;
+        for (int64_t ir = ir0; ir < ir1; ir++) {
+            const int64_t i3 = ir/(ne2*ne1);
+            const int64_t i2 = (ir - i3*ne2*ne1)/ne1;
+            const int64_t i1 = (ir - i3*ne2*ne1 - i2*ne1);
+
+            if (i2 != cached) {
+                const int64_t p = pos[i2];
+                ggml_rope_cache_init(p, freq_scale, freq_factors, corr_dims, ne0, ext_factor, attn_factor, cache, sin_sign, theta_scale);
+                cached = i2;
+            }
 
-                if (!is_neox) {
-                    for (int64_t i0 = 0; i0 < n_dims; i0 += 2) {
-                        const float cos_theta = cache[i0 + 0];
-                        const float sin_theta = cache[i0 + 1];
+            if (!is_neox) {
+                for (int64_t i0 = 0; i0 < n_dims; i0 += 2) {
+                    const float cos_theta = cache[i0 + 0];
+                    const float sin_theta = cache[i0 + 1];
 
-                        const ggml_fp16_t * const src = (ggml_fp16_t *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + i0*nb00);
-                              ggml_fp16_t * dst_data  = (ggml_fp16_t *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + i0*nb0);
+                    const ggml_fp16_t * const src = (ggml_fp16_t *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + i0*nb00);
+                          ggml_fp16_t * dst_data  = (ggml_fp16_t *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + i0*nb0);
 
-                        const float x0 = GGML_FP16_TO_FP32(src[0]);
-                        const float x1 = GGML_FP16_TO_FP32(src[1]);
+                    const float x0 = GGML_FP16_TO_FP32(src[0]);
+                    const float x1 = GGML_FP16_TO_FP32(src[1]);
 
-                        dst_data[0] = GGML_FP32_TO_FP16(x0*cos_theta - x1*sin_theta);
-                        dst_data[1] = GGML_FP32_TO_FP16(x0*sin_theta + x1*cos_theta);
-                    }
-                } else {
-                    for (int64_t i0 = 0; i0 < n_dims; i0 += 2) {
-                        const int64_t ic = i0/2;
+                    dst_data[0] = GGML_FP32_TO_FP16(x0*cos_theta - x1*sin_theta);
+                    dst_data[1] = GGML_FP32_TO_FP16(x0*sin_theta + x1*cos_theta);
+                }
+            } else {
+                for (int64_t i0 = 0; i0 < n_dims; i0 += 2) {
+                    const int64_t ic = i0/2;
 
-                        const float cos_theta = cache[i0 + 0];
-                        const float sin_theta = cache[i0 + 1];
+                    const float cos_theta = cache[i0 + 0];
+                    const float sin_theta = cache[i0 + 1];
 
-                        const ggml_fp16_t * const src = (ggml_fp16_t *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + ic*nb00);
-                        ggml_fp16_t * dst_data  = (ggml_fp16_t *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + ic*nb0);
+                    const ggml_fp16_t * const src = (ggml_fp16_t *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + ic*nb00);
+                    ggml_fp16_t * dst_data  = (ggml_fp16_t *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + ic*nb0);
 
-                        const float x0 = GGML_FP16_TO_FP32(src[0]);
-                        const float x1 = GGML_FP16_TO_FP32(src[n_dims/2]);
+                    const float x0 = GGML_FP16_TO_FP32(src[0]);
+                    const float x1 = GGML_FP16_TO_FP32(src[n_dims/2]);
 
-                        dst_data[0]        = GGML_FP32_TO_FP16(x0*cos_theta - x1*sin_theta);
-                        dst_data[n_dims/2] = GGML_FP32_TO_FP16(x0*sin_theta + x1*cos_theta);
-                    }
+                    dst_data[0]        = GGML_FP32_TO_FP16(x0*cos_theta - x1*sin_theta);
+                    dst_data[n_dims/2] = GGML_FP32_TO_FP16(x0*sin_theta + x1*cos_theta);
                 }
+            }
 
-                for (int64_t i0 = n_dims; i0 < ne0; i0 += 2) {
-                    const ggml_fp16_t * const src = (ggml_fp16_t *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + i0*nb00);
-                    ggml_fp16_t * dst_data  = (ggml_fp16_t *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + i0*nb0);
+            for (int64_t i0 = n_dims; i0 < ne0; i0 += 2) {
+                const ggml_fp16_t * const src = (ggml_fp16_t *)((char *) src0->data + i3*nb03 + i2*nb02 + i1*nb01 + i0*nb00);
+                ggml_fp16_t * dst_data  = (ggml_fp16_t *)((char *)  dst->data + i3*nb3  + i2*nb2  + i1*nb1  + i0*nb0);
 
-                    dst_data[0] = src[0];
-                    dst_data[1] = src[1];
-                }
+                dst_data[0] = src[0];
+                dst_data[1] = src[1];
             }
         }
     }
@@ -13989,7 +14044,6 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
 
     const int ith = params->ith;
-    const int nth = params->nth;
 
     const int64_t D = neq0;
     const int64_t N = neq1;
@@ -14027,13 +14081,6 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     // total rows in q
     const int nr = neq1*neq2*neq3;
 
-    // rows per thread
-    const int dr = (nr + nth - 1)/nth;
-
-    // row range for this thread
-    const int ir0 = dr*ith;
-    const int ir1 = MIN(ir0 + dr, nr);
-
     float scale    = 1.0f;
     float max_bias = 0.0f;
 
@@ -14051,123 +14098,131 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     ggml_vec_dot_t    const kq_vec_dot     = type_traits[k->type].vec_dot;
     ggml_to_float_t   const v_to_float     = type_traits[v->type].to_float;
 
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, nr, nek1*D);
+
     // loop over n_batch and n_head
-    for (int ir = ir0; ir < ir1; ++ir) {
-        // q indices
-        const int iq3 = ir/(neq2*neq1);
-        const int iq2 = (ir - iq3*neq2*neq1)/neq1;
-        const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
+    for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+        for (int ir = ir0; ir < ir1; ++ir) {
+            // q indices
+            const int iq3 = ir/(neq2*neq1);
+            const int iq2 = (ir - iq3*neq2*neq1)/neq1;
+            const int iq1 = (ir - iq3*neq2*neq1 - iq2*neq1);
 
-        const uint32_t h = iq2; // head index
-        const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+            const uint32_t h = iq2; // head index
+            const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
 
-        float S = 0.0f;      // sum
-        float M = -INFINITY; // maximum KQ value
+            float S = 0.0f;      // sum
+            float M = -INFINITY; // maximum KQ value
 
-        float       * VKQ32 = (float       *) params->wdata + ith*(3*D + CACHE_LINE_SIZE_F32); // FP32 VKQ accumulator
-        float       * V32   =                 (VKQ32 + 1*D); // (temporary) FP32 V buffer
-        ggml_fp16_t * VKQ16 = (ggml_fp16_t *) (VKQ32 + 1*D); // (temporary) FP16 VKQ accumulator
-        ggml_fp16_t * Q_q   = (ggml_fp16_t *) (VKQ32 + 2*D); // (temporary) buffer for Q converted to quantized/FP16
+            float       * VKQ32 = (float       *) params->wdata + ith*(3*D + CACHE_LINE_SIZE_F32); // FP32 VKQ accumulator
+            float       * V32   =                 (VKQ32 + 1*D); // (temporary) FP32 V buffer
+            ggml_fp16_t * VKQ16 = (ggml_fp16_t *) (VKQ32 + 1*D); // (temporary) FP16 VKQ accumulator
+            ggml_fp16_t * Q_q   = (ggml_fp16_t *) (VKQ32 + 2*D); // (temporary) buffer for Q converted to quantized/FP16
 
-        if (v->type == GGML_TYPE_F16) {
-            memset(VKQ16, 0, D*sizeof(ggml_fp16_t));
-        } else {
-            memset(VKQ32, 0, D*sizeof(float));
-        }
+            if (v->type == GGML_TYPE_F16) {
+                memset(VKQ16, 0, D*sizeof(ggml_fp16_t));
+            } else {
+                memset(VKQ32, 0, D*sizeof(float));
+            }
 
-        const ggml_fp16_t * mp = mask ? (ggml_fp16_t *)((char *) mask->data + iq1*mask->nb[1]) : NULL;
+            const ggml_fp16_t * mp = mask ? (ggml_fp16_t *)((char *) mask->data + iq1*mask->nb[1]) : NULL;
 
-        // k indices
-        const int ik3 = iq3 / rk3;
-        const int ik2 = iq2 / rk2;
+            // k indices
+            const int ik3 = iq3 / rk3;
+            const int ik2 = iq2 / rk2;
 
-        // v indices
-        const int iv3 = iq3 / rv3;
-        const int iv2 = iq2 / rv2;
+            // v indices
+            const int iv3 = iq3 / rv3;
+            const int iv2 = iq2 / rv2;
 
-        const float * pq = (const float *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3));
-        q_to_vec_dot(pq, Q_q, D);
+            const float * pq = (const float *) ((char *) q->data + (iq1*nbq1 + iq2*nbq2 + iq3*nbq3));
+            q_to_vec_dot(pq, Q_q, D);
 
-        // online softmax / attention
-        // loop over n_kv and n_head_kv
-        // ref: https://arxiv.org/pdf/2112.05682.pdf
-        for (int64_t ic = 0; ic < nek1; ++ic) {
-            const float mv = mp ? slope*GGML_FP16_TO_FP32(mp[ic]) : 0.0f;
-            if (mv == -INFINITY) {
-                continue;
-            }
+            // online softmax / attention
+            // loop over n_kv and n_head_kv
+            // ref: https://arxiv.org/pdf/2112.05682.pdf
+            for (int64_t ic = 0; ic < nek1; ++ic) {
+                const float mv = mp ? slope*GGML_FP16_TO_FP32(mp[ic]) : 0.0f;
+                if (mv == -INFINITY) {
+                    continue;
+                }
 
-            float s; // KQ value
+                float s; // KQ value
 
-            const char * k_data = (const char *) k->data + ( ic*nbk1 + ik2*nbk2 + ik3*nbk3);
-            kq_vec_dot(D, &s, 0, k_data, 0, Q_q, 0, 1);
+                const char * k_data = (const char *) k->data + ( ic*nbk1 + ik2*nbk2 + ik3*nbk3);
+                kq_vec_dot(D, &s, 0, k_data, 0, Q_q, 0, 1);
 
-            s = s*scale + mv; // scale KQ value and apply mask
+                s = s*scale + mv; // scale KQ value and apply mask
 
-            const float Mold = M;
+                const float Mold = M;
 
-            float ms = 1.0f; // upon new higher max val, scale VKQ and KQ sum with this value
-            float vs = 1.0f; // post-softmax KQ value, expf(s - M)
+                float ms = 1.0f; // upon new higher max val, scale VKQ and KQ sum with this value
+                float vs = 1.0f; // post-softmax KQ value, expf(s - M)
 
-            const char * v_data = ((const char *) v->data + (ic*nbv1 + iv2*nbv2 + iv3*nbv3));
+                const char * v_data = ((const char *) v->data + (ic*nbv1 + iv2*nbv2 + iv3*nbv3));
 
-            if (v->type== GGML_TYPE_F16) {
-                if (s > M) {
-                    // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
-                    M = s;
-                    ms = expf(Mold - M);
+                if (v->type== GGML_TYPE_F16) {
+                    if (s > M) {
+                        // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
+                        M = s;
+                        ms = expf(Mold - M);
 
-                    // V = V*expf(Mold - M)
-                    ggml_vec_scale_f16(D, VKQ16, ms);
+                        // V = V*expf(Mold - M)
+                        ggml_vec_scale_f16(D, VKQ16, ms);
+                    } else {
+                        // no new maximum, ms == 1.0f, vs != 1.0f
+                        vs = expf(s - M);
+                    }
+
+                    // V += v*expf(s - M)
+                    ggml_vec_mad_f16(D, VKQ16, (const ggml_fp16_t *) v_data, vs);
                 } else {
-                    // no new maximum, ms == 1.0f, vs != 1.0f
-                    vs = expf(s - M);
-                }
+                    if (s > M) {
+                        // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
+                        M = s;
+                        ms = expf(Mold - M);
 
-                // V += v*expf(s - M)
-                ggml_vec_mad_f16(D, VKQ16, (const ggml_fp16_t *) v_data, vs);
-            } else {
-                if (s > M) {
-                    // s is new maximum, ms < 1.0f, vs == expf(s - s) == 1.0f
-                    M = s;
-                    ms = expf(Mold - M);
+                        // V = V*expf(Mold - M)
+                        ggml_vec_scale_f32(D, VKQ32, ms);
+                    } else {
+                        // no new maximum, ms == 1.0f, vs != 1.0f
+                        vs = expf(s - M);
+                    }
 
-                    // V = V*expf(Mold - M)
-                    ggml_vec_scale_f32(D, VKQ32, ms);
-                } else {
-                    // no new maximum, ms == 1.0f, vs != 1.0f
-                    vs = expf(s - M);
+                    // V += v*expf(s - M)
+                    if (v->type == GGML_TYPE_BF16) {
+                        ggml_vec_mad_bf16(D, VKQ32, (const ggml_bf16_t *) v_data, vs); // [jart]
+                    } else {
+                        v_to_float(v_data, V32, D);
+                        ggml_vec_mad_f32(D, VKQ32, V32, vs);
+                    }
                 }
 
-                v_to_float(v_data, V32, D);
+                S = S*ms + vs; // scale and increment sum with partial sum
+            }
 
-                // V += v*expf(s - M)
-                ggml_vec_mad_f32(D, VKQ32, V32, vs);
+            if (v->type == GGML_TYPE_F16) {
+                for (int64_t d = 0; d < D; ++d) {
+                    VKQ32[d] = GGML_FP16_TO_FP32(VKQ16[d]);
+                }
             }
 
-            S = S*ms + vs; // scale and increment sum with partial sum
-        }
+            // V /= S
+            const float S_inv = 1.0f/S;
+            ggml_vec_scale_f32(D, VKQ32, S_inv);
 
-        if (v->type == GGML_TYPE_F16) {
-            for (int64_t d = 0; d < D; ++d) {
-                VKQ32[d] = GGML_FP16_TO_FP32(VKQ16[d]);
-            }
-        }
+            // dst indices
+            const int i1 = iq1;
+            const int i2 = iq2;
+            const int i3 = iq3;
 
-        // V /= S
-        const float S_inv = 1.0f/S;
-        ggml_vec_scale_f32(D, VKQ32, S_inv);
-
-        // dst indices
-        const int i1 = iq1;
-        const int i2 = iq2;
-        const int i3 = iq3;
+            // original
+            //memcpy((char *) dst->data + (i1*nb1 + i2*nb2 + i3*nb3), V, nev0*sizeof(float));
 
-        // original
-        //memcpy((char *) dst->data + (i1*nb1 + i2*nb2 + i3*nb3), V, nev0*sizeof(float));
-
-        // permute(0, 2, 1, 3)
-        memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, VKQ32, nb1);
+            // permute(0, 2, 1, 3)
+            memcpy((char *) dst->data + (i3*ne2*ne1 + i2 + i1*ne1)*nb1, VKQ32, nb1);
+        }
     }
 }
 
@@ -15498,7 +15553,7 @@ static void ggml_compute_forward(struct ggml_compute_params * params, struct ggm
     const char *desc = 0;
     if (FLAG_trace) {
         desc = ggml_op_desc(tensor);
-        llamafile_trace_begin(desc);
+        llamafile_trace_begin_tensor(desc, tensor);
     }
 
     switch (tensor->op) {
@@ -17460,6 +17515,396 @@ static int ggml_get_n_tasks(struct ggml_tensor * node, int n_threads) {
     return n_tasks;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// [jart] elementwise op fusion
+//
+// every llama layer runs rms_norm, mul, silu, mul and add as separate
+// passes over the activations, with a barrier between each one. this
+// pass finds those patterns in a graph that's about to be computed so
+// one node can do the work of several, a row at a time while it's hot
+// in the l1 cache. nodes only read by their fused consumer get skipped
+
+enum ggml_fuse_type {
+    GGML_FUSE_NONE,
+    GGML_FUSE_SKIP,             // node is computed by a fused node
+    GGML_FUSE_RMS_NORM_MUL,     // node is mul(rms_norm(x), w)
+    GGML_FUSE_SWIGLU,           // node is mul(silu(x), g)
+    GGML_FUSE_ADD_RMS_NORM_MUL, // node is add(a, b) followed by mul(rms_norm(add), w)
+    GGML_FUSE_MUL_MAT_QUANTIZE, // node is mul_mat that quantizes src1 into the share
+    GGML_FUSE_MUL_MAT_REUSE,    // node is mul_mat that uses src1 already in the share
+};
+
+// scratch bits for counting consumers, which are cleared afterwards
+#define GGML_FUSE_USED1 (1 << 29)
+#define GGML_FUSE_USED2 (1 << 30)
+
+static size_t ggml_graph_fuse_size(const struct ggml_cgraph * cgraph) {
+    return FLAG_nofuse ? 0 : GGML_PAD(cgraph->n_nodes, CACHE_LINE_SIZE);
+}
+
+static bool ggml_fuse_is_candidate(const struct ggml_tensor * t) {
+    return t->op == GGML_OP_RMS_NORM ||
+           (t->op == GGML_OP_UNARY && ggml_get_unary_op(t) == GGML_UNARY_OP_SILU);
+}
+
+// returns true if fused consumer is the only reader of intermediate t
+static bool ggml_fuse_is_dead(const struct ggml_tensor * t) {
+    return (t->flags & (GGML_FUSE_USED1 | GGML_FUSE_USED2)) == GGML_FUSE_USED1 &&
+           !(t->flags & (GGML_TENSOR_FLAG_OUTPUT | GGML_TENSOR_FLAG_SHARED));
+}
+
+static bool ggml_fuse_is_rows_f32(const struct ggml_tensor * t) {
+    return t->type == GGML_TYPE_F32 && t->nb[0] == sizeof(float);
+}
+
+static bool ggml_fuse_overlaps(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    const char * a0 = (const char *) a->data;
+    const char * b0 = (const char *) b->data;
+    return a0 < b0 + ggml_nbytes(b) && b0 < a0 + ggml_nbytes(a);
+}
+
+// a fused node reads some inputs later than ggml-alloc assumed, so we
+// must make sure writing w one row at a time won't clobber rows of r
+// that another thread hasn't read yet; exact aliasing is fine though
+static bool ggml_fuse_can_write(const struct ggml_tensor * w, const struct ggml_tensor * r) {
+    if (!ggml_fuse_overlaps(w, r)) {
+        return true;
+    }
+    if (w->data != r->data || w->type != r->type) {
+        return false;
+    }
+    for (int i = 0; i < GGML_MAX_DIMS; ++i) {
+        if (w->ne[i] != r->ne[i] || w->nb[i] != r->nb[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns true if nodes (i,j) of graph don't write to memory of x
+static bool ggml_fuse_is_intact(const struct ggml_cgraph * cgraph, int i, int j,
+                                const struct ggml_tensor * x) {
+    for (int k = i + 1; k < j; ++k) {
+        const struct ggml_tensor * node = cgraph->nodes[k];
+        if (!ggml_is_noop(node->op) && ggml_fuse_overlaps(node, x)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns true if w can be the weight of mul(rms_norm(x), w) → dst
+static bool ggml_fuse_is_norm_weight(const struct ggml_tensor * w, const struct ggml_tensor * dst) {
+    return ggml_fuse_is_rows_f32(w) && w->ne[0] == dst->ne[0] && ggml_can_repeat(w, dst);
+}
+
+// the q, k and v projections of a layer all multiply the same normalized
+// activations, as do the ffn gate and up projections. each of them would
+// quantize src1 to the vec_dot_type of its weights, so the first one puts
+// it in a region of the work buffer no other op uses, and the rest of the
+// mul_mat nodes with the same input read it from there
+
+static bool ggml_share_is_candidate(const struct ggml_tensor * node) {
+    if (node->op != GGML_OP_MUL_MAT) {
+        return false;
+    }
+    const enum ggml_type vec_dot_type = type_traits[node->src[0]->type].vec_dot_type;
+    return node->src[1]->type == GGML_TYPE_F32 && ggml_is_quantized(vec_dot_type);
+}
+
+static size_t ggml_share_bytes(const struct ggml_tensor * node) {
+    const struct ggml_tensor * src1 = node->src[1];
+    const enum ggml_type vec_dot_type = type_traits[node->src[0]->type].vec_dot_type;
+    return ggml_row_size(vec_dot_type, src1->ne[0]) * src1->ne[1] * src1->ne[2] * src1->ne[3];
+}
+
+// returns true if mul_mat nodes a and b would quantize src1 identically
+static bool ggml_share_is_same(const struct ggml_tensor * a, const struct ggml_tensor * b) {
+    const enum ggml_type ta = a->src[0]->type;
+    const enum ggml_type tb = b->src[0]->type;
+    if (a->src[1] != b->src[1] || type_traits[ta].vec_dot_type != type_traits[tb].vec_dot_type) {
+        return false;
+    }
+    const bool mat_a = ggml_n_dims(a->src[1]) == 2 && type_traits[ta].gemm &&
+                       type_traits[type_traits[ta].vec_dot_type].from_float_to_mat;
+    const bool mat_b = ggml_n_dims(b->src[1]) == 2 && type_traits[tb].gemm &&
+                       type_traits[type_traits[tb].vec_dot_type].from_float_to_mat;
+    return mat_a == mat_b &&
+           (!mat_a || type_traits[ta].blck_size_interleave == type_traits[tb].blck_size_interleave);
+}
+
+// returns bytes of work buffer needed for sharing. if fuse isn't NULL,
+// then the mul_mat nodes that share are marked, which needs the graph's
+// tensors to have been allocated, so an op that overwrites src1 in the
+// middle of a group can be noticed
+static size_t ggml_graph_share(const struct ggml_cgraph * cgraph, uint8_t * fuse) {
+    size_t size = 0;
+    int producer = -1;
+    if (FLAG_nofuse) {
+        return 0;
+    }
+    for (int i = 0; i < cgraph->n_nodes; ++i) {
+        const struct ggml_tensor * node = cgraph->nodes[i];
+        if (!ggml_share_is_candidate(node) || (fuse && fuse[i] != GGML_FUSE_NONE)) {
+            continue;
+        }
+        if (producer >= 0 && ggml_share_is_same(cgraph->nodes[producer], node) &&
+            (!fuse || ggml_fuse_is_intact(cgraph, producer, i, node->src[1]))) {
+            size = MAX(size, ggml_share_bytes(node));
+            if (fuse) {
+                fuse[producer] = GGML_FUSE_MUL_MAT_QUANTIZE;
+                fuse[i] = GGML_FUSE_MUL_MAT_REUSE;
+            }
+        } else {
+            producer = i;
+        }
+    }
+    return size ? GGML_PAD(size, CACHE_LINE_SIZE) + CACHE_LINE_SIZE : 0;
+}
+
+// populates fusion plan with one ggml_fuse_type per graph node
+static void ggml_graph_fuse(const struct ggml_cgraph * cgraph, uint8_t * fuse) {
+    const int n_nodes = cgraph->n_nodes;
+
+    memset(fuse, GGML_FUSE_NONE, n_nodes);
+
+    // count consumers of each candidate intermediate
+    for (int i = 0; i < n_nodes; ++i) {
+        struct ggml_tensor * node = cgraph->nodes[i];
+        for (int j = 0; j < GGML_MAX_SRC; ++j) {
+            struct ggml_tensor * src = node->src[j];
+            if (src && ggml_fuse_is_candidate(src)) {
+                src->flags |= (src->flags & GGML_FUSE_USED1) ? GGML_FUSE_USED2 : GGML_FUSE_USED1;
+            }
+        }
+    }
+
+    for (int i = 0; i < n_nodes; ++i) {
+        struct ggml_tensor * node = cgraph->nodes[i];
+        if (fuse[i] != GGML_FUSE_NONE) {
+            continue;
+        }
+
+        // add(a, b) → rms_norm → mul(norm, w)
+        if (node->op == GGML_OP_ADD && i + 2 < n_nodes) {
+            struct ggml_tensor * norm = cgraph->nodes[i + 1];
+            struct ggml_tensor * mul = cgraph->nodes[i + 2];
+            const struct ggml_tensor * a = node->src[0];
+            const struct ggml_tensor * b = node->src[1];
+            if (norm->op == GGML_OP_RMS_NORM && norm->src[0] == node &&
+                mul->op == GGML_OP_MUL && mul->src[0] == norm &&
+                ggml_fuse_is_dead(norm) &&
+                ggml_fuse_is_rows_f32(a) && ggml_are_same_shape(a, node) &&
+                ggml_fuse_is_rows_f32(b) && ggml_are_same_shape(b, node) &&
+                ggml_fuse_is_rows_f32(node) && ggml_are_same_shape(mul, node) &&
+                ggml_fuse_is_rows_f32(mul) && ggml_fuse_is_norm_weight(mul->src[1], mul) &&
+                ggml_fuse_can_write(mul, a) && ggml_fuse_can_write(mul, b) &&
+                ggml_fuse_can_write(mul, node) && !ggml_fuse_overlaps(node, mul->src[1])) {
+                fuse[i] = GGML_FUSE_ADD_RMS_NORM_MUL;
+                fuse[i + 1] = GGML_FUSE_SKIP;
+                fuse[i + 2] = GGML_FUSE_SKIP;
+                continue;
+            }
+        }
+
+        if (node->op != GGML_OP_MUL || !ggml_fuse_is_rows_f32(node)) {
+            continue;
+        }
+
+        struct ggml_tensor * src0 = node->src[0];
+        struct ggml_tensor * src1 = node->src[1];
+        if (!ggml_fuse_is_candidate(src0) || !ggml_fuse_is_dead(src0)) {
+            continue;
+        }
+
+        // find where the intermediate lives in this graph
+        int k;
+        for (k = i - 1; k >= 0; --k) {
+            if (cgraph->nodes[k] == src0) {
+                break;
+            }
+        }
+        if (k < 0 || fuse[k] != GGML_FUSE_NONE) {
+            continue;
+        }
+
+        const struct ggml_tensor * x = src0->src[0];
+        if (!ggml_fuse_is_rows_f32(x) || !ggml_are_same_shape(x, node) ||
+            !ggml_fuse_can_write(node, x) || !ggml_fuse_is_intact(cgraph, k, i, x)) {
+            continue;
+        }
+
+        // mul(rms_norm(x), w)
+        if (src0->op == GGML_OP_RMS_NORM) {
+            if (ggml_fuse_is_norm_weight(src1, node)) {
+                fuse[k] = GGML_FUSE_SKIP;
+                fuse[i] = GGML_FUSE_RMS_NORM_MUL;
+            }
+            continue;
+        }
+
+        // mul(silu(x), g)
+        if (ggml_fuse_is_rows_f32(src1) && ggml_are_same_shape(src1, node) &&
+            ggml_fuse_can_write(node, src1)) {
+            fuse[k] = GGML_FUSE_SKIP;
+            fuse[i] = GGML_FUSE_SWIGLU;
+        }
+    }
+
+    // clear scratch bits. only candidates were marked, and they're always
+    // intermediates of this graph, so tensors shared with other graphs that
+    // might be computing concurrently (e.g. model weights) aren't touched
+    for (int i = 0; i < n_nodes; ++i) {
+        struct ggml_tensor * node = cgraph->nodes[i];
+        for (int j = 0; j < GGML_MAX_SRC; ++j) {
+            struct ggml_tensor * src = node->src[j];
+            if (src && ggml_fuse_is_candidate(src)) {
+                src->flags &= ~(GGML_FUSE_USED1 | GGML_FUSE_USED2);
+            }
+        }
+    }
+}
+
+// returns pointer to row i of tensor t, where i counts rows in all dims
+static inline char * ggml_fuse_row(const struct ggml_tensor * t, int64_t ir) {
+    const int64_t i3 = ir/(t->ne[2]*t->ne[1]);
+    const int64_t i2 = (ir - i3*t->ne[2]*t->ne[1])/t->ne[1];
+    const int64_t i1 = (ir - i3*t->ne[2]*t->ne[1] - i2*t->ne[1]);
+    return (char *) t->data + i3*t->nb[3] + i2*t->nb[2] + i1*t->nb[1];
+}
+
+// returns pointer to row of w which broadcasts to row ir of dst
+static inline const float * ggml_fuse_weight_row(const struct ggml_tensor * w,
+                                                 const struct ggml_tensor * dst,
+                                                 int64_t ir) {
+    const int64_t i3 = ir/(dst->ne[2]*dst->ne[1]);
+    const int64_t i2 = (ir - i3*dst->ne[2]*dst->ne[1])/dst->ne[1];
+    const int64_t i1 = (ir - i3*dst->ne[2]*dst->ne[1] - i2*dst->ne[1]);
+    return (const float *) ((const char *) w->data +
+                            (i3 % w->ne[3])*w->nb[3] +
+                            (i2 % w->ne[2])*w->nb[2] +
+                            (i1 % w->ne[1])*w->nb[1]);
+}
+
+// accumulates the same way as ggml_compute_forward_rms_norm_f32() so
+// fused and unfused results are identical
+static inline float ggml_fuse_rms_scale(const struct ggml_tensor * norm, const float * x, int n) {
+    float eps;
+    ggml_float sum = 0.0;
+    memcpy(&eps, norm->op_params, sizeof(float));
+    for (int i = 0; i < n; i++) {
+        sum += (ggml_float)(x[i] * x[i]);
+    }
+    const float mean = sum/n;
+    return 1.0f/sqrtf(mean + eps);
+}
+
+static void ggml_compute_forward_mul_mat_shared(const struct ggml_compute_params * params,
+                                                struct ggml_tensor * node,
+                                                enum ggml_fuse_type type) {
+    struct ggml_compute_params share_params = *params;
+    share_params.wdata = params->shared->share;
+    share_params.wsize = params->shared->share_size;
+
+    const char *desc = 0;
+    if (FLAG_trace) {
+        desc = type == GGML_FUSE_MUL_MAT_REUSE ? "MUL_MAT+REUSE" : "MUL_MAT";
+        llamafile_trace_begin_tensor(desc, node);
+    }
+
+    ggml_compute_forward_mul_mat_impl(&share_params, node, true, type == GGML_FUSE_MUL_MAT_REUSE);
+
+    if (FLAG_trace) {
+        llamafile_trace_end(desc);
+    }
+}
+
+static void ggml_compute_forward_fused(const struct ggml_compute_params * params,
+                                       struct ggml_tensor ** nodes,
+                                       enum ggml_fuse_type type) {
+    struct ggml_tensor * node = nodes[0];
+
+    if (type == GGML_FUSE_MUL_MAT_QUANTIZE || type == GGML_FUSE_MUL_MAT_REUSE) {
+        ggml_compute_forward_mul_mat_shared(params, node, type);
+        return;
+    }
+
+    const int64_t nr = ggml_nrows(node);
+    const int n = node->ne[0];
+
+    struct ggml_chunks chunks;
+    ggml_chunks_init(&chunks, params, nr, n);
+
+    const char *desc = 0;
+
+    switch (type) {
+        case GGML_FUSE_RMS_NORM_MUL:
+            {
+                if (FLAG_trace) {
+                    desc = "RMS_NORM+MUL";
+                    llamafile_trace_begin_tensor(desc, node);
+                }
+                const struct ggml_tensor * norm = node->src[0];
+                const struct ggml_tensor * x = norm->src[0];
+                const struct ggml_tensor * w = node->src[1];
+                for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+                    for (int64_t ir = ir0; ir < ir1; ir++) {
+                        const float * xp = (const float *) ggml_fuse_row(x, ir);
+                        float * yp = (float *) ggml_fuse_row(node, ir);
+                        const float scale = ggml_fuse_rms_scale(norm, xp, n);
+                        ggml_vec_mul_scale_f32(n, yp, xp, ggml_fuse_weight_row(w, node, ir), scale);
+                    }
+                }
+            } break;
+        case GGML_FUSE_SWIGLU:
+            {
+                if (FLAG_trace) {
+                    desc = "SILU+MUL";
+                    llamafile_trace_begin_tensor(desc, node);
+                }
+                const struct ggml_tensor * x = node->src[0]->src[0];
+                const struct ggml_tensor * g = node->src[1];
+                for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+                    for (int64_t ir = ir0; ir < ir1; ir++) {
+                        ggml_vec_swiglu_f32(n,
+                                            (float *) ggml_fuse_row(node, ir),
+                                            (const float *) ggml_fuse_row(x, ir),
+                                            (const float *) ggml_fuse_row(g, ir));
+                    }
+                }
+            } break;
+        case GGML_FUSE_ADD_RMS_NORM_MUL:
+            {
+                if (FLAG_trace) {
+                    desc = "ADD+RMS_NORM+MUL";
+                    llamafile_trace_begin_tensor(desc, node);
+                }
+                const struct ggml_tensor * norm = nodes[1];
+                struct ggml_tensor * mul = nodes[2];
+                const struct ggml_tensor * a = node->src[0];
+                const struct ggml_tensor * b = node->src[1];
+                const struct ggml_tensor * w = mul->src[1];
+                for (int64_t ir0, ir1; ggml_chunks_next(&chunks, &ir0, &ir1);) {
+                    for (int64_t ir = ir0; ir < ir1; ir++) {
+                        float * zp = (float *) ggml_fuse_row(node, ir);
+                        float * yp = (float *) ggml_fuse_row(mul, ir);
+                        ggml_vec_add_f32(n, zp,
+                                         (const float *) ggml_fuse_row(a, ir),
+                                         (const float *) ggml_fuse_row(b, ir));
+                        const float scale = ggml_fuse_rms_scale(norm, zp, n);
+                        ggml_vec_mul_scale_f32(n, yp, zp, ggml_fuse_weight_row(w, mul, ir), scale);
+                    }
+                }
+            } break;
+        default:
+            GGML_ABORT("fatal error");
+    }
+
+    if (FLAG_trace) {
+        llamafile_trace_end(desc);
+    }
+}
+
 struct ggml_cplan ggml_graph_plan(const struct ggml_cgraph * cgraph, int n_threads) {
     if (n_threads <= 0) {
         n_threads = GGML_DEFAULT_N_THREADS;
@@ -17624,6 +18069,10 @@ struct ggml_cplan ggml_graph_plan(const struct ggml_cgraph * cgraph, int n_threa
         work_size += CACHE_LINE_SIZE*(n_threads - 1);
     }
 
+    // [jart] shared quantized activations and fusion plan go at the end of work buffer
+    work_size += ggml_graph_share(cgraph, NULL);
+    work_size += ggml_graph_fuse_size(cgraph);
+
     cplan.n_threads = MIN(max_tasks, n_threads);
     cplan.work_size = work_size;
     cplan.work_data = NULL;
@@ -17631,6 +18080,32 @@ struct ggml_cplan ggml_graph_plan(const struct ggml_cgraph * cgraph, int n_threa
     return cplan;
 }
 
+// [jart] tracks how popular each expert is, and as soon as the routing
+//        of a layer is known, prefetches the experts that later ops in
+//        the same layer (e.g. ffn_up_exps, ffn_down_exps) will multiply.
+//        only the prefetch happens here, since it doesn't block, and the
+//        experts are locked into memory by a helper thread
+#define GGML_EXPERTS_WINDOW 32
+
+static void ggml_graph_route_experts(const struct ggml_cgraph * cgraph, int node_n) {
+    const struct ggml_tensor * node = cgraph->nodes[node_n];
+    const struct ggml_tensor * ids  = node->src[2];
+
+    llamafile_experts_route(node->src[0], ids);
+
+    for (int i = MAX(0, node_n - GGML_EXPERTS_WINDOW); i < node_n; ++i) {
+        if (cgraph->nodes[i]->op == GGML_OP_MUL_MAT_ID && cgraph->nodes[i]->src[2] == ids) {
+            return; // an earlier op with this routing already prefetched
+        }
+    }
+
+    for (int i = node_n + 1; i < MIN(cgraph->n_nodes, node_n + GGML_EXPERTS_WINDOW); ++i) {
+        if (cgraph->nodes[i]->op == GGML_OP_MUL_MAT_ID && cgraph->nodes[i]->src[2] == ids) {
+            llamafile_experts_prefetch(cgraph->nodes[i]->src[0], ids);
+        }
+    }
+}
+
 static thread_ret_t ggml_graph_compute_thread(void * data) {
     struct ggml_compute_state * state = (struct ggml_compute_state *) data;
 
@@ -17651,10 +18126,13 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
     pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, &ct);
     pthread_testcancel();
 
+    const uint8_t * fuse = state->shared->fuse; // [jart]
+
     struct ggml_compute_params params = {
         /*.ith   =*/ state->ith,
         /*.nth   =*/ state->shared->n_threads,
-        /*.wsize =*/ cplan->work_size,
+        /*.wsize =*/ cplan->work_size - (fuse ? ggml_graph_fuse_size(cgraph) : 0) -
+                     (state->shared->share ? state->shared->share_size : 0),
         /*.wdata =*/ cplan->work_data,
         /*.shared=*/ state->shared,
     };
@@ -17665,11 +18143,21 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
         if (ggml_is_noop(node->op)) // [jart]
             continue;
 
+        if (fuse && fuse[node_n] == GGML_FUSE_SKIP) // [jart]
+            continue;
+
 #ifdef LLAMAFILE_DEBUG
         llamafile_debug_op_index = node_n;
 #endif
 
-        ggml_compute_forward(&params, node);
+        if (FLAG_moe_residency && state->ith == 0 && node->op == GGML_OP_MUL_MAT_ID) // [jart]
+            ggml_graph_route_experts(cgraph, node_n);
+
+        if (fuse && fuse[node_n] != GGML_FUSE_NONE) {
+            ggml_compute_forward_fused(&params, cgraph->nodes + node_n, fuse[node_n]);
+        } else {
+            ggml_compute_forward(&params, node);
+        }
 
         if (state->ith == 0 && cplan->abort_callback && cplan->abort_callback(cplan->abort_callback_data)) {
             state->shared->ec = GGML_STATUS_ABORTED;
@@ -17724,15 +18212,39 @@ enum ggml_status ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cpl
             (struct ggml_phaser *)(((uintptr_t)mem + az) & -az);
     memset(n_barrier_passed, 0, pz * n_threads);
 
+    // [jart] plan which nodes get fused
+    uint8_t * fuse = NULL;
+    size_t fuse_size = ggml_graph_fuse_size(cgraph);
+    if (fuse_size && cplan->work_size >= fuse_size) {
+        fuse = cplan->work_data + cplan->work_size - fuse_size;
+        ggml_graph_fuse(cgraph, fuse);
+    }
+
+    // [jart] plan which mul_mat nodes share quantized activations
+    void * share = NULL;
+    size_t share_size = fuse ? ggml_graph_share(cgraph, NULL) : 0;
+    if (share_size && cplan->work_size >= fuse_size + share_size) {
+        char * end = (char *) cplan->work_data + cplan->work_size - fuse_size;
+        share = (void *) GGML_PAD((uintptr_t) (end - share_size), CACHE_LINE_SIZE);
+        share_size = end - (char *) share;
+        ggml_graph_share(cgraph, fuse);
+    } else {
+        share_size = 0;
+    }
+
     struct ggml_compute_state_shared state_shared = {
         /*.cgraph                  =*/ cgraph,
         /*.cgraph_plan             =*/ cplan,
+        /*.fuse                    =*/ fuse,
+        /*.share                   =*/ share,
+        /*.share_size              =*/ share_size,
         /*.n_threads               =*/ n_threads,
         /*.n_barrier               =*/ 0,
         /*.n_barrier_passed        =*/ n_barrier_passed,
         /*.abort_callback          =*/ NULL,
         /*.abort_callback_data     =*/ NULL,
         /*.current_chunk           =*/ 0,
+        /*.n_chunk                 =*/ 0,
         /*.ec                      =*/ GGML_STATUS_SUCCESS,
     };
 
@@ -19651,6 +20163,17 @@ struct gguf_context {
 
     //uint8_t * padding;
     void * data;
+
+    // metadata loaded from a file is parsed in place. strings are kept
+    // in a single arena and numeric arrays may point into the mapping,
+    // which is either our own, or belongs to a zip embedded file
+    const char        * view;
+    size_t              view_size;
+    char              * arena;
+    size_t              arena_size;
+    void              * mapping;
+    size_t              mapsize;
+    struct llamafile  * file;
 };
 
 static size_t gguf_type_size(enum gguf_type type) {
@@ -19672,40 +20195,130 @@ static void gguf_tensor_info_sanitize(struct gguf_tensor_info * info) {
     GGML_ASSERT(INT64_MAX/info->ne[3] > info->ne[0]*info->ne[1]*info->ne[2]);
 }
 
-static bool gguf_fread_el(struct llamafile * file, void * dst, size_t size, size_t * offset) {
-    const size_t n = llamafile_read(file, dst, size);
-    *offset += n;
-    return n == size;
+// parsing gguf metadata with one read() and malloc() per key, string
+// and array element is slow for vocabularies with 100k+ tokens, so the
+// header is walked in place within a memory mapping of the file
+struct gguf_reader {
+    const char * p;
+    const char * e;
+    size_t arena; // bytes needed to copy strings and unaligned arrays
+};
+
+static bool gguf_read_el(struct gguf_reader * r, void * dst, size_t size) {
+    if ((size_t)(r->e - r->p) < size) {
+        return false;
+    }
+    memcpy(dst, r->p, size);
+    r->p += size;
+    return true;
 }
 
-static bool gguf_fread_str(struct llamafile * file, struct gguf_str * p, size_t * offset) {
+// points string into the mapping until gguf_intern_str() is called
+static bool gguf_read_str(struct gguf_reader * r, struct gguf_str * p) {
     p->n    = 0;
     p->data = NULL;
 
-    bool ok = true;
-
-    ok = ok && gguf_fread_el(file, &p->n, sizeof(p->n), offset);
+    if (!gguf_read_el(r, &p->n, sizeof(p->n))) {
+        return false;
+    }
 
     // early exit if string length is invalid, prevents from integer overflow
-    if (p->n == SIZE_MAX) {
+    if (p->n > (uint64_t)(r->e - r->p)) {
         fprintf(stderr, "%s: invalid string length (%" PRIu64 ")\n", __func__, p->n);
         return false;
     }
 
-    p->data = GGML_CALLOC(p->n + 1, 1);
+    p->data = p->n ? (char *) r->p : NULL;
+    r->p += p->n;
+    r->arena += p->n + 1;
+
+    return true;
+}
+
+// points array into the mapping until gguf_intern_arr() is called
+static bool gguf_read_arr(struct gguf_reader * r, void ** data, uint64_t n, size_t size) {
+    *data = NULL;
+
+    // prevent from integer overflow in the size computations below
+    if (n > (uint64_t)(r->e - r->p) / size) {
+        fprintf(stderr, "%s: array size is too large (%" PRIu64 ")\n", __func__, n);
+        return false;
+    }
+
+    *data = n ? (void *) r->p : NULL;
+    r->p += n * size;
+    r->arena += n * size + size;
+
+    return true;
+}
 
-    ok = ok && gguf_fread_el(file,  p->data, p->n, offset);
+// returns true if pointer refers to memory that gguf_free() mustn't free
+static bool gguf_is_borrowed(const struct gguf_context * ctx, const void * ptr) {
+    const char * p = ptr;
+    return (ctx->view  && ctx->view  <= p && p < ctx->view  + ctx->view_size) ||
+           (ctx->arena && ctx->arena <= p && p < ctx->arena + ctx->arena_size);
+}
 
-    return ok;
+static void gguf_intern_str(struct gguf_context * ctx, struct gguf_str * p, size_t * used) {
+    char * dst = ctx->arena + *used;
+    if (p->n) {
+        memcpy(dst, p->data, p->n);
+    }
+    dst[p->n] = '\0';
+    p->data = dst;
+    *used += p->n + 1;
+}
+
+// arrays that aren't naturally aligned in the file are copied
+static void gguf_intern_arr(struct gguf_context * ctx, void ** data, uint64_t n, size_t size, size_t * used) {
+    if (*data && !((uintptr_t) *data % size)) {
+        return;
+    }
+    *used = GGML_PAD(*used, size);
+    char * dst = ctx->arena + *used;
+    if (n) {
+        memcpy(dst, *data, n * size);
+    }
+    *data = dst;
+    *used += n * size;
 }
 
-static void gguf_free_kv(struct gguf_kv * kv) {
-    if (kv->key.data) {
+// maps file from its current position to the end
+static bool gguf_map_file(struct gguf_context * ctx, struct llamafile * file) {
+    const size_t pos  = llamafile_tell(file);
+    const size_t size = llamafile_size(file);
+    if (pos > size) {
+        return false;
+    }
+    if (llamafile_content(file)) {
+        llamafile_ref(file);
+        ctx->file      = file;
+        ctx->view      = (const char *) llamafile_content(file) + pos;
+        ctx->view_size = size - pos;
+        return true;
+    }
+    if (!size) {
+        return false;
+    }
+    void * mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(llamafile_fp(file)), 0);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "%s: failed to map gguf file: %s\n", __func__, strerror(errno));
+        return false;
+    }
+    ctx->mapping   = mapping;
+    ctx->mapsize   = size;
+    ctx->view      = (const char *) mapping + pos;
+    ctx->view_size = size - pos;
+    return true;
+}
+
+static void gguf_free_kv(struct gguf_context * ctx, struct gguf_kv * kv) {
+    if (kv->key.data && !gguf_is_borrowed(ctx, kv->key.data)) {
         GGML_FREE(kv->key.data);
     }
 
     if (kv->type == GGUF_TYPE_STRING) {
-        if (kv->value.str.data) {
+        if (kv->value.str.data && !gguf_is_borrowed(ctx, kv->value.str.data)) {
             GGML_FREE(kv->value.str.data);
         }
     }
@@ -19715,12 +20328,14 @@ static void gguf_free_kv(struct gguf_kv * kv) {
             if (kv->value.arr.type == GGUF_TYPE_STRING) {
                 for (uint64_t j = 0; j < kv->value.arr.n; ++j) {
                     struct gguf_str * str = &((struct gguf_str *) kv->value.arr.data)[j];
-                    if (str->data) {
+                    if (str->data && !gguf_is_borrowed(ctx, str->data)) {
                         GGML_FREE(str->data);
                     }
                 }
             }
-            GGML_FREE(kv->value.arr.data);
+            if (!gguf_is_borrowed(ctx, kv->value.arr.data)) {
+                GGML_FREE(kv->value.arr.data);
+            }
         }
     }
 }
@@ -19750,11 +20365,16 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
     // offset from start of file
     size_t offset = 0;
 
+    const size_t start = llamafile_tell(file);
+
     char magic[4];
 
     // check the magic before making allocations
     {
-        gguf_fread_el(file, &magic, sizeof(magic), &offset);
+        if (llamafile_read(file, &magic, sizeof(magic)) != sizeof(magic)) {
+            fprintf(stderr, "%s: failed to read magic\n", __func__);
+            return NULL;
+        }
 
         for (uint32_t i = 0; i < sizeof(magic); i++) {
             if (magic[i] != GGUF_MAGIC[i]) {
@@ -19762,12 +20382,27 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
                 return NULL;
             }
         }
+
+        llamafile_seek(file, start, SEEK_SET);
     }
 
     bool ok = true;
 
     struct gguf_context * ctx = GGML_CALLOC(1, sizeof(struct gguf_context));
 
+    if (!gguf_map_file(ctx, file)) {
+        fprintf(stderr, "%s: failed to map file\n", __func__);
+        gguf_free(ctx);
+        return NULL;
+    }
+
+    struct gguf_reader reader = {
+        .p     = ctx->view + sizeof(magic),
+        .e     = ctx->view + ctx->view_size,
+        .arena = 0,
+    };
+    struct gguf_reader * r = &reader;
+
     // read the header
     {
         strncpy(ctx->header.magic, magic, 4);
@@ -19776,9 +20411,9 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
         ctx->infos = NULL;
         ctx->data  = NULL;
 
-        ok = ok && gguf_fread_el(file, &ctx->header.version,   sizeof(ctx->header.version),   &offset);
-        ok = ok && gguf_fread_el(file, &ctx->header.n_tensors, sizeof(ctx->header.n_tensors), &offset);
-        ok = ok && gguf_fread_el(file, &ctx->header.n_kv,      sizeof(ctx->header.n_kv),      &offset);
+        ok = ok && gguf_read_el(r, &ctx->header.version,   sizeof(ctx->header.version));
+        ok = ok && gguf_read_el(r, &ctx->header.n_tensors, sizeof(ctx->header.n_tensors));
+        ok = ok && gguf_read_el(r, &ctx->header.n_kv,      sizeof(ctx->header.n_kv));
 
         if (ctx->header.version == 1) {
             fprintf(stderr, "%s: GGUFv1 is no longer supported. please use a more up-to-date version\n", __func__);
@@ -19792,6 +20427,11 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
         ok = ok && (ctx->header.n_tensors < (SIZE_MAX/2)/ggml_tensor_overhead());
         ok = ok && (ctx->header.n_kv      < (SIZE_MAX/2)/sizeof(struct gguf_kv));
 
+        // every key needs at least 12 bytes, so this is a cheap way to
+        // catch bogus counts before they turn into huge allocations
+        ok = ok && (ctx->header.n_kv      <= (uint64_t)(r->e - r->p)/12);
+        ok = ok && (ctx->header.n_tensors <= (uint64_t)(r->e - r->p)/12);
+
         if (!ok) {
             fprintf(stderr, "%s: failed to read header\n", __func__);
             gguf_free(ctx);
@@ -19810,30 +20450,34 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
         for (uint64_t i = 0; i < n_kv; ++i) {
             struct gguf_kv * kv = &ctx->kv[i];
 
-            //fprintf(stderr, "%s: reading kv %d\n", __func__, i);
-
-            ok = ok && gguf_fread_str(file, &kv->key,                    &offset);
-            ok = ok && gguf_fread_el (file, &kv->type, sizeof(kv->type), &offset);
+            ok = ok && gguf_read_str(r, &kv->key);
+            ok = ok && gguf_read_el (r, &kv->type, sizeof(kv->type));
 
-            //fprintf(stderr, "%s: reading kv with key %s\n", __func__, kv->key.data);
+            if (!ok) {
+                break;
+            }
 
             switch (kv->type) {
-                case GGUF_TYPE_UINT8:   ok = ok && gguf_fread_el (file, &kv->value.uint8,   sizeof(kv->value.uint8),   &offset); break;
-                case GGUF_TYPE_INT8:    ok = ok && gguf_fread_el (file, &kv->value.int8,    sizeof(kv->value.int8),    &offset); break;
-                case GGUF_TYPE_UINT16:  ok = ok && gguf_fread_el (file, &kv->value.uint16,  sizeof(kv->value.uint16),  &offset); break;
-                case GGUF_TYPE_INT16:   ok = ok && gguf_fread_el (file, &kv->value.int16,   sizeof(kv->value.int16),   &offset); break;
-                case GGUF_TYPE_UINT32:  ok = ok && gguf_fread_el (file, &kv->value.uint32,  sizeof(kv->value.uint32),  &offset); break;
-                case GGUF_TYPE_INT32:   ok = ok && gguf_fread_el (file, &kv->value.int32,   sizeof(kv->value.int32),   &offset); break;
-                case GGUF_TYPE_FLOAT32: ok = ok && gguf_fread_el (file, &kv->value.float32, sizeof(kv->value.float32), &offset); break;
-                case GGUF_TYPE_UINT64:  ok = ok && gguf_fread_el (file, &kv->value.uint64,  sizeof(kv->value.uint64),  &offset); break;
-                case GGUF_TYPE_INT64:   ok = ok && gguf_fread_el (file, &kv->value.int64,   sizeof(kv->value.int64),   &offset); break;
-                case GGUF_TYPE_FLOAT64: ok = ok && gguf_fread_el (file, &kv->value.float64, sizeof(kv->value.float64), &offset); break;
-                case GGUF_TYPE_BOOL:    ok = ok && gguf_fread_el (file, &kv->value.bool_,   sizeof(kv->value.bool_),   &offset); break;
-                case GGUF_TYPE_STRING:  ok = ok && gguf_fread_str(file, &kv->value.str,                                &offset); break;
+                case GGUF_TYPE_UINT8:   ok = ok && gguf_read_el (r, &kv->value.uint8,   sizeof(kv->value.uint8));   break;
+                case GGUF_TYPE_INT8:    ok = ok && gguf_read_el (r, &kv->value.int8,    sizeof(kv->value.int8));    break;
+                case GGUF_TYPE_UINT16:  ok = ok && gguf_read_el (r, &kv->value.uint16,  sizeof(kv->value.uint16));  break;
+                case GGUF_TYPE_INT16:   ok = ok && gguf_read_el (r, &kv->value.int16,   sizeof(kv->value.int16));   break;
+                case GGUF_TYPE_UINT32:  ok = ok && gguf_read_el (r, &kv->value.uint32,  sizeof(kv->value.uint32));  break;
+                case GGUF_TYPE_INT32:   ok = ok && gguf_read_el (r, &kv->value.int32,   sizeof(kv->value.int32));   break;
+                case GGUF_TYPE_FLOAT32: ok = ok && gguf_read_el (r, &kv->value.float32, sizeof(kv->value.float32)); break;
+                case GGUF_TYPE_UINT64:  ok = ok && gguf_read_el (r, &kv->value.uint64,  sizeof(kv->value.uint64));  break;
+                case GGUF_TYPE_INT64:   ok = ok && gguf_read_el (r, &kv->value.int64,   sizeof(kv->value.int64));   break;
+                case GGUF_TYPE_FLOAT64: ok = ok && gguf_read_el (r, &kv->value.float64, sizeof(kv->value.float64)); break;
+                case GGUF_TYPE_BOOL:    ok = ok && gguf_read_el (r, &kv->value.bool_,   sizeof(kv->value.bool_));   break;
+                case GGUF_TYPE_STRING:  ok = ok && gguf_read_str(r, &kv->value.str);                                 break;
                 case GGUF_TYPE_ARRAY:
                     {
-                        ok = ok && gguf_fread_el(file, &kv->value.arr.type, sizeof(kv->value.arr.type), &offset);
-                        ok = ok && gguf_fread_el(file, &kv->value.arr.n,    sizeof(kv->value.arr.n),    &offset);
+                        ok = ok && gguf_read_el(r, &kv->value.arr.type, sizeof(kv->value.arr.type));
+                        ok = ok && gguf_read_el(r, &kv->value.arr.n,    sizeof(kv->value.arr.n));
+
+                        if (!ok) {
+                            break;
+                        }
 
                         switch (kv->value.arr.type) {
                             case GGUF_TYPE_UINT8:
@@ -19848,30 +20492,22 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
                             case GGUF_TYPE_FLOAT64:
                             case GGUF_TYPE_BOOL:
                                 {
-                                    // prevent from integer overflow in the malloc below
-                                    if (kv->value.arr.n >= SIZE_MAX/gguf_type_size(kv->value.arr.type)) {
-                                        fprintf(stderr, "%s: array size is too large (%" PRIu64 ")\n", __func__, kv->value.arr.n);
-                                        gguf_free(ctx);
-                                        return NULL;
-                                    }
-
-                                    kv->value.arr.data = GGML_CALLOC(kv->value.arr.n, gguf_type_size(kv->value.arr.type));
-
-                                    ok = ok && gguf_fread_el(file, kv->value.arr.data, kv->value.arr.n * gguf_type_size(kv->value.arr.type), &offset);
+                                    ok = ok && gguf_read_arr(r, &kv->value.arr.data, kv->value.arr.n, gguf_type_size(kv->value.arr.type));
                                 } break;
                             case GGUF_TYPE_STRING:
                                 {
                                     // prevent from integer overflow in the malloc below
-                                    if (kv->value.arr.n >= SIZE_MAX/sizeof(struct gguf_str)) {
+                                    // each string needs at least 8 bytes for its length
+                                    if (kv->value.arr.n > (uint64_t)(r->e - r->p)/sizeof(uint64_t)) {
                                         fprintf(stderr, "%s: array size is too large (%" PRIu64 ")\n", __func__, kv->value.arr.n);
-                                        gguf_free(ctx);
-                                        return NULL;
+                                        ok = false;
+                                        break;
                                     }
 
                                     kv->value.arr.data = GGML_CALLOC(kv->value.arr.n, sizeof(struct gguf_str));
 
                                     for (uint64_t j = 0; j < kv->value.arr.n; ++j) {
-                                        ok = ok && gguf_fread_str(file, &((struct gguf_str *) kv->value.arr.data)[j], &offset);
+                                        ok = ok && gguf_read_str(r, &((struct gguf_str *) kv->value.arr.data)[j]);
                                     }
                                 } break;
                             case GGUF_TYPE_ARRAY:
@@ -19881,11 +20517,11 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
                 default: GGML_ABORT("invalid type");
             }
 
+            ctx->header.n_kv++;
+
             if (!ok) {
                 break;
             }
-
-            ctx->header.n_kv++;
         }
 
         if (!ok) {
@@ -19906,35 +20542,79 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
                 info->ne[j] = 1;
             }
 
-            ok = ok && gguf_fread_str(file, &info->name,                          &offset);
-            ok = ok && gguf_fread_el (file, &info->n_dims, sizeof(info->n_dims),  &offset);
+            ok = ok && gguf_read_str(r, &info->name);
+            ok = ok && gguf_read_el (r, &info->n_dims, sizeof(info->n_dims));
 
             ok = ok && (info->n_dims <= GGML_MAX_DIMS);
 
-            for (uint32_t j = 0; j < info->n_dims; ++j) {
-                ok = ok && gguf_fread_el(file, &info->ne[j], sizeof(info->ne[j]), &offset);
+            for (uint32_t j = 0; ok && j < info->n_dims; ++j) {
+                ok = ok && gguf_read_el(r, &info->ne[j], sizeof(info->ne[j]));
             }
 
-            ok = ok && gguf_fread_el (file, &info->type,   sizeof(info->type),    &offset);
-            ok = ok && gguf_fread_el (file, &info->offset, sizeof(info->offset),  &offset);
+            ok = ok && gguf_read_el (r, &info->type,   sizeof(info->type));
+            ok = ok && gguf_read_el (r, &info->offset, sizeof(info->offset));
+
+            if (!ok) {
+                fprintf(stderr, "%s: failed to read tensor info\n", __func__);
+                gguf_free(ctx);
+                return NULL;
+            }
 
             // TODO: return an error instead of crashing with GGML_ASSERT
             gguf_tensor_info_sanitize(info);
+        }
+    }
+
+    offset = r->p - ctx->view;
+
+    // copy strings, and any arrays that are unaligned, into one arena
+    {
+        size_t used = 0;
+
+        ctx->arena_size = r->arena;
+        ctx->arena      = GGML_MALLOC(ctx->arena_size ? ctx->arena_size : 1);
+
+        for (uint64_t i = 0; i < ctx->header.n_kv; ++i) {
+            struct gguf_kv * kv = &ctx->kv[i];
+
+            gguf_intern_str(ctx, &kv->key, &used);
 
-            // make sure there is no duplicated tensor names
-            for (uint64_t j = 0; j < i && ok; ++j) {
-                if (strcmp(info->name.data, ctx->infos[j].name.data) == 0) {
-                    fprintf(stderr, "%s: duplicated tensor name %s\n", __func__, info->name.data);
-                    ok = false;
+            if (kv->type == GGUF_TYPE_STRING) {
+                gguf_intern_str(ctx, &kv->value.str, &used);
+            } else if (kv->type == GGUF_TYPE_ARRAY) {
+                if (kv->value.arr.type == GGUF_TYPE_STRING) {
+                    for (uint64_t j = 0; j < kv->value.arr.n; ++j) {
+                        gguf_intern_str(ctx, &((struct gguf_str *) kv->value.arr.data)[j], &used);
+                    }
+                } else {
+                    gguf_intern_arr(ctx, &kv->value.arr.data, kv->value.arr.n, gguf_type_size(kv->value.arr.type), &used);
                 }
             }
+        }
 
-            if (!ok) {
-                fprintf(stderr, "%s: failed to read tensor info\n", __func__);
-                gguf_free(ctx);
-                return NULL;
+        for (uint64_t i = 0; i < ctx->header.n_tensors; ++i) {
+            gguf_intern_str(ctx, &ctx->infos[i].name, &used);
+        }
+
+        GGML_ASSERT(used <= ctx->arena_size);
+    }
+
+    // make sure there is no duplicated tensor names
+    for (uint64_t i = 0; i < ctx->header.n_tensors; ++i) {
+        struct gguf_tensor_info * info = &ctx->infos[i];
+
+        for (uint64_t j = 0; j < i && ok; ++j) {
+            if (strcmp(info->name.data, ctx->infos[j].name.data) == 0) {
+                fprintf(stderr, "%s: duplicated tensor name %s\n", __func__, info->name.data);
+                ok = false;
             }
         }
+
+        if (!ok) {
+            fprintf(stderr, "%s: failed to read tensor info\n", __func__);
+            gguf_free(ctx);
+            return NULL;
+        }
     }
 
     ctx->alignment = GGUF_DEFAULT_ALIGNMENT;
@@ -19950,8 +20630,9 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
 
         if (offset_pad != 0) {
             offset += ctx->alignment - offset_pad;
-            llamafile_seek(file, offset, SEEK_SET);
         }
+
+        llamafile_seek(file, start + offset, SEEK_SET);
     }
 
     // store the current file offset - this is where the data section starts
@@ -20017,7 +20698,7 @@ struct gguf_context * gguf_init_from_file(struct llamafile * file, struct gguf_i
             ok = ok && data != NULL;
 
             // read the binary blob with the tensor data
-            ok = ok && gguf_fread_el(file, data->data, ctx->size, &offset);
+            ok = ok && llamafile_read(file, data->data, ctx->size) == (long) ctx->size;
 
             if (!ok) {
                 fprintf(stderr, "%s: failed to read tensor data\n", __func__);
@@ -20078,7 +20759,7 @@ void gguf_free(struct gguf_context * ctx) {
     if (ctx->kv) {
         // free string memory - not great..
         for (uint64_t i = 0; i < ctx->header.n_kv; ++i) {
-            gguf_free_kv(&ctx->kv[i]);
+            gguf_free_kv(ctx, &ctx->kv[i]);
         }
 
         GGML_FREE(ctx->kv);
@@ -20088,7 +20769,7 @@ void gguf_free(struct gguf_context * ctx) {
         for (uint64_t i = 0; i < ctx->header.n_tensors; ++i) {
             struct gguf_tensor_info * info = &ctx->infos[i];
 
-            if (info->name.data) {
+            if (info->name.data && !gguf_is_borrowed(ctx, info->name.data)) {
                 GGML_FREE(info->name.data);
             }
         }
@@ -20096,6 +20777,18 @@ void gguf_free(struct gguf_context * ctx) {
         GGML_FREE(ctx->infos);
     }
 
+    if (ctx->arena) {
+        GGML_FREE(ctx->arena);
+    }
+
+    if (ctx->mapping) {
+        munmap(ctx->mapping, ctx->mapsize);
+    }
+
+    if (ctx->file) {
+        llamafile_unref(ctx->file);
+    }
+
     GGML_FREE(ctx);
 }
 
@@ -20307,7 +21000,7 @@ void gguf_remove_key(struct gguf_context * ctx, const char * key) {
     const int idx = gguf_find_key(ctx, key);
     if (idx >= 0) {
         const int n_kv = gguf_get_n_kv(ctx);
-        gguf_free_kv(&ctx->kv[idx]);
+        gguf_free_kv(ctx, &ctx->kv[idx]);
         for (int i = idx; i < n_kv-1; ++i) {
             ctx->kv[i] = ctx->kv[i+1];
         }
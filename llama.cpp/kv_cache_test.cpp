@@ -0,0 +1,203 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "llama.h"
+#include "llamafile/llamafile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// checks llama_kv_cache_seq_apply() edits many sequences in one pass the
+// same way as calling llama_kv_cache_seq_rm(), llama_kv_cache_seq_add()
+// and llama_kv_cache_seq_div() for one sequence after another, like the
+// upstream examples do, including for cells several sequences share.
+
+#define MODEL "models/TinyLLama-v0.1-5M-F16.gguf"
+#define SEQS 4
+#define PROMPT 48 // tokens all sequences share
+
+static llama_model *g_model;
+
+// returns a context whose sequences share a prompt, then diverge
+static llama_context *setup(void) {
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx = 512;
+    cparams.n_seq_max = SEQS;
+    llama_context *ctx;
+    if (!(ctx = llama_new_context_with_model(g_model, cparams)))
+        exit(2);
+    llama_batch batch = llama_batch_init(512, 0, 1);
+    for (int i = 0; i < PROMPT; ++i) {
+        batch.token[batch.n_tokens] = 1 + i * 37 % 1000;
+        batch.pos[batch.n_tokens] = i;
+        batch.n_seq_id[batch.n_tokens] = 1;
+        batch.seq_id[batch.n_tokens][0] = 0;
+        batch.logits[batch.n_tokens] = false;
+        ++batch.n_tokens;
+    }
+    if (llama_decode(ctx, batch))
+        exit(3);
+    batch.n_tokens = 0;
+    for (int s = 0; s < SEQS; ++s) {
+        if (s)
+            llama_kv_cache_seq_cp(ctx, 0, s, -1, -1);
+        for (int i = PROMPT; i < PROMPT + 16 + 8 * s; ++i) {
+            batch.token[batch.n_tokens] = 1 + (i * 37 + s) % 1000;
+            batch.pos[batch.n_tokens] = i;
+            batch.n_seq_id[batch.n_tokens] = 1;
+            batch.seq_id[batch.n_tokens][0] = s;
+            batch.logits[batch.n_tokens] = false;
+            ++batch.n_tokens;
+        }
+    }
+    if (llama_decode(ctx, batch))
+        exit(4);
+    llama_batch_free(batch);
+    return ctx;
+}
+
+// returns the policy of each sequence, as listed in `order`
+static std::vector<llama_kv_seq> policies(const int order[SEQS]) {
+    llama_kv_seq seq[SEQS] = {};
+    for (int s = 0; s < SEQS; ++s) {
+        seq[s].seq_id = s;
+        seq[s].n_past = PROMPT + 16 + 8 * s;
+        seq[s].n_tokens = 1;
+        seq[s].ga_n = 1;
+    }
+    // sliding window with attention sinks
+    seq[0].n_ctx = 60;
+    seq[0].n_keep = 4;
+    // sliding window that evicts the shared prompt
+    seq[1].n_ctx = 70;
+    seq[1].n_discard = 20;
+    // self-extend
+    seq[2].ga_n = 4;
+    seq[2].ga_w = 16;
+    seq[3].ga_n = 2;
+    seq[3].ga_w = 32;
+    std::vector<llama_kv_seq> seqs;
+    for (int s = 0; s < SEQS; ++s)
+        seqs.push_back(seq[order[s]]);
+    return seqs;
+}
+
+// edits each sequence with the calls upstream's examples would make
+static void apply_slowly(llama_context *ctx, llama_kv_seq &seq) {
+    seq.n_evicted = 0;
+    if (seq.ga_n != 1) {
+        while (seq.n_past >= seq.ga_i + seq.ga_w) {
+            const int ib = (seq.ga_n * seq.ga_i) / seq.ga_w;
+            const int bd = (seq.ga_w / seq.ga_n) * (seq.ga_n - 1);
+            const int dd = (seq.ga_w / seq.ga_n) - ib * bd - seq.ga_w;
+            llama_kv_cache_seq_add(ctx, seq.seq_id, seq.ga_i, seq.n_past, ib * bd);
+            llama_kv_cache_seq_div(ctx, seq.seq_id, seq.ga_i + ib * bd,
+                                   seq.ga_i + ib * bd + seq.ga_w, seq.ga_n);
+            llama_kv_cache_seq_add(ctx, seq.seq_id, seq.ga_i + ib * bd + seq.ga_w,
+                                   seq.n_past + ib * bd, dd);
+            seq.n_past -= bd;
+            seq.ga_i += seq.ga_w / seq.ga_n;
+        }
+        return;
+    }
+    if (seq.n_past + seq.n_tokens <= seq.n_ctx)
+        return;
+    const int n_left = seq.n_past - seq.n_keep;
+    const int n_discard = seq.n_discard ? seq.n_discard : n_left / 2;
+    llama_kv_cache_seq_rm(ctx, seq.seq_id, seq.n_keep, seq.n_keep + n_discard);
+    llama_kv_cache_seq_add(ctx, seq.seq_id, seq.n_keep + n_discard, seq.n_past, -n_discard);
+    seq.n_past -= n_discard;
+    seq.n_evicted = n_discard;
+}
+
+// returns position and sequences of each used cell, in a stable order
+static std::vector<std::vector<int>> cells(llama_context *ctx) {
+    std::vector<std::vector<int>> res;
+    llama_kv_cache_view view = llama_kv_cache_view_init(ctx, SEQS);
+    llama_kv_cache_view_update(ctx, &view);
+    for (int i = 0; i < view.n_cells; ++i) {
+        if (view.cells[i].pos < 0)
+            continue;
+        std::vector<int> cell = {view.cells[i].pos};
+        for (int j = 0; j < SEQS; ++j)
+            if (view.cells_sequences[i * SEQS + j] >= 0)
+                cell.push_back(view.cells_sequences[i * SEQS + j]);
+        std::sort(cell.begin() + 1, cell.end());
+        res.push_back(cell);
+    }
+    llama_kv_cache_view_free(&view);
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+// returns logits of one more token for each sequence
+static std::vector<float> next(llama_context *ctx, const std::vector<llama_kv_seq> &seqs) {
+    llama_batch batch = llama_batch_init(SEQS, 0, 1);
+    for (const llama_kv_seq &seq : seqs) {
+        batch.token[batch.n_tokens] = 7;
+        batch.pos[batch.n_tokens] = seq.n_past;
+        batch.n_seq_id[batch.n_tokens] = 1;
+        batch.seq_id[batch.n_tokens][0] = seq.seq_id;
+        batch.logits[batch.n_tokens] = true;
+        ++batch.n_tokens;
+    }
+    if (llama_decode(ctx, batch))
+        exit(5);
+    std::vector<float> logits;
+    for (int i = 0; i < batch.n_tokens; ++i) {
+        float *p = llama_get_logits_ith(ctx, i);
+        logits.insert(logits.end(), p, p + llama_n_vocab(g_model));
+    }
+    llama_batch_free(batch);
+    return logits;
+}
+
+static void check(const int order[SEQS], int fail) {
+    llama_context *fast = setup();
+    llama_context *slow = setup();
+    std::vector<llama_kv_seq> a = policies(order);
+    std::vector<llama_kv_seq> b = policies(order);
+    llama_kv_cache_seq_apply(fast, a.data(), a.size());
+    for (llama_kv_seq &seq : b)
+        apply_slowly(slow, seq);
+    for (int s = 0; s < SEQS; ++s)
+        if (a[s].n_past != b[s].n_past || a[s].ga_i != b[s].ga_i ||
+            a[s].n_evicted != b[s].n_evicted)
+            exit(fail);
+    if (cells(fast) != cells(slow))
+        exit(fail + 1);
+    if (next(fast, a) != next(slow, b))
+        exit(fail + 2);
+    llama_free(slow);
+    llama_free(fast);
+}
+
+int main() {
+    FLAGS_READY = true;
+    llama_backend_init();
+    llama_model_params mparams = llama_model_default_params();
+    if (!(g_model = llama_load_model_from_file(MODEL, mparams)))
+        return 1;
+    static const int kForward[SEQS] = {0, 1, 2, 3};
+    static const int kShuffled[SEQS] = {3, 1, 0, 2};
+    check(kForward, 10);
+    check(kShuffled, 20);
+    llama_free_model(g_model);
+    llama_backend_free();
+}
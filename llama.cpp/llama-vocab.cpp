@@ -1569,7 +1569,7 @@ int32_t llama_token_to_piece_impl(const struct llama_vocab & vocab, llama_token
         const auto & cache = vocab.cache_token_to_piece;
 
         if (!cache.empty()) {
-            const auto & result = cache.at(token);
+            const std::string_view result = cache.at(token);
             return _try_copy(result.data(), result.size());
         }
     }
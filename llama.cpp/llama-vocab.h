@@ -4,7 +4,9 @@
 
 #include "llama-impl.h"
 
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <map>
@@ -29,7 +31,25 @@ struct llama_vocab {
     std::vector<token_data>       id_to_token;
 
     std::vector<id>    cache_special_tokens;
-    std::vector<token> cache_token_to_piece; // llama_token_to_piece(special = true);
+    // [jart] llama_token_to_piece(special = true) of every token, packed
+    //        into one blob so it can be viewed without copying. piece i
+    //        is at offs[i] and ends with a nul at offs[i + 1] - 1
+    struct piece_cache {
+        std::string           blob;
+        std::vector<uint32_t> offs;
+        std::vector<uint8_t>  flags; // enum llama_piece_flags
+
+        bool empty() const { return flags.empty(); }
+
+        std::string_view at(id token) const {
+            if ((size_t) token >= flags.size()) {
+                throw std::out_of_range("piece_cache::at");
+            }
+            return std::string_view(blob.data() + offs[token], offs[token + 1] - offs[token] - 1);
+        }
+    };
+
+    piece_cache cache_token_to_piece;
 
     std::map<std::pair<std::string, std::string>, int> bpe_ranks;
 
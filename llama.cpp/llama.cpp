@@ -4,6 +4,8 @@
 #include "llamafile/log.h"
 #include "llamafile/latency.h"
 #include "llamafile/debug.h"
+#include "llamafile/sgemm.h"
+#include "llamafile/experts.h"
 
 #include "llama-impl.h"
 #include "llama-vocab.h"
@@ -18,6 +20,8 @@
 #include "ggml-backend.h"
 #include "ggml-cuda.h"
 #include "ggml-metal.h"
+#include "ggml-rpc.h"
+#include "ggml-aarch64.h"
 
 #include "llamafile/threadlocal.h"
 #include "llamafile/core_manager.h"
@@ -1649,6 +1653,7 @@ struct llama_mmap {
     }
 
     ~llama_mmap() {
+        llamafile_experts_forget(addr, size);
         if (is_owned) {
             for (const auto & frag : mapped_fragments) {
                 if (munmap((char *) addr + frag.first, frag.second - frag.first)) {
@@ -1745,6 +1750,24 @@ struct llama_mlock {
 };
 using llama_mlocks = std::vector<std::unique_ptr<llama_mlock>>;
 
+// [jart] returns true if str is a whole number of utf-8 sequences
+static bool llama_utf8_is_complete(const std::string & str) {
+    for (size_t i = 0; i < str.size();) {
+        static const int lookup[] = { 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 2, 2, 3, 4 };
+        int len = lookup[(uint8_t) str[i] >> 4];
+        if (!len || i + len > str.size()) {
+            return false;
+        }
+        for (int j = 1; j < len; ++j) {
+            if (((uint8_t) str[i + j] & 0xc0) != 0x80) {
+                return false;
+            }
+        }
+        i += len;
+    }
+    return true;
+}
+
 // NOTE: avoid ever using this except for building the token_to_piece caches
 static std::string llama_token_to_piece(const struct llama_model * model, llama_token token, bool special) {
     std::string piece;
@@ -2150,6 +2173,7 @@ struct llama_layer {
     struct ggml_tensor * ffn_gate; // w1
     struct ggml_tensor * ffn_down; // w2
     struct ggml_tensor * ffn_up;   // w3
+    struct ggml_tensor * ffn_gate_up; // w1 and w3 concatenated [jart]
     struct ggml_tensor * ffn_gate_enc;
     struct ggml_tensor * ffn_down_enc;
     struct ggml_tensor * ffn_up_enc;
@@ -2251,6 +2275,13 @@ struct llama_kv_cache {
     std::vector<struct ggml_context *> ctxs;
     std::vector<ggml_backend_buffer_t> bufs;
 
+    // [jart] host memory is committed on demand, one block of cells at
+    //        a time, and empty blocks are given back to the system. so a
+    //        context only costs ram for the cells its sequences are using
+    static constexpr uint32_t block_size = 256;
+    std::vector<bool> resident; // per block
+    std::vector<std::pair<void *, size_t>> maps;
+
     size_t total_size() const {
         size_t size = 0;
         for (ggml_backend_buffer_t buf : bufs) {
@@ -2266,6 +2297,9 @@ struct llama_kv_cache {
         for (ggml_backend_buffer_t buf : bufs) {
             ggml_backend_buffer_free(buf);
         }
+        for (auto & map : maps) {
+            munmap(map.first, map.second);
+        }
     }
 };
 
@@ -2389,6 +2423,36 @@ struct llama_model {
     }
 };
 
+// [jart] cached decode graph
+//
+// single token decode builds a graph of the same shape every time. it
+// only differs in the kv window, the positions and where the new kv
+// entries get stored. so we hold on to the last graph llama_decode()
+// built, along with its scheduler allocation, and reuse it while the
+// (n_tokens, n_outputs, n_kv) key stays the same. kv_self.n is padded
+// so a single graph covers many tokens. the only things which need to
+// change are the input tensors, and the offsets of the kv store views
+struct llama_graph_cache {
+    struct kv_view {
+        struct ggml_tensor * t;
+        size_t offs;   // view offset when kv head is zero
+        size_t stride; // bytes per kv cell
+    };
+
+    ggml_cgraph * gf = nullptr; // lives in buf_compute_meta
+    uint32_t n_tokens  = 0;
+    uint32_t n_outputs = 0;
+    uint32_t n_kv      = 0;
+    bool     has_token = false;
+
+    std::vector<kv_view> kv_views;
+
+    void clear() {
+        gf = nullptr;
+        kv_views.clear();
+    }
+};
+
 struct llama_context {
     llama_context(const llama_model & model)
         : model(model)
@@ -2470,6 +2534,9 @@ struct llama_context {
     std::vector<uint8_t> buf_compute_meta;
     ggml_backend_sched_t sched = nullptr;
 
+    // last decode graph, which is only valid if nothing else was built since
+    struct llama_graph_cache graph_cache;
+
     ggml_abort_callback abort_callback      = nullptr;
     void *              abort_callback_data = nullptr;
 
@@ -2628,6 +2695,13 @@ static size_t llama_get_device_memory(const llama_model & model, int device) {
         ggml_backend_rpc_get_device_memory(endpoint, &free, &total);
         return free;
     }
+    if (rpc_count && !llamafile_has_gpu()) {
+        // [jart] weigh this host's share of layers against the workers
+        size_t total;
+        size_t free;
+        ggml_backend_rpc_get_host_memory(&free, &total);
+        return free;
+    }
 #endif
     if (llamafile_has_cuda()) {
         size_t total;
@@ -2666,6 +2740,115 @@ static size_t llama_get_device_memory(const llama_model & model, int device) {
 // kv cache helpers
 //
 
+// [jart] reserves kv memory that the system only commits when touched
+static ggml_backend_buffer_t llama_kv_cache_alloc_lazy(
+             struct llama_kv_cache & cache,
+              struct ggml_context * ctx) {
+    ggml_backend_buffer_type_t buft = ggml_backend_cpu_buffer_type();
+    const size_t align = ggml_backend_buft_get_alignment(buft);
+
+    size_t size = 0;
+    for (ggml_tensor * t = ggml_get_first_tensor(ctx); t; t = ggml_get_next_tensor(ctx, t)) {
+        size += GGML_PAD(ggml_backend_buft_get_alloc_size(buft, t), align);
+    }
+
+    void * addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+    cache.maps.emplace_back(addr, size);
+
+    ggml_backend_buffer_t buf = ggml_backend_cpu_buffer_from_ptr(addr, size);
+    struct ggml_tallocr talloc = ggml_tallocr_new(buf);
+    for (ggml_tensor * t = ggml_get_first_tensor(ctx); t; t = ggml_get_next_tensor(ctx, t)) {
+        ggml_tallocr_alloc(&talloc, t);
+    }
+    return buf;
+}
+
+static bool llama_kv_cache_is_lazy(const struct llama_kv_cache & cache, const void * addr) {
+    for (const auto & map : cache.maps) {
+        if ((const char *) map.first <= (const char *) addr &&
+            (const char *) addr < (const char *) map.first + map.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void llama_kv_cache_discard(void * addr, size_t size) {
+    static const uintptr_t pagesz = sysconf(_SC_PAGESIZE);
+    uintptr_t beg = ((uintptr_t) addr + pagesz - 1) & -pagesz;
+    uintptr_t end = ((uintptr_t) addr + size) & -pagesz;
+    if (beg < end) {
+        madvise((void *) beg, end - beg, MADV_DONTNEED);
+    }
+}
+
+// notes that cells [c0, c1) are about to be written
+static void llama_kv_cache_page_in(struct llama_kv_cache & cache, uint32_t c0, uint32_t c1) {
+    for (uint32_t b = c0 / cache.block_size; b * cache.block_size < c1; ++b) {
+        cache.resident[b] = true;
+    }
+}
+
+// gives the memory of cells [c0, c1) back to the system
+static void llama_kv_cache_page_out(struct llama_kv_cache & cache, uint32_t c0, uint32_t c1) {
+    const uintptr_t pagesz = sysconf(_SC_PAGESIZE);
+    for (size_t il = 0; il < cache.k_l.size(); ++il) {
+        ggml_tensor * k = cache.k_l[il];
+        ggml_tensor * v = cache.v_l[il];
+        if (!llama_kv_cache_is_lazy(cache, k->data)) {
+            continue;
+        }
+        const size_t k_size_row = ggml_row_size(k->type, k->ne[0] / cache.size);
+        llama_kv_cache_discard((char *) k->data + c0*k_size_row, (c1 - c0)*k_size_row);
+        if (cache.v_trans) {
+            // each embedding has its own row of cells
+            const size_t  v_size_el = ggml_type_size(v->type);
+            const int64_t n_embd_v  = v->ne[0] / cache.size;
+            if ((c1 - c0)*v_size_el < pagesz) {
+                continue;
+            }
+            for (int64_t j = 0; j < n_embd_v; ++j) {
+                llama_kv_cache_discard((char *) v->data + (j*cache.size + c0)*v_size_el, (c1 - c0)*v_size_el);
+            }
+        } else {
+            const size_t v_size_row = ggml_row_size(v->type, v->ne[0] / cache.size);
+            llama_kv_cache_discard((char *) v->data + c0*v_size_row, (c1 - c0)*v_size_row);
+        }
+    }
+}
+
+// pages out runs of blocks whose cells no longer belong to a sequence
+static void llama_kv_cache_trim(struct llama_kv_cache & cache) {
+    if (cache.maps.empty()) {
+        return;
+    }
+    const uint32_t n_blocks = cache.resident.size();
+    uint32_t start = n_blocks;
+    bool dirty = false;
+    for (uint32_t b = 0; b <= n_blocks; ++b) {
+        bool empty = b < n_blocks;
+        for (uint32_t i = b*cache.block_size; empty && i < std::min((b + 1)*cache.block_size, cache.size); ++i) {
+            empty = cache.cells[i].pos < 0;
+        }
+        if (empty) {
+            if (start == n_blocks) {
+                start = b;
+            }
+            dirty |= cache.resident[b];
+            cache.resident[b] = false;
+            continue;
+        }
+        if (start != n_blocks && dirty) {
+            llama_kv_cache_page_out(cache, start*cache.block_size, std::min(b*cache.block_size, cache.size));
+        }
+        start = n_blocks;
+        dirty = false;
+    }
+}
+
 static bool llama_kv_cache_init(
              struct llama_kv_cache & cache,
                const llama_context * ctx,
@@ -2751,16 +2934,24 @@ static bool llama_kv_cache_init(
     for (auto it : ctx_map) {
         ggml_backend_buffer_type_t buft = it.first;
         ggml_context * ctx = it.second;
-        ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors_from_buft(ctx, buft);
+        ggml_backend_buffer_t buf = nullptr;
+        if (buft == ggml_backend_cpu_buffer_type() && !cache.recurrent) {
+            buf = llama_kv_cache_alloc_lazy(cache, ctx); // already zero
+        }
         if (!buf) {
-            LLAMA_LOG_ERROR("%s: failed to allocate buffer for kv cache\n", __func__);
-            return false;
+            buf = ggml_backend_alloc_ctx_tensors_from_buft(ctx, buft);
+            if (!buf) {
+                LLAMA_LOG_ERROR("%s: failed to allocate buffer for kv cache\n", __func__);
+                return false;
+            }
+            ggml_backend_buffer_clear(buf, 0);
         }
-        ggml_backend_buffer_clear(buf, 0);
         LLAMA_LOG_INFO("%s: %10s KV buffer size = %8.2f MiB\n", __func__, ggml_backend_buffer_name(buf), ggml_backend_buffer_get_size(buf)/1024.0/1024.0);
         cache.bufs.push_back(buf);
     }
 
+    cache.resident.assign((kv_size + cache.block_size - 1) / cache.block_size, false);
+
     return true;
 }
 
@@ -2865,6 +3056,8 @@ static bool llama_kv_cache_find_slot(
 
     cache.used += n_tokens;
 
+    llama_kv_cache_page_in(cache, cache.head, cache.head + n_tokens);
+
     return true;
 }
 
@@ -2890,8 +3083,12 @@ static void llama_kv_cache_clear(struct llama_kv_cache & cache) {
     cache.used = 0;
 
     for (auto & buf : cache.bufs) {
-        ggml_backend_buffer_clear(buf, 0);
+        if (!llama_kv_cache_is_lazy(cache, ggml_backend_buffer_get_base(buf))) {
+            ggml_backend_buffer_clear(buf, 0);
+        }
     }
+
+    llama_kv_cache_trim(cache);
 }
 
 static bool llama_kv_cache_seq_rm(
@@ -2945,6 +3142,8 @@ static bool llama_kv_cache_seq_rm(
     // If we freed up a slot, set head to it so searching can start there.
     if (new_head != cache.size && new_head < cache.head) cache.head = new_head;
 
+    llama_kv_cache_trim(cache);
+
     return true;
 }
 
@@ -3006,6 +3205,8 @@ static void llama_kv_cache_seq_keep(struct llama_kv_cache & cache, llama_seq_id
 
     // If we freed up a slot, set head to it so searching can start there.
     if (new_head != cache.size && new_head < cache.head) cache.head = new_head;
+
+    llama_kv_cache_trim(cache);
 }
 
 static void llama_kv_cache_seq_add(
@@ -3054,6 +3255,10 @@ static void llama_kv_cache_seq_add(
     // If we freed up a slot, set head to it so searching can start there.
     // Otherwise we just start the next search from the beginning.
     cache.head = new_head != cache.size ? new_head : 0;
+
+    if (new_head != cache.size) {
+        llama_kv_cache_trim(cache);
+    }
 }
 
 static void llama_kv_cache_seq_div(
@@ -3091,6 +3296,137 @@ static void llama_kv_cache_seq_div(
     }
 }
 
+// [jart] one edit of the positions of a sequence, in the order they'd
+//        have been made by seq_rm(), seq_add() and seq_div() calls
+struct llama_kv_edit {
+    enum { RM, ADD, DIV } op;
+    llama_pos p0;
+    llama_pos p1;
+    llama_pos arg;
+};
+
+// decides which edits the policy of a sequence calls for
+static void llama_kv_seq_plan(llama_kv_seq & seq, std::vector<llama_kv_edit> & edits) {
+    seq.n_evicted = 0;
+    if (seq.ga_n != 1) {
+        // context extension via self-extend
+        GGML_ASSERT(seq.ga_n > 0 && seq.ga_w >= seq.ga_n);
+        while (seq.n_past >= seq.ga_i + seq.ga_w) {
+            const int ib = (seq.ga_n * seq.ga_i) / seq.ga_w;
+            const int bd = (seq.ga_w / seq.ga_n) * (seq.ga_n - 1);
+            const int dd = (seq.ga_w / seq.ga_n) - ib * bd - seq.ga_w;
+            edits.push_back({llama_kv_edit::ADD, seq.ga_i, seq.n_past, ib * bd});
+            edits.push_back({llama_kv_edit::DIV, seq.ga_i + ib * bd, seq.ga_i + ib * bd + seq.ga_w, seq.ga_n});
+            edits.push_back({llama_kv_edit::ADD, seq.ga_i + ib * bd + seq.ga_w, seq.n_past + ib * bd, dd});
+            seq.n_past -= bd;
+            seq.ga_i += seq.ga_w / seq.ga_n;
+        }
+        return;
+    }
+    if (seq.n_past + seq.n_tokens <= seq.n_ctx) {
+        return;
+    }
+    // sliding window which keeps the first n_keep positions as sinks
+    const int n_keep = std::max(0, std::min(seq.n_keep, seq.n_past));
+    const int n_left = seq.n_past - n_keep;
+    int n_discard = seq.n_discard > 0 ? seq.n_discard : n_left / 2;
+    n_discard = std::max(n_discard, seq.n_past + seq.n_tokens - seq.n_ctx);
+    n_discard = std::min(n_discard, n_left);
+    if (n_discard <= 0) {
+        return;
+    }
+    edits.push_back({llama_kv_edit::RM, n_keep, n_keep + n_discard, 0});
+    edits.push_back({llama_kv_edit::ADD, n_keep + n_discard, seq.n_past, -n_discard});
+    seq.n_past -= n_discard;
+    seq.n_evicted = n_discard;
+}
+
+static void llama_kv_cache_seq_apply(struct llama_kv_cache & cache, llama_kv_seq * seqs, int32_t n_seqs) {
+    // plan every sequence first, so the cells only need to be visited once
+    std::vector<llama_kv_edit> edits;
+    std::vector<std::pair<size_t, size_t>> spans; // edits of each seq_id
+    for (int32_t s = 0; s < n_seqs; ++s) {
+        const llama_seq_id seq_id = seqs[s].seq_id;
+        GGML_ASSERT(seq_id >= 0);
+        size_t e0 = edits.size();
+        llama_kv_seq_plan(seqs[s], edits);
+        if ((size_t) seq_id >= spans.size()) {
+            spans.resize(seq_id + 1);
+        }
+        GGML_ASSERT(spans[seq_id].first == spans[seq_id].second && "sequence listed twice");
+        spans[seq_id] = {e0, edits.size()};
+    }
+    if (edits.empty()) {
+        return;
+    }
+
+    if (cache.recurrent) {
+        for (int32_t s = 0; s < n_seqs; ++s) {
+            const auto & span = spans[seqs[s].seq_id];
+            for (size_t e = span.first; e < span.second; ++e) {
+                const llama_kv_edit & edit = edits[e];
+                switch (edit.op) {
+                    case llama_kv_edit::RM:  llama_kv_cache_seq_rm (cache, seqs[s].seq_id, edit.p0, edit.p1);           break;
+                    case llama_kv_edit::ADD: llama_kv_cache_seq_add(cache, seqs[s].seq_id, edit.p0, edit.p1, edit.arg); break;
+                    case llama_kv_edit::DIV: llama_kv_cache_seq_div(cache, seqs[s].seq_id, edit.p0, edit.p1, edit.arg); break;
+                }
+            }
+        }
+        return;
+    }
+
+    uint32_t new_head = cache.size;
+
+    for (uint32_t i = 0; i < cache.size; ++i) {
+        llama_kv_cell & cell = cache.cells[i];
+        // visit sequences in the order they're listed, because an edit to
+        // a cell that's shared also moves it for the other sequences, so
+        // the result depends on order the same way separate calls would
+        for (int32_t s = 0; s < n_seqs && cell.pos >= 0; ++s) {
+            const llama_seq_id id = seqs[s].seq_id;
+            if (!cell.has_seq_id(id)) {
+                continue;
+            }
+            for (size_t e = spans[id].first; e < spans[id].second; ++e) {
+                const llama_kv_edit & edit = edits[e];
+                if (cell.pos < edit.p0 || cell.pos >= edit.p1) {
+                    continue;
+                }
+                if (edit.op == llama_kv_edit::RM) {
+                    cell.seq_id.erase(id);
+                    if (cell.is_empty()) {
+                        cache.used--;
+                        cell.pos = -1;
+                        if (new_head == cache.size) new_head = i;
+                    }
+                    break;
+                }
+                const llama_pos p_old = cell.pos;
+                cache.has_shift = true;
+                if (edit.op == llama_kv_edit::ADD) {
+                    cell.pos += edit.arg;
+                } else {
+                    cell.pos /= edit.arg;
+                }
+                cell.delta += cell.pos - p_old;
+                if (cell.pos < 0) {
+                    cache.used--;
+                    cell.pos = -1;
+                    cell.seq_id.clear();
+                    if (new_head == cache.size) new_head = i;
+                    break;
+                }
+            }
+        }
+    }
+
+    cache.head = new_head != cache.size ? new_head : 0;
+
+    if (new_head != cache.size) {
+        llama_kv_cache_trim(cache);
+    }
+}
+
 static llama_pos llama_kv_cache_seq_pos_max(struct llama_kv_cache & cache, llama_seq_id seq_id) {
     llama_pos result = 0;
 
@@ -3322,6 +3658,26 @@ static size_t llama_model_max_nodes(const llama_model & model) {
     return std::max<size_t>(8192, model.tensors_by_name.size()*5);
 }
 
+// [jart] returns true if weight should be rewritten once it's been read
+//        into cpu memory, so it's laid out the way our matmul kernels
+//        want. it's never done for mmap()'d weights, since it'd dirty
+//        every page. tensors that aren't only used by ggml_mul_mat() on
+//        2d activations (e.g. embeddings for ggml_get_rows) are skipped.
+//        host buffers owned by gpu backends (e.g. pinned cuda memory) are
+//        skipped too, since their kernels don't know the repacked layout
+static bool llama_want_repack(const struct ggml_tensor * cur) {
+    const char * name = ggml_get_name(cur);
+    return cur->buffer &&
+           ggml_backend_buffer_get_type(cur->buffer) == ggml_backend_cpu_buffer_type() &&
+           llamafile_repack_supported(cur->type) &&
+           ggml_n_dims(cur) == 2 &&
+           cur->ne[1] % 8 == 0 &&
+           cur->ne[0] % QK4_0 == 0 &&
+           !strstr(name, "embd") &&
+           !strstr(name, "rel_b") &&
+           strstr(name, ".weight");
+}
+
 struct llama_model_loader {
     int n_kv      = 0;
     int n_tensors = 0;
@@ -3984,6 +4340,7 @@ struct llama_model_loader {
 
         std::vector<no_init<uint8_t>> read_buf;
         std::vector<std::future<std::pair<ggml_tensor *, bool>>> validation_result;
+        int n_repacked = 0;
 
 // #if defined(GGML_USE_CUDA)
         // 4 staging buffers for async uploads, each sized 1MB seems to be a good default for single NVMe drives.
@@ -4076,6 +4433,10 @@ struct llama_model_loader {
                         validation_result.emplace_back(std::async(std::launch::async, [cur, n_size] {
                             return std::make_pair(cur, ggml_validate_row_data(cur->type, cur->data, n_size));
                         }));
+                    } else if (llama_want_repack(cur)) {
+                        ggml_repack_q4_0_8x8(cur->data, cur->ne[1], cur->ne[0]);
+                        cur->type = GGML_TYPE_Q4_0_8_8;
+                        n_repacked++;
                     }
                 } else {
 // #if defined(GGML_USE_CUDA)
@@ -4115,6 +4476,10 @@ struct llama_model_loader {
             size_done += n_size;
         }
 
+        if (n_repacked) {
+            LLAMA_LOG_INFO("%s: repacked %d q4_0 tensors into interleaved tiles\n", __func__, n_repacked);
+        }
+
 // #if defined(GGML_USE_CUDA)
         // free temporary resources used for async cuda uploads
         if (cuda_backend) {
@@ -5286,6 +5651,7 @@ static void llm_load_vocab(
     const uint32_t n_vocab = gguf_get_arr_n(ctx, token_idx);
 
     vocab.id_to_token.resize(n_vocab);
+    vocab.token_to_id.reserve(n_vocab);
 
     for (uint32_t i = 0; i < n_vocab; i++) {
         std::string word = gguf_get_arr_str(ctx, token_idx, i);
@@ -5467,19 +5833,37 @@ static void llm_load_vocab(
 
     // build token to piece cache
     {
-        size_t size_cache = 0;
+        llama_vocab::piece_cache cache_token_to_piece;
 
-        std::vector<llama_vocab::token> cache_token_to_piece(n_vocab);
+        cache_token_to_piece.offs.resize(n_vocab + 1);
+        cache_token_to_piece.flags.resize(n_vocab);
 
         for (uint32_t id = 0; id < n_vocab; ++id) {
-            cache_token_to_piece[id] = llama_token_to_piece(&model, id, true);
+            const std::string piece = llama_token_to_piece(&model, id, true);
+            const llama_token_attr attr = vocab.id_to_token[id].attr;
+
+            uint8_t flags = 0;
+            if (attr & (LLAMA_TOKEN_ATTR_UNKNOWN | LLAMA_TOKEN_ATTR_CONTROL)) {
+                flags |= LLAMA_PIECE_SPECIAL;
+            }
+            if (attr & LLAMA_TOKEN_ATTR_BYTE) {
+                flags |= LLAMA_PIECE_BYTE;
+            }
+            if (!llama_utf8_is_complete(piece)) {
+                flags |= LLAMA_PIECE_INCOMPLETE;
+            }
 
-            size_cache += cache_token_to_piece[id].size();
+            cache_token_to_piece.offs[id]  = cache_token_to_piece.blob.size();
+            cache_token_to_piece.flags[id] = flags;
+            cache_token_to_piece.blob     += piece;
+            cache_token_to_piece.blob     += '\0';
         }
+        cache_token_to_piece.offs[n_vocab] = cache_token_to_piece.blob.size();
+        cache_token_to_piece.blob.shrink_to_fit();
 
         std::swap(vocab.cache_token_to_piece, cache_token_to_piece);
 
-        LLAMA_LOG_INFO("%s: token to piece cache size = %.4f MB\n", __func__, size_cache / 1024.0 / 1024.0);
+        LLAMA_LOG_INFO("%s: token to piece cache size = %.4f MB\n", __func__, vocab.cache_token_to_piece.blob.size() / 1024.0 / 1024.0);
     }
 
     // Handle per token attributes
@@ -5667,6 +6051,126 @@ static void llm_load_print_meta(llama_model_loader & ml, llama_model & model) {
     }
 }
 
+// [jart] returns true if weights can be stacked into one matrix on cpu
+static bool llm_weights_can_fuse(std::initializer_list<const ggml_tensor *> ws) {
+    const ggml_tensor * w0 = *ws.begin();
+    for (const ggml_tensor * w : ws) {
+        if (!w || !w->buffer ||
+            w->type != w0->type ||
+            w->ne[0] != w0->ne[0] ||
+            w->ne[2] != 1 || w->ne[3] != 1 ||
+            !ggml_is_contiguous(w)) {
+            return false;
+        }
+        ggml_backend_buffer_type_t buft = ggml_backend_buffer_get_type(w->buffer);
+        if (buft != ggml_backend_cpu_buffer_type() &&
+            buft != llama_default_buffer_type_cpu(true)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// [jart] stacks weights that multiply the same activations
+//
+// llama computes q, k and v from the same normalized input, and the ffn
+// gate and up projections also share an input. multiplying them as one
+// matrix means threads are partitioned and synchronized once, which is
+// helpful when k and v are short due to grouped query attention. rows
+// are concatenated in order, so the graph recovers each product as a
+// view of the fused one. the original tensors are kept, since lora
+// adapters are keyed on them, but they're pointed at their rows of the
+// fused copy, and the memory they used to occupy is given back, so the
+// weights don't end up being resident (or locked) twice.
+static void llm_release_weight(void * addr, size_t size, bool use_mlock) {
+    static const uintptr_t pagesz = sysconf(_SC_PAGESIZE);
+    uintptr_t beg = ((uintptr_t) addr + pagesz - 1) & -pagesz;
+    uintptr_t end = ((uintptr_t) addr + size) & -pagesz;
+    if (beg < end) {
+        if (use_mlock) {
+            munlock((void *) beg, end - beg);
+        }
+        madvise((void *) beg, end - beg, MADV_DONTNEED);
+    }
+}
+
+static void llm_fuse_weights(llama_model & model, bool use_mlock) {
+    if (model.arch != LLM_ARCH_LLAMA) {
+        return;
+    }
+
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ model.layers.size() * 2 * ggml_tensor_overhead(),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true,
+    };
+    ggml_context * ctx = ggml_init(params);
+    if (!ctx) {
+        throw std::runtime_error(format("failed to create context"));
+    }
+
+    std::vector<std::pair<ggml_tensor *, std::vector<ggml_tensor *>>> fused;
+    auto fuse = [&](std::initializer_list<ggml_tensor *> ws, const char * name, int il) {
+        int64_t rows = 0;
+        for (const ggml_tensor * w : ws) {
+            rows += w->ne[1];
+        }
+        const ggml_tensor * w0 = *ws.begin();
+        ggml_tensor * t = ggml_new_tensor_2d(ctx, w0->type, w0->ne[0], rows);
+        ggml_format_name(t, "blk.%d.%s.weight", il, name);
+        fused.emplace_back(t, ws);
+        return t;
+    };
+
+    for (int il = 0; il < (int) model.layers.size(); ++il) {
+        auto & layer = model.layers[il];
+        if (!layer.wqkv && llm_weights_can_fuse({layer.wq, layer.wk, layer.wv})) {
+            layer.wqkv = fuse({layer.wq, layer.wk, layer.wv}, "attn_qkv", il);
+        }
+        if (!layer.ffn_gate_b && !layer.ffn_up_b &&
+            llm_weights_can_fuse({layer.ffn_gate, layer.ffn_up})) {
+            layer.ffn_gate_up = fuse({layer.ffn_gate, layer.ffn_up}, "ffn_gate_up", il);
+        }
+    }
+
+    if (fused.empty()) {
+        ggml_free(ctx);
+        return;
+    }
+    model.ctxs.push_back(ctx);
+
+    ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors_from_buft(ctx, ggml_backend_cpu_buffer_type());
+    if (buf == nullptr) {
+        throw std::runtime_error("unable to allocate backend buffer");
+    }
+    model.bufs.push_back(buf);
+    ggml_backend_buffer_set_usage(buf, GGML_BACKEND_BUFFER_USAGE_WEIGHTS);
+    if (use_mlock) {
+        model.mlock_bufs.emplace_back(new llama_mlock);
+        auto & mlock_buf = model.mlock_bufs.back();
+        mlock_buf->init   (ggml_backend_buffer_get_base(buf));
+        mlock_buf->grow_to(ggml_backend_buffer_get_size(buf));
+    }
+
+    for (auto & it : fused) {
+        char * data = (char *) it.first->data;
+        for (ggml_tensor * w : it.second) {
+            memcpy(data, w->data, ggml_nbytes(w));
+            // pages shared with neighbors that weren't fused are kept.
+            // pinned buffers of gpu backends are never released either
+            if (ggml_backend_buffer_get_type(w->buffer) == ggml_backend_cpu_buffer_type()) {
+                llm_release_weight(w->data, ggml_nbytes(w), use_mlock);
+            }
+            w->data = data;
+            w->buffer = buf;
+            data += ggml_nbytes(w);
+        }
+    }
+
+    LLAMA_LOG_INFO("%s: fused %zu weight matrices (%.2f MiB)\n", __func__,
+                   fused.size(), ggml_backend_buffer_get_size(buf) / 1024.0 / 1024.0);
+}
+
 // Returns false if cancelled by progress_callback
 static bool llm_load_tensors(
         llama_model_loader & ml,
@@ -7544,6 +8048,10 @@ static bool llm_load_tensors(
         }
     }
 
+    if (FLAG_fuse_weights) {
+        llm_fuse_weights(model, use_mlock);
+    }
+
     if (use_mmap_buffer) {
         for (auto & mapping : ml.mappings) {
             model.mappings.emplace_back(std::move(mapping));
@@ -8302,6 +8810,9 @@ struct llm_build_context {
 
         ctx0 = ggml_init(params);
 
+        // building any graph overwrites buf_compute_meta and lctx.inp_*
+        lctx.graph_cache.clear();
+
         lctx.inp_tokens      = nullptr;
         lctx.inp_embd        = nullptr;
         lctx.inp_pos         = nullptr;
@@ -8335,6 +8846,12 @@ struct llm_build_context {
         cb(lctx.inp_K_shift, "K_shift", -1);
         ggml_set_input(lctx.inp_K_shift);
 
+        // [jart] cells past the last one in use don't need rotating, and
+        //        touching them would commit memory for the whole cache
+        const int64_t n_shift = std::min<int64_t>(n_ctx,
+            GGML_PAD(std::max(llama_kv_cache_cell_max(kv_self), 1u), kv_self.block_size));
+        struct ggml_tensor * k_shift = ggml_view_1d(ctx0, lctx.inp_K_shift, n_shift, 0);
+
         for (int il = 0; il < n_layer; ++il) {
             const int64_t n_head_kv = hparams.n_head_kv(il);
             const int64_t n_embd_k_gqa = hparams.n_embd_k_gqa(il);
@@ -8343,11 +8860,11 @@ struct llm_build_context {
                 // we rotate only the first n_rot dimensions
                 ggml_rope_ext_inplace(ctx0,
                         ggml_view_3d(ctx0, kv_self.k_l[il],
-                            n_embd_head_k, n_head_kv, n_ctx,
+                            n_embd_head_k, n_head_kv, n_shift,
                             ggml_row_size(kv_self.k_l[il]->type, n_embd_head_k),
                             ggml_row_size(kv_self.k_l[il]->type, n_embd_k_gqa),
                             0),
-                        lctx.inp_K_shift, rope_factors, n_rot, rope_type, n_ctx_orig, freq_base, freq_scale,
+                        k_shift, rope_factors, n_rot, rope_type, n_ctx_orig, freq_base, freq_scale,
                         ext_factor, attn_factor, beta_fast, beta_slow);
 
             cb(tmp, "K_shifted", il);
@@ -8661,21 +9178,36 @@ struct llm_build_context {
                 struct ggml_tensor * rope_factors = build_rope_factors(il);
 
                 // compute Q and K and RoPE them
-                struct ggml_tensor * Qcur = llm_build_lora_mm(lctx, ctx0, model.layers[il].wq, cur);
+                struct ggml_tensor * Qcur;
+                struct ggml_tensor * Kcur;
+                struct ggml_tensor * Vcur;
+                if (model.layers[il].wqkv && lctx.lora_adapters.empty()) {
+                    // [jart] weights were fused by --fuse-weights
+                    cur = ggml_mul_mat(ctx0, model.layers[il].wqkv, cur);
+                    cb(cur, "wqkv", il);
+                    const int64_t n_q = model.layers[il].wq->ne[1];
+                    const int64_t n_k = model.layers[il].wk->ne[1];
+                    const int64_t n_v = model.layers[il].wv->ne[1];
+                    Qcur = ggml_view_2d(ctx0, cur, n_q, n_tokens, cur->nb[1], 0);
+                    Kcur = ggml_view_2d(ctx0, cur, n_k, n_tokens, cur->nb[1], ggml_row_size(cur->type, n_q));
+                    Vcur = ggml_view_2d(ctx0, cur, n_v, n_tokens, cur->nb[1], ggml_row_size(cur->type, n_q + n_k));
+                } else {
+                    Qcur = llm_build_lora_mm(lctx, ctx0, model.layers[il].wq, cur);
+                    Kcur = llm_build_lora_mm(lctx, ctx0, model.layers[il].wk, cur);
+                    Vcur = llm_build_lora_mm(lctx, ctx0, model.layers[il].wv, cur);
+                }
                 cb(Qcur, "Qcur", il);
                 if (model.layers[il].bq) {
                     Qcur = ggml_add(ctx0, Qcur, model.layers[il].bq);
                     cb(Qcur, "Qcur", il);
                 }
 
-                struct ggml_tensor * Kcur = llm_build_lora_mm(lctx, ctx0, model.layers[il].wk, cur);
                 cb(Kcur, "Kcur", il);
                 if (model.layers[il].bk) {
                     Kcur = ggml_add(ctx0, Kcur, model.layers[il].bk);
                     cb(Kcur, "Kcur", il);
                 }
 
-                struct ggml_tensor * Vcur = llm_build_lora_mm(lctx, ctx0, model.layers[il].wv, cur);
                 cb(Vcur, "Vcur", il);
                 if (model.layers[il].bv) {
                     Vcur = ggml_add(ctx0, Vcur, model.layers[il].bv);
@@ -8683,14 +9215,14 @@ struct llm_build_context {
                 }
 
                 Qcur = ggml_rope_ext(
-                    ctx0, ggml_reshape_3d(ctx0, Qcur, n_embd_head, n_head, n_tokens), inp_pos, rope_factors,
+                    ctx0, ggml_view_3d(ctx0, Qcur, n_embd_head, n_head, n_tokens, Qcur->nb[0]*n_embd_head, Qcur->nb[1], 0), inp_pos, rope_factors,
                     n_rot, rope_type, n_ctx_orig, freq_base, freq_scale,
                     ext_factor, attn_factor, beta_fast, beta_slow
                 );
                 cb(Qcur, "Qcur", il);
 
                 Kcur = ggml_rope_ext(
-                    ctx0, ggml_reshape_3d(ctx0, Kcur, n_embd_head, n_head_kv, n_tokens), inp_pos, rope_factors,
+                    ctx0, ggml_view_3d(ctx0, Kcur, n_embd_head, n_head_kv, n_tokens, Kcur->nb[0]*n_embd_head, Kcur->nb[1], 0), inp_pos, rope_factors,
                     n_rot, rope_type, n_ctx_orig, freq_base, freq_scale,
                     ext_factor, attn_factor, beta_fast, beta_slow
                 );
@@ -8719,12 +9251,32 @@ struct llm_build_context {
                         LLM_NORM_RMS, cb, il);
                 cb(cur, "ffn_norm", il);
 
-                cur = llm_build_ffn(ctx0, lctx, cur,
-                        model.layers[il].ffn_up,   model.layers[il].ffn_up_b,   NULL,
-                        model.layers[il].ffn_gate, model.layers[il].ffn_gate_b, NULL,
-                        model.layers[il].ffn_down, model.layers[il].ffn_down_b, NULL,
-                        NULL,
-                        LLM_FFN_SILU, LLM_FFN_PAR, cb, il);
+                if (model.layers[il].ffn_gate_up && lctx.lora_adapters.empty()) {
+                    // [jart] weights were fused by --fuse-weights, and since
+                    //        they only run on cpu, silu and mul can read the
+                    //        two halves in place without ggml_cont()
+                    const int64_t n_ff = model.layers[il].ffn_gate->ne[1];
+                    cur = ggml_mul_mat(ctx0, model.layers[il].ffn_gate_up, cur);
+                    cb(cur, "ffn_gate_up", il);
+                    struct ggml_tensor * up = ggml_view_2d(ctx0, cur, n_ff, cur->ne[1], cur->nb[1], ggml_row_size(cur->type, n_ff));
+                    cur = ggml_view_2d(ctx0, cur, n_ff, cur->ne[1], cur->nb[1], 0);
+                    cur = ggml_silu(ctx0, cur);
+                    cb(cur, "ffn_silu", il);
+                    cur = ggml_mul(ctx0, cur, up);
+                    cb(cur, "ffn_gate_par", il);
+                    cur = ggml_mul_mat(ctx0, model.layers[il].ffn_down, cur);
+                    cb(cur, "ffn_down", il);
+                    if (model.layers[il].ffn_down_b) {
+                        cur = ggml_add(ctx0, cur, model.layers[il].ffn_down_b);
+                    }
+                } else {
+                    cur = llm_build_ffn(ctx0, lctx, cur,
+                            model.layers[il].ffn_up,   model.layers[il].ffn_up_b,   NULL,
+                            model.layers[il].ffn_gate, model.layers[il].ffn_gate_b, NULL,
+                            model.layers[il].ffn_down, model.layers[il].ffn_down_b, NULL,
+                            NULL,
+                            LLM_FFN_SILU, LLM_FFN_PAR, cb, il);
+                }
                 cb(cur, "ffn_out", il);
             } else {
                 // MoE branch
@@ -14603,10 +15155,14 @@ static size_t llama_output_reserve(llama_context & lctx, size_t n_outputs) {
 }
 
 
-static void llama_graph_compute(
+// [jart] graphs that update the kv cache in place, e.g. k-shift and
+//        defrag, must not be abortable since their callers clear the
+//        pending update afterwards; a partial run would corrupt cells
+static enum ggml_status llama_graph_compute(
         llama_context & lctx,
           ggml_cgraph * gf,
-                  int   n_threads) {
+                  int   n_threads,
+                 bool   abortable = true) {
 
     // [jart] resource management
     n_threads = g_core_manager.acquire(1, n_threads);
@@ -14624,7 +15180,11 @@ static void llama_graph_compute(
 
     if (lctx.backend_cpu != nullptr) {
         ggml_backend_cpu_set_n_threads(lctx.backend_cpu, n_threads);
-        ggml_backend_cpu_set_abort_callback(lctx.backend_cpu, lctx.abort_callback, lctx.abort_callback_data);
+        if (abortable) {
+            ggml_backend_cpu_set_abort_callback(lctx.backend_cpu, lctx.abort_callback, lctx.abort_callback_data);
+        } else {
+            ggml_backend_cpu_set_abort_callback(lctx.backend_cpu, nullptr, nullptr);
+        }
     }
 #ifdef GGML_USE_BLAS
     if (lctx.backend_blas != nullptr) {
@@ -14632,13 +15192,95 @@ static void llama_graph_compute(
     }
 #endif
 
-    ggml_backend_sched_graph_compute_async(lctx.sched, gf);
+    enum ggml_status status = ggml_backend_sched_graph_compute_async(lctx.sched, gf);
 
     // [jart] resources management
     cleanup.set(nullptr);
     g_core_manager.release((intptr_t)n_threads);
 
     // fprintf(stderr, "splits: %d\n", ggml_backend_sched_get_n_splits(lctx.sched));
+    return status;
+}
+
+// returns cached decode graph if its shape matches the upcoming ubatch
+static ggml_cgraph * llama_graph_cache_get(
+         llama_context & lctx,
+     const llama_batch & batch) {
+    auto & cache = lctx.graph_cache;
+    const auto & kv_self = lctx.kv_self;
+
+    if (!cache.gf ||
+        cache.n_tokens  != (uint32_t) batch.n_tokens ||
+        cache.n_outputs != (uint32_t) lctx.n_outputs ||
+        cache.n_kv      != kv_self.n ||
+        cache.has_token != (batch.token != nullptr)) {
+        return nullptr;
+    }
+
+    // move the kv store views to where find_slot() put the new cells
+    for (const auto & v : cache.kv_views) {
+        v.t->view_offs = v.offs + (size_t) kv_self.head*v.stride;
+        v.t->data = (char *) v.t->view_src->data + v.t->view_offs;
+    }
+
+    return cache.gf;
+}
+
+// remembers a freshly built and allocated decode graph for later reuse
+static void llama_graph_cache_put(
+         llama_context & lctx,
+     const llama_batch & batch,
+           ggml_cgraph * gf) {
+    auto & cache = lctx.graph_cache;
+    const auto & hparams = lctx.model.hparams;
+    const auto & cparams = lctx.cparams;
+    const auto & kv_self = lctx.kv_self;
+
+    cache.clear();
+
+    // recurrent state copies, encoder outputs and pooling have extra
+    // shape dependencies, and pipeline parallelism rotates its inputs
+    if (kv_self.recurrent ||
+        cparams.embeddings ||
+        llama_model_has_encoder(&lctx.model) ||
+        ggml_backend_sched_get_n_copies(lctx.sched) != 1) {
+        return;
+    }
+
+    std::unordered_map<const ggml_tensor *, size_t> strides;
+    for (size_t il = 0; il < kv_self.k_l.size(); ++il) {
+        strides[kv_self.k_l[il]] = ggml_row_size(kv_self.k_l[il]->type, hparams.n_embd_k_gqa(il));
+        strides[kv_self.v_l[il]] = cparams.flash_attn
+            ? ggml_row_size(kv_self.v_l[il]->type, hparams.n_embd_v_gqa(il))
+            : ggml_element_size(kv_self.v_l[il]); // transposed
+    }
+
+    // find the ggml_cpy() nodes created by llm_build_kv_store()
+    for (int i = 0; i < gf->n_nodes; ++i) {
+        ggml_tensor * node = gf->nodes[i];
+        if (node->op != GGML_OP_CPY || !node->view_src) {
+            continue;
+        }
+        auto it = strides.find(node->view_src);
+        if (it == strides.end()) {
+            continue;
+        }
+        const size_t stride = it->second;
+        const size_t offs = (size_t) kv_self.head*stride;
+        for (ggml_tensor * t : {node, node->src[1]}) {
+            if (t->view_src != node->view_src || t->view_offs < offs) {
+                cache.kv_views.clear();
+                return;
+            }
+            cache.kv_views.push_back({t, t->view_offs - offs, stride});
+        }
+    }
+
+    cache.gf        = gf;
+    cache.n_tokens  = batch.n_tokens;
+    cache.n_outputs = lctx.n_outputs;
+    cache.n_kv      = kv_self.n;
+    cache.has_token = batch.token != nullptr;
 }
 
 struct llama_coder {
@@ -14659,6 +15301,44 @@ struct llama_coder {
 // return positive int on warning
 // return negative int on error
 //
+// [jart] undoes the cells claimed by a decode that couldn't finish, so
+//        the cache is left the way it was before
+static void llama_kv_cache_unclaim(
+                    llama_context & lctx,
+    const std::vector<std::pair<uint32_t, uint32_t>> & claimed) {
+    auto & kv_self = lctx.kv_self;
+    for (const auto & span : claimed) {
+        for (uint32_t i = 0; i < span.second; ++i) {
+            llama_kv_cell & cell = kv_self.cells[span.first + i];
+            if (cell.pos >= 0) {
+                cell.pos = -1;
+                cell.seq_id.clear();
+                kv_self.used--;
+            }
+        }
+    }
+    if (!claimed.empty()) {
+        kv_self.head = claimed.front().first;
+        llama_kv_cache_trim(kv_self);
+    }
+    lctx.n_outputs = 0;
+}
+
+// [jart] waits for rpc backends and returns true if any graph they were
+//        given since the last check failed
+static bool llama_rpc_failed(llama_context & lctx) {
+    bool failed = false;
+#if defined(GGML_USE_RPC)
+    for (ggml_backend_t backend : lctx.backends) {
+        if (ggml_backend_is_rpc(backend)) {
+            failed |= ggml_backend_rpc_failed(backend);
+        }
+    }
+#endif
+    return failed;
+    GGML_UNUSED(lctx);
+}
+
 static int llama_decode_internal(
          llama_context & lctx,
          llama_batch   batch_all,
@@ -14697,6 +15377,9 @@ static int llama_decode_internal(
 
     const auto n_ubatch = cparams.n_ubatch;
 
+    // [jart] kv cells claimed by each ubatch, so an abort can undo them
+    std::vector<std::pair<uint32_t, uint32_t>> claimed;
+
     // [jart] delete
     // // TODO: simplify or deprecate
     // std::vector<llama_pos> pos;
@@ -14819,6 +15502,8 @@ static int llama_decode_internal(
             }
 
             if (!kv_self.recurrent) {
+                claimed.push_back({kv_self.head, n_tokens}); // [jart]
+
                 // a heuristic, to avoid attending the full cache if it is not yet utilized
                 // after enough generations, the benefit from this heuristic disappears
                 // if we start defragmenting the cache, the benefit from this will be more important
@@ -14830,10 +15515,16 @@ static int llama_decode_internal(
 
         //printf("kv_self.n = %5d, kv_self.used = %5d, kv_self.head = %5d\n", kv_self.n, kv_self.used, kv_self.head);
 
-        ggml_backend_sched_reset(lctx.sched);
         ggml_backend_sched_set_eval_callback(lctx.sched, lctx.cparams.cb_eval, lctx.cparams.cb_eval_user_data);
 
-        ggml_cgraph * gf = llama_build_graph(lctx, u_batch, false);
+        // [jart] reuse the previous graph and its allocation if possible
+        ggml_cgraph * gf = llama_graph_cache_get(lctx, u_batch);
+        if (!gf) {
+            ggml_backend_sched_reset(lctx.sched);
+            gf = llama_build_graph(lctx, u_batch, false);
+            ggml_backend_sched_alloc_graph(lctx.sched, gf);
+            llama_graph_cache_put(lctx, u_batch, gf);
+        }
 
         // the output is always the last tensor in the graph
         struct ggml_tensor * res  = gf->nodes[gf->n_nodes - 1];
@@ -14859,11 +15550,21 @@ static int llama_decode_internal(
         }
         // LLAMA_LOG_INFO("graph build time: %.3f ms (%d nodes, %d leafs)\n", (ggml_time_us() - t_start_us)/1000.0, gf->n_nodes, gf->n_leafs);
 
-        ggml_backend_sched_alloc_graph(lctx.sched, gf);
-
         llama_set_inputs(lctx, u_batch);
 
-        llama_graph_compute(lctx, gf, n_threads);
+        // [jart] the abort callback may stop us in the middle of a graph,
+        //        or a backend may fail to compute it. undo the cells
+        //        claimed by this call so the cache is left the way it was
+        //        before, and the caller can simply move on.
+        enum ggml_status status = llama_graph_compute(lctx, gf, n_threads);
+        if (status != GGML_STATUS_SUCCESS) {
+            llama_kv_cache_unclaim(lctx, claimed);
+            if (status == GGML_STATUS_ABORTED) {
+                return 2;
+            }
+            LLAMA_LOG_ERROR("%s: graph compute failed with status %d\n", __func__, status);
+            return -3;
+        }
 
         // update the kv ring buffer
         {
@@ -14947,6 +15648,15 @@ static int llama_decode_internal(
     // wait for the computation to finish (automatically done when obtaining the model output)
     //llama_synchronize(&lctx);
 
+    // [jart] rpc workers only report failures once they're waited on,
+    //        which usually happens after the graph compute that failed
+    //        returned success, so check here before the outputs get used
+    if (llama_rpc_failed(lctx)) {
+        llama_kv_cache_unclaim(lctx, claimed);
+        LLAMA_LOG_ERROR("%s: remote graph compute failed\n", __func__);
+        return -3;
+    }
+
     // decide if we need to defrag the kv cache
     if (cparams.causal_attn && cparams.defrag_thold >= 0.0f) {
         const float fragmentation = kv_self.n >= 128 ? 1.0f - float(kv_self.used)/float(kv_self.n) : 0.0f;
@@ -14961,7 +15671,9 @@ static int llama_decode_internal(
 
     // Reset state for the next token before backend sync, to allow the CPU activities in the reset to
     // overlap with device computation.
-    ggml_backend_sched_reset(lctx.sched);
+    if (!lctx.graph_cache.gf) { // [jart] keep allocation of cached graph
+        ggml_backend_sched_reset(lctx.sched);
+    }
 
     return 0;
 }
@@ -15363,9 +16075,13 @@ static void llama_kv_cache_defrag_internal(struct llama_context & lctx) {
 
     ggml_cgraph * gf = llama_build_graph_defrag(lctx, ids);
 
-    llama_graph_compute(lctx, gf, lctx.cparams.n_threads);
+    llama_graph_compute(lctx, gf, lctx.cparams.n_threads, false);
 #endif
 
+    // cells were moved down into holes, which leaves the end empty
+    llama_kv_cache_page_in(kv_self, 0, n_used);
+    llama_kv_cache_trim(kv_self);
+
     //const int64_t t_end = ggml_time_us();
 
     //LLAMA_LOG_INFO("(tmp log) KV defrag time: %.3f ms\n", (t_end - t_start)/1000.0);
@@ -15389,7 +16105,7 @@ static void llama_kv_cache_update_internal(struct llama_context & lctx) {
 
             llama_set_k_shift(lctx);
 
-            llama_graph_compute(lctx, gf, lctx.cparams.n_threads);
+            llama_graph_compute(lctx, gf, lctx.cparams.n_threads, false);
 
             need_reserve = true;
         }
@@ -15415,7 +16131,7 @@ static void llama_kv_cache_update_internal(struct llama_context & lctx) {
 
             llama_set_s_copy(lctx);
 
-            llama_graph_compute(lctx, gf, lctx.cparams.n_threads);
+            llama_graph_compute(lctx, gf, lctx.cparams.n_threads, false);
 
             need_reserve = true;
         }
@@ -16503,6 +17219,7 @@ int32_t llama_lora_adapter_set(
         return -1;
     }
     ctx->lora_adapters[adapter] = scale;
+    ctx->graph_cache.clear();
     return 0;
 }
 
@@ -16512,6 +17229,7 @@ int32_t llama_lora_adapter_remove(
     auto pos = ctx->lora_adapters.find(adapter);
     if (pos != ctx->lora_adapters.end()) {
         ctx->lora_adapters.erase(pos);
+        ctx->graph_cache.clear();
         return 0;
     }
     return -1;
@@ -16519,6 +17237,7 @@ int32_t llama_lora_adapter_remove(
 
 void llama_lora_adapter_clear(struct llama_context * ctx) {
     ctx->lora_adapters.clear();
+    ctx->graph_cache.clear();
 }
 
 void llama_lora_adapter_free(struct llama_lora_adapter * adapter) {
@@ -16705,6 +17424,19 @@ struct llama_model * llama_load_model_from_file(
         }
         model->rpc_servers.push_back(servers);
     }
+#if defined(GGML_USE_RPC)
+    // [jart] fail now if a worker can't be reached, since layers would
+    //        otherwise be assigned to a buffer type that doesn't exist
+    if (params.n_gpu_layers > 0) {
+        for (const auto & endpoint : model->rpc_servers) {
+            if (ggml_backend_rpc_buffer_type(endpoint.c_str()) == nullptr) {
+                LLAMA_LOG_ERROR("%s: failed to connect to RPC server '%s'\n", __func__, endpoint.c_str());
+                delete model;
+                return nullptr;
+            }
+        }
+    }
+#endif
     int status = llama_model_load(path_model, *model, params);
     GGML_ASSERT(status <= 0);
     if (status < 0) {
@@ -17089,9 +17821,9 @@ struct llama_context * llama_new_context_with_model(
                 model->split_mode == LLAMA_SPLIT_MODE_LAYER &&
                 params.offload_kqv;
 // #ifndef GGML_USE_CUDA
-            if (!llamafile_has_cuda())
-            // pipeline parallelism requires support for async compute and events
-            // currently this is only implemented in the CUDA backend
+            if (!llamafile_has_cuda() && model->rpc_servers.empty())
+            // pipeline parallelism requires support for async compute
+            // currently this is only implemented in the CUDA and RPC backends
             pipeline_parallel = false;
 // #endif
             ctx->sched = ggml_backend_sched_new(ctx->backends.data(), backend_buft.data(), ctx->backends.size(), max_nodes, pipeline_parallel);
@@ -17432,6 +18164,8 @@ int32_t llama_control_vector_apply(struct llama_context * lctx, const float * da
     const llama_model & model = lctx->model;
     llama_control_vector & cvec = lctx->cvec;
 
+    lctx->graph_cache.clear();
+
     if (data == nullptr) {
         // disable the current control vector (but leave allocated for later)
         cvec.layer_start = -1;
@@ -17605,6 +18339,10 @@ void llama_kv_cache_seq_div(struct llama_context * ctx, llama_seq_id seq_id, lla
     llama_kv_cache_seq_div(ctx->kv_self, seq_id, p0, p1, d);
 }
 
+void llama_kv_cache_seq_apply(struct llama_context * ctx, llama_kv_seq * seqs, int32_t n_seqs) {
+    llama_kv_cache_seq_apply(ctx->kv_self, seqs, n_seqs);
+}
+
 llama_pos llama_kv_cache_seq_pos_max(struct llama_context * ctx, llama_seq_id seq_id) {
     return llama_kv_cache_seq_pos_max(ctx->kv_self, seq_id);
 }
@@ -18031,6 +18769,8 @@ struct llama_data_read {
 
             kv_self.head = 0;
             kv_self.used = cell_count;
+
+            llama_kv_cache_page_in(kv_self, 0, cell_count);
         }
 
         return true;
@@ -18575,10 +19315,12 @@ void llama_set_abort_callback(struct llama_context * ctx, bool (*abort_callback)
 
 void llama_set_embeddings(struct llama_context * ctx, bool embeddings) {
     ctx->cparams.embeddings = embeddings;
+    ctx->graph_cache.clear();
 }
 
 void llama_set_causal_attn(struct llama_context * ctx, bool causal_attn) {
     ctx->cparams.causal_attn = causal_attn;
+    ctx->graph_cache.clear();
 }
 
 struct llama_batch llama_batch_get_one(
@@ -18900,6 +19642,20 @@ int32_t llama_tokenize(
     return llama_tokenize_impl(model->vocab, text, text_len, tokens, n_tokens_max, add_special, parse_special);
 }
 
+const char * llama_token_get_piece(
+    const struct llama_model * model,
+                 llama_token   token,
+                     int32_t * length,
+                     int32_t * flags) {
+    const auto & cache = model->vocab.cache_token_to_piece;
+    if ((size_t) token >= cache.flags.size()) {
+        return nullptr;
+    }
+    *length = cache.offs[token + 1] - cache.offs[token] - 1;
+    *flags  = cache.flags[token];
+    return cache.blob.data() + cache.offs[token];
+}
+
 int32_t llama_token_to_piece(
     const struct llama_model * model,
                  llama_token   token,
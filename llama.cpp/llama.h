@@ -130,6 +130,13 @@ extern "C" {
         LLAMA_TOKEN_ATTR_SINGLE_WORD  = 1 << 9,
     };
 
+    // [jart] properties of the text of a token, see llama_token_get_piece()
+    enum llama_piece_flags {
+        LLAMA_PIECE_SPECIAL    = 1 << 0, // control or unknown; only rendered when special
+        LLAMA_PIECE_BYTE       = 1 << 1, // byte fallback token, e.g. <0xE2>
+        LLAMA_PIECE_INCOMPLETE = 1 << 2, // not valid utf-8 on its own
+    };
+
     // model file types
     enum llama_ftype {
         LLAMA_FTYPE_ALL_F32              = 0,
@@ -680,6 +687,31 @@ extern "C" {
                        llama_pos   p1,
                              int   d);
 
+    // Context management policy of one sequence, see llama_kv_cache_seq_apply()
+    typedef struct llama_kv_seq {
+        llama_seq_id seq_id;
+        llama_pos    n_past;    // position of the next token (updated)
+        int32_t      n_tokens;  // number of tokens about to be decoded
+        int32_t      n_ctx;     // positions this sequence may span
+        int32_t      n_keep;    // leading positions (attention sinks) never evicted
+        int32_t      n_discard; // positions evicted per shift, or 0 for half of the rest
+        int32_t      ga_n;      // self-extend group factor, or 1 for a sliding window
+        int32_t      ga_w;      // self-extend group width
+        int32_t      ga_i;      // self-extend progress (updated)
+        int32_t      n_evicted; // set to the number of positions evicted
+    } llama_kv_seq;
+
+    // Makes room for the next n_tokens of many sequences at once
+    // With ga_n == 1 and n_past + n_tokens > n_ctx, positions [n_keep, n_keep + n_discard)
+    // are removed and the rest are moved down, i.e. a sliding window with attention sinks
+    // With ga_n > 1, positions at or beyond ga_i + ga_w are grouped using self-extend
+    // The edits of every sequence are applied in a single pass over the KV cache
+    // n_past is not advanced by n_tokens, that's up to the caller once decoded
+    LLAMA_API void llama_kv_cache_seq_apply(
+            struct llama_context * ctx,
+                    llama_kv_seq * seqs,
+                         int32_t   n_seqs);
+
     // Returns the largest position present in the KV cache for the specified sequence
     LLAMA_API llama_pos llama_kv_cache_seq_pos_max(
             struct llama_context * ctx,
@@ -832,6 +864,8 @@ extern "C" {
     // Positive return values does not mean a fatal error, but rather a warning.
     //   0 - success
     //   1 - could not find a KV slot for the batch (try reducing the size of the batch or increase the context)
+    //   2 - aborted by the abort callback; KV cells claimed by the batch are released again
+    //  -3 - a backend failed to compute the graph; KV cells are released as above
     // < 0 - error
     LLAMA_API int32_t llama_decode(
             struct llama_context * ctx,
@@ -963,6 +997,17 @@ extern "C" {
                                int32_t   lstrip,
                                   bool   special);
 
+    // [jart] Token Id -> Piece, without copying.
+    // Returns the text llama_token_to_piece() would render with special = true,
+    // which remains valid for the lifetime of the model, and is nul-terminated.
+    // Its length is stored to *length and its llama_piece_flags to *flags.
+    // Returns NULL if token isn't in the vocabulary.
+    LLAMA_API const char * llama_token_get_piece(
+              const struct llama_model * model,
+                           llama_token   token,
+                               int32_t * length,
+                               int32_t * flags);
+
     /// @details Convert the provided tokens into text (inverse of llama_tokenize()).
     /// @param text The char pointer must be large enough to hold the resulting text.
     /// @return Returns the number of chars/bytes on success, no more than text_len_max.
@@ -1193,6 +1238,7 @@ extern "C" {
 
 #include <random>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct ggml_tensor;
@@ -1234,7 +1280,7 @@ std::vector<llama_grammar_candidate> llama_grammar_reject_candidates_for_stack(
         const llama_grammar_candidates & candidates);
 
 std::pair<std::vector<uint32_t>, llama_partial_utf8> decode_utf8(
-        const std::string & src,
+        std::string_view src,
         llama_partial_utf8 partial_start);
 
 // Randomly selects a token from the candidates based on their probabilities using given std::mt19937.
@@ -150,6 +150,7 @@ enum Program {
     SERVER,
     CHATBOT,
     EMBEDDING,
+    RPC_SERVER,
 };
 
 enum Program determine_program(char *argv[]) {
@@ -163,6 +164,8 @@ enum Program determine_program(char *argv[]) {
             prog = SERVER;
         } else if (!strcmp(argv[i], "--embedding")) {
             prog = EMBEDDING;
+        } else if (!strcmp(argv[i], "--rpc-server")) {
+            prog = RPC_SERVER;
         }
     }
     return prog;
@@ -195,6 +198,11 @@ int main(int argc, char ** argv) {
     if (prog == SERVER)
         return server_cli(argc, argv);
 
+    if (prog == RPC_SERVER) {
+        int rpc_server_cli(int, char **);
+        return rpc_server_cli(argc, argv);
+    }
+
     if (prog == CHATBOT ||
         (prog == UNKNOWN &&
          !llamafile_has(argv, "-p") &&
@@ -0,0 +1,53 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+
+#include "llama.cpp/common.h"
+#include "llama.cpp/ggml-backend.h"
+#include "llama.cpp/ggml-rpc.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/trust.h"
+
+#include <cstdio>
+#include <string>
+
+// [jart] runs this process as a worker which other llamafile processes
+//        may offload layers to by passing `--rpc HOST:PORT,...` which
+//        is useful for serving models that don't fit on one machine
+int rpc_server_cli(int argc, char ** argv) {
+    gpt_params params;
+
+    if (!gpt_params_parse(argc, argv, params)) {
+        return 1;
+    }
+
+    if (!llamafile_has(argv, "--port")) {
+        params.port = 50052;
+    }
+
+    long ip = parse_ip(params.hostname);
+    if (ip == -1 || !is_loopback_ip(ip)) {
+        fprintf(stderr, "%s: warning: rpc workers trust their clients, so only "
+                        "expose %s to networks you trust\n", __func__, params.hostname.c_str());
+    }
+
+    llama_backend_init();
+
+    ggml_backend_t backend = ggml_backend_cpu_init();
+    if (!backend) {
+        fprintf(stderr, "%s: failed to initialize cpu backend\n", __func__);
+        return 1;
+    }
+    ggml_backend_cpu_set_n_threads(backend, params.n_threads);
+
+    size_t free_mem;
+    size_t total_mem;
+    ggml_backend_rpc_get_host_memory(&free_mem, &total_mem);
+
+    std::string endpoint = params.hostname + ":" + std::to_string(params.port);
+    ggml_backend_rpc_start_server(backend, endpoint.c_str(), free_mem, total_mem);
+
+    ggml_backend_free(backend);
+    llama_backend_free();
+    return 1;
+}
@@ -3,6 +3,8 @@
 
 #define LLAMA_API_INTERNAL
 #include "sampling.h"
+#include "ggml-vector.h"
+#include <algorithm>
 #include <random>
 #include <cosmo.h>
 
@@ -267,6 +269,213 @@ static void sampler_queue(
     }
 }
 
+// [jart] returns k-th largest logit, or -INFINITY if there's fewer
+//
+// this keeps a small buffer of logits that might be in the top k and
+// raises the threshold for getting in whenever the buffer fills up, so
+// most of the vocabulary is rejected by a simd compare with no copying
+static float llama_sampling_kth_largest(
+        struct llama_sampling_context * ctx_sampling,
+                          const float * logits,
+                                  int   n_vocab,
+                                  int   k) {
+    const int chunk = 4096;
+    const int cap   = std::max(k * 4, chunk);
+    auto & ids = ctx_sampling->ids;
+    auto & top = ctx_sampling->top;
+    if ((int) ids.size() < std::max(n_vocab, cap + chunk)) {
+        ids.resize(std::max(n_vocab, cap + chunk));
+    }
+    if ((int) top.size() < cap + chunk) {
+        top.resize(cap + chunk);
+    }
+    float t = -INFINITY;
+    int n = 0;
+    for (int i = 0; i < n_vocab; i += chunk) {
+        const int m = ggml_vec_select_ge_f32(std::min(chunk, n_vocab - i), ids.data(), logits + i, t);
+        if ((int) top.size() < n + m) {
+            top.resize(n + m); // lots of ties
+        }
+        for (int j = 0; j < m; ++j) {
+            top[n++] = logits[i + ids[j]];
+        }
+        if (n >= cap) {
+            std::nth_element(top.begin(), top.begin() + k - 1, top.begin() + n, std::greater<float>());
+            t = top[k - 1];
+            n = std::remove_if(top.begin(), top.begin() + n, [t](float x) { return x < t; }) - top.begin();
+        }
+    }
+    if (n < k) {
+        return -INFINITY;
+    }
+    std::nth_element(top.begin(), top.begin() + k - 1, top.begin() + n, std::greater<float>());
+    return top[k - 1];
+}
+
+// [jart] samples without building a llama_token_data for every token
+//
+// most sampler chains begin truncating with top-k or min-p, which only
+// look at how a token's logit compares to the biggest logits. that lets
+// us find a threshold using simd passes over the raw logits, and compact
+// tokens above it into a small candidate array, in vocabulary order. the
+// samplers then run on that array unmodified and make the same choices
+// they'd make on the whole vocabulary. returns false if the chain needs
+// the whole vocabulary (e.g. top-p first, tail free, grammar, mirostat)
+// in which case nothing is modified.
+static bool llama_sampling_prepare_fast(
+        struct llama_sampling_context * ctx_sampling,
+                 struct llama_context * ctx_main,
+                 struct llama_context * ctx_cfg,
+                                  int   idx,
+               llama_token_data_array * cur_p) {
+    const llama_sampling_params & params = ctx_sampling->params;
+
+    if (ctx_sampling->grammar || ctx_cfg || params.mirostat) {
+        return false;
+    }
+
+    const int    n_vocab  = llama_n_vocab(llama_get_model(ctx_main));
+    const size_t min_keep = std::max(1, params.min_keep);
+
+    // find first sampler that truncates
+    int   top_k = 0;
+    float min_p = 0;
+    float scale = 1;
+    if (params.temp == 0) {
+        if (params.n_probs) {
+            return false; // server wants softmax of the whole vocabulary
+        }
+        top_k = 1;
+    } else if (params.temp < 0) {
+        return false;
+    } else {
+        for (auto sampler_type : params.samplers_sequence) {
+            switch (sampler_type) {
+                case llama_sampler_type::TOP_K:
+                    if (params.top_k > 0) {
+                        top_k = std::max(params.top_k, (int) min_keep);
+                    }
+                    break;
+                case llama_sampler_type::MIN_P:
+                    if (params.min_p > 0) {
+                        min_p = params.min_p;
+                    }
+                    break;
+                case llama_sampler_type::TEMPERATURE:
+                    if (params.dynatemp_range > 0) {
+                        return false;
+                    }
+                    scale = params.temp;
+                    break;
+                case llama_sampler_type::TFS_Z:
+                    if (params.tfs_z < 1) {
+                        return false;
+                    }
+                    break;
+                case llama_sampler_type::TYPICAL_P:
+                    if (params.typical_p < 1) {
+                        return false;
+                    }
+                    break;
+                case llama_sampler_type::TOP_P:
+                    if (params.top_p < 1) {
+                        return false;
+                    }
+                    break;
+                default:
+                    return false;
+            }
+            if (top_k || min_p) {
+                break;
+            }
+        }
+        if (!min_p && (!top_k || top_k >= n_vocab)) {
+            return false;
+        }
+    }
+
+    float * logits = llama_get_logits_ith(ctx_main, idx);
+
+    // apply params.logit_bias map
+    for (auto it = params.logit_bias.begin(); it != params.logit_bias.end(); it++) {
+        logits[it->first] += it->second;
+    }
+
+    // penalties only change a few logits, so apply them in place and
+    // put the old values back once candidates have been copied
+    auto & penalized = ctx_sampling->penalized;
+    size_t n_penalized = 0;
+    const int32_t penalty_last_n = params.penalty_last_n < 0 ? params.n_prev : params.penalty_last_n;
+    const auto & penalty_tokens = params.use_penalty_prompt_tokens ? params.penalty_prompt_tokens : ctx_sampling->prev;
+    const int penalty_tokens_used_size = std::min((int)penalty_tokens.size(), penalty_last_n);
+    if (penalty_tokens_used_size) {
+        const llama_token * last_tokens = penalty_tokens.data() + penalty_tokens.size() - penalty_tokens_used_size;
+        penalized.clear();
+        for (int i = 0; i < penalty_tokens_used_size; ++i) {
+            if (0 <= last_tokens[i] && last_tokens[i] < n_vocab) {
+                penalized.push_back(llama_token_data{last_tokens[i], logits[last_tokens[i]], 0.0f});
+            }
+        }
+        std::sort(penalized.begin(), penalized.end(), [](const llama_token_data & a, const llama_token_data & b) {
+            return a.id < b.id;
+        });
+        n_penalized = std::unique(penalized.begin(), penalized.end(), [](const llama_token_data & a, const llama_token_data & b) {
+            return a.id == b.id;
+        }) - penalized.begin();
+        penalized.resize(n_penalized * 2);
+        std::copy(penalized.begin(), penalized.begin() + n_penalized, penalized.begin() + n_penalized);
+        llama_token_data_array pen_p = { penalized.data(), n_penalized, false };
+        llama_sample_repetition_penalties(ctx_main, &pen_p, last_tokens, penalty_tokens_used_size,
+                                          params.penalty_repeat, params.penalty_freq, params.penalty_present);
+        const llama_token nl = llama_token_nl(llama_get_model(ctx_main));
+        for (size_t i = 0; i < n_penalized; ++i) {
+            if (params.penalize_nl || penalized[i].id != nl) {
+                logits[penalized[i].id] = penalized[i].logit;
+            }
+        }
+    }
+
+    // pick a threshold that keeps every token which could survive
+    float t;
+    if (top_k) {
+        t = llama_sampling_kth_largest(ctx_sampling, logits, n_vocab, top_k);
+    } else {
+        ggml_vec_max_f32(n_vocab, &t, logits);
+        t += logf(min_p) * scale;
+        t -= 1e-3f * (1 + fabsf(t)); // min_p decides for real later
+    }
+
+    // compact candidates in vocabulary order
+    auto & ids = ctx_sampling->ids;
+    if ((int) ids.size() < n_vocab) {
+        ids.resize(n_vocab);
+    }
+    int n = ggml_vec_select_ge_f32(n_vocab, ids.data(), logits, t);
+    if (n < (int) min_keep) {
+        // min_p would keep the top min_keep tokens instead
+        t = std::min(t, llama_sampling_kth_largest(ctx_sampling, logits, n_vocab, std::min((int) min_keep, n_vocab)));
+        n = ggml_vec_select_ge_f32(n_vocab, ids.data(), logits, t);
+    }
+    if (!n) {
+        for (int i = 0; i < n_vocab; ++i) {
+            ids[i] = i; // every logit is nan
+        }
+        n = n_vocab;
+    }
+    auto & cur = ctx_sampling->cur;
+    cur.resize(n);
+    for (int i = 0; i < n; ++i) {
+        cur[i] = llama_token_data{ids[i], logits[ids[i]], 0.0f};
+    }
+
+    for (size_t i = 0; i < n_penalized; ++i) {
+        logits[penalized[n_penalized + i].id] = penalized[n_penalized + i].logit;
+    }
+
+    *cur_p = { cur.data(), cur.size(), false };
+    return true;
+}
+
 static llama_token llama_sampling_sample_impl(
                   struct llama_sampling_context * ctx_sampling,
                   struct llama_context * ctx_main,
@@ -281,7 +490,10 @@ static llama_token llama_sampling_sample_impl(
     const float   mirostat_eta    = params.mirostat_eta;
 
     std::vector<float> original_logits;
-    auto cur_p = llama_sampling_prepare(ctx_sampling, ctx_main, ctx_cfg, idx, /* apply_grammar= */ is_resampling, &original_logits);
+    llama_token_data_array cur_p;
+    if (!llama_sampling_prepare_fast(ctx_sampling, ctx_main, ctx_cfg, idx, &cur_p)) {
+        cur_p = llama_sampling_prepare(ctx_sampling, ctx_main, ctx_cfg, idx, /* apply_grammar= */ is_resampling, &original_logits);
+    }
     if (ctx_sampling->grammar != NULL && !is_resampling) {
         GGML_ASSERT(!original_logits.empty());
     }
@@ -83,6 +83,11 @@ struct llama_sampling_context {
     std::vector<llama_token_data> cur;
     size_t n_valid; // Number of correct top tokens with correct probabilities.
 
+    // [jart] scratch space for the fast path, so sampling doesn't allocate
+    std::vector<int>              ids;
+    std::vector<float>            top;
+    std::vector<llama_token_data> penalized;
+
     std::mt19937 rng;
 };
 
@@ -0,0 +1,182 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define LLAMA_API_INTERNAL
+#include "llama.h"
+#include "llamafile/llamafile.h"
+#include "sampling.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// checks llama_sampling_sample() picks the same tokens when it compacts
+// candidates (e.g. top-k or min-p first) as it would if every token of
+// the vocabulary were given to the samplers like upstream does.
+
+#define MODEL "models/TinyLLama-v0.1-5M-F16.gguf"
+#define TOKENS 64
+#define SAMPLES 200
+
+static llama_model *g_model;
+static llama_context *g_ctx;
+static std::vector<float> g_logits;
+
+// puts logits back, since logit_bias is added to them in place
+static void restore(int idx) {
+    int n_vocab = llama_n_vocab(g_model);
+    std::copy_n(g_logits.begin() + idx * n_vocab, n_vocab, llama_get_logits_ith(g_ctx, idx));
+}
+
+// samples the slow way, using the public samplers on every token
+static llama_token sample_full(llama_sampling_context *ctx_sampling, int idx) {
+    const llama_sampling_params &params = ctx_sampling->params;
+    size_t min_keep = std::max(1, params.min_keep);
+    llama_token_data_array cur_p = llama_sampling_prepare(ctx_sampling, g_ctx, nullptr, idx, false);
+    if (params.temp == 0)
+        return llama_sample_token_greedy(g_ctx, &cur_p);
+    for (auto sampler_type : params.samplers_sequence) {
+        switch (sampler_type) {
+            case llama_sampler_type::TOP_K:
+                llama_sample_top_k(g_ctx, &cur_p, params.top_k, min_keep);
+                break;
+            case llama_sampler_type::TFS_Z:
+                llama_sample_tail_free(g_ctx, &cur_p, params.tfs_z, min_keep);
+                break;
+            case llama_sampler_type::TYPICAL_P:
+                llama_sample_typical(g_ctx, &cur_p, params.typical_p, min_keep);
+                break;
+            case llama_sampler_type::TOP_P:
+                llama_sample_top_p(g_ctx, &cur_p, params.top_p, min_keep);
+                break;
+            case llama_sampler_type::MIN_P:
+                llama_sample_min_p(g_ctx, &cur_p, params.min_p, min_keep);
+                break;
+            case llama_sampler_type::TEMPERATURE:
+                llama_sample_temp(g_ctx, &cur_p, params.temp);
+                break;
+            default:
+                break;
+        }
+    }
+    return llama_sample_token_with_rng(g_ctx, &cur_p, ctx_sampling->rng);
+}
+
+// samples both ways with identical state many times, for each position
+static void check(const llama_sampling_params &params, int fail) {
+    llama_sampling_context *fast = llama_sampling_init(params);
+    llama_sampling_context *full = llama_sampling_init(params);
+    for (int i = 0; i < SAMPLES; ++i) {
+        int idx = i % TOKENS;
+        restore(idx);
+        llama_token a = llama_sampling_sample(fast, g_ctx, nullptr, idx);
+        restore(idx);
+        llama_token b = sample_full(full, idx);
+        if (a != b) {
+            fprintf(stderr, "sample %d at %d picked %d but full vocab picked %d\n", i, idx, a, b);
+            exit(fail);
+        }
+        llama_sampling_accept(fast, g_ctx, a, false);
+        llama_sampling_accept(full, g_ctx, b, false);
+    }
+    llama_sampling_free(full);
+    llama_sampling_free(fast);
+}
+
+static llama_sampling_params chain(std::vector<llama_sampler_type> samplers) {
+    llama_sampling_params params;
+    params.seed = 42;
+    params.samplers_sequence = samplers;
+    params.penalty_repeat = 1.3f;
+    params.penalty_freq = .2f;
+    params.penalty_present = .1f;
+    params.penalize_nl = false;
+    return params;
+}
+
+int main() {
+    FLAGS_READY = true;
+    llama_backend_init();
+    llama_model_params mparams = llama_model_default_params();
+    if (!(g_model = llama_load_model_from_file(MODEL, mparams)))
+        return 1;
+    llama_context_params cparams = llama_context_default_params();
+    cparams.n_ctx = TOKENS;
+    if (!(g_ctx = llama_new_context_with_model(g_model, cparams)))
+        return 2;
+    llama_batch batch = llama_batch_init(TOKENS, 0, 1);
+    for (int i = 0; i < TOKENS; ++i) {
+        batch.token[i] = 1 + i * 37 % 1000;
+        batch.pos[i] = i;
+        batch.n_seq_id[i] = 1;
+        batch.seq_id[i][0] = 0;
+        batch.logits[i] = true;
+    }
+    batch.n_tokens = TOKENS;
+    if (llama_decode(g_ctx, batch))
+        return 3;
+    for (int i = 0; i < TOKENS; ++i) {
+        float *logits = llama_get_logits_ith(g_ctx, i);
+        g_logits.insert(g_logits.end(), logits, logits + llama_n_vocab(g_model));
+    }
+
+    using st = llama_sampler_type;
+
+    // the default chain, which truncates with top-k first
+    llama_sampling_params params = chain({st::TOP_K, st::TFS_Z, st::TYPICAL_P, st::TOP_P,
+                                          st::MIN_P, st::TEMPERATURE});
+    params.top_k = 40;
+    params.top_p = .9f;
+    params.min_p = .05f;
+    params.temp = 1.5f;
+    check(params, 10);
+
+    // min-p first, with temperature already applied to its threshold
+    params = chain({st::TEMPERATURE, st::MIN_P, st::TOP_K, st::TOP_P});
+    params.top_k = 0;
+    params.top_p = .95f;
+    params.min_p = .02f;
+    params.temp = .7f;
+    check(params, 11);
+
+    // min-p so strict that min_keep decides
+    params = chain({st::MIN_P, st::TEMPERATURE});
+    params.min_p = .999f;
+    params.min_keep = 5;
+    params.temp = 3;
+    check(params, 12);
+
+    // top-k bigger than anything the fast path keeps in its buffer
+    params = chain({st::TOP_K, st::TOP_P, st::TEMPERATURE});
+    params.top_k = 5000;
+    params.top_p = .99f;
+    params.temp = 1;
+    check(params, 13);
+
+    // greedy, which is top-k of one
+    params = chain({st::TOP_K, st::TEMPERATURE});
+    params.temp = 0;
+    params.logit_bias[100] = 5;
+    check(params, 14);
+
+    llama_batch_free(batch);
+    llama_free(g_ctx);
+    llama_free_model(g_model);
+    llama_backend_free();
+}
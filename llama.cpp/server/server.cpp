@@ -1681,43 +1681,56 @@ struct llama_server_context
         task.target_id = -1;
         queue_tasks.post(task);
 
+        // shift the context of every slot that's full, all at once
+        std::vector<llama_kv_seq> shifts;
+        std::vector<llama_client_slot *> shifted;
         for (llama_client_slot &slot : slots)
         {
-            if (slot.ga_n == 1)
+            if (slot.ga_n == 1 && slot.is_processing())
             {
-                if (slot.is_processing() && system_tokens.size() + slot.cache_tokens.size() >= (size_t) slot.n_ctx)
-                {
-                    // Shift context
-                    const int n_keep    = slot.params.n_keep + add_bos_token;
-                    const int n_left    = (int) system_tokens.size() + slot.n_past - n_keep;
-                    const int n_discard = n_left / 2;
-
-                    LOG_INFO("slot context shift", {
-                        {"slot_id",         slot.id},
-                        {"task_id",         slot.task_id},
-                        {"n_keep",          n_keep},
-                        {"n_left",          n_left},
-                        {"n_discard",       n_discard},
-                        {"n_ctx",           n_ctx},
-                        {"n_past",          slot.n_past},
-                        {"n_system_tokens", system_tokens.size()},
-                        {"n_cache_tokens",  slot.cache_tokens.size()}
-                    });
-                    llama_kv_cache_seq_rm (ctx, slot.id, n_keep            , n_keep + n_discard);
-                    llama_kv_cache_seq_add(ctx, slot.id, n_keep + n_discard, system_tokens.size() + slot.n_past, -n_discard);
+                llama_kv_seq seq = {};
+                seq.seq_id   = slot.id;
+                seq.n_past   = system_tokens.size() + slot.n_past;
+                seq.n_tokens = 1;
+                seq.n_ctx    = slot.n_ctx;
+                seq.n_keep   = slot.params.n_keep + add_bos_token;
+                seq.ga_n     = 1;
+                shifts.push_back(seq);
+                shifted.push_back(&slot);
+            }
+        }
+        llama_kv_cache_seq_apply(ctx, shifts.data(), shifts.size());
+        for (size_t k = 0; k < shifts.size(); ++k)
+        {
+            if (!shifts[k].n_evicted)
+            {
+                continue;
+            }
+            llama_client_slot &slot = *shifted[k];
+            const int n_keep    = shifts[k].n_keep;
+            const int n_discard = shifts[k].n_evicted;
+
+            LOG_INFO("slot context shift", {
+                {"slot_id",         slot.id},
+                {"task_id",         slot.task_id},
+                {"n_keep",          n_keep},
+                {"n_discard",       n_discard},
+                {"n_ctx",           n_ctx},
+                {"n_past",          slot.n_past},
+                {"n_system_tokens", system_tokens.size()},
+                {"n_cache_tokens",  slot.cache_tokens.size()}
+            });
 
-                    for (size_t i = n_keep + n_discard; i < slot.cache_tokens.size(); i++)
-                    {
-                        slot.cache_tokens[i - n_discard] = slot.cache_tokens[i];
-                    }
+            for (size_t i = n_keep + n_discard; i < slot.cache_tokens.size(); i++)
+            {
+                slot.cache_tokens[i - n_discard] = slot.cache_tokens[i];
+            }
 
-                    slot.cache_tokens.resize(slot.cache_tokens.size() - n_discard);
+            slot.cache_tokens.resize(slot.cache_tokens.size() - n_discard);
 
-                    slot.n_past -= n_discard;
+            slot.n_past -= n_discard;
 
-                    slot.truncated = true;
-                }
-            }
+            slot.truncated = true;
         }
 
         // decode any currently ongoing sequences
@@ -1992,35 +2005,32 @@ struct llama_server_context
         {
             const int32_t n_tokens = std::min(n_batch, (int32_t) (batch.n_tokens - i));
 
+            // context extension via Self-Extend, for all slots at once
+            std::vector<llama_kv_seq> extends;
             for (auto & slot : slots)
             {
                 if (slot.ga_n != 1)
                 {
-                    // context extension via Self-Extend
-                    while (slot.n_past_se >= slot.ga_i + slot.ga_w)
-                    {
-                        const int ib = (slot.ga_n * slot.ga_i) / slot.ga_w;
-                        const int bd = (slot.ga_w / slot.ga_n) * (slot.ga_n - 1);
-                        const int dd = (slot.ga_w / slot.ga_n) - ib * bd - slot.ga_w;
-
-                        LOG_TEE("\n");
-                        LOG_TEE("shift: [%6d, %6d] + %6d -> [%6d, %6d]\n", slot.ga_i, slot.n_past_se, ib * bd, slot.ga_i + ib * bd, slot.n_past_se + ib * bd);
-                        LOG_TEE("div:   [%6d, %6d] / %6d -> [%6d, %6d]\n", slot.ga_i + ib * bd, slot.ga_i + ib * bd + slot.ga_w, slot.ga_n, (slot.ga_i + ib * bd) / slot.ga_n, (slot.ga_i + ib * bd + slot.ga_w) / slot.ga_n);
-                        LOG_TEE("shift: [%6d, %6d] + %6d -> [%6d, %6d]\n", slot.ga_i + ib * bd + slot.ga_w, slot.n_past_se + ib * bd, dd, slot.ga_i + ib * bd + slot.ga_w + dd, slot.n_past_se + ib * bd + dd);
-
-                        llama_kv_cache_seq_add(ctx, slot.id, slot.ga_i, slot.n_past_se, ib * bd);
-                        llama_kv_cache_seq_div(ctx, slot.id, slot.ga_i + ib * bd, slot.ga_i + ib * bd + slot.ga_w,slot.ga_n);
-                        llama_kv_cache_seq_add(ctx, slot.id, slot.ga_i + ib * bd + slot.ga_w,slot.n_past_se + ib * bd, dd);
-
-                        slot.n_past_se -= bd;
-
-                        slot.ga_i += slot.ga_w / slot.ga_n;
-
-                        LOG_TEE("\nn_past_old = %d, n_past = %d, ga_i = %d\n\n", slot.n_past_se + bd, slot.n_past_se, slot.ga_i);
-                    }
-                    slot.n_past_se += n_tokens;
+                    llama_kv_seq seq = {};
+                    seq.seq_id = slot.id;
+                    seq.n_past = slot.n_past_se;
+                    seq.ga_n   = slot.ga_n;
+                    seq.ga_w   = slot.ga_w;
+                    seq.ga_i   = slot.ga_i;
+                    extends.push_back(seq);
                 }
             }
+            llama_kv_cache_seq_apply(ctx, extends.data(), extends.size());
+            for (auto & seq : extends)
+            {
+                llama_client_slot & slot = slots[seq.seq_id];
+                if (seq.ga_i != slot.ga_i)
+                {
+                    LOG_TEE("\nself-extend slot %d: n_past_old = %d, n_past = %d, ga_i = %d\n\n", slot.id, slot.n_past_se, seq.n_past, seq.ga_i);
+                }
+                slot.n_past_se = seq.n_past + n_tokens;
+                slot.ga_i      = seq.ga_i;
+            }
 
             llama_batch batch_view =
             {
@@ -2164,6 +2174,7 @@ static void server_print_usage(const char *argv0, const gpt_params &params,
         printf("                            fraction of the model to offload to each GPU, comma-separated list of proportions, e.g. 3,1\n");
         printf("  -mg i, --main-gpu i       the GPU to use for the model (with split-mode = none),\n");
         printf("                            or for intermediate results and KV (with split-mode = row)\n");
+        printf("  --rpc SERVERS             comma separated list of RPC servers to offload layers to\n");
     // } // [jart] prevent init error
     printf("  -m FNAME, --model FNAME\n");
     printf("                            model path (default: %s)\n", params.model.c_str());
@@ -2536,6 +2547,15 @@ static void server_params_parse(int argc, char **argv, server_params &sparams,
                 }
             }
         }
+        else if (arg == "--rpc")
+        {
+            if (++i >= argc)
+            {
+                invalid_param = true;
+                break;
+            }
+            params.rpc_servers = argv[i];
+        }
         else if (arg == "--main-gpu" || arg == "-mg")
         {
             if (++i >= argc)
@@ -2775,7 +2795,11 @@ static void server_params_parse(int argc, char **argv, server_params &sparams,
         params.embedding = true;  // [jart] #243 always enable embedding mode
 #endif
 
-    params.n_gpu_layers = llamafile_gpu_layers(params.n_gpu_layers);
+    if (!params.rpc_servers.empty() && params.n_gpu_layers > 0 && !llamafile_has_gpu()) {
+        FLAG_gpu = LLAMAFILE_GPU_DISABLE; // [jart] offload to rpc workers
+    } else {
+        params.n_gpu_layers = llamafile_gpu_layers(params.n_gpu_layers);
+    }
 
     if (!params.kv_overrides.empty()) {
         params.kv_overrides.emplace_back();
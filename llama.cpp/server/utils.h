@@ -8,6 +8,8 @@
 #include <set>
 #include <mutex>
 #include <condition_variable>
+#include <deque>
+#include <memory>
 #include <unordered_map>
 #include <iostream> // [jart]
 
@@ -407,47 +409,59 @@ struct llama_server_queue {
 struct llama_server_response {
     typedef std::function<void(int, int, task_result&)> callback_multitask_t;
     callback_multitask_t callback_update_multitask;
+
+    // [jart] each waiting http thread gets its own channel, so a result
+    //        only wakes up the one thread that wants it. previously all
+    //        results went into one vector, and every token generated by
+    //        every slot woke up every waiter to scan it for their own id
+    struct channel {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<task_result> results;
+    };
+
     // for keeping track of all tasks waiting for the result
-    std::set<int> waiting_task_ids;
-    // the main result queue
-    std::vector<task_result> queue_results;
+    std::unordered_map<int, std::shared_ptr<channel>> channels;
     std::mutex mutex_results;
-    std::condition_variable condition_results;
+
+    std::shared_ptr<channel> get_channel(int task_id) {
+        std::unique_lock<std::mutex> lock(mutex_results);
+        auto it = channels.find(task_id);
+        if (it == channels.end()) {
+            return nullptr;
+        }
+        return it->second;
+    }
 
     void add_waiting_task_id(int task_id) {
         LOG_VERBOSE("waiting for task id", {{"task_id", task_id}});
         std::unique_lock<std::mutex> lock(mutex_results);
-        waiting_task_ids.insert(task_id);
+        if (!channels.count(task_id)) {
+            channels[task_id] = std::make_shared<channel>();
+        }
     }
 
     void remove_waiting_task_id(int task_id) {
         LOG_VERBOSE("remove waiting for task id", {{"task_id", task_id}});
         std::unique_lock<std::mutex> lock(mutex_results);
-        waiting_task_ids.erase(task_id);
+        channels.erase(task_id);
     }
 
     // This function blocks the thread until there is a response for this task_id
     task_result recv(int task_id) {
-        while (true)
-        {
-            std::unique_lock<std::mutex> lock(mutex_results);
-            condition_results.wait(lock, [&]{
-                return !queue_results.empty();
-            });
-
-            for (int i = 0; i < (int) queue_results.size(); i++)
-            {
-                if (queue_results[i].id == task_id)
-                {
-                    assert(queue_results[i].multitask_id == -1);
-                    task_result res = queue_results[i];
-                    queue_results.erase(queue_results.begin() + i);
-                    return res;
-                }
-            }
+        std::shared_ptr<channel> chan = get_channel(task_id);
+        if (!chan) {
+            add_waiting_task_id(task_id);
+            chan = get_channel(task_id);
         }
-
-        // should never reach here
+        std::unique_lock<std::mutex> lock(chan->mutex);
+        chan->cond.wait(lock, [&]{
+            return !chan->results.empty();
+        });
+        task_result res = std::move(chan->results.front());
+        chan->results.pop_front();
+        assert(res.multitask_id == -1);
+        return res;
     }
 
     // Register the function to update multitask
@@ -457,26 +471,25 @@ struct llama_server_response {
 
     // Send a new result to a waiting task_id
     void send(task_result result) {
-        std::unique_lock<std::mutex> lock(mutex_results);
-        LOG_VERBOSE("send new result", {{"task_id", result.id}});
-        for (auto& task_id : waiting_task_ids) {
-            // LOG_TEE("waiting task id %i \n", task_id);
+        std::shared_ptr<channel> chan;
+        {
+            std::unique_lock<std::mutex> lock(mutex_results);
+            LOG_VERBOSE("send new result", {{"task_id", result.id}});
             // for now, tasks that have associated parent multitasks just get erased once multitask picks up the result
-            if (result.multitask_id == task_id)
-            {
-                LOG_VERBOSE("callback_update_multitask", {{"task_id", task_id}});
-                callback_update_multitask(task_id, result.id, result);
-                continue;
+            if (result.multitask_id != -1 && channels.count(result.multitask_id)) {
+                LOG_VERBOSE("callback_update_multitask", {{"task_id", result.multitask_id}});
+                callback_update_multitask(result.multitask_id, result.id, result);
             }
-
-            if (result.id == task_id)
-            {
-                LOG_VERBOSE("queue_results.push_back", {{"task_id", task_id}});
-                queue_results.push_back(result);
-                condition_results.notify_all();
+            auto it = channels.find(result.id);
+            if (it == channels.end()) {
                 return;
             }
+            chan = it->second;
         }
+        LOG_VERBOSE("queue_results.push_back", {{"task_id", result.id}});
+        std::unique_lock<std::mutex> lock(chan->mutex);
+        chan->results.push_back(std::move(result));
+        chan->cond.notify_one();
     }
 };
 
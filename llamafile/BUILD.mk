@@ -59,11 +59,18 @@ o/$(MODE)/llamafile:						\
 		o/$(MODE)/llamafile/tokenize			\
 		o/$(MODE)/llamafile/addnl			\
 		o/$(MODE)/llamafile/high			\
+		o/$(MODE)/llamafile/base64_test.runs		\
+		o/$(MODE)/llamafile/chunks_test.runs		\
 		o/$(MODE)/llamafile/datauri_test.runs		\
+		o/$(MODE)/llamafile/experts_test.runs		\
+		o/$(MODE)/llamafile/fuse_test.runs		\
+		o/$(MODE)/llamafile/mixmul_test.runs		\
 		o/$(MODE)/llamafile/parse_cidr_test.runs	\
 		o/$(MODE)/llamafile/pool_cancel_test.runs	\
 		o/$(MODE)/llamafile/pool_test.runs		\
+		o/$(MODE)/llamafile/rpc_test.runs		\
 		o/$(MODE)/llamafile/json_test.runs		\
+		o/$(MODE)/llamafile/string_test.runs		\
 		o/$(MODE)/llamafile/thread_test.runs		\
 		o/$(MODE)/llamafile/vmathf_test.runs		\
 
@@ -110,6 +117,7 @@ o/$(MODE)/llamafile:						\
 # - HWCAP_ASIMDDP       +dotprod  (e.g. m1, rpi5)  __ARM_FEATURE_DOTPROD
 #
 
+o/$(MODE)/llamafile/base64_amd_avx2.o: private TARGET_ARCH += -Xx86_64-mtune=skylake -Xx86_64-mavx -Xx86_64-mavx2
 o/$(MODE)/llamafile/iqk_mul_mat_amd_avx2.o: private TARGET_ARCH += -Xx86_64-mtune=skylake -Xx86_64-mavx -Xx86_64-mavx2 -Xx86_64-mfma -Xx86_64-mf16c
 o/$(MODE)/llamafile/iqk_mul_mat_amd_zen4.o: private TARGET_ARCH += -Xx86_64-mtune=skylake -Xx86_64-mavx -Xx86_64-mavx2 -Xx86_64-mfma -Xx86_64-mf16c -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bw -Xx86_64-mavx512dq
 o/$(MODE)/llamafile/iqk_mul_mat_arm82.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+dotprod+fp16
@@ -126,11 +134,14 @@ o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_avx512f.o: private TARGET_ARCH += -X
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_zen4.o: private TARGET_ARCH += -Xx86_64-mtune=znver4 -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bf16
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_zen4.o: private TARGET_ARCH += -Xx86_64-mtune=znver4 -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni -Xx86_64-mavx512bf16
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_arm82.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+dotprod+fp16
+o/$(MODE)/llamafile/tinyblas_cpu_repack_amd_avx2.o: private TARGET_ARCH += -Xx86_64-mtune=skylake -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2
+o/$(MODE)/llamafile/tinyblas_cpu_repack_amd_zen4.o: private TARGET_ARCH += -Xx86_64-mtune=znver4 -Xx86_64-mavx -Xx86_64-mf16c -Xx86_64-mfma -Xx86_64-mavx2 -Xx86_64-mavx512f -Xx86_64-mavx512vl -Xx86_64-mavx512vnni
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm82.o: private TARGET_ARCH += -Xaarch64-march=armv8.2-a+dotprod+fp16
 
 o/$(MODE)/llamafile/sgemm.o: private CXXFLAGS += -Os
 
 o/$(MODE)/llamafile/sgemm_matmul_test.o			\
+o/$(MODE)/llamafile/sgemm_repack_test.o			\
 o/$(MODE)/llamafile/sgemm_sss_test.o			\
 o/$(MODE)/llamafile/sgemm_vecdot_test.o			\
 o/$(MODE)/llamafile/iqk_mul_mat_amd_avx2.o		\
@@ -144,6 +155,8 @@ o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_fma.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_amd_zen4.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm80.o		\
 o/$(MODE)/llamafile/tinyblas_cpu_mixmul_arm82.o		\
+o/$(MODE)/llamafile/tinyblas_cpu_repack_amd_avx2.o	\
+o/$(MODE)/llamafile/tinyblas_cpu_repack_amd_zen4.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx2.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx512f.o	\
 o/$(MODE)/llamafile/tinyblas_cpu_sgemm_amd_avx.o	\
@@ -167,6 +180,30 @@ o/$(MODE)/llamafile/vmathf_test:			\
 		o/$(MODE)/llamafile/vmathf_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a		\
 
+o/$(MODE)/llamafile/rpc_test:				\
+		o/$(MODE)/llamafile/rpc_test.o		\
+		o/$(MODE)/llama.cpp/llama.cpp.a
+
+o/$(MODE)/llamafile/chunks_test:			\
+		o/$(MODE)/llamafile/chunks_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/llamafile/experts_test:			\
+		o/$(MODE)/llamafile/experts_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/llamafile/fuse_test:				\
+		o/$(MODE)/llamafile/fuse_test.o		\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/llamafile/mixmul_test:			\
+		o/$(MODE)/llamafile/mixmul_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
+o/$(MODE)/llamafile/string_test:			\
+		o/$(MODE)/llamafile/string_test.o	\
+		o/$(MODE)/llamafile/string.o		\
+
 o/$(MODE)/llamafile/parse_cidr_test:			\
 		o/$(MODE)/llamafile/parse_cidr_test.o	\
 		o/$(MODE)/llamafile/parse_cidr.o	\
@@ -182,6 +219,10 @@ o/$(MODE)/llamafile/datauri_test:			\
 		o/$(MODE)/llama.cpp/llama.cpp.a		\
 		o/$(MODE)/third_party/stb/stb.a		\
 
+o/$(MODE)/llamafile/base64_test:			\
+		o/$(MODE)/llamafile/base64_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a		\
+
 o/$(MODE)/llamafile/high:					\
 		o/$(MODE)/llamafile/high.o			\
 		o/$(MODE)/llamafile/highlight/highlight.a	\
@@ -205,6 +246,8 @@ o/$(MODE)/llamafile/sgemm_sss_test: private LDFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_sss_test.o: private CCFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_matmul_test: private LDFLAGS += -fopenmp
 o/$(MODE)/llamafile/sgemm_matmul_test.o: private CCFLAGS += -fopenmp
+o/$(MODE)/llamafile/sgemm_repack_test: private LDFLAGS += -fopenmp
+o/$(MODE)/llamafile/sgemm_repack_test.o: private CCFLAGS += -fopenmp
 
 o/$(MODE)/llamafile/sgemm_sss_test:			\
 		o/$(MODE)/llamafile/sgemm_sss_test.o	\
@@ -214,6 +257,10 @@ o/$(MODE)/llamafile/sgemm_matmul_test:			\
 		o/$(MODE)/llamafile/sgemm_matmul_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a
 
+o/$(MODE)/llamafile/sgemm_repack_test:			\
+		o/$(MODE)/llamafile/sgemm_repack_test.o	\
+		o/$(MODE)/llama.cpp/llama.cpp.a
+
 o/$(MODE)/llamafile/sgemm_vecdot_test:			\
 		o/$(MODE)/llamafile/sgemm_vecdot_test.o	\
 		o/$(MODE)/llama.cpp/llama.cpp.a
@@ -246,3 +293,11 @@ o/$(MODE)/llamafile/pick_a_warp_kernel.o: private CFLAGS += -fopenmp
 .PHONY: o/$(MODE)/llamafile/check
 o/$(MODE)/llamafile/check:				\
 		o/$(MODE)/llamafile/tinyblas_test.runs
+
+# runs the cpu op tests with benchmarks, which take too long for `make`
+.PHONY: o/$(MODE)/llamafile/bench
+o/$(MODE)/llamafile/bench:				\
+		o/$(MODE)/llamafile/chunks_test		\
+		o/$(MODE)/llamafile/fuse_test		\
+		o/$(MODE)/llamafile/mixmul_test
+	$(foreach x,$^,$(x) -b &&) true
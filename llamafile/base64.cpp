@@ -0,0 +1,246 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base64.h"
+#include <cosmo.h>
+#include <string>
+#include <string_view>
+
+#ifdef __aarch64__
+#include <arm_neon.h>
+#endif
+
+// base64 codec for data uris
+//
+// images pasted into chat messages arrive as megabytes of base64, so
+// the bulk of the input is handled 32 or 64 characters at a time with
+// simd, and only the tail, the padding, and anything invalid are left
+// for the scalar code. both the standard and url safe alphabets may be
+// used, even if they're mixed together within the same input.
+
+namespace lf {
+
+static const char kBase64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const signed char kBase64Decode[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, 62, -1, 63, //
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1, //
+    -1, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, //
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63, //
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, //
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+};
+
+#ifdef __aarch64__
+
+static size_t encode_base64_neon(char *out, const unsigned char *in, size_t n, size_t *consumed) {
+    size_t i = 0;
+    char *p = out;
+    uint8x16x4_t alphabet = vld1q_u8_x4((const uint8_t *)kBase64);
+    uint8x16_t mask = vdupq_n_u8(63);
+    for (; i + 48 <= n; i += 48, p += 64) {
+        uint8x16x3_t x = vld3q_u8(in + i);
+        uint8x16x4_t y;
+        y.val[0] = vshrq_n_u8(x.val[0], 2);
+        y.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(x.val[0], 4), vshrq_n_u8(x.val[1], 4)), mask);
+        y.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(x.val[1], 2), vshrq_n_u8(x.val[2], 6)), mask);
+        y.val[3] = vandq_u8(x.val[2], mask);
+        y.val[0] = vqtbl4q_u8(alphabet, y.val[0]);
+        y.val[1] = vqtbl4q_u8(alphabet, y.val[1]);
+        y.val[2] = vqtbl4q_u8(alphabet, y.val[2]);
+        y.val[3] = vqtbl4q_u8(alphabet, y.val[3]);
+        vst4q_u8((uint8_t *)p, y);
+    }
+    *consumed = i;
+    return p - out;
+}
+
+static inline uint8x16_t decode_base64_neon_lookup(uint8x16x4_t lo, uint8x16x4_t hi,
+                                                   uint8x16_t c, uint8x16_t *err) {
+    // characters 0..63 come from `lo` and 64..127 come from `hi`, and
+    // invalid characters map to 255, so that the high bit means error
+    uint8x16_t d = vqtbl4q_u8(lo, c);
+    d = vqtbx4q_u8(d, hi, vsubq_u8(c, vdupq_n_u8(64)));
+    *err = vorrq_u8(*err, vorrq_u8(d, c));
+    return d;
+}
+
+static size_t decode_base64_neon(unsigned char *out, const char *in, size_t n, size_t *consumed) {
+    uint8_t table[128];
+    for (int i = 0; i < 128; ++i)
+        table[i] = kBase64Decode[i];
+    uint8x16x4_t lo = vld1q_u8_x4(table);
+    uint8x16x4_t hi = vld1q_u8_x4(table + 64);
+    size_t i = 0;
+    unsigned char *p = out;
+    for (; i + 64 <= n; i += 64, p += 48) {
+        uint8x16_t err = vdupq_n_u8(0);
+        uint8x16x4_t x = vld4q_u8((const uint8_t *)in + i);
+        uint8x16_t a = decode_base64_neon_lookup(lo, hi, x.val[0], &err);
+        uint8x16_t b = decode_base64_neon_lookup(lo, hi, x.val[1], &err);
+        uint8x16_t c = decode_base64_neon_lookup(lo, hi, x.val[2], &err);
+        uint8x16_t d = decode_base64_neon_lookup(lo, hi, x.val[3], &err);
+        if (vmaxvq_u8(err) & 0x80)
+            break; // padding or invalid
+        uint8x16x3_t y;
+        y.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        y.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        y.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(p, y);
+    }
+    *consumed = i;
+    return p - out;
+}
+
+#endif // __aarch64__
+
+/**
+ * Returns number of characters needed to encode `n` bytes.
+ */
+size_t base64_encoded_size(size_t n) {
+    return (n + 2) / 3 * 4;
+}
+
+/**
+ * Returns max number of bytes `n` base64 characters may decode to.
+ */
+size_t base64_decoded_size(size_t n) {
+    return n / 4 * 3 + 2;
+}
+
+/**
+ * Encodes binary as padded base64.
+ *
+ * @param out needs to have base64_encoded_size(n) bytes of room
+ * @return number of characters written to `out`
+ */
+size_t encode_base64(char *out, const void *data, size_t n) {
+    size_t i = 0;
+    char *p = out;
+    const unsigned char *in = (const unsigned char *)data;
+#ifdef __x86_64__
+    if (X86_HAVE(AVX2))
+        p += encode_base64_avx2(p, in, n, &i);
+#elif defined(__aarch64__)
+    p += encode_base64_neon(p, in, n, &i);
+#endif
+    for (; i + 3 <= n; i += 3) {
+        unsigned w = in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+        *p++ = kBase64[w >> 18];
+        *p++ = kBase64[w >> 12 & 63];
+        *p++ = kBase64[w >> 6 & 63];
+        *p++ = kBase64[w & 63];
+    }
+    if (i < n) {
+        unsigned w = in[i] << 16;
+        if (i + 1 < n)
+            w |= in[i + 1] << 8;
+        *p++ = kBase64[w >> 18];
+        *p++ = kBase64[w >> 12 & 63];
+        *p++ = i + 1 < n ? kBase64[w >> 6 & 63] : '=';
+        *p++ = '=';
+    }
+    return p - out;
+}
+
+/**
+ * Decodes base64.
+ *
+ * Padding is optional, but once an `=` is encountered, nothing except
+ * more padding may follow. Leftover bits of an unpadded final quantum
+ * are ignored. The standard and url safe alphabets are both accepted.
+ *
+ * @param out needs to have base64_decoded_size(n) bytes of room
+ * @return number of bytes written to `out`, or -1 if `in` is invalid
+ */
+ssize_t decode_base64(void *out, const char *in, size_t n) {
+    size_t i = 0;
+    unsigned char *p = (unsigned char *)out;
+#ifdef __x86_64__
+    if (X86_HAVE(AVX2))
+        p += decode_base64_avx2(p, in, n, &i);
+#elif defined(__aarch64__)
+    p += decode_base64_neon(p, in, n, &i);
+#endif
+    for (; i + 4 <= n; i += 4) {
+        int a = kBase64Decode[(unsigned char)in[i + 0]];
+        int b = kBase64Decode[(unsigned char)in[i + 1]];
+        int c = kBase64Decode[(unsigned char)in[i + 2]];
+        int d = kBase64Decode[(unsigned char)in[i + 3]];
+        if ((a | b | c | d) < 0)
+            break;
+        unsigned w = a << 18 | b << 12 | c << 6 | d;
+        *p++ = w >> 16;
+        *p++ = w >> 8;
+        *p++ = w;
+    }
+    int bits = 0;
+    unsigned w = 0;
+    for (; i < n; ++i) {
+        int c = kBase64Decode[(unsigned char)in[i]];
+        if (c < 0) {
+            if (in[i] == '=')
+                break;
+            return -1;
+        }
+        w = w << 6 | c;
+        if ((bits += 6) >= 8)
+            *p++ = w >> (bits -= 8);
+    }
+    for (; i < n; ++i)
+        if (in[i] != '=')
+            return -1;
+    return p - (unsigned char *)out;
+}
+
+/**
+ * Appends base64 encoding of `data` to string.
+ */
+void append_base64(std::string *r, const std::string_view &data) {
+    size_t size = r->size();
+    r->resize(size + base64_encoded_size(data.size()));
+    r->resize(size + encode_base64(r->data() + size, data.data(), data.size()));
+}
+
+/**
+ * Replaces `*r` with the decoding of base64 `s`.
+ *
+ * @return false if `s` isn't valid base64
+ */
+bool decode_base64(std::string *r, const std::string_view &s) {
+    r->resize(base64_decoded_size(s.size()));
+    ssize_t got = decode_base64(r->data(), s.data(), s.size());
+    if (got == -1) {
+        r->clear();
+        return false;
+    }
+    r->resize(got);
+    return true;
+}
+
+} // namespace lf
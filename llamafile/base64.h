@@ -0,0 +1,35 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <__fwd/string.h>
+#include <__fwd/string_view.h>
+#include <sys/types.h>
+
+namespace lf {
+
+size_t base64_encoded_size(size_t);
+size_t base64_decoded_size(size_t);
+size_t encode_base64(char *, const void *, size_t);
+ssize_t decode_base64(void *, const char *, size_t);
+void append_base64(std::string *, const std::string_view &);
+bool decode_base64(std::string *, const std::string_view &);
+
+size_t encode_base64_avx2(char *, const unsigned char *, size_t, size_t *);
+size_t decode_base64_avx2(unsigned char *, const char *, size_t, size_t *);
+
+} // namespace lf
@@ -0,0 +1,125 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifdef __x86_64__
+
+#include "base64.h"
+#include <immintrin.h>
+
+// avx2 base64 kernels
+//
+// these use the vectorized lookup and bit packing techniques that were
+// described by Wojciech Muła and Daniel Lemire in "Faster Base64
+// Encoding and Decoding Using AVX2 Instructions" (ACM TOW 2018). they
+// only process whole blocks and leave the remainder to the caller.
+
+namespace lf {
+
+static inline __m256i enc_reshuffle(__m256i in) {
+    in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                                 14, 15, 13, 14, 11, 12, 10, 11, 8, 9, 7, 8, 5, 6,
+                                                 4, 5));
+    __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t1, t3);
+}
+
+static inline __m256i enc_translate(__m256i in) {
+    const __m256i lut = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16,
+                                         0, 0, 65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4,
+                                         -19, -16, 0, 0);
+    __m256i indices = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+    __m256i mask = _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25));
+    indices = _mm256_sub_epi8(indices, mask);
+    return _mm256_add_epi8(in, _mm256_shuffle_epi8(lut, indices));
+}
+
+size_t encode_base64_avx2(char *out, const unsigned char *in, size_t n, size_t *consumed) {
+    size_t i = 0;
+    char *p = out;
+    if (n >= 28) {
+        // each block loads 32 bytes starting 4 bytes before the 24 it
+        // encodes. the first one masks off those bytes, since they're
+        // before the start of the buffer.
+        __m256i x = _mm256_maskload_epi32((const int *)(in - 4),
+                                          _mm256_set_epi32(-1, -1, -1, -1, -1, -1, -1, 0));
+        for (;;) {
+            _mm256_storeu_si256((__m256i *)p, enc_translate(enc_reshuffle(x)));
+            i += 24;
+            p += 32;
+            if (i + 28 > n)
+                break;
+            x = _mm256_loadu_si256((const __m256i *)(in + i - 4));
+        }
+    }
+    *consumed = i;
+    return p - out;
+}
+
+size_t decode_base64_avx2(unsigned char *out, const char *in, size_t n, size_t *consumed) {
+    const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B,
+        0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B,
+        0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0,
+                                              0, 0, 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0,
+                                              0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+    size_t i = 0;
+    unsigned char *p = out;
+    for (; i + 32 <= n; i += 32, p += 24) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(in + i));
+
+        // fold the url safe alphabet into the standard one
+        x = _mm256_blendv_epi8(x, _mm256_set1_epi8('+'),
+                               _mm256_cmpeq_epi8(x, _mm256_set1_epi8('-')));
+        x = _mm256_blendv_epi8(x, _mm256_set1_epi8('/'),
+                               _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+
+        // validate and translate ascii to sextets
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(x, 4), mask_2f);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(x, mask_2f));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi))
+            break; // padding or invalid
+        __m256i eq_2f = _mm256_cmpeq_epi8(x, mask_2f);
+        __m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+        x = _mm256_add_epi8(x, roll);
+
+        // pack four sextets into three bytes
+        x = _mm256_maddubs_epi16(x, _mm256_set1_epi32(0x01400140));
+        x = _mm256_madd_epi16(x, _mm256_set1_epi32(0x00011000));
+        x = _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+                                                    -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13,
+                                                    12, -1, -1, -1, -1));
+        x = _mm256_permutevar8x32_epi32(x, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+        _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(x));
+        _mm_storel_epi64((__m128i *)(p + 16), _mm256_extracti128_si256(x, 1));
+    }
+    *consumed = i;
+    return p - out;
+}
+
+} // namespace lf
+
+#endif // __x86_64__
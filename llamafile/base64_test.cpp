@@ -0,0 +1,147 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base64.h"
+#include "bench.h"
+#include "llama.cpp/base64.h"
+#include <cosmo.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define ITERATIONS 30
+
+// checks simd base64 against the scalar reference implementation, for
+// every length that exercises the block tails, and benchmarks decoding
+// a screenshot sized data uri.
+
+std::string random_bytes(size_t n) {
+    std::string s(n, 0);
+    for (size_t i = 0; i < n; ++i)
+        s[i] = rand();
+    return s;
+}
+
+std::string encode(const std::string &s) {
+    std::string r;
+    lf::append_base64(&r, s);
+    return r;
+}
+
+bool decode(std::string *r, const std::string &s) {
+    return lf::decode_base64(r, s);
+}
+
+void test_round_trip() {
+    std::string got;
+    for (size_t n = 0; n < 700; ++n) {
+        std::string bin = random_bytes(n);
+        std::string want = base64::encode(bin);
+        std::string b64 = encode(bin);
+        if (b64 != want)
+            exit(1);
+        if (!decode(&got, b64) || got != bin)
+            exit(2);
+        // unpadded
+        while (!b64.empty() && b64.back() == '=')
+            b64.pop_back();
+        if (!decode(&got, b64) || got != bin)
+            exit(3);
+        // url safe
+        for (char &c : b64)
+            if (c == '+')
+                c = '-';
+            else if (c == '/')
+                c = '_';
+        if (!decode(&got, b64) || got != bin)
+            exit(4);
+    }
+}
+
+void test_invalid() {
+    std::string got;
+    std::string b64 = encode(random_bytes(300));
+    for (size_t i = 0; i < b64.size(); ++i) {
+        if (b64[i] == '=')
+            continue;
+        for (char c : {'\0', ' ', '\n', '.', '*', '\x80', '\xff'}) {
+            std::string bad = b64;
+            bad[i] = c;
+            if (decode(&got, bad))
+                exit(5);
+        }
+    }
+}
+
+void test_padding() {
+    std::string got;
+    if (!decode(&got, "") || !got.empty())
+        exit(6);
+    if (!decode(&got, "TWE=") || got != "Ma")
+        exit(7);
+    if (!decode(&got, "TWE") || got != "Ma")
+        exit(8);
+    if (!decode(&got, "TQ==") || got != "M")
+        exit(9);
+    if (!decode(&got, "TQ=") || got != "M")
+        exit(10);
+    if (decode(&got, "TQ==TQ=="))
+        exit(11);
+    if (decode(&got, "TQ=a"))
+        exit(12);
+
+    // padding at the start of a simd block
+    std::string b64 = encode(random_bytes(96)) + "====";
+    if (!decode(&got, b64) || got.size() != 96)
+        exit(13);
+    b64 = encode(random_bytes(96)) + "==" + encode(random_bytes(96));
+    if (decode(&got, b64))
+        exit(14);
+}
+
+void test_decode_matches_reference() {
+    std::string got;
+    for (size_t n = 0; n < 300; ++n) {
+        std::string b64 = encode(random_bytes(n));
+        while (!b64.empty() && b64.back() == '=')
+            b64.pop_back();
+        for (size_t m = 0; m <= b64.size(); ++m) {
+            std::string s = b64.substr(0, m);
+            if (!decode(&got, s) || got != base64::decode(s))
+                exit(15);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    ShowCrashReports();
+
+    test_round_trip();
+    test_invalid();
+    test_padding();
+    test_decode_matches_reference();
+
+    std::string got;
+    std::string bin = random_bytes(3 * 1024 * 1024);
+    std::string b64 = encode(bin);
+    BENCH(encode(bin));
+    BENCH(base64::encode(bin));
+    BENCH(decode(&got, b64));
+    BENCH(base64::decode(b64));
+    if (got != bin)
+        exit(16);
+}
@@ -0,0 +1,183 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ggml_test.h"
+#include <atomic>
+#include <pthread.h>
+
+#define ITERATIONS 30
+
+// checks row-parallel ops which steal chunks produce the same output
+// regardless of thread count, and benchmarks them while other threads
+// compete for the cpu, like noisy neighbors or efficiency cores would.
+
+static std::atomic_bool g_noisy;
+
+static void compute(struct ggml_cgraph *gf, int n) {
+    ggml_graph_compute_with_ctx(ctx, gf, n);
+}
+
+static void *noise(void *arg) {
+    volatile unsigned long x = 0;
+    while (g_noisy.load(std::memory_order_relaxed))
+        for (int i = 0; i < 10000; ++i)
+            x = x * 6364136223846793005ul + 1;
+    return 0;
+}
+
+static int check(const char *name, struct ggml_cgraph *gf, struct ggml_tensor *out) {
+    int rc = 0;
+    size_t size = ggml_nbytes(out);
+    char *want = (char *)malloc(size);
+
+    memset(out->data, 0, size);
+    compute(gf, 1);
+    memcpy(want, out->data, size);
+    for (int n = 2; n <= nth * 2; n += n) {
+        memset(out->data, 0, size);
+        compute(gf, n);
+        if (memcmp(want, out->data, size)) {
+            fprintf(stderr, "%s: %s output changed with %d threads\n", __FILE__, name, n);
+            rc = 1;
+            goto Finish;
+        }
+    }
+
+    if (g_bench) {
+        printf("%s %lld rows\n", name, (long long)ggml_nrows(out));
+        BENCH(compute(gf, nth));
+        pthread_t th[64];
+        int noisy = nth / 2 > 0 ? nth / 2 : 1;
+        if (noisy > 64)
+            noisy = 64;
+        g_noisy = true;
+        for (int i = 0; i < noisy; ++i)
+            pthread_create(&th[i], 0, noise, 0);
+        BENCH(compute(gf, nth));
+        g_noisy = false;
+        for (int i = 0; i < noisy; ++i)
+            pthread_join(th[i], 0);
+    }
+
+Finish:
+    free(want);
+    return rc;
+}
+
+static int test_rms_norm(int n_embd, int n_tokens) {
+    struct ggml_tensor *x = randomized(GGML_TYPE_F32, n_embd, n_tokens, 1);
+    struct ggml_tensor *y = ggml_rms_norm(ctx, x, 1e-5f);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("rms_norm", gf, y);
+}
+
+static int test_rms_norm_mul(int n_embd, int n_tokens) {
+    struct ggml_tensor *x = randomized(GGML_TYPE_F32, n_embd, n_tokens, 1);
+    struct ggml_tensor *w = randomized(GGML_TYPE_F32, n_embd, 1, 1);
+    struct ggml_tensor *y = ggml_mul(ctx, ggml_rms_norm(ctx, x, 1e-5f), w);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("rms_norm+mul", gf, y);
+}
+
+static int test_norm(int n_embd, int n_tokens) {
+    struct ggml_tensor *x = randomized(GGML_TYPE_F32, n_embd, n_tokens, 1);
+    struct ggml_tensor *y = ggml_norm(ctx, x, 1e-5f);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("norm", gf, y);
+}
+
+static int test_soft_max(int n_kv, int n_tokens, int n_head) {
+    struct ggml_tensor *kq = randomized(GGML_TYPE_F32, n_kv, n_tokens, n_head);
+    struct ggml_tensor *mask = randomized(GGML_TYPE_F16, n_kv, n_tokens, 1);
+    struct ggml_tensor *y = ggml_soft_max_ext(ctx, kq, mask, 0.125f, 0.0f);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("soft_max", gf, y);
+}
+
+static int test_rope(int n_rot, int n_head, int n_tokens, int mode) {
+    struct ggml_tensor *x = randomized(GGML_TYPE_F32, n_rot, n_head, n_tokens);
+    struct ggml_tensor *pos = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, n_tokens);
+    for (int i = 0; i < n_tokens; ++i)
+        ((int32_t *)pos->data)[i] = 100 + i;
+    struct ggml_tensor *y =
+        ggml_rope_ext(ctx, x, pos, NULL, n_rot, mode, 4096, 10000.f, 1.f, 0.f, 1.f, 32.f, 1.f);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check(mode ? "rope (neox)" : "rope", gf, y);
+}
+
+static int test_get_rows(int n_embd, int n_vocab, int n_tokens) {
+    struct ggml_tensor *x = randomized(GGML_TYPE_F32, n_embd, n_vocab, 1);
+    struct ggml_tensor *q = ggml_new_tensor_2d(ctx, GGML_TYPE_Q8_0, n_embd, n_vocab);
+    ggml_quantize_chunk(GGML_TYPE_Q8_0, (float *)x->data, q->data, 0, n_vocab, n_embd, nullptr);
+    struct ggml_tensor *ids = ggml_new_tensor_1d(ctx, GGML_TYPE_I32, n_tokens);
+    for (int i = 0; i < n_tokens; ++i)
+        ((int32_t *)ids->data)[i] = rand() % n_vocab;
+    struct ggml_tensor *y = ggml_get_rows(ctx, q, ids);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("get_rows", gf, y);
+}
+
+static int test_cpy(int n_embd, int n_tokens) {
+    struct ggml_tensor *x = randomized(GGML_TYPE_F32, n_embd, n_tokens, 1);
+    struct ggml_tensor *k = ggml_new_tensor_2d(ctx, GGML_TYPE_F16, n_embd, n_tokens);
+    struct ggml_tensor *y = ggml_cpy(ctx, x, k);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("cpy f32->f16", gf, y);
+}
+
+static int test_flash_attn(int head_dim, int n_head, int n_kv, int n_tokens) {
+    struct ggml_tensor *q = randomized(GGML_TYPE_F32, head_dim, n_tokens, n_head);
+    struct ggml_tensor *k = randomized(GGML_TYPE_F16, head_dim, n_kv, n_head);
+    struct ggml_tensor *v = randomized(GGML_TYPE_F16, head_dim, n_kv, n_head);
+    struct ggml_tensor *mask =
+        randomized(GGML_TYPE_F16, n_kv, GGML_PAD(n_tokens, GGML_KQ_MASK_PAD), 1);
+    struct ggml_tensor *y = ggml_flash_attn_ext(ctx, q, k, v, mask, 0.125f, 0.0f);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("flash_attn_ext", gf, y);
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+    ggml_test_init(argc, argv, 512 * 1024 * 1024, 4);
+    if ((rc = test_rms_norm(4096, 512)))
+        return rc;
+    if ((rc = test_rms_norm_mul(4096, 512)))
+        return rc;
+    if ((rc = test_norm(4096, 77)))
+        return rc;
+    if ((rc = test_soft_max(1024, 64, 32)))
+        return rc;
+    if ((rc = test_rope(128, 32, 64, 0)))
+        return rc;
+    if ((rc = test_rope(128, 32, 7, GGML_ROPE_TYPE_NEOX)))
+        return rc;
+    if ((rc = test_get_rows(4096, 1000, 100)))
+        return rc;
+    if ((rc = test_cpy(1024, 512)))
+        return rc;
+    if ((rc = test_flash_attn(128, 8, 512, 16)))
+        return rc;
+    ggml_free(ctx);
+}
@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #include "datauri.h"
+#include "base64.h"
 #include "llama.cpp/base64.h"
 #include "llamafile/string.h"
 #include <cctype>
@@ -267,8 +268,12 @@ size_t DataUri::parse(std::string_view s) {
 }
 
 std::string DataUri::decode() {
-    if (has_param("base64"))
-        return base64::decode(data);
+    if (has_param("base64")) {
+        std::string r;
+        if (!lf::decode_base64(&r, data))
+            throw base64_error("invalid base64");
+        return r;
+    }
     return percent_decode(data);
 }
 
@@ -0,0 +1,372 @@
+// -*- mode:c;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=c ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "experts.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "llama.cpp/ggml.h"
+#include "llamafile.h"
+#include "log.h"
+
+// expert aware weight residency
+//
+// when a mixture of experts model is bigger than ram, the kernel will
+// evict pages of the mmap()'d weights with no regard for which experts
+// the router actually likes. we keep a decaying histogram of how often
+// each expert of each weight tensor gets picked, then ask the kernel to
+// keep the popular ones resident, and to reclaim unpopular ones first.
+// routing only updates the histogram, since it happens on the critical
+// path of inference. the decisions, which mlock() and so fault pages in
+// synchronously, are made by a helper thread.
+
+#define EXPERTS_TABLE 1024 // max moe weight tensors tracked (two power)
+#define EXPERTS_MAX 512 // max experts per weight tensor
+#define EXPERTS_DECAY .995f // per token, so history has a half life of ~140 tokens
+#define EXPERTS_PERIOD 32 // routings between residency decisions
+#define EXPERTS_WARMUP 256 // tokens seen before anything is called cold
+#define EXPERTS_HOT 1.5f // multiple of fair share that makes an expert hot
+#define EXPERTS_COLD .25f // multiple of fair share that makes an expert cold
+
+enum {
+    EXPERT_WARM,
+    EXPERT_HOT,
+    EXPERT_COLD,
+};
+
+struct Experts {
+    const char *data;
+    size_t size; // bytes per expert
+    int count;
+    unsigned routes;
+    unsigned long tokens;
+    bool pending; // helper thread should decide residency
+    float *score;
+    unsigned char *state;
+    unsigned char *locked; // mlock() succeeded, which it may not for all
+};
+
+static bool g_nolock;
+static bool g_busy; // helper thread is changing residency outside lock
+static int g_count;
+static int g_worker; // 1 if helper thread is running, -1 if it failed
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_idle = PTHREAD_COND_INITIALIZER;
+static struct Experts g_experts[EXPERTS_TABLE];
+
+static uintptr_t page_size(void) {
+    static uintptr_t pagesz;
+    if (!pagesz)
+        pagesz = sysconf(_SC_PAGESIZE);
+    return pagesz;
+}
+
+// returns pages wholly or partially covered by expert
+static char *outer_pages(const char *data, size_t stride, int i, size_t *size) {
+    uintptr_t mask = page_size() - 1;
+    uintptr_t beg = (uintptr_t)data + stride * i;
+    uintptr_t end = beg + stride;
+    beg &= ~mask;
+    end = (end + mask) & ~mask;
+    *size = end - beg;
+    return (char *)beg;
+}
+
+// returns pages wholly covered by expert, so neighbors aren't harmed.
+// pages shared with a neighbor are never locked, since unlocking them
+// later could unlock a neighbor that's still hot, and it's only a page
+// on either side of experts that are many megabytes
+static char *inner_pages(const struct Experts *e, int i, size_t *size) {
+    uintptr_t mask = page_size() - 1;
+    uintptr_t beg = (uintptr_t)e->data + e->size * i;
+    uintptr_t end = beg + e->size;
+    beg = (beg + mask) & ~mask;
+    end &= ~mask;
+    *size = end > beg ? end - beg : 0;
+    return (char *)beg;
+}
+
+static unsigned experts_hash(const void *data) {
+    return (uintptr_t)data * 0x9e3779b97f4a7c15ull >> 32;
+}
+
+static struct Experts *experts_get(const struct ggml_tensor *weights) {
+    int count = weights->ne[2];
+    if (count < 2 || count > EXPERTS_MAX)
+        return 0;
+    unsigned hash = experts_hash(weights->data);
+    for (int i = 0; i < EXPERTS_TABLE; ++i) {
+        struct Experts *e = &g_experts[(hash + i) & (EXPERTS_TABLE - 1)];
+        if (e->data == weights->data)
+            return e->count == count ? e : 0;
+        if (e->data)
+            continue;
+        if (!(e->score = calloc(count, sizeof(float))))
+            return 0;
+        if (!(e->state = calloc(count, 1))) {
+            free(e->score);
+            return 0;
+        }
+        if (!(e->locked = calloc(count, 1))) {
+            free(e->state);
+            free(e->score);
+            return 0;
+        }
+        e->data = weights->data;
+        e->size = weights->nb[2];
+        e->count = count;
+        ++g_count;
+        return e;
+    }
+    return 0;
+}
+
+static void expert_lock(struct Experts *e, int i) {
+    size_t size;
+    char *addr = outer_pages(e->data, e->size, i, &size);
+    posix_madvise(addr, size, POSIX_MADV_WILLNEED);
+    if (FLAG_mlock || g_nolock)
+        return;
+    addr = inner_pages(e, i, &size);
+    if (!size)
+        return;
+    if (mlock(addr, size)) {
+        tinylog("warning: couldn't mlock() hot experts: ", strerror(errno),
+                " (try raising RLIMIT_MEMLOCK)\n", NULL);
+        g_nolock = true;
+        return;
+    }
+    e->locked[i] = 1;
+}
+
+static void expert_unlock(struct Experts *e, int i) {
+    size_t size;
+    if (!e->locked[i])
+        return;
+    char *addr = inner_pages(e, i, &size);
+    munlock(addr, size);
+    e->locked[i] = 0;
+}
+
+static void expert_cool(struct Experts *e, int i) {
+#ifdef MADV_COLD
+    size_t size;
+    char *addr = inner_pages(e, i, &size);
+    if (size)
+        madvise(addr, size, MADV_COLD);
+#endif
+}
+
+// changes residency of experts based on a snapshot of their scores.
+// this is only called by the helper thread while g_busy is set, which
+// forget() waits on, so e can't be freed or moved from under us
+static void experts_decide(struct Experts *e, const float *score, unsigned long tokens) {
+    float sum = 0;
+    for (int i = 0; i < e->count; ++i)
+        sum += score[i];
+    if (!(sum > 0))
+        return;
+    float fair = sum / e->count;
+    for (int i = 0; i < e->count; ++i) {
+        int want = EXPERT_WARM;
+        if (score[i] >= EXPERTS_HOT * fair || (e->state[i] == EXPERT_HOT && score[i] >= fair))
+            want = EXPERT_HOT; // with hysteresis to avoid flapping
+        else if (tokens >= EXPERTS_WARMUP && score[i] < EXPERTS_COLD * fair)
+            want = EXPERT_COLD;
+        if (want == e->state[i])
+            continue;
+        if (e->state[i] == EXPERT_HOT)
+            expert_unlock(e, i);
+        if (want == EXPERT_HOT)
+            expert_lock(e, i);
+        else if (want == EXPERT_COLD)
+            expert_cool(e, i);
+        e->state[i] = want;
+    }
+}
+
+static struct Experts *experts_pending(void) {
+    for (int i = 0; i < EXPERTS_TABLE; ++i)
+        if (g_experts[i].pending)
+            return &g_experts[i];
+    return 0;
+}
+
+static void *experts_worker(void *arg) {
+    float score[EXPERTS_MAX];
+    pthread_mutex_lock(&g_lock);
+    for (;;) {
+        struct Experts *e;
+        if (!(e = experts_pending())) {
+            pthread_cond_wait(&g_work, &g_lock);
+            continue;
+        }
+        e->pending = false;
+        memcpy(score, e->score, e->count * sizeof(float));
+        unsigned long tokens = e->tokens;
+        g_busy = true;
+        pthread_mutex_unlock(&g_lock);
+        experts_decide(e, score, tokens);
+        pthread_mutex_lock(&g_lock);
+        g_busy = false;
+        pthread_cond_broadcast(&g_idle);
+    }
+    return 0;
+}
+
+// asks helper thread to decide residency of e, starting it if needed
+static void experts_schedule(struct Experts *e) {
+    if (!g_worker) {
+        pthread_t th;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 128 * 1024);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        errno_t err = pthread_create(&th, &attr, experts_worker, 0);
+        pthread_attr_destroy(&attr);
+        if (err)
+            tinylog("warning: couldn't start expert residency thread: ", strerror(err), "\n",
+                    NULL);
+        g_worker = err ? -1 : 1;
+    }
+    if (g_worker < 0)
+        return;
+    e->pending = true;
+    pthread_cond_signal(&g_work);
+}
+
+/**
+ * Records which experts of `weights` were chosen by router `plan`.
+ *
+ * This is called by GGML_OP_MUL_MAT_ID once its plan is known. Every so
+ * often a helper thread is asked to prefault and lock the most popular
+ * experts into memory, and mark the least popular ones as the first to
+ * be reclaimed. This function itself never blocks on the kernel.
+ */
+void llamafile_experts_route(const struct ggml_tensor *weights, const struct ggml_tensor *plan) {
+    int counts[EXPERTS_MAX];
+    struct Experts *e;
+    pthread_mutex_lock(&g_lock);
+    if ((e = experts_get(weights))) {
+        memset(counts, 0, e->count * sizeof(int));
+        for (int64_t token = 0; token < plan->ne[1]; ++token)
+            for (int64_t k = 0; k < plan->ne[0]; ++k) {
+                int i = *(const int32_t *)((const char *)plan->data + token * plan->nb[1] +
+                                           k * plan->nb[0]);
+                if (0 <= i && i < e->count)
+                    ++counts[i];
+            }
+        float decay = powf(EXPERTS_DECAY, plan->ne[1]);
+        for (int i = 0; i < e->count; ++i)
+            e->score[i] = e->score[i] * decay + counts[i];
+        e->tokens += plan->ne[1];
+        if (!(++e->routes % EXPERTS_PERIOD))
+            experts_schedule(e);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * Asks kernel to start reading experts of `weights` chosen by `plan`.
+ *
+ * This is called as soon as the router output is known, for the expert
+ * weights that'll be multiplied after the one currently being computed,
+ * so their page faults can overlap with useful work.
+ */
+void llamafile_experts_prefetch(const struct ggml_tensor *weights, const struct ggml_tensor *plan) {
+    unsigned char seen[EXPERTS_MAX];
+    int count = weights->ne[2];
+    if (count < 2 || count > EXPERTS_MAX)
+        return;
+    memset(seen, 0, count);
+    for (int64_t token = 0; token < plan->ne[1]; ++token)
+        for (int64_t k = 0; k < plan->ne[0]; ++k) {
+            int i = *(const int32_t *)((const char *)plan->data + token * plan->nb[1] +
+                                       k * plan->nb[0]);
+            if (i < 0 || i >= count || seen[i])
+                continue;
+            seen[i] = 1;
+            size_t size;
+            char *addr = outer_pages(weights->data, weights->nb[2], i, &size);
+            posix_madvise(addr, size, POSIX_MADV_WILLNEED);
+        }
+}
+
+/**
+ * Waits for the helper thread to finish deciding residency of experts.
+ */
+void llamafile_experts_sync(void) {
+    pthread_mutex_lock(&g_lock);
+    while (g_busy || experts_pending())
+        pthread_cond_wait(&g_idle, &g_lock);
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * Forgets experts whose weights live inside the memory `[addr,addr+size)`.
+ *
+ * This must be called before weights memory is unmapped or freed, so the
+ * statistics get freed, hot experts get unlocked, and new weights that
+ * happen to land at the same address aren't confused with the old ones.
+ */
+void llamafile_experts_forget(const void *addr, size_t size) {
+    static struct Experts keep[EXPERTS_TABLE];
+    int n = 0;
+    pthread_mutex_lock(&g_lock);
+    while (g_busy)
+        pthread_cond_wait(&g_idle, &g_lock);
+    if (!g_count) {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+    for (int i = 0; i < EXPERTS_TABLE; ++i) {
+        struct Experts *e = &g_experts[i];
+        if (!e->data)
+            continue;
+        if ((uintptr_t)e->data - (uintptr_t)addr < size) {
+            for (int j = 0; j < e->count; ++j)
+                expert_unlock(e, j);
+            free(e->score);
+            free(e->state);
+            free(e->locked);
+            --g_count;
+        } else {
+            keep[n++] = *e;
+        }
+    }
+    // rebuild the table, since removing entries breaks probe sequences
+    memset(g_experts, 0, sizeof(g_experts));
+    for (int k = 0; k < n; ++k) {
+        unsigned hash = experts_hash(keep[k].data);
+        for (int i = 0; i < EXPERTS_TABLE; ++i) {
+            struct Experts *e = &g_experts[(hash + i) & (EXPERTS_TABLE - 1)];
+            if (!e->data) {
+                *e = keep[k];
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+}
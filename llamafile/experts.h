@@ -0,0 +1,16 @@
+#pragma once
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ggml_tensor;
+
+void llamafile_experts_route(const struct ggml_tensor *, const struct ggml_tensor *);
+void llamafile_experts_prefetch(const struct ggml_tensor *, const struct ggml_tensor *);
+void llamafile_experts_forget(const void *, size_t);
+void llamafile_experts_sync(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,119 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "experts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "llama.cpp/ggml.h"
+#include "llamafile.h"
+
+#define EXPERTS 8
+#define PAGES 16 // per expert
+#define TOKENS 64 // per routing
+#define ROUTES 32 // routings per residency decision
+
+static char *g_data;
+static size_t g_size;
+static struct ggml_tensor g_weights;
+
+// returns kilobytes of memory locked by this process, or -1 if unknown
+static long locked_kb(void) {
+    char line[256];
+    long kb = -1;
+    FILE *f;
+    if (!(f = fopen("/proc/self/status", "r")))
+        return -1;
+    while (fgets(line, sizeof(line), f))
+        if (!strncmp(line, "VmLck:", 6))
+            kb = atol(line + 6);
+    fclose(f);
+    return kb;
+}
+
+// routes each token to experts `a` and `b` until a decision is made
+static void route(int a, int b) {
+    int32_t ids[TOKENS][2];
+    for (int t = 0; t < TOKENS; ++t) {
+        ids[t][0] = a;
+        ids[t][1] = b;
+    }
+    struct ggml_tensor plan = {};
+    plan.type = GGML_TYPE_I32;
+    plan.data = ids;
+    plan.ne[0] = 2;
+    plan.ne[1] = TOKENS;
+    plan.nb[0] = sizeof(int32_t);
+    plan.nb[1] = sizeof(ids[0]);
+    for (int i = 0; i < ROUTES; ++i)
+        llamafile_experts_route(&g_weights, &plan);
+    llamafile_experts_sync();
+}
+
+int main() {
+    FLAGS_READY = true;
+    long expert_size = PAGES * sysconf(_SC_PAGESIZE);
+    g_size = EXPERTS * expert_size;
+    g_data = (char *)mmap(0, g_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (g_data == MAP_FAILED)
+        return 1;
+    memset(g_data, 1, g_size);
+    g_weights.type = GGML_TYPE_F32;
+    g_weights.data = g_data;
+    g_weights.ne[0] = expert_size / sizeof(float);
+    g_weights.ne[1] = 1;
+    g_weights.ne[2] = EXPERTS;
+    g_weights.nb[0] = sizeof(float);
+    g_weights.nb[1] = expert_size;
+    g_weights.nb[2] = expert_size;
+
+    // skip if we can't tell what's locked, or aren't allowed to lock
+    if (locked_kb() != 0 || mlock(g_data, expert_size * 2))
+        return 0;
+    munlock(g_data, expert_size * 2);
+
+    // an expert the router always picks gets locked
+    route(3, 3);
+    if (locked_kb() != expert_size / 1024)
+        return 2;
+
+    // and unlocked once the router has moved on to another one
+    route(5, 5);
+    if (locked_kb() != expert_size / 1024)
+        return 3;
+    // it's expert five that's locked, if unlocking it unlocks everything
+    if (munlock(g_data + expert_size * 5, expert_size) || locked_kb() != 0)
+        return 4;
+    if (mlock(g_data + expert_size * 5, expert_size))
+        return 5;
+
+    // an expert that can't be locked stops further locking, but experts
+    // that were locked before that still need to be unlocked later on
+    munmap(g_data + expert_size * 6, expert_size);
+    route(5, 6);
+    if (locked_kb() != expert_size / 1024)
+        return 6;
+    llamafile_experts_forget(g_data, g_size);
+    if (locked_kb() != 0)
+        return 7;
+
+    munmap(g_data, g_size);
+}
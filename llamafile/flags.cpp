@@ -40,12 +40,15 @@ bool FLAGS_READY = false;
 bool FLAG_ascii = false;
 bool FLAG_completion_mode = false;
 bool FLAG_fast = false;
+bool FLAG_fuse_weights = false;
 bool FLAG_iq = false;
 bool FLAG_log_disable = false;
 bool FLAG_mlock = false;
 bool FLAG_mmap = true;
+bool FLAG_moe_residency = false;
 bool FLAG_no_display_prompt = false;
 bool FLAG_nocompile = false;
+bool FLAG_nofuse = false;
 bool FLAG_nologo = false;
 bool FLAG_precise = false;
 bool FLAG_recompile = false;
@@ -70,11 +73,14 @@ float FLAG_presence_penalty = 0;
 float FLAG_temperature = .8;
 float FLAG_top_p = .95;
 int FLAG_batch = 2048;
+int FLAG_cache_type_k = GGML_TYPE_F16;
+int FLAG_cache_type_v = GGML_TYPE_F16;
 int FLAG_ctx_size = 8192;
 int FLAG_flash_attn = false;
 int FLAG_gpu = 0;
 int FLAG_http_ibuf_size = 5 * 1024 * 1024;
 int FLAG_http_obuf_size = 1024 * 1024;
+int FLAG_keep = 4;
 int FLAG_keepalive = 5;
 int FLAG_main_gpu = 0;
 int FLAG_n_gpu_layers = -1;
@@ -128,6 +134,18 @@ static wontreturn void unknown(const char *flag) {
     exit(1);
 }
 
+// returns kv cache type having name, or -1 if unsupported
+static int parse_cache_type(const char *name) {
+    static const ggml_type kCacheTypes[] = {
+        GGML_TYPE_F16,  GGML_TYPE_BF16, GGML_TYPE_Q8_0, GGML_TYPE_Q4_0,
+        GGML_TYPE_Q4_1, GGML_TYPE_Q5_0, GGML_TYPE_Q5_1, GGML_TYPE_IQ4_NL,
+    };
+    for (ggml_type type : kCacheTypes)
+        if (!strcasecmp(name, ggml_type_name(type)))
+            return type;
+    return -1;
+}
+
 static bool is_valid_chat_template(const char *tmpl) {
     llama_chat_message chat[] = {{"user", "test"}};
     return llama_chat_apply_template(nullptr, tmpl, chat, 1, true, nullptr, 0) >= 0;
@@ -386,6 +404,13 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--keep")) {
+            if (i == argc)
+                missing("--keep");
+            FLAG_keep = atoi(argv[i++]);
+            continue;
+        }
+
         if (!strcmp(flag, "--chat-template")) {
             if (i == argc)
                 missing("--chat-template");
@@ -458,6 +483,22 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "-ctk") || !strcmp(flag, "--cache-type-k")) {
+            if (i == argc)
+                missing("--cache-type-k");
+            if ((FLAG_cache_type_k = parse_cache_type(argv[i++])) == -1)
+                bad("--cache-type-k");
+            continue;
+        }
+
+        if (!strcmp(flag, "-ctv") || !strcmp(flag, "--cache-type-v")) {
+            if (i == argc)
+                missing("--cache-type-v");
+            if ((FLAG_cache_type_v = parse_cache_type(argv[i++])) == -1)
+                bad("--cache-type-v");
+            continue;
+        }
+
         if (!strcmp(flag, "--no-warmup")) {
             FLAG_warmup = false;
             continue;
@@ -487,6 +528,21 @@ void llamafile_get_flags(int argc, char **argv) {
             continue;
         }
 
+        if (!strcmp(flag, "--no-fuse")) {
+            FLAG_nofuse = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--fuse-weights")) {
+            FLAG_fuse_weights = true;
+            continue;
+        }
+
+        if (!strcmp(flag, "--moe-residency")) {
+            FLAG_moe_residency = true;
+            continue;
+        }
+
         if (!strcmp(flag, "--trap")) {
             FLAG_trap = true;
             FLAG_unsecure = true;
@@ -590,6 +646,10 @@ void llamafile_get_flags(int argc, char **argv) {
     if (!FLAG_model)
         required("--model");
 
+    if (FLAG_cache_type_v != GGML_TYPE_F16 && FLAG_cache_type_v != GGML_TYPE_BF16 &&
+        !FLAG_flash_attn)
+        error("quantized --cache-type-v requires --flash-attn");
+
     FLAGS_READY = true;
     FLAG_n_gpu_layers = llamafile_gpu_layers(FLAG_n_gpu_layers);
 }
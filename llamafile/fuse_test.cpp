@@ -0,0 +1,131 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ggml_test.h"
+
+#define ITERATIONS 100
+
+// checks fused elementwise ops produce the same output as unfused ops
+
+static void unfused(struct ggml_cgraph *gf) {
+    FLAG_nofuse = true;
+    ggml_graph_compute_with_ctx(ctx, gf, nth);
+}
+
+static void fused(struct ggml_cgraph *gf) {
+    FLAG_nofuse = false;
+    ggml_graph_compute_with_ctx(ctx, gf, nth);
+}
+
+// fused ops accumulate the same way as unfused ones, so they must agree
+// exactly, otherwise the same prompt could sample differently
+static int compare(const char *name, struct ggml_tensor *t, const float *want) {
+    const float *got = (const float *)t->data;
+    for (int i = 0; i < ggml_nelements(t); ++i) {
+        if (got[i] != want[i]) {
+            fprintf(stderr, "%s: %s mismatch at %d: got %g want %g\n", __FILE__, name, i, got[i],
+                    want[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int check(const char *name, struct ggml_cgraph *gf, struct ggml_tensor *out) {
+    int rc;
+    size_t size = ggml_nbytes(out);
+    float *want = (float *)malloc(size);
+
+    memset(out->data, 0, size);
+    unfused(gf);
+    memcpy(want, out->data, size);
+    memset(out->data, 0, size);
+    fused(gf);
+    if ((rc = compare(name, out, want)))
+        goto Finish;
+
+    if (g_bench) {
+        printf("%s %lld elements\n", name, (long long)ggml_nelements(out));
+        BENCH(unfused(gf));
+        BENCH(fused(gf));
+    }
+
+Finish:
+    free(want);
+    return rc;
+}
+
+static int test_rms_norm_mul(int n_embd, int n_tokens) {
+    struct ggml_tensor *x = randomized(GGML_TYPE_F32, n_embd, n_tokens, 1);
+    struct ggml_tensor *w = randomized(GGML_TYPE_F32, n_embd, 1, 1);
+    struct ggml_tensor *y = ggml_mul(ctx, ggml_rms_norm(ctx, x, 1e-5f), w);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("rms_norm+mul", gf, y);
+}
+
+static int test_swiglu(int n_ff, int n_tokens) {
+    struct ggml_tensor *gate = randomized(GGML_TYPE_F32, n_ff, n_tokens, 1);
+    struct ggml_tensor *up = randomized(GGML_TYPE_F32, n_ff, n_tokens, 1);
+    struct ggml_tensor *y = ggml_mul(ctx, ggml_silu(ctx, gate), up);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("silu+mul", gf, y);
+}
+
+static int test_add_rms_norm_mul(int n_embd, int n_tokens) {
+    struct ggml_tensor *a = randomized(GGML_TYPE_F32, n_embd, n_tokens, 1);
+    struct ggml_tensor *b = randomized(GGML_TYPE_F32, n_embd, n_tokens, 1);
+    struct ggml_tensor *w = randomized(GGML_TYPE_F32, n_embd, 1, 1);
+    struct ggml_tensor *inpSA = ggml_add(ctx, a, b);
+    struct ggml_tensor *y = ggml_mul(ctx, ggml_rms_norm(ctx, inpSA, 1e-5f), w);
+    struct ggml_tensor *z = ggml_add(ctx, y, inpSA); // residual is still live
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, z);
+    return check("add+rms_norm+mul", gf, z);
+}
+
+static int test_silu_shared(int n_ff, int n_tokens) {
+    // silu has two consumers so it mustn't be elided
+    struct ggml_tensor *gate = randomized(GGML_TYPE_F32, n_ff, n_tokens, 1);
+    struct ggml_tensor *up = randomized(GGML_TYPE_F32, n_ff, n_tokens, 1);
+    struct ggml_tensor *s = ggml_silu(ctx, gate);
+    struct ggml_tensor *y = ggml_add(ctx, ggml_mul(ctx, s, up), s);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    return check("silu+mul (shared)", gf, y);
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+    ggml_test_init(argc, argv, 256 * 1024 * 1024, 1);
+    if ((rc = test_rms_norm_mul(4096, 1)))
+        return rc;
+    if ((rc = test_rms_norm_mul(4096, 64)))
+        return rc;
+    if ((rc = test_swiglu(11008, 1)))
+        return rc;
+    if ((rc = test_swiglu(11008, 64)))
+        return rc;
+    if ((rc = test_add_rms_norm_mul(4096, 1)))
+        return rc;
+    if ((rc = test_add_rms_norm_mul(4096, 64)))
+        return rc;
+    if ((rc = test_silu_shared(1000, 3)))
+        return rc;
+    ggml_free(ctx);
+}
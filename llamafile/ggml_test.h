@@ -0,0 +1,52 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "llama.cpp/cores.h"
+#include "llama.cpp/ggml.h"
+#include "llamafile.h"
+
+// shared fixture for tests of cpu ggml ops
+//
+// by default tests only check correctness, so they're quick enough to
+// run with the other tests. passing -b makes them benchmark too, which
+// is what `make o//llamafile/bench` does.
+
+static struct ggml_context *ctx;
+static int nth;
+static bool g_bench;
+
+static float frand(void) {
+    return (float)rand() / RAND_MAX * 2 - 1;
+}
+
+static struct ggml_tensor *randomized(enum ggml_type type, int ne0, int ne1, int ne2) {
+    struct ggml_tensor *t = ggml_new_tensor_3d(ctx, type, ne0, ne1, ne2);
+    for (int i = 0; i < ne0 * ne1 * ne2; ++i)
+        if (type == GGML_TYPE_F16) {
+            ((ggml_fp16_t *)t->data)[i] = ggml_fp32_to_fp16(frand());
+        } else {
+            ((float *)t->data)[i] = frand();
+        }
+    return t;
+}
+
+// creates the context and picks the thread count. `min_threads` lets
+// tests exercise work splitting even on machines with few cores.
+static void ggml_test_init(int argc, char *argv[], size_t mem_size, int min_threads) {
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ mem_size,
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ false,
+    };
+    g_bench = argc > 1 && !strcmp(argv[1], "-b");
+    FLAGS_READY = true;
+    nth = cpu_get_num_math();
+    if (nth < min_threads)
+        nth = min_threads;
+    ctx = ggml_init(params);
+}
@@ -19,6 +19,7 @@
 #include "llama.cpp/llama.h"
 #include <cassert>
 #include <string>
+#include <string_view>
 #include <vector>
 
 int llamafile_token_eot(llama_model *model) {
@@ -28,20 +29,17 @@ int llamafile_token_eot(llama_model *model) {
     return llama_token_eos(model);
 }
 
+// returns text of token, which is valid as long as the model is loaded
+std::string_view llamafile_token_piece(const llama_model *model, llama_token token, bool special) {
+    int32_t length, flags;
+    const char *piece = llama_token_get_piece(model, token, &length, &flags);
+    if (!piece || (!special && (flags & LLAMA_PIECE_SPECIAL)))
+        return {};
+    return std::string_view(piece, length);
+}
+
 std::string llamafile_token_to_piece(const llama_context *ctx, llama_token token, bool special) {
-    std::string piece;
-    piece.resize(piece.capacity());
-    const int n_chars =
-        llama_token_to_piece(llama_get_model(ctx), token, &piece[0], piece.size(), 0, special);
-    if (n_chars < 0) {
-        piece.resize(-n_chars);
-        int check =
-            llama_token_to_piece(llama_get_model(ctx), token, &piece[0], piece.size(), 0, special);
-        unassert(check == -n_chars);
-    } else {
-        piece.resize(n_chars);
-    }
-    return piece;
+    return std::string(llamafile_token_piece(llama_get_model(ctx), token, special));
 }
 
 std::vector<llama_token> llamafile_tokenize(const struct llama_model *model,
@@ -10,12 +10,15 @@ extern bool FLAGS_READY;
 extern bool FLAG_ascii;
 extern bool FLAG_completion_mode;
 extern bool FLAG_fast;
+extern bool FLAG_fuse_weights;
 extern bool FLAG_iq;
 extern bool FLAG_log_disable;
 extern bool FLAG_mlock;
 extern bool FLAG_mmap;
+extern bool FLAG_moe_residency;
 extern bool FLAG_no_display_prompt;
 extern bool FLAG_nocompile;
+extern bool FLAG_nofuse;
 extern bool FLAG_nologo;
 extern bool FLAG_precise;
 extern bool FLAG_recompile;
@@ -40,12 +43,15 @@ extern float FLAG_presence_penalty;
 extern float FLAG_temperature;
 extern float FLAG_top_p;
 extern int FLAG_batch;
+extern int FLAG_cache_type_k;
+extern int FLAG_cache_type_v;
 extern int FLAG_ctx_size;
 extern int FLAG_flash_attn;
 extern int FLAG_gpu;
 extern int FLAG_gpu;
 extern int FLAG_http_ibuf_size;
 extern int FLAG_http_obuf_size;
+extern int FLAG_keep;
 extern int FLAG_keepalive;
 extern int FLAG_main_gpu;
 extern int FLAG_n_gpu_layers;
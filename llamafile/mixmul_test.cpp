@@ -0,0 +1,133 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ggml_test.h"
+#include <math.h>
+#include <vector>
+
+#define ITERATIONS 10
+
+// checks mixture of experts matmul against the definition, makes sure
+// the way experts get scheduled across threads doesn't change results,
+// and benchmarks prompt processing with realistic routing like uniform
+// top-2 of 8 (mixtral) and zipf skewed top-4 of 60 (qwen moe).
+
+// picks `used` distinct experts per token where expert i is chosen
+// with probability proportional to 1/(i+1)^skew
+static void route(struct ggml_tensor *ids, int experts, int used, double skew) {
+    std::vector<double> cdf(experts);
+    double sum = 0;
+    for (int i = 0; i < experts; ++i)
+        cdf[i] = sum += 1 / pow(i + 1, skew);
+    for (int64_t token = 0; token < ids->ne[1]; ++token) {
+        int32_t *plan = (int32_t *)((char *)ids->data + token * ids->nb[1]);
+        for (int k = 0; k < used;) {
+            double x = (double)rand() / RAND_MAX * sum;
+            int e = 0;
+            while (e < experts - 1 && cdf[e] < x)
+                ++e;
+            bool dupe = false;
+            for (int j = 0; j < k; ++j)
+                dupe |= plan[j] == e;
+            if (!dupe)
+                plan[k++] = e;
+        }
+    }
+}
+
+static int check(const char *name, enum ggml_type type, int cols, int rows, int experts,
+                 int used, int tokens, double skew) {
+    int rc = 0;
+    if (!g_bench && tokens > 64)
+        tokens = 64; // checking against the definition is slow
+    struct ggml_tensor *w = ggml_new_tensor_3d(ctx, type, cols, rows, experts);
+    struct ggml_tensor *x = randomized(GGML_TYPE_F32, cols, 1, tokens);
+    struct ggml_tensor *ids = ggml_new_tensor_2d(ctx, GGML_TYPE_I32, used, tokens);
+    std::vector<float> wf((size_t)cols * rows * experts);
+    for (auto &f : wf)
+        f = frand();
+    ggml_quantize_chunk(type, wf.data(), w->data, 0, (int64_t)rows * experts, cols, nullptr);
+    ggml_internal_get_type_traits(type).to_float(w->data, wf.data(), wf.size());
+    route(ids, experts, used, skew);
+    struct ggml_tensor *y = ggml_mul_mat_id(ctx, w, x, ids);
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+
+    // compare against the definition
+    ggml_graph_compute_with_ctx(ctx, gf, 1);
+    double err = 0, mag = 0;
+    for (int token = 0; token < tokens; ++token)
+        for (int k = 0; k < used; ++k) {
+            int expert = ((int32_t *)ids->data)[token * used + k];
+            const float *b = (const float *)x->data + (size_t)token * cols;
+            const float *c = (const float *)((char *)y->data + token * y->nb[2] + k * y->nb[1]);
+            for (int row = 0; row < rows; ++row) {
+                const float *a = &wf[((size_t)expert * rows + row) * cols];
+                double sum = 0;
+                for (int col = 0; col < cols; ++col)
+                    sum += (double)a[col] * b[col];
+                err = fmax(err, fabs(c[row] - sum));
+                mag = fmax(mag, fabs(sum));
+            }
+        }
+    if (!(err <= mag * 1e-2)) {
+        fprintf(stderr, "%s: %s error %g exceeds %g\n", __FILE__, name, err, mag * 1e-2);
+        return 1;
+    }
+
+    // results shouldn't depend on how experts were split among threads
+    size_t size = ggml_nbytes(y);
+    char *want = (char *)malloc(size);
+    memcpy(want, y->data, size);
+    for (int n = 2; n <= nth * 2; n += n - 1) {
+        memset(y->data, 0, size);
+        ggml_graph_compute_with_ctx(ctx, gf, n);
+        if (memcmp(want, y->data, size)) {
+            fprintf(stderr, "%s: %s output changed with %d threads\n", __FILE__, name, n);
+            rc = 2;
+            goto Finish;
+        }
+    }
+
+    if (g_bench) {
+        printf("%s %s %dx%d top-%d of %d w/ %d tokens\n", name, ggml_type_name(type), rows,
+               cols, used, experts, tokens);
+        BENCH(ggml_graph_compute_with_ctx(ctx, gf, nth));
+    }
+
+Finish:
+    free(want);
+    return rc;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+    ggml_test_init(argc, argv, 1024 * 1024 * 1024, 4);
+    if ((rc = check("mixtral", GGML_TYPE_Q4_0, 1024, 512, 8, 2, 256, 0)))
+        return rc;
+    if ((rc = check("mixtral skewed", GGML_TYPE_Q4_0, 1024, 512, 8, 2, 256, 1.2)))
+        return rc;
+    if ((rc = check("qwen moe", GGML_TYPE_Q8_0, 1024, 256, 60, 4, 256, 1.2)))
+        return rc;
+    if ((rc = check("mixtral", GGML_TYPE_F16, 512, 256, 8, 2, 67, 1.2)))
+        return rc;
+    if ((rc = check("mixtral", GGML_TYPE_Q4_K, 1024, 512, 8, 2, 256, 1.2)))
+        return rc;
+    if ((rc = check("generation", GGML_TYPE_Q4_0, 1024, 512, 8, 2, 1, 0)))
+        return rc;
+    ggml_free(ctx);
+}
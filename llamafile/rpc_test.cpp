@@ -0,0 +1,182 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bench.h"
+#include "llama.cpp/ggml-alloc.h"
+#include "llama.cpp/ggml-backend.h"
+#include "llama.cpp/ggml-rpc.h"
+#include "llama.cpp/ggml.h"
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#define ITERATIONS 100
+
+// checks graphs computed by an rpc worker on loopback match the cpu
+
+struct ggml_tensor *a, *b, *w, *y;
+
+float frand(void) {
+    return (float)rand() / RAND_MAX * 2 - 1;
+}
+
+struct ggml_context *build(void) {
+    struct ggml_init_params params = {
+        /*.mem_size   =*/ 64 * ggml_tensor_overhead() + ggml_graph_overhead(),
+        /*.mem_buffer =*/ NULL,
+        /*.no_alloc   =*/ true,
+    };
+    struct ggml_context *ctx = ggml_init(params);
+    a = ggml_new_tensor_2d(ctx, GGML_TYPE_Q8_0, 256, 64);
+    b = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, 256, 8);
+    w = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 64);
+    ggml_set_input(b);
+    struct ggml_tensor *x = ggml_mul_mat(ctx, a, b);
+    x = ggml_mul(ctx, ggml_rms_norm(ctx, x, 1e-5f), w);
+    y = ggml_mul(ctx, ggml_silu(ctx, x), x);
+    ggml_set_output(y);
+    return ctx;
+}
+
+std::vector<float> compute(ggml_backend_t backend, const std::vector<uint8_t> &aq,
+                           const std::vector<float> &bv, const std::vector<float> &wv) {
+    struct ggml_context *ctx = build();
+    struct ggml_cgraph *gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, y);
+    ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors(ctx, backend);
+    ggml_backend_tensor_set(a, aq.data(), 0, aq.size());
+    ggml_backend_tensor_set(b, bv.data(), 0, bv.size() * sizeof(float));
+    ggml_backend_tensor_set(w, wv.data(), 0, wv.size() * sizeof(float));
+    ggml_gallocr_t galloc = ggml_gallocr_new(ggml_backend_get_default_buffer_type(backend));
+    ggml_gallocr_alloc_graph(galloc, gf);
+    ggml_backend_graph_compute(backend, gf);
+    std::vector<float> res(ggml_nelements(y));
+    ggml_backend_tensor_get(y, res.data(), 0, ggml_nbytes(y));
+    ggml_gallocr_free(galloc);
+    ggml_backend_buffer_free(buf);
+    ggml_free(ctx);
+    return res;
+}
+
+void nop(struct ggml_tensor *, const struct ggml_tensor *, int, int, void *) {
+}
+
+// sends a graph the worker refuses, which should fail the next compute
+// on that backend instead of leaving garbage outputs behind
+bool rejected_graph_fails(ggml_backend_t backend) {
+    size_t size = 8 * ggml_tensor_overhead() + 2 * ggml_graph_overhead();
+    struct ggml_init_params params = {size, NULL, true};
+    struct ggml_context *ctx = ggml_init(params);
+    struct ggml_tensor *x = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 64);
+    struct ggml_tensor *bad = ggml_map_custom1(ctx, x, nop, 1, nullptr);
+    struct ggml_tensor *good = ggml_scale(ctx, x, 2);
+    struct ggml_cgraph *g1 = ggml_new_graph(ctx);
+    struct ggml_cgraph *g2 = ggml_new_graph(ctx);
+    ggml_build_forward_expand(g1, bad);
+    ggml_build_forward_expand(g2, good);
+    ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors(ctx, backend);
+    // the failure is reported by the next graph compute, or by polling
+    // after synchronizing, which mustn't take the process down
+    bool ok = ggml_backend_graph_compute_async(backend, g1) == GGML_STATUS_SUCCESS &&
+              ggml_backend_graph_compute_async(backend, g2) == GGML_STATUS_FAILED &&
+              ggml_backend_graph_compute(backend, g2) == GGML_STATUS_SUCCESS &&
+              !ggml_backend_rpc_failed(backend) &&
+              ggml_backend_graph_compute_async(backend, g1) == GGML_STATUS_SUCCESS;
+    ggml_backend_synchronize(backend);
+    ok = ok && ggml_backend_rpc_failed(backend) && !ggml_backend_rpc_failed(backend);
+    ggml_backend_buffer_free(buf);
+    ggml_free(ctx);
+    return ok;
+}
+
+void roundtrip(struct ggml_tensor *t, std::vector<float> &v) {
+    ggml_backend_tensor_set(t, v.data(), 0, v.size() * sizeof(float));
+    ggml_backend_tensor_get(t, v.data(), 0, v.size() * sizeof(float));
+}
+
+int main(int argc, char *argv[]) {
+    ggml_backend_t cpu = ggml_backend_cpu_init();
+    std::string endpoint = "127.0.0.1:" + std::to_string(20000 + getpid() % 20000);
+
+    pid_t pid = fork();
+    if (!pid) {
+        ggml_backend_rpc_start_server(cpu, endpoint.c_str(), 1024, 1024);
+        _exit(1);
+    }
+
+    ggml_backend_t rpc = nullptr;
+    for (int i = 0; i < 500 && !rpc; ++i) {
+        usleep(10000);
+        rpc = ggml_backend_rpc_init(endpoint.c_str());
+    }
+    if (!rpc) {
+        fprintf(stderr, "%s: couldn't connect to rpc server\n", __FILE__);
+        kill(pid, SIGKILL);
+        return 1;
+    }
+
+    size_t free_mem, total_mem;
+    ggml_backend_rpc_get_device_memory(endpoint.c_str(), &free_mem, &total_mem);
+    if (free_mem != 1024 || total_mem != 1024) {
+        fprintf(stderr, "%s: wrong device memory\n", __FILE__);
+        return 2;
+    }
+
+    std::vector<float> av(256 * 64), bv(256 * 8), wv(64);
+    std::vector<uint8_t> aq(ggml_row_size(GGML_TYPE_Q8_0, 256) * 64);
+    for (auto &x : av)
+        x = frand();
+    for (auto &x : bv)
+        x = frand();
+    for (auto &x : wv)
+        x = frand();
+    ggml_quantize_chunk(GGML_TYPE_Q8_0, av.data(), aq.data(), 0, 64, 256, nullptr);
+
+    std::vector<float> want = compute(cpu, aq, bv, wv);
+    std::vector<float> got = compute(rpc, aq, bv, wv);
+    for (size_t i = 0; i < want.size(); ++i)
+        if (!(fabsf(got[i] - want[i]) <= 1e-5f * (1 + fabsf(want[i])))) {
+            fprintf(stderr, "%s: mismatch at %zu: got %g want %g\n", __FILE__, i, got[i],
+                    want[i]);
+            return 3;
+        }
+
+    if (!rejected_graph_fails(rpc)) {
+        fprintf(stderr, "%s: remote graph failure wasn't reported\n", __FILE__);
+        return 4;
+    }
+
+    // measure latency of handing 4096 activations to a worker and back
+    struct ggml_init_params params = {ggml_tensor_overhead(), NULL, true};
+    struct ggml_context *ctx = ggml_init(params);
+    struct ggml_tensor *t = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, 4096);
+    ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors(ctx, rpc);
+    std::vector<float> v(4096, 1.f);
+    BENCH(roundtrip(t, v));
+    ggml_backend_buffer_free(buf);
+    ggml_free(ctx);
+
+    ggml_backend_free(rpc);
+    ggml_backend_free(cpu);
+    kill(pid, SIGKILL);
+    waitpid(pid, 0, 0);
+}
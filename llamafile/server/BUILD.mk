@@ -46,6 +46,24 @@ o/$(MODE)/llamafile/server/fastjson_test:					\
 		o/$(MODE)/llamafile/server/fastjson.o				\
 		o/$(MODE)/double-conversion/double-conversion.a			\
 
+o/$(MODE)/llamafile/server/slot_test:						\
+		o/$(MODE)/llamafile/server/slot_test.o				\
+		o/$(MODE)/llamafile/server/slot.o				\
+		o/$(MODE)/llamafile/server/atom.o				\
+		o/$(MODE)/llamafile/server/image.o				\
+		o/$(MODE)/llamafile/server/log.o				\
+		o/$(MODE)/llamafile/server/time.o				\
+		o/$(MODE)/llama.cpp/llava/llava.a				\
+		o/$(MODE)/llama.cpp/llama.cpp.a					\
+		o/$(MODE)/third_party/stb/stb.a					\
+
+o/$(MODE)/llamafile/server/slot_test.runs:					\
+		models/TinyLLama-v0.1-5M-F16.gguf				\
+
+o/$(MODE)/llamafile/server/stopper_test:					\
+		o/$(MODE)/llamafile/server/stopper_test.o			\
+		o/$(MODE)/llamafile/server/stopper.o				\
+
 o/$(MODE)/llamafile/server/tokenbucket_test:					\
 		o/$(MODE)/llamafile/server/tokenbucket_test.o			\
 		o/$(MODE)/llamafile/server/tokenbucket.o			\
@@ -58,4 +76,6 @@ o/$(MODE)/llamafile/server:							\
 		o/$(MODE)/llamafile/server/atom_test.runs			\
 		o/$(MODE)/llamafile/server/fastjson_test.runs			\
 		o/$(MODE)/llamafile/server/image_test.runs			\
+		o/$(MODE)/llamafile/server/slot_test.runs			\
+		o/$(MODE)/llamafile/server/stopper_test.runs			\
 		o/$(MODE)/llamafile/server/tokenbucket_test.runs		\
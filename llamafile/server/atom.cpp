@@ -29,6 +29,9 @@ namespace server {
  * Each individual atom can hold one of two values. The first is a token
  * which is a short piece of text, subjective to each `llama_model`. The
  * second is an `Image` which uses a separate evaluation process.
+ *
+ * Image atoms share their `Image` by reference counting, so copying an
+ * atom, or a vector of atoms, never copies image bytes.
  */
 
 Atom::Atom(int token) : word_(1ull << 56 | (unsigned)token)
@@ -46,20 +49,39 @@ Atom::Atom(Atom&& other)
     other.word_ = 0;
 }
 
-Atom::Atom(const Atom& other)
+Atom::Atom(const Atom& other) : word_(other.word_)
 {
-    if (!other.is_image()) {
-        word_ = other.word_;
-        return;
-    }
-    Image* image = new Image(other.image());
-    word_ = 2ull << 56 | (uintptr_t)image;
+    if (is_image())
+        image().retain();
 }
 
 Atom::~Atom()
 {
     if (is_image())
-        delete (Image*)(word_ & 0x00ffffffffffffff);
+        image().release();
+}
+
+Atom&
+Atom::operator=(const Atom& other)
+{
+    if (other.is_image())
+        other.image().retain();
+    if (is_image())
+        image().release();
+    word_ = other.word_;
+    return *this;
+}
+
+Atom&
+Atom::operator=(Atom&& other)
+{
+    if (this != &other) {
+        if (is_image())
+            image().release();
+        word_ = other.word_;
+        other.word_ = 0;
+    }
+    return *this;
 }
 
 bool
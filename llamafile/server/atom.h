@@ -31,6 +31,8 @@ class Atom
     Atom(const Atom&);
     Atom(Atom&&);
     ~Atom();
+    Atom& operator=(const Atom&);
+    Atom& operator=(Atom&&);
     int token() const;
     bool empty() const;
     int ctx_used() const;
@@ -18,6 +18,7 @@
 #include "atom.h"
 #include "image.h"
 #include <cstdlib>
+#include <vector>
 
 namespace lf {
 namespace server {
@@ -105,11 +106,33 @@ test_atom_operator_eq()
                     exit(8);
 }
 
+void
+test_atom_copy()
+{
+    // copying an image atom shares the image
+    Atom a(new Image("screenshot", 7));
+    Atom b(a);
+    if (&a.image() != &b.image())
+        exit(9);
+    Atom c(1);
+    c = b;
+    if (&c.image() != &a.image() || !(c == a))
+        exit(10);
+    c = Atom(2);
+    if (!c.is_token() || c.token() != 2 || a.image().ctx_used() != 7)
+        exit(11);
+    std::vector<Atom> v(100, a);
+    std::vector<Atom> w(v);
+    if (&w[99].image() != &a.image())
+        exit(12);
+}
+
 void
 atom_test()
 {
     test_atom_operator_lt();
     test_atom_operator_eq();
+    test_atom_copy();
 }
 
 } // namespace
@@ -24,6 +24,7 @@
 #include "llamafile/server/image.h"
 #include "llamafile/string.h"
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace lf {
@@ -70,7 +71,7 @@ atomize(const llama_model* model,
         if (!get_image_type(image))
             continue;
         append_tokens(model, result, s.substr(0, pos), parse_special);
-        result->emplace_back(new Image(image, -1));
+        result->emplace_back(new Image(std::move(image), -1));
         s = s.substr(i + end);
         i = 0;
     }
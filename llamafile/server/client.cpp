@@ -30,6 +30,7 @@
 #include "llamafile/threadlocal.h"
 #include "llamafile/trust.h"
 #include "llamafile/version.h"
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -399,6 +400,38 @@ Client::send_response(char* p0, char* p, std::string_view content)
     return send2(std::string_view(p0, p - p0), content);
 }
 
+// sends http response message and body in one shot
+//
+// unlike send_response() the body may contain binary data, and it's
+// sent before any deferred cleanups are run, so it may be owned by one
+//
+// @param p0 points to start of http response message
+// @param p points to end of http response message headers
+bool
+Client::send_binary_response(char* p0, char* p, const std::string_view content)
+{
+    pthread_testcancel();
+    should_send_error_if_canceled_ = false;
+
+    // append content length
+    p = stpcpy(p, "Content-Length: ");
+    p = FormatInt64(p, content.size());
+    *p++ = '\r';
+    *p++ = '\n';
+
+    // finish message
+    *p++ = '\r';
+    *p++ = '\n';
+
+    if (!send(std::string_view(p0, p - p0)))
+        return false;
+    for (size_t i = 0; i < content.size(); i += 65536)
+        if (!send_binary(content.data() + i,
+                         std::min(content.size() - i, (size_t)65536)))
+            return false;
+    return true;
+}
+
 // sends http response message, but not its body.
 //
 // after this function is called, send_response_chunk() may be called to
@@ -679,6 +712,8 @@ Client::dispatcher()
     // look for dynamic endpoints
     if (p1 == "tokenize")
         return tokenize();
+    if (p1 == "detokenize")
+        return detokenize();
     if (p1 == "embedding")
         return embedding();
     if (p1 == "v1/embeddings")
@@ -691,6 +726,8 @@ Client::dispatcher()
         return slotz();
     if (p1 == "flagz")
         return flagz();
+    if (p1 == "tracez")
+        return tracez();
 
     if (p1 == "db/chats" || p1 == "db/chats/")
         return db_chats();
@@ -43,6 +43,7 @@ struct Cleanup;
 struct Slot;
 struct Worker;
 struct TokenizeParams;
+struct DetokenizeParams;
 struct EmbeddingParams;
 struct V1CompletionParams;
 struct V1ChatCompletionParams;
@@ -86,6 +87,7 @@ struct Client
     bool send_continue() __wur;
     bool send(const std::string_view) __wur;
     bool send_binary(const void*, size_t) __wur;
+    bool send_binary_response(char*, char*, const std::string_view) __wur;
     void defer_cleanup(void (*)(void*), void*);
     bool send_error(int, const char* = nullptr);
     char* append_http_response_message(char*, int, const char* = nullptr);
@@ -107,6 +109,10 @@ struct Client
 
     bool tokenize() __wur;
     bool get_tokenize_params(TokenizeParams*) __wur;
+    bool tokenize_batch(TokenizeParams*) __wur;
+
+    bool detokenize() __wur;
+    bool get_detokenize_params(DetokenizeParams*) __wur;
 
     bool embedding() __wur;
     bool get_embedding_params(EmbeddingParams*) __wur;
@@ -119,6 +125,7 @@ struct Client
 
     bool slotz() __wur;
     bool flagz() __wur;
+    bool tracez() __wur;
     bool db_chat(int64_t) __wur;
     bool db_chats() __wur;
     bool db_message(int64_t) __wur;
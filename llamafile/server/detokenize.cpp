@@ -0,0 +1,198 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/json.h"
+#include "llamafile/server/log.h"
+#include "llamafile/server/utils.h"
+#include <cosmo.h>
+#include <string>
+#include <vector>
+
+using jt::Json;
+
+namespace lf {
+namespace server {
+
+struct DetokenizeParams
+{
+    bool remove_special;
+    bool unparse_special;
+    bool batch = false;
+    std::vector<std::vector<llama_token>> ids;
+};
+
+static void
+cleanup_detokenize_params(void* arg)
+{
+    delete (DetokenizeParams*)arg;
+}
+
+static bool
+get_ids(Json& json, std::vector<llama_token>* ids)
+{
+    for (const Json& id : json.getArray()) {
+        if (!id.isLong() || id.getLong() != (llama_token)id.getLong())
+            return false;
+        ids->push_back(id.getLong());
+    }
+    return true;
+}
+
+// parses what POST /tokenize sends to clients that accept binary, i.e.
+// little endian int32 records, each of which is a count of tokens that
+// is followed by that many token ids
+static bool
+get_binary_ids(std::string_view payload, DetokenizeParams* params)
+{
+    const char* p = payload.data();
+    const char* e = p + payload.size();
+    while (p < e) {
+        if (e - p < 4)
+            return false;
+        uint32_t count = READ32LE(p);
+        p += 4;
+        if ((size_t)(e - p) / 4 < count)
+            return false;
+        std::vector<llama_token>& ids = params->ids.emplace_back(count);
+        for (uint32_t i = 0; i < count; ++i, p += 4)
+            ids[i] = READ32LE(p);
+    }
+    return true;
+}
+
+bool
+Client::get_detokenize_params(DetokenizeParams* params)
+{
+    params->remove_special = atob(or_empty(param("remove_special")), false);
+    params->unparse_special = atob(or_empty(param("unparse_special")), false);
+    if (!HasHeader(kHttpContentType))
+        return send_error(400, "Content-Type header missing");
+    if (IsMimeType(HeaderData(kHttpContentType),
+                   HeaderLength(kHttpContentType),
+                   "application/octet-stream")) {
+        params->batch = true;
+        if (!get_binary_ids(payload_, params))
+            return send_error(400, "truncated token id records");
+    } else if (IsMimeType(HeaderData(kHttpContentType),
+                          HeaderLength(kHttpContentType),
+                          "application/json")) {
+        auto [status, json] = Json::parse(std::string(payload_));
+        if (status != Json::success)
+            return send_error(400, Json::StatusToString(status));
+        if (!json.isObject())
+            return send_error(400, "JSON body must be an object");
+        if (!json["ids"].isArray())
+            return send_error(400, "JSON missing \"ids\" array");
+        std::vector<Json>& ids = json["ids"].getArray();
+        if (!ids.empty() && ids[0].isArray()) {
+            params->batch = true;
+            for (Json& seq : ids)
+                if (!seq.isArray() ||
+                    !get_ids(seq, &params->ids.emplace_back()))
+                    return send_error(400, "ids must be array of int arrays");
+        } else if (!get_ids(json["ids"], &params->ids.emplace_back())) {
+            return send_error(400, "ids must be array of ints");
+        }
+        if (json["remove_special"].isBool())
+            params->remove_special = json["remove_special"].getBool();
+        if (json["unparse_special"].isBool())
+            params->unparse_special = json["unparse_special"].getBool();
+    } else {
+        return send_error(501, "Content Type Not Implemented");
+    }
+    int n_vocab = llama_n_vocab(model_);
+    for (const auto& ids : params->ids)
+        for (llama_token id : ids)
+            if (!(0 <= id && id < n_vocab))
+                return send_error(400, "token id out of range");
+    return true;
+}
+
+static bool
+detokenize_ids(const llama_model* model,
+               const std::vector<llama_token>& ids,
+               const DetokenizeParams* params,
+               std::string* text)
+{
+    text->resize(ids.size() * 4 + 16);
+    int n = llama_detokenize(model,
+                             ids.data(),
+                             ids.size(),
+                             text->data(),
+                             text->size(),
+                             params->remove_special,
+                             params->unparse_special);
+    if (n < 0) {
+        text->resize(-n);
+        n = llama_detokenize(model,
+                             ids.data(),
+                             ids.size(),
+                             text->data(),
+                             text->size(),
+                             params->remove_special,
+                             params->unparse_special);
+    }
+    if (n < 0)
+        return false;
+    text->resize(n);
+    return true;
+}
+
+bool
+Client::detokenize()
+{
+    if (msg_.method != kHttpPost)
+        return send_error(405);
+
+    if (!read_payload())
+        return false;
+
+    // get parameters
+    auto params = new DetokenizeParams;
+    defer_cleanup(cleanup_detokenize_params, params);
+    if (!get_detokenize_params(params))
+        return false;
+
+    // turn tokens into text
+    Json json;
+    std::string text;
+    for (size_t i = 0; i < params->ids.size(); ++i) {
+        if (!detokenize_ids(model_, params->ids[i], params, &text)) {
+            SLOG("llama_detokenize failed");
+            return send_error(500);
+        }
+        if (params->batch) {
+            json["text"][i] = std::move(text);
+        } else {
+            json["text"] = std::move(text);
+        }
+    }
+    if (params->batch && params->ids.empty())
+        json["text"].setArray();
+
+    // send response
+    dump_ = json.toStringPretty();
+    dump_ += '\n';
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    return send_response(obuf_.p, p, dump_);
+}
+
+} // namespace server
+} // namespace lf
@@ -199,8 +199,8 @@ Client::embedding()
     cparams.attention_type = LLAMA_ATTENTION_TYPE_UNSPECIFIED;
     cparams.rope_scaling_type = LLAMA_ROPE_SCALING_TYPE_NONE;
     cparams.pooling_type = LLAMA_POOLING_TYPE_NONE;
-    cparams.type_k = GGML_TYPE_F16;
-    cparams.type_v = GGML_TYPE_F16;
+    cparams.type_k = (ggml_type)FLAG_cache_type_k;
+    cparams.type_v = (ggml_type)FLAG_cache_type_v;
     cparams.flash_attn = FLAG_flash_attn;
     llama_context* ctx = llama_new_context_with_model(model_, cparams);
     if (!ctx) {
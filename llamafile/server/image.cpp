@@ -18,26 +18,134 @@
 #include "image.h"
 #include "llamafile/llamafile.h"
 #include <cassert>
+#include <cosmo.h>
+#include <pthread.h>
+#include <unordered_map>
 #include <utility>
 
 namespace lf {
 namespace server {
 
-Image::~Image() = default;
+/**
+ * @fileoverview Immutable image container.
+ *
+ * Image bytes are interned, so no matter how many requests, atoms, and
+ * slot histories refer to the same screenshot, only one copy exists in
+ * memory. Copying an `Image` is O(1) and comparing two images is O(1)
+ * unless they're different images whose hashes collide. An `Image` is
+ * also reference counted so an `Atom` can share it without copying.
+ */
 
-Image::Image(const Image& old) : Image(old.bytes_, old.ctx_used_)
+struct ImageBlob
 {
+    std::string bytes;
+    uint64_t hash;
+    std::atomic_int refs;
+};
+
+static pthread_mutex_t g_blobs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static std::unordered_multimap<uint64_t, ImageBlob*>*
+blobs()
+{
+    // intentionally leaked so images in static storage can't outlive it
+    static auto* blobs = new std::unordered_multimap<uint64_t, ImageBlob*>;
+    return blobs;
+}
+
+static ImageBlob*
+intern(std::string&& bytes)
+{
+    ImageBlob* blob;
+    uint64_t hash = __fnv(bytes.data(), bytes.size());
+    pthread_mutex_lock(&g_blobs_lock);
+    auto range = blobs()->equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        blob = it->second;
+        if (blob->bytes != bytes)
+            continue;
+        // don't resurrect a blob whose last reference is being dropped
+        int refs = blob->refs.load(std::memory_order_relaxed);
+        while (refs && !blob->refs.compare_exchange_weak(
+                         refs, refs + 1, std::memory_order_relaxed)) {
+        }
+        if (refs) {
+            pthread_mutex_unlock(&g_blobs_lock);
+            return blob;
+        }
+    }
+    blob = new ImageBlob{ std::move(bytes), hash, 1 };
+    blobs()->emplace(hash, blob);
+    pthread_mutex_unlock(&g_blobs_lock);
+    return blob;
+}
+
+static ImageBlob*
+intern(ImageBlob* blob)
+{
+    blob->refs.fetch_add(1, std::memory_order_relaxed);
+    return blob;
+}
+
+static void
+unintern(ImageBlob* blob)
+{
+    if (blob->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+    pthread_mutex_lock(&g_blobs_lock);
+    auto range = blobs()->equal_range(blob->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == blob) {
+            blobs()->erase(it);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_blobs_lock);
+    delete blob;
+}
+
+Image::~Image()
+{
+    unintern(blob_);
+}
+
+Image::Image(const Image& old) : Image(old, old.ctx_used_)
+{
+}
+
+Image::Image(const Image& old, int ctx_used)
+  : blob_(intern(old.blob_)), ctx_used_(ctx_used), refs_(1)
+{
+}
+
+Image::Image(std::string bytes, int ctx_used)
+  : blob_(intern(std::move(bytes))), ctx_used_(ctx_used), refs_(1)
+{
+}
+
+void
+Image::retain() const
+{
+    refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+Image::release() const
+{
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete this;
 }
 
-Image::Image(const std::string_view& bytes, int ctx_used)
-  : bytes_(bytes), ctx_used_(ctx_used)
+uint64_t
+Image::hash() const
 {
+    return blob_->hash;
 }
 
 const std::string&
 Image::bytes() const
 {
-    return bytes_;
+    return blob_->bytes;
 }
 
 int
@@ -63,13 +171,19 @@ Image::ctx_used() const
 bool
 operator<(const Image& lhs, const Image& rhs)
 {
+    if (lhs.hash() != rhs.hash())
+        return lhs.hash() < rhs.hash();
+    if (&lhs.bytes() == &rhs.bytes())
+        return false;
     return lhs.bytes() < rhs.bytes();
 }
 
 bool
 operator==(const Image& lhs, const Image& rhs)
 {
-    return lhs.bytes() == rhs.bytes();
+    if (&lhs.bytes() == &rhs.bytes())
+        return true;
+    return lhs.hash() == rhs.hash() && lhs.bytes() == rhs.bytes();
 }
 
 } // namespace server
@@ -16,23 +16,32 @@
 // limitations under the License.
 
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <string>
 
 namespace lf {
 namespace server {
 
+struct ImageBlob;
+
 class Image
 {
   public:
     ~Image();
     Image(const Image&);
-    Image(const std::string_view&, int);
+    Image(const Image&, int);
+    Image(std::string, int);
     const std::string& bytes() const;
+    uint64_t hash() const;
     int ctx_used() const;
+    void retain() const;
+    void release() const;
 
   private:
-    std::string bytes_;
+    ImageBlob* blob_;
     int ctx_used_;
+    mutable std::atomic_int refs_;
 };
 
 bool
@@ -103,11 +103,47 @@ test_image_operator_eq()
                     exit(8);
 }
 
+void
+test_image_interning()
+{
+    // identical bytes are only stored once
+    Image a("hello", 1);
+    Image b(std::string("hel") + "lo", 2);
+    if (&a.bytes() != &b.bytes())
+        exit(9);
+
+    // copying shares bytes even if ctx_used changes
+    Image c(a, 3);
+    if (&c.bytes() != &a.bytes() || c.ctx_used() != 3)
+        exit(10);
+
+    // bytes can be interned again after the last reference is gone
+    std::string* bytes;
+    {
+        Image d("unique", 1);
+        bytes = (std::string*)&d.bytes();
+        Image e(d);
+        if (&e.bytes() != bytes)
+            exit(11);
+    }
+    Image f("unique", 1);
+    if (f.bytes() != "unique")
+        exit(12);
+
+    // a buffer that's moved in becomes the interned copy
+    std::string g(1000, 'x');
+    const char* data = g.data();
+    Image h(std::move(g), 1);
+    if (h.bytes().data() != data)
+        exit(13);
+}
+
 void
 image_test()
 {
     test_image_operator_lt();
     test_image_operator_eq();
+    test_image_interning();
 }
 
 } // namespace
@@ -30,6 +30,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cosmo.h>
+#include <poll.h>
 
 namespace lf {
 namespace server {
@@ -89,6 +90,8 @@ Slot::describe_error(int err)
             return "decode_image_failed";
         case encode_image_failed:
             return "encode_image_failed";
+        case aborted:
+            return "aborted";
         default:
             return "bad_error_code";
     }
@@ -133,18 +136,52 @@ Slot::start()
     cparams.yarn_orig_ctx = 0;
     cparams.defrag_thold = -1;
     cparams.offload_kqv = true;
-    cparams.type_k = GGML_TYPE_F16;
-    cparams.type_v = GGML_TYPE_F16;
+    cparams.type_k = (ggml_type)FLAG_cache_type_k;
+    cparams.type_v = (ggml_type)FLAG_cache_type_v;
     cparams.flash_attn = FLAG_flash_attn;
     system_fingerprint_ = generate_system_fingerprint(&cparams);
     if (!(ctx_ = llama_new_context_with_model(model_, cparams)))
         return false;
+    llama_set_abort_callback(ctx_, should_abort, this);
     if (FLAG_mmproj)
         if (!(clip_ctx_ = clip_model_load(FLAG_mmproj, FLAG_verbose)))
             return false;
     return true;
 }
 
+// returns true if the client has gone away, e.g. closed its browser
+// tab, so there's nobody left who'd read what we're generating. eof on
+// the socket isn't enough, since a client may shutdown(SHUT_WR) after
+// sending its request and still wait for the response.
+bool
+Slot::hung_up()
+{
+    if (fd_ == -1 || hung_up_)
+        return hung_up_;
+    struct pollfd pfd = { fd_, 0 };
+    if (poll(&pfd, 1, 0) != 1)
+        return false;
+    if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))
+        return hung_up_ = true;
+    return false;
+}
+
+// called by ggml in between the nodes of a graph, which lets us stop a
+// big prefill or a slow token midway. llama_decode() then returns 2 and
+// puts the kv cache back the way it was before
+bool
+Slot::should_abort(void* arg)
+{
+    Slot* slot = (Slot*)arg;
+    if (slot->cancelled_)
+        return true;
+    timespec now = timespec_mono();
+    if (timespec_tomillis(timespec_sub(now, slot->polled_)) < 10)
+        return false;
+    slot->polled_ = now;
+    return slot->hung_up();
+}
+
 int
 Slot::ctx_size() const
 {
@@ -160,9 +197,56 @@ Slot::ctx_used() const
     return tokens;
 }
 
+// evicts atoms from the middle of the context window, to make room for
+// generating n more tokens, while the first FLAG_keep tokens are kept
+int
+Slot::make_room(int n)
+{
+    if (!ctx_)
+        return uninitialized;
+    int used = ctx_used();
+    if (used + n <= ctx_size())
+        return 0;
+    if (FLAG_keep < 0)
+        return out_of_context;
+
+    // images can't be split, so evict at atom boundaries
+    int keep_atoms = 0;
+    int keep_tokens = 0;
+    while (keep_atoms < history_.size() && keep_tokens < FLAG_keep)
+        keep_tokens += history_[keep_atoms++].ctx_used();
+    int want = std::max((used - keep_tokens) / 2, used + n - ctx_size());
+    int evict_atoms = 0;
+    int evict_tokens = 0;
+    while (keep_atoms + evict_atoms < history_.size() && evict_tokens < want)
+        evict_tokens += history_[keep_atoms + evict_atoms++].ctx_used();
+    if (used - evict_tokens + n > ctx_size())
+        return out_of_context;
+
+    llama_kv_seq seq = {};
+    seq.seq_id = 0;
+    seq.n_past = used;
+    seq.n_tokens = n;
+    seq.n_ctx = ctx_size();
+    seq.n_keep = keep_tokens;
+    seq.n_discard = evict_tokens;
+    seq.ga_n = 1;
+    llama_kv_cache_seq_apply(ctx_, &seq, 1);
+    unassert(seq.n_evicted == evict_tokens);
+    history_.erase(history_.begin() + keep_atoms,
+                   history_.begin() + keep_atoms + evict_atoms);
+    SLOG("context shift evicted %d tokens after the first %d",
+         evict_tokens,
+         keep_tokens);
+    return evict_tokens;
+}
+
 int
 Slot::eval_token(int token)
 {
+    int rc;
+    if ((rc = make_room(1)) < 0)
+        return rc;
     return eval_tokens({ token });
 }
 
@@ -182,12 +266,18 @@ Slot::eval_tokens(const std::vector<int>& tokens)
         int n_eval = N - i;
         if (n_eval > FLAG_batch)
             n_eval = FLAG_batch;
-        if (llama_decode(ctx_,
-                         { .n_tokens = n_eval,
-                           .token = &toks[i],
-                           .all_pos_0 = used,
-                           .all_pos_1 = 1 }))
-            return decode_token_failed;
+        switch (llama_decode(ctx_,
+                             { .n_tokens = n_eval,
+                               .token = &toks[i],
+                               .all_pos_0 = used,
+                               .all_pos_1 = 1 })) {
+            case 0:
+                break;
+            case 2:
+                return aborted;
+            default:
+                return decode_token_failed;
+        }
         for (int j = 0; j < n_eval; ++j)
             history_.emplace_back(toks[i + j]);
         used += n_eval;
@@ -196,8 +286,9 @@ Slot::eval_tokens(const std::vector<int>& tokens)
 }
 
 int
-Slot::eval_image(const std::string_view& bytes)
+Slot::eval_image(const Image& image)
 {
+    const std::string& bytes = image.bytes();
     if (!ctx_)
         return uninitialized;
     if (!clip_ctx_)
@@ -220,18 +311,21 @@ Slot::eval_image(const std::string_view& bytes)
         int n_eval = N - i;
         if (n_eval > FLAG_batch)
             n_eval = FLAG_batch;
-        if (llama_decode(ctx_,
-                         { .n_tokens = n_eval,
-                           .embd = image_embed->embed + i * n_embd,
-                           .all_pos_0 = used,
-                           .all_pos_1 = 1 })) {
+        int rc = llama_decode(ctx_,
+                              { .n_tokens = n_eval,
+                                .embd = image_embed->embed + i * n_embd,
+                                .all_pos_0 = used,
+                                .all_pos_1 = 1 });
+        if (rc) {
+            // image only goes in history once whole, so drop partial kv
+            llama_kv_cache_seq_rm(ctx_, 0, used - i, -1);
             llava_image_embed_free(image_embed);
-            return decode_image_failed;
+            return rc == 2 ? aborted : decode_image_failed;
         }
         used += n_eval;
     }
     llava_image_embed_free(image_embed);
-    history_.emplace_back(new Image(bytes, N));
+    history_.emplace_back(new Image(image, N));
     return N;
 }
 
@@ -249,7 +343,7 @@ Slot::eval_atoms(const std::vector<Atom>& atoms)
                 return rc;
             token_count += rc;
             tokens.clear();
-            if ((rc = eval_image(atom.image().bytes())) < 0)
+            if ((rc = eval_image(atom.image())) < 0)
                 return rc;
             token_count += rc;
         }
@@ -260,8 +354,21 @@ Slot::eval_atoms(const std::vector<Atom>& atoms)
     return token_count;
 }
 
+static int
+count_tokens(const std::vector<Atom>& atoms, int i, int j)
+{
+    int tokens = 0;
+    for (; i < j; ++i)
+        tokens += atoms[i].ctx_used();
+    return tokens;
+}
+
+// evaluates atoms, reusing whatever prefix of them is already in the
+// context window. if `tail` is an index into atoms, then the atoms in
+// [tail, atoms.size() - 1) may also be found further along in history
+// in which case their kv is moved into place rather than being evaled
 int
-Slot::prefill(const std::vector<Atom>& atoms_)
+Slot::prefill(const std::vector<Atom>& atoms_, int tail)
 {
     if (!ctx_)
         return uninitialized;
@@ -280,6 +387,70 @@ Slot::prefill(const std::vector<Atom>& atoms_)
         reuse_atoms -= 1;
         reuse_tokens -= history_[reuse_atoms].ctx_used();
     }
+
+    // look for the tail where the last atom was evaluated previously,
+    // e.g. `<SUF> suffix` before `<MID>` in a fill-in-the-middle prompt.
+    // its keys were computed in the context of an older prefix, so this
+    // is an approximation, but it's what lets an edit near an editor's
+    // cursor cost time proportional to the edit, not the file size
+    int last = atoms.size() - 1;
+    int move_from = 0;
+    int move_atoms = 0;
+    if (tail >= reuse_atoms && atoms.size() == atoms_.size() &&
+        count_tokens(atoms, 0, atoms.size()) <= ctx_size()) {
+        for (int j = reuse_atoms; j < history_.size(); ++j) {
+            if (history_[j] == atoms[last]) {
+                while (last - move_atoms - 1 >= tail &&
+                       j - move_atoms - 1 >= reuse_atoms &&
+                       history_[j - move_atoms - 1] ==
+                         atoms[last - move_atoms - 1])
+                    ++move_atoms;
+                move_from = j - move_atoms;
+                break;
+            }
+        }
+    }
+    if (move_atoms) {
+        int old_pos = count_tokens(history_, 0, move_from);
+        int move_tokens =
+          count_tokens(history_, move_from, move_from + move_atoms);
+        int new_pos = reuse_tokens + count_tokens(atoms,
+                                                  reuse_atoms, //
+                                                  last - move_atoms);
+        if (llama_kv_cache_seq_rm(ctx_, 0, reuse_tokens, old_pos) &&
+            llama_kv_cache_seq_rm(ctx_, 0, old_pos + move_tokens, -1)) {
+            llama_kv_cache_seq_add(
+              ctx_, 0, old_pos, old_pos + move_tokens, new_pos - old_pos);
+            std::vector<Atom> moved(history_.begin() + move_from,
+                                    history_.begin() + move_from + move_atoms);
+            history_.resize(reuse_atoms);
+            // on failure, drop kv that history doesn't account for, e.g.
+            // the moved cells, otherwise the next prefill would see them
+            int rc;
+            if ((rc = eval_atoms(std::vector<Atom>(
+                   atoms.begin() + reuse_atoms,
+                   atoms.begin() + last - move_atoms))) < 0) {
+                llama_kv_cache_seq_rm(ctx_, 0, ctx_used(), -1);
+                return rc;
+            }
+            history_.insert(history_.end(), moved.begin(), moved.end());
+            if ((rc = eval_atoms(std::vector<Atom>(atoms.begin() + last,
+                                                   atoms.end()))) < 0) {
+                llama_kv_cache_seq_rm(ctx_, 0, ctx_used(), -1);
+                return rc;
+            }
+            int token_count = ctx_used();
+            SLOG("prefilled %d tokens (after removing %d, reusing %d, and "
+                 "moving %d)",
+                 token_count,
+                 used_tokens - reuse_tokens - move_tokens,
+                 reuse_tokens,
+                 move_tokens);
+            return token_count;
+        }
+        // recurrent models can't be partially erased, so evaluate it all
+    }
+
     if (used_tokens > reuse_tokens) {
         erase_tokens = used_tokens - reuse_tokens;
         if (llama_kv_cache_seq_rm(ctx_, 0, reuse_tokens, -1)) {
@@ -311,8 +482,7 @@ Slot::dump(std::string* result)
     for (size_t i = 0; i < history_.size(); ++i) {
         if (history_[i].is_token()) {
             llama_token token = history_[i].token();
-            *result +=
-              llamafile_token_to_piece(ctx_, token, RENDER_SPECIAL_TOKENS);
+            *result += llamafile_token_piece(model_, token, RENDER_SPECIAL_TOKENS);
         } else if (history_[i].is_image()) {
             convert_image_to_uri(result, history_[i].image().bytes());
         }
@@ -16,7 +16,9 @@
 // limitations under the License.
 
 #pragma once
+#include <atomic>
 #include <cosmo.h>
+#include <ctime>
 #include <string>
 #include <vector>
 
@@ -42,9 +44,11 @@ struct Slot
         decode_token_failed,
         decode_image_failed,
         encode_image_failed,
+        aborted,
     };
 
     static const char* describe_error(int);
+    static bool should_abort(void*);
 
     Dll elem_;
     llama_model* model_;
@@ -52,17 +56,24 @@ struct Slot
     llama_context* ctx_ = nullptr;
     std::vector<Atom> history_;
     std::string system_fingerprint_;
+    std::string session_; // guarded by Slots::lock_
+    std::atomic_bool cancelled_ = false;
+    int fd_ = -1; // client socket polled for hangup, or -1
+    bool hung_up_ = false;
+    timespec polled_ = {};
 
     ~Slot();
     explicit Slot(llama_model*);
     int ctx_size() const;
     int ctx_used() const;
     bool start();
+    bool hung_up();
+    int make_room(int);
     int eval_token(int);
-    int eval_image(const std::string_view&);
+    int eval_image(const Image&);
     int eval_tokens(const std::vector<int>&);
     int eval_atoms(const std::vector<Atom>&);
-    int prefill(const std::vector<Atom>&);
+    int prefill(const std::vector<Atom>&, int = -1);
     void tokenize(std::vector<Atom>*, std::string_view, bool);
     void dump(std::string*);
 };
@@ -0,0 +1,192 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "atom.h"
+#include "llama.cpp/llama.h"
+#include "llamafile/llamafile.h"
+#include "slot.h"
+#include <cstdlib>
+#include <vector>
+
+#define MODEL "models/TinyLLama-v0.1-5M-F16.gguf"
+
+namespace lf {
+namespace server {
+namespace {
+
+llama_model* g_model;
+
+// token ids don't matter to prefill(), so these stand in for the infill
+// special tokens of a code model
+enum
+{
+    PRE = 10,
+    SUF,
+    MID,
+};
+
+// returns `<PRE> prefix <SUF> suffix <MID>` and where its tail begins
+std::vector<Atom>
+fim(const std::vector<int>& prefix, const std::vector<int>& suffix, int* tail)
+{
+    std::vector<Atom> atoms;
+    atoms.emplace_back(PRE);
+    for (int token : prefix)
+        atoms.emplace_back(token);
+    *tail = atoms.size();
+    atoms.emplace_back(SUF);
+    for (int token : suffix)
+        atoms.emplace_back(token);
+    atoms.emplace_back(MID);
+    return atoms;
+}
+
+std::vector<int>
+range(int start, int count)
+{
+    std::vector<int> tokens;
+    for (int i = 0; i < count; ++i)
+        tokens.emplace_back(start + i);
+    return tokens;
+}
+
+std::vector<int>
+concat(std::vector<int> a, const std::vector<int>& b)
+{
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+// returns number of tokens the slot's context has evaluated so far
+int
+evaluated(Slot* slot)
+{
+    llama_synchronize(slot->ctx_);
+    llama_timings t = llama_get_timings(slot->ctx_);
+    return t.n_p_eval + t.n_eval;
+}
+
+// checks the kv cache holds exactly what the slot's history says
+bool
+is_consistent(Slot* slot)
+{
+    int used = slot->ctx_used();
+    return llama_get_kv_cache_used_cells(slot->ctx_) == used &&
+           (!used || llama_kv_cache_seq_pos_max(slot->ctx_, 0) == used - 1);
+}
+
+void
+test_prefill_tail_moves_suffix()
+{
+    int tail;
+    Slot slot(g_model);
+    if (!slot.start())
+        exit(1);
+    std::vector<int> suffix = range(300, 200);
+    std::vector<Atom> a = fim(range(100, 150), suffix, &tail);
+    if (slot.prefill(a, tail) != a.size())
+        exit(2);
+    if (slot.history_ != a || !is_consistent(&slot))
+        exit(3);
+
+    // typing ten tokens at the cursor only evaluates them and <MID>, as
+    // well as the last reused token, which prefill() always evaluates
+    int before = evaluated(&slot);
+    std::vector<Atom> b =
+      fim(concat(range(100, 150), range(900, 10)), suffix, &tail);
+    if (slot.prefill(b, tail) != b.size())
+        exit(4);
+    if (evaluated(&slot) - before != 1 + 10 + 1)
+        exit(5);
+    if (slot.history_ != b || !is_consistent(&slot))
+        exit(6);
+
+    // deleting text works too
+    before = evaluated(&slot);
+    std::vector<Atom> c = fim(range(100, 120), suffix, &tail);
+    if (slot.prefill(c, tail) != c.size())
+        exit(7);
+    if (evaluated(&slot) - before != 1 + 1)
+        exit(8);
+    if (slot.history_ != c || !is_consistent(&slot))
+        exit(9);
+
+    // without a tail, everything after the first change is evaluated
+    before = evaluated(&slot);
+    std::vector<Atom> d = fim(range(100, 119), suffix, &tail);
+    if (slot.prefill(d) != d.size())
+        exit(10);
+    if (evaluated(&slot) - before != 1 + 1 + suffix.size() + 1)
+        exit(11);
+    if (slot.history_ != d || !is_consistent(&slot))
+        exit(12);
+}
+
+void
+test_prefill_tail_abort_drops_moved_kv()
+{
+    int tail;
+    Slot slot(g_model);
+    if (!slot.start())
+        exit(13);
+    std::vector<int> suffix = range(300, 200);
+    std::vector<Atom> a = fim(range(100, 150), suffix, &tail);
+    if (slot.prefill(a, tail) != a.size())
+        exit(14);
+
+    // cancel while the middle is being evaluated, after the suffix kv
+    // has already been moved, and nothing of the prefix is reusable
+    slot.cancelled_ = true;
+    std::vector<Atom> b = fim(range(1000, 50), suffix, &tail);
+    if (slot.prefill(b, tail) != Slot::aborted)
+        exit(15);
+    if (!slot.history_.empty() || !is_consistent(&slot))
+        exit(16);
+
+    // the next request mustn't attend to the leftovers
+    slot.cancelled_ = false;
+    std::vector<Atom> c = fim(range(2000, 50), range(3000, 50), &tail);
+    if (slot.prefill(c) != c.size())
+        exit(17);
+    if (slot.history_ != c || !is_consistent(&slot))
+        exit(18);
+}
+
+void
+slot_test()
+{
+    FLAGS_READY = true;
+    FLAG_ctx_size = 1024;
+    llama_backend_init();
+    llama_model_params mparams = llama_model_default_params();
+    if (!(g_model = llama_load_model_from_file(MODEL, mparams)))
+        exit(19);
+    test_prefill_tail_moves_suffix();
+    test_prefill_tail_abort_drops_moved_kv();
+    llama_free_model(g_model);
+    llama_backend_free();
+}
+
+} // namespace
+} // namespace server
+} // namespace lf
+
+int
+main()
+{
+    lf::server::slot_test();
+}
@@ -67,10 +67,17 @@ Slots::start(int count)
     return made;
 }
 
+// borrows the free slot whose history best matches prefix. if session
+// isn't empty, then any slot still generating for that same session is
+// told to stop, since a newer request from the same editor supersedes
 Slot*
-Slots::take(const std::vector<Atom>& prefix)
+Slots::take(const std::vector<Atom>& prefix, const std::string& session)
 {
     pthread_mutex_lock(&lock_);
+    if (!session.empty())
+        for (auto& slot : slots_)
+            if (slot->session_ == session)
+                slot->cancelled_ = true;
     for (;;) {
 
         // find slot with longest matching prefix
@@ -88,6 +95,9 @@ Slots::take(const std::vector<Atom>& prefix)
         // return borrowed pointer to best slot
         if (best_slot) {
             dll_remove(&free_slots_, best_slot);
+            SLOT(best_slot)->session_ = session;
+            SLOT(best_slot)->cancelled_ = false;
+            SLOT(best_slot)->hung_up_ = false;
             pthread_mutex_unlock(&lock_);
             return SLOT(best_slot);
         }
@@ -104,6 +114,8 @@ Slots::give(Slot* slot)
     SLOG("relinquishing slot");
     unassert(slot);
     pthread_mutex_lock(&lock_);
+    slot->session_.clear();
+    slot->fd_ = -1;
     dll_make_first(&free_slots_, &slot->elem_);
     pthread_cond_signal(&cond_);
     pthread_mutex_unlock(&lock_);
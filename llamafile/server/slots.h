@@ -18,6 +18,7 @@
 #pragma once
 #include <memory>
 #include <pthread.h>
+#include <string>
 #include <vector>
 
 struct llama_model;
@@ -46,7 +47,7 @@ struct Slots
     size_t size();
     int start(int);
     void tokenize(std::vector<Atom>*, std::string_view, bool);
-    Slot* take(const std::vector<Atom>&);
+    Slot* take(const std::vector<Atom>&, const std::string& = "");
     void give(Slot*);
 };
 
@@ -0,0 +1,138 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stopper.h"
+#include <deque>
+
+namespace lf {
+namespace server {
+
+// stop strings are matched using an aho-corasick automaton over bytes
+// of the detokenized text. unlike comparing token ids, this finds stop
+// strings no matter how the model happened to tokenize them, and each
+// byte is examined once, regardless of how many stop strings there are
+//
+// text is held back only while it could still be the start of a stop
+// string, so a streaming client never gets sent a stop string, or any
+// text that comes after it, but it isn't delayed any more than needed
+
+bool
+Stopper::empty() const
+{
+    return nodes_.size() == 1;
+}
+
+int
+Stopper::child(int state, unsigned char byte) const
+{
+    for (int v = nodes_[state].child; v; v = nodes_[v].sibling)
+        if (nodes_[v].byte == byte)
+            return v;
+    return 0;
+}
+
+int
+Stopper::next(int state, unsigned char byte) const
+{
+    for (;;) {
+        int v;
+        if ((v = child(state, byte)))
+            return v;
+        if (!state)
+            return 0;
+        state = nodes_[state].fail;
+    }
+}
+
+void
+Stopper::add(const std::string_view stop)
+{
+    if (stop.empty())
+        return;
+    int state = 0;
+    for (unsigned char byte : stop) {
+        int v;
+        if (!(v = child(state, byte))) {
+            v = nodes_.size();
+            nodes_.emplace_back();
+            nodes_[v].depth = nodes_[state].depth + 1;
+            nodes_[v].byte = byte;
+            nodes_[v].sibling = nodes_[state].child;
+            nodes_[state].child = v;
+        }
+        state = v;
+    }
+    nodes_[state].match = stop.size();
+    built_ = false;
+}
+
+void
+Stopper::build()
+{
+    std::deque<int> queue;
+    for (int v = nodes_[0].child; v; v = nodes_[v].sibling) {
+        nodes_[v].fail = 0;
+        queue.push_back(v);
+    }
+    while (!queue.empty()) {
+        int u = queue.front();
+        queue.pop_front();
+        if (!nodes_[u].match)
+            nodes_[u].match = nodes_[nodes_[u].fail].match;
+        for (int v = nodes_[u].child; v; v = nodes_[v].sibling) {
+            nodes_[v].fail = next(nodes_[u].fail, nodes_[v].byte);
+            queue.push_back(v);
+        }
+    }
+    built_ = true;
+}
+
+// appends to `out` the part of `text` that can't be part of a stop
+// string. returns true if a stop string was found, in which case all
+// the text before it has been appended, and generation should cease
+bool
+Stopper::feed(const std::string_view text, std::string* out)
+{
+    if (!built_)
+        build();
+    for (unsigned char byte : text) {
+        state_ = next(state_, byte);
+        tail_ += byte;
+        if (nodes_[state_].match) {
+            out->append(tail_, 0, tail_.size() - nodes_[state_].match);
+            tail_.clear();
+            state_ = 0;
+            return true;
+        }
+    }
+    size_t keep = nodes_[state_].depth;
+    out->append(tail_, 0, tail_.size() - keep);
+    tail_.erase(0, tail_.size() - keep);
+    return false;
+}
+
+// appends text that was held back, for when generation ends otherwise
+void
+Stopper::flush(std::string* out)
+{
+    *out += tail_;
+    tail_.clear();
+    state_ = 0;
+}
+
+} // namespace server
+} // namespace lf
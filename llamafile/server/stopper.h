@@ -0,0 +1,54 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lf {
+namespace server {
+
+// finds the first stop string in text that's generated a piece at a time
+struct Stopper
+{
+    struct Node
+    {
+        int fail = 0;
+        int depth = 0;
+        int match = 0; // length of longest stop string ending here
+        int child = 0;
+        int sibling = 0;
+        unsigned char byte = 0;
+    };
+
+    std::vector<Node> nodes_ = { Node() };
+    std::string tail_;
+    int state_ = 0;
+    bool built_ = true;
+
+    bool empty() const;
+    void add(const std::string_view);
+    bool feed(const std::string_view, std::string*);
+    void flush(std::string*);
+    int child(int, unsigned char) const;
+    int next(int, unsigned char) const;
+    void build();
+};
+
+} // namespace server
+} // namespace lf
@@ -0,0 +1,128 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stopper.h"
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+namespace lf {
+namespace server {
+namespace {
+
+void
+test_no_stops()
+{
+    Stopper s;
+    std::string out;
+    if (!s.empty())
+        exit(1);
+    if (s.feed("hello", &out))
+        exit(2);
+    if (out != "hello")
+        exit(3);
+}
+
+void
+test_stop_split_across_pieces()
+{
+    Stopper s;
+    s.add("</s>");
+    std::string out;
+    if (s.feed("hi <", &out) || out != "hi ")
+        exit(4);
+    if (s.feed("/", &out) || out != "hi ")
+        exit(5);
+    if (!s.feed("s> there", &out) || out != "hi ")
+        exit(6);
+}
+
+void
+test_partial_match_released()
+{
+    Stopper s;
+    s.add("User:");
+    std::string out;
+    if (s.feed("Use", &out) || out != "")
+        exit(7);
+    if (s.feed("s", &out) || out != "Uses")
+        exit(8);
+    if (s.feed(" Us", &out) || out != "Uses ")
+        exit(9);
+    s.flush(&out);
+    if (out != "Uses Us")
+        exit(10);
+}
+
+void
+test_first_occurrence_wins()
+{
+    Stopper s;
+    s.add("abcd");
+    s.add("bc");
+    s.add("\n\n");
+    std::string out;
+    if (!s.feed("xabcd", &out) || out != "xa")
+        exit(11);
+    Stopper t;
+    t.add("aab");
+    out.clear();
+    if (!t.feed("aaaab!", &out) || out != "aa")
+        exit(12);
+}
+
+// compares against string::find() for every way of cutting up text
+void
+test_against_find()
+{
+    const char* stops[] = { "ab", "bab", "abba", "\xc3\xa9t\xc3\xa9" };
+    const std::string text = "xbabbababbaabbbaab\xc3\xa9t\xc3\xa9z";
+    for (int k = 0; k < 4; ++k) {
+        size_t want = std::string::npos;
+        for (int j = 0; j <= k; ++j)
+            want = std::min(want, text.find(stops[j]));
+        for (size_t cut = 1; cut < text.size(); ++cut) {
+            Stopper s;
+            for (int j = 0; j <= k; ++j)
+                s.add(stops[j]);
+            std::string out;
+            bool stopped = false;
+            for (size_t i = 0; i < text.size() && !stopped; i += cut)
+                stopped = s.feed(text.substr(i, cut), &out);
+            if (!stopped)
+                s.flush(&out);
+            if (stopped != (want != std::string::npos))
+                exit(13);
+            if (out != text.substr(0, want))
+                exit(14);
+        }
+    }
+}
+
+} // namespace
+} // namespace server
+} // namespace lf
+
+int
+main()
+{
+    lf::server::test_no_stops();
+    lf::server::test_stop_split_across_pieces();
+    lf::server::test_partial_match_released();
+    lf::server::test_first_occurrence_wins();
+    lf::server::test_against_find();
+}
@@ -18,16 +18,25 @@
 #include "client.h"
 #include "llama.cpp/llama.h"
 #include "llamafile/json.h"
+#include "llamafile/llama.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/pool.h"
 #include "llamafile/server/cleanup.h"
 #include "llamafile/server/fastjson.h"
 #include "llamafile/server/log.h"
 #include "llamafile/server/signals.h"
 #include "llamafile/server/utils.h"
+#include <algorithm>
+#include <cosmo.h>
 #include <cstring>
+#include <pthread.h>
 #include <sys/resource.h>
 #include <utility>
 #include <vector>
 
+// batches with less text than this per thread aren't worth splitting
+#define TOKENIZE_SHARD_BYTES 65536
+
 using jt::Json;
 
 namespace lf {
@@ -37,8 +46,22 @@ struct TokenizeParams
 {
     bool add_special;
     bool parse_special;
+    bool count_only;
+    bool binary;
+    bool batch = false;
     std::string_view prompt;
     std::string content;
+    std::vector<std::string> prompts;
+    std::vector<std::vector<llama_token>> results;
+    std::string output;
+};
+
+struct TokenizeShard
+{
+    const llama_model* model;
+    TokenizeParams* params;
+    size_t begin;
+    size_t end;
 };
 
 void
@@ -52,6 +75,11 @@ Client::get_tokenize_params(TokenizeParams* params)
 {
     params->add_special = atob(or_empty(param("add_special")), true);
     params->parse_special = atob(or_empty(param("parse_special")), false);
+    params->count_only = atob(or_empty(param("count_only")), false);
+    params->binary = HasHeader(kHttpAccept) &&
+                     IsMimeType(HeaderData(kHttpAccept),
+                                HeaderLength(kHttpAccept),
+                                "application/octet-stream");
     std::optional<std::string_view> prompt = param("prompt");
     if (prompt.has_value()) {
         params->prompt = prompt.value();
@@ -68,14 +96,26 @@ Client::get_tokenize_params(TokenizeParams* params)
                 return send_error(400, Json::StatusToString(status));
             if (!json.isObject())
                 return send_error(400, "JSON body must be an object");
-            if (!json["prompt"].isString())
+            if (json["prompt"].isArray()) {
+                params->batch = true;
+                for (Json& prompt : json["prompt"].getArray()) {
+                    if (!prompt.isString())
+                        return send_error(400,
+                                          "prompt array item must be string");
+                    params->prompts.emplace_back(std::move(prompt.getString()));
+                }
+            } else if (json["prompt"].isString()) {
+                params->content = std::move(json["prompt"].getString());
+                params->prompt = params->content;
+            } else {
                 return send_error(400, "JSON missing \"prompt\" key");
-            params->content = std::move(json["prompt"].getString());
-            params->prompt = params->content;
+            }
             if (json["add_special"].isBool())
                 params->add_special = json["add_special"].getBool();
             if (json["parse_special"].isBool())
                 params->parse_special = json["parse_special"].getBool();
+            if (json["count_only"].isBool())
+                params->count_only = json["count_only"].getBool();
         } else {
             return send_error(501, "Content Type Not Implemented");
         }
@@ -85,6 +125,164 @@ Client::get_tokenize_params(TokenizeParams* params)
     return true;
 }
 
+static void*
+tokenize_shard(void* arg)
+{
+    TokenizeShard* shard = (TokenizeShard*)arg;
+    TokenizeParams* params = shard->params;
+    for (size_t i = shard->begin; i < shard->end; ++i)
+        params->results[i] = llamafile_tokenize(shard->model,
+                                                params->prompts[i],
+                                                params->add_special,
+                                                params->parse_special);
+    return nullptr;
+}
+
+// tokenizes every prompt in a batch. big batches are divided into shards
+// holding about the same amount of text, which are handed out to worker
+// threads from the pool, so a job that's counting tokens for millions of
+// documents isn't limited by the speed of a single core
+static void
+tokenize_prompts(const llama_model* model, TokenizeParams* params)
+{
+    size_t n = params->prompts.size();
+    size_t bytes = 0;
+    for (const std::string& prompt : params->prompts)
+        bytes += prompt.size();
+    size_t shards = std::min({ (size_t)std::max(FLAG_threads, 1),
+                               std::max(n, (size_t)1),
+                               bytes / TOKENIZE_SHARD_BYTES + 1 });
+    params->results.resize(n);
+    std::vector<TokenizeShard> work(shards);
+    for (size_t i = 0, j = 0, sum = 0; j < shards; ++j) {
+        work[j] = { model, params, i, i };
+        while (i < n && (j == shards - 1 || sum < bytes * (j + 1) / shards))
+            sum += params->prompts[i++].size();
+        work[j].end = i;
+    }
+
+    // shards write to memory that's freed by cleanup, so this thread
+    // mustn't be cancelled until all of them have been joined
+    int cancelstate;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelstate);
+    std::vector<llamafile_task_t> tasks(shards);
+    for (size_t j = 1; j < shards; ++j)
+        if (llamafile_task_create(&tasks[j], tokenize_shard, &work[j]))
+            tasks[j] = nullptr;
+    tokenize_shard(&work[0]);
+    for (size_t j = 1; j < shards; ++j) {
+        if (tasks[j]) {
+            npassert(!llamafile_task_join(tasks[j], 0));
+        } else {
+            tokenize_shard(&work[j]);
+        }
+    }
+    pthread_setcancelstate(cancelstate, 0);
+}
+
+// serializes results as little endian int32 records, each of which is a
+// token count that's followed by that many token ids, unless count_only
+static void
+encode_binary(TokenizeParams* params)
+{
+    size_t words = params->results.size();
+    if (!params->count_only)
+        for (const auto& toks : params->results)
+            words += toks.size();
+    params->output.resize(words * 4);
+    char* p = params->output.data();
+    for (const auto& toks : params->results) {
+        WRITE32LE(p, toks.size());
+        p += 4;
+        if (!params->count_only)
+            for (llama_token tok : toks) {
+                WRITE32LE(p, tok);
+                p += 4;
+            }
+    }
+}
+
+static void
+encode_batch(TokenizeParams* params)
+{
+    char buf[32];
+    std::string& out = params->output;
+    out += "{\n";
+    out += "  \"add_special\": ";
+    out += params->add_special ? "true" : "false";
+    out += ",\n";
+    out += "  \"parse_special\": ";
+    out += params->parse_special ? "true" : "false";
+    out += ",\n";
+    out += "  \"counts\": [";
+    for (size_t i = 0; i < params->results.size(); ++i) {
+        if (i)
+            out += ", ";
+        out.append(buf, encode_json(buf, (int)params->results[i].size()) - buf);
+    }
+    out += "]";
+    if (!params->count_only) {
+        out += ",\n  \"ids\": [";
+        for (size_t i = 0; i < params->results.size(); ++i) {
+            out += i ? ",\n    [" : "\n    [";
+            for (size_t j = 0; j < params->results[i].size(); ++j) {
+                if (j)
+                    out += ", ";
+                out.append(buf, encode_json(buf, params->results[i][j]) - buf);
+            }
+            out += "]";
+        }
+        out += "\n  ]";
+    }
+    out += "\n}\n";
+}
+
+bool
+Client::tokenize_batch(TokenizeParams* params)
+{
+    // setup statistics
+    rusage rustart = {};
+    getrusage(RUSAGE_THREAD, &rustart);
+    timespec started = timespec_real();
+
+    // turn text into tokens
+    if (!params->batch)
+        params->prompts.emplace_back(params->prompt);
+    tokenize_prompts(model_, params);
+    if (params->binary) {
+        encode_binary(params);
+    } else {
+        encode_batch(params);
+    }
+
+    // collect statistics
+    rusage ruend = {};
+    getrusage(RUSAGE_THREAD, &ruend);
+    timeval user = timeval_sub(ruend.ru_utime, rustart.ru_utime);
+    timeval system = timeval_sub(ruend.ru_stime, rustart.ru_stime);
+    timespec ended = timespec_real();
+    timespec wall = timespec_sub(ended, started);
+    long wall_us = timespec_tomicros(wall);
+    long user_us = timeval_tomicros(user);
+    long system_us = timeval_tomicros(system);
+
+    // send response
+    char* p = append_http_response_message(obuf_.p, 200);
+    if (params->binary) {
+        p = stpcpy(p, "Content-Type: application/octet-stream\r\n");
+    } else {
+        p = stpcpy(p, "Content-Type: application/json\r\n");
+    }
+    p = stpcpy(p, "X-Wall-Micros: ");
+    p = FormatInt64(p, wall_us);
+    p = stpcpy(p, "\r\nX-User-Micros: ");
+    p = FormatInt64(p, user_us);
+    p = stpcpy(p, "\r\nX-System-Micros: ");
+    p = FormatInt64(p, system_us);
+    p = stpcpy(p, "\r\n");
+    return send_binary_response(obuf_.p, p, params->output);
+}
+
 bool
 Client::tokenize()
 {
@@ -99,6 +297,8 @@ Client::tokenize()
     defer_cleanup(cleanup_tokenize_params, params);
     if (!get_tokenize_params(params))
         return false;
+    if (params->batch || params->binary)
+        return tokenize_batch(params);
 
     // setup statistics
     rusage rustart = {};
@@ -135,14 +335,8 @@ Client::tokenize()
         if (i)
             *p++ = ',';
         p = stpcpy(p, "\n    ");
-        char s[32];
-        int n =
-          llama_token_to_piece(model_, (*toks)[i], s, sizeof(s), false, true);
-        if (n < 0) {
-            SLOG("failed to turn token into string");
-            return send_error(405);
-        }
-        p = encode_json(p, std::string_view(s, n));
+        p = encode_json(
+          p, llamafile_token_piece(model_, (*toks)[i], RENDER_SPECIAL_TOKENS));
     }
     p = stpcpy(p, "\n  ]\n");
     p = stpcpy(p, "}\n");
@@ -0,0 +1,58 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "client.h"
+#include "llamafile/llamafile.h"
+#include "llamafile/trace.h"
+#include "utils.h"
+#include <cstdlib>
+#include <string>
+
+namespace lf {
+namespace server {
+
+// snapshots the last few seconds of the op profiler
+//
+// returns chrome://tracing/ json by default, or a table of time spent
+// per op and shape if the `summary` parameter is true.
+bool
+Client::tracez()
+{
+    if (!FLAG_trace)
+        return send_error(404, "Pass --trace To Enable Profiling");
+    std::string s = std::string(or_empty(param("seconds")));
+    double seconds = s.empty() ? 2 : atof(s.c_str());
+    if (!(seconds > 0 && seconds <= 3600))
+        return send_error(400);
+    size_t size;
+    char* json;
+    if (atob(or_empty(param("summary")), false)) {
+        json = llamafile_trace_summary(seconds, &size);
+    } else {
+        json = llamafile_trace_json(seconds, &size);
+    }
+    if (!json)
+        return send_error(503);
+    char* p = append_http_response_message(obuf_.p, 200);
+    p = stpcpy(p, "Content-Type: application/json\r\n");
+    bool ok = send_response(obuf_.p, p, std::string_view(json, size));
+    free(json);
+    return ok;
+}
+
+} // namespace server
+} // namespace lf
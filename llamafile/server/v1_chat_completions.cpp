@@ -28,10 +28,10 @@
 #include "llamafile/server/server.h"
 #include "llamafile/server/slot.h"
 #include "llamafile/server/slots.h"
+#include "llamafile/server/stopper.h"
 #include "llamafile/server/utils.h"
 #include "llamafile/server/worker.h"
 #include "llamafile/string.h"
-#include "llamafile/vector.h"
 #include <cmath>
 #include <cstring>
 #include <sys/resource.h>
@@ -54,22 +54,8 @@ struct V1ChatCompletionParams
     std::string user;
     std::string model;
     std::vector<llama_chat_msg> messages;
-    std::vector<std::vector<Atom>> stop;
+    Stopper stop;
     std::string grammar;
-
-    void add_stop(llama_model* model, const std::string& text)
-    {
-        stop.emplace_back();
-        atomize(model, &stop.back(), text, DONT_PARSE_SPECIAL);
-    }
-
-    bool should_stop(const std::vector<Atom>& history)
-    {
-        for (const auto& suffix : stop)
-            if (vector_ends_with(history, suffix))
-                return true;
-        return false;
-    }
 };
 
 struct V1ChatCompletionState
@@ -367,7 +353,7 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
     Json& stop = json["stop"];
     if (!stop.isNull()) {
         if (stop.isString()) {
-            params->add_stop(model_, stop.getString());
+            params->stop.add(stop.getString());
         } else if (stop.isArray()) {
             std::vector<Json>& stops = stop.getArray();
             if (stops.size() > 4)
@@ -377,7 +363,7 @@ Client::get_v1_chat_completions_params(V1ChatCompletionParams* params)
                     return send_error(400, "stop array item must be string");
                 if (stop2.getString().size() > 50)
                     return send_error(400, "stop array string too long");
-                params->add_stop(model_, stop2.getString());
+                params->stop.add(stop2.getString());
             }
         } else {
             return send_error(400, "stop field must be string or string array");
@@ -468,6 +454,7 @@ Client::v1_chat_completions()
     // find appropriate slot
     slot_ = worker_->server_->slots_->take(state->atoms);
     defer_cleanup(cleanup_slot, this);
+    slot_->fd_ = fd_;
 
     // init sampling
     llama_sampling_context* sampler = create_sampler(params);
@@ -478,6 +465,10 @@ Client::v1_chat_completions()
     // prefill time
     int prompt_tokens = 0;
     if ((prompt_tokens = slot_->prefill(state->atoms)) < 0) {
+        if (slot_->hung_up()) {
+            SLOG("client hung up during prefill");
+            return false;
+        }
         SLOG("slot prefill failed: %s", Slot::describe_error(prompt_tokens));
         return send_error(500, Slot::describe_error(prompt_tokens));
     }
@@ -508,9 +499,14 @@ Client::v1_chat_completions()
     }
 
     // prediction time
+    int rc;
     int completion_tokens = 0;
     const char* finish_reason = "length";
     for (;;) {
+        if (slot_->hung_up()) {
+            SLOG("client hung up after %d tokens", completion_tokens);
+            return false;
+        }
         if (params->max_tokens >= 0 &&
             completion_tokens >= params->max_tokens) {
             slot_->eval_token(llamafile_token_eot(model_));
@@ -519,41 +515,50 @@ Client::v1_chat_completions()
         llama_token id = llama_sampling_sample(sampler, slot_->ctx_, NULL);
         llama_sampling_accept(sampler, slot_->ctx_, id, APPLY_GRAMMAR);
         ++completion_tokens;
-        if (!slot_->eval_token(id)) {
-            SLOG("ran out of context window");
+        if ((rc = slot_->eval_token(id)) < 0) {
+            if (rc == Slot::aborted && slot_->hung_up())
+                return false;
+            SLOG("generation failed: %s", Slot::describe_error(rc));
             break;
         }
         if (llama_token_is_eog(model_, id)) {
             finish_reason = "stop";
             break;
         }
-        if (params->should_stop(slot_->history_)) {
-            slot_->eval_token(llamafile_token_eot(model_));
-            finish_reason = "stop";
-            break;
-        }
-        state->piece =
-          llamafile_token_to_piece(slot_->ctx_, id, DONT_RENDER_SPECIAL_TOKENS);
-        if (!state->piece.empty()) {
-            if (params->stream) {
-                char* p = append_http_response_message(obuf_.p, 200);
-                choice["delta"]["content"] = state->piece;
+        bool stopped = params->stop.feed(
+          llamafile_token_piece(model_, id, DONT_RENDER_SPECIAL_TOKENS),
+          &state->piece);
+        if (params->stream) {
+            // don't send utf-8 sequences until all their bytes arrive
+            size_t n = state->piece.size() - utf8_incomplete(state->piece);
+            if (n) {
+                choice["delta"]["content"] = state->piece.substr(0, n);
                 response->json["created"] = timespec_real().tv_sec;
                 response->content = make_event(response->json);
                 choice.getObject().erase("delta");
                 if (!send_response_chunk(response->content))
                     return false;
-            } else {
-                response->content += state->piece;
+                state->piece.erase(0, n);
             }
+        } else {
+            response->content += state->piece;
+            state->piece.clear();
+        }
+        if (stopped) {
+            slot_->eval_token(llamafile_token_eot(model_));
+            finish_reason = "stop";
+            break;
         }
     }
     choice["finish_reason"] = finish_reason;
 
+    // release text held back in case it began a stop string
+    params->stop.flush(&state->piece);
+
     // finalize response
     cleanup_slot(this);
     if (params->stream) {
-        choice["delta"]["content"] = "";
+        choice["delta"]["content"] = state->piece;
         response->json["created"] = timespec_real().tv_sec;
         response->content = make_event(response->json);
         choice.getObject().erase("delta");
@@ -568,6 +573,7 @@ Client::v1_chat_completions()
         usage["completion_tokens"] = completion_tokens;
         usage["total_tokens"] = completion_tokens + prompt_tokens;
         choice["message"]["role"] = "assistant";
+        response->content += state->piece;
         choice["message"]["content"] = std::move(response->content);
         response->json["created"] = timespec_real().tv_sec;
         char* p = append_http_response_message(obuf_.p, 200);
@@ -28,10 +28,10 @@
 #include "llamafile/server/server.h"
 #include "llamafile/server/slot.h"
 #include "llamafile/server/slots.h"
+#include "llamafile/server/stopper.h"
 #include "llamafile/server/utils.h"
 #include "llamafile/server/worker.h"
 #include "llamafile/string.h"
-#include "llamafile/vector.h"
 #include <cmath>
 #include <cstring>
 #include <sys/resource.h>
@@ -46,6 +46,8 @@ struct V1CompletionParams
 {
     bool echo = false;
     bool stream = false;
+    bool infill = false;
+    bool reuse_suffix = false;
     long max_tokens = -1;
     long seed = _rand64();
     double top_p = 1;
@@ -53,23 +55,11 @@ struct V1CompletionParams
     double presence_penalty = 0;
     double frequency_penalty = 0;
     std::string user;
+    std::string session;
     std::string model;
     std::string prompt;
-    std::vector<std::vector<Atom>> stop;
-
-    void add_stop(llama_model* model, const std::string& text)
-    {
-        stop.emplace_back();
-        atomize(model, &stop.back(), text, DONT_PARSE_SPECIAL);
-    }
-
-    bool should_stop(const std::vector<Atom>& history)
-    {
-        for (const auto& s : stop)
-            if (vector_ends_with(history, s))
-                return true;
-        return false;
-    }
+    std::string suffix;
+    Stopper stop;
 };
 
 struct V1CompletionState
@@ -183,10 +173,6 @@ Client::get_v1_completions_params(V1CompletionParams* params)
     if (!json.isObject())
         return send_error(400, "JSON body must be an object");
 
-    // fields openai documents that we don't support
-    if (json.contains("suffix"))
-        return send_error(400, "OpenAI suffix field not supported");
-
     // model: string
     Json& model = json["model"];
     if (!model.isString())
@@ -198,6 +184,35 @@ Client::get_v1_completions_params(V1CompletionParams* params)
         return send_error(400, "JSON missing prompt string");
     params->prompt = json["prompt"].getString();
 
+    // suffix: string|null
+    //
+    // The suffix that comes after a completion of inserted text. When
+    // this is specified, the prompt is the text before the cursor, and
+    // the model fills in the middle, using its infill special tokens.
+    Json& suffix = json["suffix"];
+    if (!suffix.isNull()) {
+        if (!suffix.isString())
+            return send_error(400, "suffix must be string");
+        if (llama_token_prefix(model_) == -1 ||
+            llama_token_suffix(model_) == -1 ||
+            llama_token_middle(model_) == -1)
+            return send_error(400, "model doesn't support fill-in-the-middle");
+        params->infill = true;
+        params->suffix = suffix.getString();
+    }
+
+    // reuse_suffix: boolean|null
+    //
+    // Allows the KV of an unchanged suffix to be moved rather than being
+    // evaluated again, when the text before it changed. This is faster
+    // but approximate, since its keys were computed after another prefix.
+    Json& reuse_suffix = json["reuse_suffix"];
+    if (!reuse_suffix.isNull()) {
+        if (!reuse_suffix.isBool())
+            return send_error(400, "reuse_suffix must be boolean");
+        params->reuse_suffix = reuse_suffix.getBool();
+    }
+
     // n: integer|null
     //
     // How many chat completion choices to generate for each input
@@ -354,13 +369,25 @@ Client::get_v1_completions_params(V1CompletionParams* params)
         params->user = user.getString();
     }
 
+    // session: string|null
+    //
+    // Names the editing session of fill-in-the-middle requests, so a
+    // newer request cancels the one still generating for it. This is
+    // scoped to the client's ip so other clients can't cancel it.
+    Json& session = json["session"];
+    if (!session.isNull()) {
+        if (!session.isString())
+            return send_error(400, "session must be string");
+        params->session = session.getString();
+    }
+
     // stop: string|array<string>|null
     //
     // Up to 4 sequences where the API will stop generating further tokens.
     Json& stop = json["stop"];
     if (!stop.isNull()) {
         if (stop.isString()) {
-            params->add_stop(model_, stop.getString());
+            params->stop.add(stop.getString());
         } else if (stop.isArray()) {
             std::vector<Json>& stops = stop.getArray();
             if (stops.size() > 4)
@@ -370,7 +397,7 @@ Client::get_v1_completions_params(V1CompletionParams* params)
                     return send_error(400, "stop array item must be string");
                 if (stop2.getString().size() > 50)
                     return send_error(400, "stop array string too long");
-                params->add_stop(model_, stop2.getString());
+                params->stop.add(stop2.getString());
             }
         } else {
             return send_error(400, "stop field must be string or string array");
@@ -400,11 +427,29 @@ Client::v1_completions()
         state->atoms.emplace_back(llama_token_bos(model_));
 
     // turn text into tokens
-    atomize(model_, &state->atoms, params->prompt, PARSE_SPECIAL);
+    int tail = -1;
+    if (params->infill) {
+        // prefix-suffix-middle order, so the prefix caches like usual
+        // and the suffix kv can be moved when the text before it moves
+        state->atoms.emplace_back(llama_token_prefix(model_));
+        atomize(model_, &state->atoms, params->prompt, DONT_PARSE_SPECIAL);
+        if (params->reuse_suffix)
+            tail = state->atoms.size();
+        state->atoms.emplace_back(llama_token_suffix(model_));
+        atomize(model_, &state->atoms, params->suffix, DONT_PARSE_SPECIAL);
+        state->atoms.emplace_back(llama_token_middle(model_));
+    } else {
+        atomize(model_, &state->atoms, params->prompt, PARSE_SPECIAL);
+    }
 
     // find appropriate slot
-    slot_ = worker_->server_->slots_->take(state->atoms);
+    // a newer infill request for the same session cancels the older one
+    std::string session;
+    if (params->infill && !params->session.empty())
+        session = std::to_string(effective_ip_) + ' ' + params->session;
+    slot_ = worker_->server_->slots_->take(state->atoms, session);
     defer_cleanup(cleanup_slot, this);
+    slot_->fd_ = fd_;
 
     // init sampling
     llama_sampling_context* sampler = create_sampler(params);
@@ -414,7 +459,11 @@ Client::v1_completions()
 
     // prefill time
     int prompt_tokens = 0;
-    if ((prompt_tokens = slot_->prefill(state->atoms)) < 0) {
+    if ((prompt_tokens = slot_->prefill(state->atoms, tail)) < 0) {
+        if (slot_->hung_up()) {
+            SLOG("client hung up during prefill");
+            return false;
+        }
         SLOG("slot prefill failed: %s", Slot::describe_error(prompt_tokens));
         return send_error(500, Slot::describe_error(prompt_tokens));
     }
@@ -445,9 +494,18 @@ Client::v1_completions()
     }
 
     // prediction time
+    int rc;
     int completion_tokens = 0;
     const char* finish_reason = "length";
     for (;;) {
+        if (slot_->hung_up()) {
+            SLOG("client hung up after %d tokens", completion_tokens);
+            return false;
+        }
+        if (slot_->cancelled_) {
+            finish_reason = "cancelled";
+            break;
+        }
         if (params->max_tokens >= 0 &&
             completion_tokens >= params->max_tokens) {
             slot_->eval_token(llamafile_token_eot(model_));
@@ -456,40 +514,53 @@ Client::v1_completions()
         llama_token id = llama_sampling_sample(sampler, slot_->ctx_, NULL);
         llama_sampling_accept(sampler, slot_->ctx_, id, DONT_APPLY_GRAMMAR);
         ++completion_tokens;
-        if (!slot_->eval_token(id)) {
-            SLOG("ran out of context window");
+        if ((rc = slot_->eval_token(id)) < 0) {
+            if (rc == Slot::aborted) {
+                if (slot_->hung_up())
+                    return false;
+                finish_reason = "cancelled";
+                break;
+            }
+            SLOG("generation failed: %s", Slot::describe_error(rc));
             break;
         }
         if (llama_token_is_eog(model_, id)) {
             finish_reason = "stop";
             break;
         }
-        if (params->should_stop(slot_->history_)) {
-            slot_->eval_token(llamafile_token_eot(model_));
-            finish_reason = "stop";
-            break;
-        }
-        state->piece =
-          llamafile_token_to_piece(slot_->ctx_, id, DONT_RENDER_SPECIAL_TOKENS);
-        if (!state->piece.empty()) {
-            if (params->stream) {
-                char* p = append_http_response_message(obuf_.p, 200);
-                choice["text"] = state->piece;
+        bool stopped = params->stop.feed(
+          llamafile_token_piece(model_, id, DONT_RENDER_SPECIAL_TOKENS),
+          &state->piece);
+        if (params->stream) {
+            // don't send utf-8 sequences until all their bytes arrive
+            size_t n = state->piece.size() - utf8_incomplete(state->piece);
+            if (n) {
+                choice["text"] = state->piece.substr(0, n);
                 response->json["created"] = timespec_real().tv_sec;
                 response->content = make_event(response->json);
                 if (!send_response_chunk(response->content))
                     return false;
-            } else {
-                response->content += state->piece;
+                state->piece.erase(0, n);
             }
+        } else {
+            response->content += state->piece;
+            state->piece.clear();
+        }
+        if (stopped) {
+            slot_->eval_token(llamafile_token_eot(model_));
+            finish_reason = "stop";
+            break;
         }
     }
     choice["finish_reason"] = finish_reason;
 
+    // release text held back in case it began a stop string
+    params->stop.flush(&state->piece);
+
     // finalize response
     cleanup_slot(this);
     if (params->stream) {
-        choice["text"] = "";
+        choice["text"] = state->piece;
         response->json["created"] = timespec_real().tv_sec;
         response->content = make_event(response->json);
         if (!send_response_chunk(response->content))
@@ -502,6 +573,7 @@ Client::v1_completions()
         usage["prompt_tokens"] = prompt_tokens;
         usage["completion_tokens"] = completion_tokens;
         usage["total_tokens"] = completion_tokens + prompt_tokens;
+        response->content += state->piece;
         choice["text"] = std::move(response->content);
         response->json["created"] = timespec_real().tv_sec;
         char* p = append_http_response_message(obuf_.p, 200);
@@ -16,6 +16,7 @@
 // limitations under the License.
 
 #include "sgemm.h"
+#include "llama.cpp/ggml.h"
 #include "llamafile.h"
 #include <cassert>
 #include <cosmo.h>
@@ -27,6 +28,8 @@ static const struct GemmFuncs {
     typeof(llamafile_sgemm) *sgemm;
     typeof(llamafile_mixmul) *mixmul;
     typeof(llamafile_mixmul_iqk) *iqk_mixmul = iqk_mul_mat_moe_unsupported;
+    typeof(llamafile_gemv_q4_0_8x8) *gemv_q4_0_8x8 = llamafile_gemv_q4_0_8x8_unsupported;
+    typeof(llamafile_gemm_q4_0_8x8) *gemm_q4_0_8x8 = llamafile_gemm_q4_0_8x8_unsupported;
     GemmFuncs() {
 #ifdef __x86_64__
         if (X86_HAVE(AVX)) {
@@ -42,24 +45,35 @@ static const struct GemmFuncs {
                             sgemm = llamafile_sgemm_amd_zen4;
                             mixmul = llamafile_mixmul_amd_zen4;
                             iqk_mixmul = iqk_mul_mat_moe_zen4;
+                            gemv_q4_0_8x8 = llamafile_gemv_q4_0_8x8_amd_zen4;
+                            gemm_q4_0_8x8 = llamafile_gemm_q4_0_8x8_amd_zen4;
                         } else {
                             // Intel Xeon Skylake+ (2015-)
                             sgemm = llamafile_sgemm_amd_avx512f;
                             mixmul = llamafile_mixmul_amd_avx512f;
                             iqk_mixmul = iqk_mul_mat_moe;
+                            if (X86_HAVE(F16C)) {
+                                gemv_q4_0_8x8 = llamafile_gemv_q4_0_8x8_amd_avx2;
+                                gemm_q4_0_8x8 = llamafile_gemm_q4_0_8x8_amd_avx2;
+                            }
                         }
                     } else if (X86_HAVE(AVXVNNI)) {
                         // Intel Alderlake (2021-)
                         sgemm = llamafile_sgemm_amd_avxvnni;
                         mixmul = llamafile_mixmul_amd_avxvnni;
                         iqk_mixmul = iqk_mul_mat_moe;
+                        gemv_q4_0_8x8 = llamafile_gemv_q4_0_8x8_amd_avx2;
+                        gemm_q4_0_8x8 = llamafile_gemm_q4_0_8x8_amd_avx2;
                     } else {
                         // Intel Haswell/Broadwell/Skylake (2013-2020)
                         // AMD Excavator (2015-2022)
                         sgemm = llamafile_sgemm_amd_avx2;
                         mixmul = llamafile_mixmul_amd_avx2;
-                        if (X86_HAVE(F16C))
+                        if (X86_HAVE(F16C)) {
                             iqk_mixmul = iqk_mul_mat_moe;
+                            gemv_q4_0_8x8 = llamafile_gemv_q4_0_8x8_amd_avx2;
+                            gemm_q4_0_8x8 = llamafile_gemm_q4_0_8x8_amd_avx2;
+                        }
                     }
                 } else {
                     // AMD Piledriver (2011-2014)
@@ -143,3 +157,31 @@ bool llamafile_mixmul_iqk(long Nx, long Ny, long ne00, int ne11, int typeA, cons
                           int ith, int nth) {
     return funcs.iqk_mixmul(Nx, Ny, ne00, ne11, typeA, A, B, C, nb1, nb2, vrow_mapping, ith, nth);
 }
+
+/**
+ * Returns true if weights of GGML type should be repacked at load time.
+ *
+ * This is the case when we have interleaved kernels for this CPU which
+ * go faster than tinyBLAS on the original type. For example, Q4_0 gets
+ * rewritten as Q4_0_8_8, after which matmuls go through the gemv/gemm
+ * functions below rather than llamafile_sgemm().
+ */
+bool llamafile_repack_supported(int type) {
+    return type == GGML_TYPE_Q4_0 && funcs.gemv_q4_0_8x8 != llamafile_gemv_q4_0_8x8_unsupported;
+}
+
+/**
+ * Multiplies Q4_0_8_8 weights with a Q8_0 activation row on CPU.
+ */
+bool llamafile_gemv_q4_0_8x8(int n, float *s, size_t bs, const void *vx, const void *vy, int nr,
+                             int nc) {
+    return funcs.gemv_q4_0_8x8(n, s, bs, vx, vy, nr, nc);
+}
+
+/**
+ * Multiplies Q4_0_8_8 weights with Q8_0x4 activation rows on CPU.
+ */
+bool llamafile_gemm_q4_0_8x8(int n, float *s, size_t bs, const void *vx, const void *vy, int nr,
+                             int nc) {
+    return funcs.gemm_q4_0_8x8(n, s, bs, vx, vy, nr, nc);
+}
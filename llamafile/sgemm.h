@@ -1,5 +1,6 @@
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -76,6 +77,18 @@ bool llamafile_mixmul_arm82(const struct ggml_compute_params *, const struct ggm
 bool llamafile_mixmul_iqk(long, long, long, int, int, const void *, const void *, float *, long,
                           long, const void *, int, int);
 
+bool llamafile_repack_supported(int);
+bool llamafile_gemv_q4_0_8x8(int, float *, size_t, const void *, const void *, int, int);
+bool llamafile_gemm_q4_0_8x8(int, float *, size_t, const void *, const void *, int, int);
+bool llamafile_gemv_q4_0_8x8_unsupported(int, float *, size_t, const void *, const void *, int,
+                                         int);
+bool llamafile_gemm_q4_0_8x8_unsupported(int, float *, size_t, const void *, const void *, int,
+                                         int);
+bool llamafile_gemv_q4_0_8x8_amd_avx2(int, float *, size_t, const void *, const void *, int, int);
+bool llamafile_gemm_q4_0_8x8_amd_avx2(int, float *, size_t, const void *, const void *, int, int);
+bool llamafile_gemv_q4_0_8x8_amd_zen4(int, float *, size_t, const void *, const void *, int, int);
+bool llamafile_gemm_q4_0_8x8_amd_zen4(int, float *, size_t, const void *, const void *, int, int);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,136 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bench.h"
+#include "llama.cpp/cores.h"
+#include "llama.cpp/ggml-aarch64.h"
+#include "llama.cpp/ggml.h"
+#include "numba.h"
+#include "sgemm.h"
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// checks q4_0 weights repacked as q4_0_8_8 multiply the same as q4_0
+
+#define ITERATIONS 30
+#define ALLOC(n) memalign(4096, n)
+
+void tinyblas_openmp(long m, long n, long k, const void *A, const void *B, float *C) {
+    static int nth = cpu_get_num_math();
+#pragma omp parallel for
+    for (int ith = 0; ith < nth; ++ith) {
+        bool res = llamafile_sgemm(m, n, k / QK8_0, A, k / QK8_0, B, k / QK8_0, C, m, ith, nth,
+                                   GGML_TYPE_Q4_0, GGML_TYPE_Q8_0, GGML_TYPE_F32);
+        assert(res);
+    }
+}
+
+void repack_openmp(long m, long n, long k, const void *A, const void *B, float *C) {
+    static int nth = cpu_get_num_math();
+    const size_t row_size = ggml_row_size(GGML_TYPE_Q4_0, k);
+#pragma omp parallel for
+    for (int ith = 0; ith < nth; ++ith) {
+        long start = m / 8 * ith / nth * 8;
+        long end = m / 8 * (ith + 1) / nth * 8;
+        const char *a = (const char *)A + start * row_size;
+        if (n > 3) {
+            llamafile_gemm_q4_0_8x8(k, C + start, m, a, B, n, end - start);
+        } else {
+            for (long j = 0; j < n; ++j)
+                llamafile_gemv_q4_0_8x8(k, C + j * m + start, m, a,
+                                        (const char *)B + ggml_row_size(GGML_TYPE_Q8_0, k) * j, 1,
+                                        end - start);
+        }
+    }
+}
+
+int test(long m, long n, long k) {
+    size_t a_size = ggml_row_size(GGML_TYPE_Q4_0, k) * m;
+    size_t b_size = ggml_row_size(GGML_TYPE_Q8_0, k) * n;
+    float *A = (float *)ALLOC(sizeof(float) * k * m);
+    float *B = (float *)ALLOC(sizeof(float) * k * n);
+    float *C = (float *)ALLOC(sizeof(float) * m * n);
+    float *G = (float *)ALLOC(sizeof(float) * m * n);
+    void *Aq = ALLOC(a_size);
+    void *Ar = ALLOC(a_size);
+    void *Bq = ALLOC(b_size);
+    void *Bi = ALLOC(b_size);
+    randomize(A, k * m);
+    randomize(B, k * n);
+
+    // quantize weights and activations the way ggml would
+    ggml_quantize_chunk(GGML_TYPE_Q4_0, A, Aq, 0, m, k, nullptr);
+    ggml_quantize_chunk(GGML_TYPE_Q8_0, B, Bq, 0, n, k, nullptr);
+    memcpy(Ar, Aq, a_size);
+    ggml_repack_q4_0_8x8(Ar, m, k);
+    if (n > 3) {
+        for (long j = 0; j < n; j += 4)
+            quantize_mat_q8_0(B + j * k, (char *)Bi + ggml_row_size(GGML_TYPE_Q8_0, k) * j, 4, k,
+                              8);
+    } else {
+        memcpy(Bi, Bq, b_size);
+    }
+
+    printf("m=%ld n=%ld k=%ld\n", m, n, k);
+    BENCH(tinyblas_openmp(m, n, k, Aq, Bq, G));
+    BENCH(repack_openmp(m, n, k, Ar, Bi, C));
+
+    for (long j = 0; j < n; ++j)
+        for (long i = 0; i < m; ++i) {
+            float g = G[j * m + i];
+            float c = C[j * m + i];
+            if (!(std::fabs(g - c) <= 1e-3f * (1 + std::fabs(g)))) {
+                fprintf(stderr, "%s:%d: mismatch at i=%ld j=%ld: %g vs. %g\n", __FILE__, __LINE__,
+                        i, j, c, g);
+                return 1;
+            }
+        }
+
+    free(Bi);
+    free(Bq);
+    free(Ar);
+    free(Aq);
+    free(G);
+    free(C);
+    free(B);
+    free(A);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rc;
+    ggml_init_params params = {0, nullptr, true};
+    ggml_free(ggml_init(params)); // initializes fp16 tables
+    if (!llamafile_repack_supported(GGML_TYPE_Q4_0)) {
+        printf("skipping test: no interleaved kernels for this cpu\n");
+        return 0;
+    }
+    if ((rc = test(64, 1, 256)))
+        return rc;
+    if ((rc = test(64, 8, 256)))
+        return rc;
+    if ((rc = test(4096, 1, 4096)))
+        return rc;
+    if ((rc = test(4096, 3, 4096)))
+        return rc;
+    if ((rc = test(4096, 128, 4096)))
+        return rc;
+    if ((rc = test(11008, 512, 4096)))
+        return rc;
+}
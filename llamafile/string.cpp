@@ -169,4 +169,17 @@ std::string collapse(const std::string_view &input) {
     return result;
 }
 
+// returns number of bytes at the end of `s` that begin a utf-8 sequence
+// which isn't complete yet, e.g. because the rest is in the next token
+size_t utf8_incomplete(const std::string_view &s) {
+    for (size_t n = 1; n <= 3 && n <= s.size(); ++n) {
+        unsigned char c = s[s.size() - n];
+        if ((c & 0300) == 0200)
+            continue;
+        size_t len = c >= 0360 ? 4 : c >= 0340 ? 3 : c >= 0300 ? 2 : 1;
+        return len > n ? n : 0;
+    }
+    return 0;
+}
+
 } // namespace lf
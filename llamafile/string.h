@@ -36,6 +36,7 @@ std::string resolve(const std::string_view &, const std::string_view &);
 std::string stripext(const std::string &);
 std::string tolower(const std::string_view &);
 std::string_view extname(const std::string_view &);
+size_t utf8_incomplete(const std::string_view &);
 void append_wchar(std::string *, wchar_t);
 
 } // namespace lf
@@ -0,0 +1,46 @@
+// -*- mode:c++;indent-tabs-mode:nil;c-basic-offset:4;coding:utf-8 -*-
+// vi: set et ft=cpp ts=4 sts=4 sw=4 fenc=utf-8 :vi
+//
+// Copyright 2024 Mozilla Foundation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "string.h"
+
+#include <string_view>
+
+int main(int argc, char *argv[]) {
+    using lf::utf8_incomplete;
+    using namespace std::literals;
+
+    if (utf8_incomplete(""))
+        return 1;
+    if (utf8_incomplete("hello"))
+        return 2;
+    if (utf8_incomplete("caf\xc3\xa9"))
+        return 3;
+    if (utf8_incomplete("caf\xc3") != 1)
+        return 4;
+    if (utf8_incomplete("\xe2\x82") != 2)
+        return 5;
+    if (utf8_incomplete("\xe2\x82\xac"))
+        return 6;
+    if (utf8_incomplete("x\xf0\x9f\x98") != 3)
+        return 7;
+    if (utf8_incomplete("\xf0\x9f\x98\x80"))
+        return 8;
+    if (utf8_incomplete("\x80\x80\x80\x80"))
+        return 9; // garbage isn't worth waiting for
+    if (utf8_incomplete("a\0"sv))
+        return 10;
+}
@@ -0,0 +1,5 @@
+#ifdef __x86_64__
+#define llamafile_gemv_q4_0_8x8 llamafile_gemv_q4_0_8x8_amd_avx2
+#define llamafile_gemm_q4_0_8x8 llamafile_gemm_q4_0_8x8_amd_avx2
+#include "tinyblas_cpu_repack.inc"
+#endif // __x86_64__
@@ -34,3 +34,13 @@ bool iqk_mul_mat_moe_unsupported(long, long, long, int, int, const void *, const
                                  long, long, const void *, int, int) {
     return false;
 }
+
+bool llamafile_gemv_q4_0_8x8_unsupported(int n, float *s, size_t bs, const void *vx,
+                                         const void *vy, int nr, int nc) {
+    return false;
+}
+
+bool llamafile_gemm_q4_0_8x8_unsupported(int n, float *s, size_t bs, const void *vx,
+                                         const void *vy, int nr, int nc) {
+    return false;
+}
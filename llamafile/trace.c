@@ -18,56 +18,166 @@
 #include "trace.h"
 
 #include <cosmo.h>
+#include <limits.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
 #include <threads.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "llama.cpp/ggml.h"
 #include "llamafile.h"
 #include "log.h"
 
+// continuous op profiler
+//
+// each thread owns a ring buffer of the most recent events it recorded,
+// so tracing can stay enabled in long running servers without running
+// out of memory. rings are only written by their owner thread. readers
+// may snapshot them at any time, and discard whichever events might've
+// been overwritten while they were being copied.
+
+#define TRACE_RING 65536 // events per thread (must be two power)
+#define TRACE_DEPTH 8 // max nesting of begin/end pairs
+#define TRACE_THREADS 1024
+#define TRACE_SUMMARY 8192 // max distinct op shapes in summaries (two power)
+
+enum {
+    TRACE_OP,
+    TRACE_WAIT,
+};
+
 struct TraceEvent {
     unsigned long long ts;
-    int pid;
+    const char *name;
+    const char *parent; // op which a barrier wait happened in
+    int ne[4];
+    unsigned dur;
     int tid;
+    short layer;
+    unsigned char type;
+    unsigned char kind;
+};
+
+struct TraceRing {
+    atomic_ullong head;
+    struct TraceRing *next;
+    struct TraceEvent ev[TRACE_RING];
+};
+
+struct TraceFrame {
+    unsigned long long ts;
     const char *name;
-    const char *cat;
-    char ph;
+    const struct ggml_tensor *tensor;
+};
+
+struct TraceStat {
+    const char *name;
+    const char *parent;
+    int ne[4];
+    short layer;
+    unsigned char type;
+    unsigned char kind;
+    unsigned long long count;
+    unsigned long long total;
+    unsigned long long max;
 };
 
 static int g_pid;
 static atomic_bool g_oom;
+static pthread_key_t g_key;
+static pthread_once_t g_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct TraceRing *g_free;
 static atomic_int g_count;
-static thread_local int g_id;
-static thread_local int g_ids;
+static struct TraceRing *g_rings[TRACE_THREADS];
+static unsigned long long g_tsc0;
+static struct timespec g_ts0;
+
 static thread_local int g_tid;
-static struct TraceEvent g_events[1000000];
+static thread_local int g_depth;
+static thread_local struct TraceRing *g_ring;
+static thread_local struct TraceFrame g_frames[TRACE_DEPTH];
+static thread_local struct TraceEvent g_last;
 
-static int llamafile_trace_oom(void) {
+static void llamafile_trace_release(void *arg) {
+    struct TraceRing *ring = arg;
+    pthread_mutex_lock(&g_lock);
+    ring->next = g_free;
+    g_free = ring;
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void llamafile_trace_init(void) {
+    g_tsc0 = rdtsc();
+    clock_gettime(CLOCK_MONOTONIC, &g_ts0);
+    pthread_key_create(&g_key, llamafile_trace_release);
+}
+
+static struct TraceRing *llamafile_trace_ring(void) {
+    struct TraceRing *ring;
+    if (g_ring)
+        return g_ring;
     if (atomic_load_explicit(&g_oom, memory_order_relaxed))
+        return 0;
+    pthread_once(&g_once, llamafile_trace_init);
+    pthread_mutex_lock(&g_lock);
+    if ((ring = g_free)) {
+        g_free = ring->next;
+    } else {
+        int n = atomic_load_explicit(&g_count, memory_order_relaxed);
+        if (n < TRACE_THREADS && (ring = calloc(1, sizeof(struct TraceRing)))) {
+            g_rings[n] = ring;
+            atomic_store_explicit(&g_count, n + 1, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    if (!ring) {
+        if (!atomic_exchange_explicit(&g_oom, true, memory_order_acq_rel))
+            tinylog("warning: ran out of trace event memory\n", NULL);
+        return 0;
+    }
+    pthread_setspecific(g_key, ring);
+    return g_ring = ring;
+}
+
+// llama.cpp names graph nodes like "ffn_out-12"
+static int llamafile_trace_layer(const char *s) {
+    const char *p;
+    int layer = 0;
+    if (!(p = strrchr(s, '-')) || !*++p)
         return -1;
-    if (atomic_exchange_explicit(&g_oom, true, memory_order_acq_rel))
-        return -1;
-    tinylog("warning: ran out of trace event memory\n", NULL);
-    return -1;
+    for (; *p; ++p) {
+        if (*p < '0' || *p > '9')
+            return -1;
+        if ((layer = layer * 10 + (*p - '0')) > SHRT_MAX)
+            return -1;
+    }
+    return layer;
 }
 
-static int llamafile_trace_reserve(int count) {
-    int id = atomic_load_explicit(&g_count, memory_order_relaxed);
-    if (id + count > sizeof(g_events) / sizeof(*g_events))
-        return llamafile_trace_oom();
-    id = atomic_fetch_add_explicit(&g_count, count, memory_order_acq_rel);
-    if (id + count > sizeof(g_events) / sizeof(*g_events))
-        return llamafile_trace_oom();
-    return id;
+static void llamafile_trace_describe(struct TraceEvent *e, const struct ggml_tensor *t) {
+    if (!t) {
+        memset(e->ne, 0, sizeof(e->ne));
+        e->type = GGML_TYPE_COUNT;
+        e->layer = -1;
+        return;
+    }
+    for (int i = 0; i < 4; ++i)
+        e->ne[i] = t->ne[i] > INT_MAX ? INT_MAX : t->ne[i];
+    e->type = t->src[0] ? t->src[0]->type : t->type;
+    e->layer = llamafile_trace_layer(t->name);
 }
 
-static void llamafile_trace_event(int id, const char *name, const char *cat, char ph) {
-    g_events[id].ts = rdtsc();
-    g_events[id].pid = g_pid ? g_pid - 1 : getpid();
-    g_events[id].tid = g_tid ? g_tid - 1 : gettid();
-    g_events[id].name = name;
-    g_events[id].cat = cat;
-    g_events[id].ph = ph;
+static void llamafile_trace_push(const struct TraceEvent *e) {
+    struct TraceRing *ring;
+    if (!(ring = llamafile_trace_ring()))
+        return;
+    unsigned long long i = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring->ev[i & (TRACE_RING - 1)] = *e;
+    atomic_store_explicit(&ring->head, i + 1, memory_order_release);
 }
 
 void llamafile_trace_set_pid(int pid) {
@@ -78,33 +188,270 @@ void llamafile_trace_set_tid(int tid) {
     g_tid = tid + 1;
 }
 
-void llamafile_trace_begin(const char *name) {
+unsigned long long llamafile_trace_now(void) {
+    return rdtsc();
+}
+
+void llamafile_trace_begin_tensor(const char *name, const struct ggml_tensor *tensor) {
     if (!FLAG_trace)
         return;
-    if (g_ids < 2) {
-        g_ids = 20;
-        g_id = llamafile_trace_reserve(g_ids);
-        if (g_id == -1) {
-            g_ids = 0;
-            return;
-        }
+    if (g_depth < TRACE_DEPTH) {
+        g_frames[g_depth].name = name;
+        g_frames[g_depth].tensor = tensor;
+        g_frames[g_depth].ts = rdtsc();
     }
-    llamafile_trace_event(g_id++, name, "category", 'B');
-    --g_ids;
+    ++g_depth;
+}
+
+void llamafile_trace_begin(const char *name) {
+    llamafile_trace_begin_tensor(name, 0);
 }
 
 void llamafile_trace_end(const char *name) {
+    struct TraceFrame *f;
+    if (!g_depth)
+        return;
+    if (--g_depth >= TRACE_DEPTH)
+        return;
+    f = &g_frames[g_depth];
+    unsigned long long dur = rdtsc() - f->ts;
+    g_last.ts = f->ts;
+    g_last.name = f->name;
+    g_last.parent = 0;
+    g_last.dur = dur > UINT_MAX ? UINT_MAX : dur;
+    g_last.tid = g_tid ? g_tid - 1 : gettid();
+    g_last.kind = TRACE_OP;
+    llamafile_trace_describe(&g_last, f->tensor);
+    llamafile_trace_push(&g_last);
+}
+
+// records time a thread spent waiting in a barrier since `start`
+//
+// waits are attributed to the op they happened inside, or otherwise to
+// the op this thread most recently finished, since it's usually uneven
+// work partitioning in that op which made this thread wait for others.
+void llamafile_trace_wait(const char *name, unsigned long long start) {
+    struct TraceEvent e;
     if (!FLAG_trace)
         return;
-    if (g_ids < 1)
+    unsigned long long dur = rdtsc() - start;
+    if (g_depth && g_depth <= TRACE_DEPTH) {
+        e.parent = g_frames[g_depth - 1].name;
+        llamafile_trace_describe(&e, g_frames[g_depth - 1].tensor);
+    } else if (g_last.name) {
+        e = g_last;
+        e.parent = g_last.name;
+    } else {
+        e.parent = 0;
+        llamafile_trace_describe(&e, 0);
+    }
+    e.ts = start;
+    e.name = name;
+    e.dur = dur > UINT_MAX ? UINT_MAX : dur;
+    e.tid = g_tid ? g_tid - 1 : gettid();
+    e.kind = TRACE_WAIT;
+    llamafile_trace_push(&e);
+}
+
+// returns time stamp counter ticks per second
+static double llamafile_trace_hz(void) {
+    struct timespec ts;
+    pthread_once(&g_once, llamafile_trace_init);
+    for (;;) {
+        unsigned long long tsc = rdtsc();
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        double ns = (ts.tv_sec - g_ts0.tv_sec) * 1e9 + (ts.tv_nsec - g_ts0.tv_nsec);
+        if (ns >= 1e7)
+            return (tsc - g_tsc0) / ns * 1e9;
+        usleep(10000);
+    }
+}
+
+// calls f() on each event recorded within the last `seconds`
+//
+// if seconds isn't positive then every event still held is visited.
+static void llamafile_trace_visit(double seconds, void f(const struct TraceEvent *, void *),
+                                  void *arg) {
+    struct TraceEvent *buf;
+    unsigned long long since = 0;
+    if (seconds > 0) {
+        unsigned long long now = rdtsc();
+        double ticks = seconds * llamafile_trace_hz();
+        if (ticks < now - g_tsc0)
+            since = now - (unsigned long long)ticks;
+    }
+    if (!(buf = malloc(sizeof(struct TraceEvent) * TRACE_RING)))
         return;
-    llamafile_trace_event(g_id++, name, "category", 'E');
-    --g_ids;
+    int n = atomic_load_explicit(&g_count, memory_order_acquire);
+    for (int i = 0; i < n; ++i) {
+        struct TraceRing *ring = g_rings[i];
+        unsigned long long hi = atomic_load_explicit(&ring->head, memory_order_acquire);
+        unsigned long long lo = hi > TRACE_RING ? hi - TRACE_RING : 0;
+        for (unsigned long long j = lo; j < hi; ++j)
+            buf[j - lo] = ring->ev[j & (TRACE_RING - 1)];
+        atomic_thread_fence(memory_order_acquire);
+        unsigned long long hi2 = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        unsigned long long ok = hi2 >= TRACE_RING ? hi2 - TRACE_RING + 1 : 0;
+        for (unsigned long long j = lo > ok ? lo : ok; j < hi; ++j)
+            if (buf[j - lo].ts >= since)
+                f(&buf[j - lo], arg);
+    }
+    free(buf);
+}
+
+struct TraceJson {
+    FILE *f;
+    bool once;
+    double hz;
+    int pid;
+};
+
+static void llamafile_trace_json_event(const struct TraceEvent *e, void *arg) {
+    struct TraceJson *j = arg;
+    fputs(j->once ? ",\n" : "\n", j->f);
+    j->once = true;
+    fprintf(j->f,
+            "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":%d,\"tid\":%d",
+            e->name, e->kind == TRACE_WAIT ? "wait" : "op", (long long)(e->ts - g_tsc0) * 1e6 / j->hz,
+            e->dur * 1e6 / j->hz, j->pid, e->tid);
+    if (e->type != GGML_TYPE_COUNT || e->parent) {
+        fputs(",\"args\":{", j->f);
+        if (e->type != GGML_TYPE_COUNT)
+            fprintf(j->f, "\"type\":\"%s\",\"shape\":[%d,%d,%d,%d],\"layer\":%d%s",
+                    ggml_type_name(e->type), e->ne[0], e->ne[1], e->ne[2], e->ne[3], e->layer,
+                    e->parent ? "," : "");
+        if (e->parent)
+            fprintf(j->f, "\"op\":\"%s\"", e->parent);
+        fputc('}', j->f);
+    }
+    fputc('}', j->f);
+}
+
+static void llamafile_trace_write(FILE *f, double seconds) {
+    struct TraceJson j = {f, false, llamafile_trace_hz(), g_pid ? g_pid - 1 : getpid()};
+    fputc('[', f);
+    llamafile_trace_visit(seconds, llamafile_trace_json_event, &j);
+    fputs("\n]\n", f);
+}
+
+// returns chrome://tracing/ json of events from the last `seconds`
+//
+// the caller must free() the result. returns null if out of memory.
+char *llamafile_trace_json(double seconds, size_t *out_size) {
+    char *s;
+    FILE *f;
+    if (!(f = open_memstream(&s, out_size)))
+        return 0;
+    llamafile_trace_write(f, seconds);
+    fclose(f);
+    return s;
+}
+
+struct TraceSummary {
+    struct TraceStat *tab;
+    int count;
+    unsigned long long dropped;
+    unsigned long long total;
+};
+
+static unsigned llamafile_trace_hash(const struct TraceEvent *e) {
+    unsigned h = (uintptr_t)e->name * 0x9e3779b1u;
+    h = (h ^ (uintptr_t)e->parent) * 0x9e3779b1u;
+    h = (h ^ e->type) * 0x9e3779b1u;
+    for (int i = 0; i < 4; ++i)
+        h = (h ^ e->ne[i]) * 0x9e3779b1u;
+    return h ^ h >> 16;
+}
+
+static void llamafile_trace_tally(const struct TraceEvent *e, void *arg) {
+    struct TraceSummary *s = arg;
+    unsigned i = llamafile_trace_hash(e);
+    for (;; ++i) {
+        struct TraceStat *t = &s->tab[i & (TRACE_SUMMARY - 1)];
+        if (!t->name) {
+            if (s->count >= TRACE_SUMMARY / 2) {
+                ++s->dropped;
+                return;
+            }
+            ++s->count;
+            t->name = e->name;
+            t->parent = e->parent;
+            t->type = e->type;
+            t->kind = e->kind;
+            t->layer = e->layer;
+            memcpy(t->ne, e->ne, sizeof(t->ne));
+        } else if (t->name != e->name || t->parent != e->parent || t->type != e->type ||
+                   memcmp(t->ne, e->ne, sizeof(t->ne))) {
+            continue;
+        }
+        if (t->layer != e->layer)
+            t->layer = -1;
+        t->count += 1;
+        t->total += e->dur;
+        if (e->dur > t->max)
+            t->max = e->dur;
+        s->total += e->dur;
+        return;
+    }
+}
+
+static int llamafile_trace_compare(const void *a, const void *b) {
+    const struct TraceStat *x = a, *y = b;
+    return (x->total < y->total) - (x->total > y->total);
+}
+
+// returns json summary of events from the last `seconds`
+//
+// events are grouped by op, weight type and shape, then sorted by the
+// total time spent on them. barrier waits are grouped by the op which
+// they happened in. the caller must free() the result.
+char *llamafile_trace_summary(double seconds, size_t *out_size) {
+    char *res;
+    FILE *f;
+    struct TraceSummary s = {0};
+    if (!(s.tab = calloc(TRACE_SUMMARY, sizeof(struct TraceStat))))
+        return 0;
+    llamafile_trace_visit(seconds, llamafile_trace_tally, &s);
+    // move the filled slots to the front, since empty ones can tie with
+    // stats whose events all took zero ticks and then get sorted first
+    for (int i = 0, j = 0; i < TRACE_SUMMARY; ++i)
+        if (s.tab[i].name)
+            s.tab[j++] = s.tab[i];
+    qsort(s.tab, s.count, sizeof(struct TraceStat), llamafile_trace_compare);
+    if (!(f = open_memstream(&res, out_size))) {
+        free(s.tab);
+        return 0;
+    }
+    double hz = llamafile_trace_hz();
+    fprintf(f, "{\"seconds\":%g,\"threads\":%d,\"total_us\":%.3f,\"dropped\":%llu,\"ops\":[",
+            seconds, atomic_load_explicit(&g_count, memory_order_acquire), s.total * 1e6 / hz,
+            s.dropped);
+    for (int i = 0; i < s.count; ++i) {
+        struct TraceStat *t = &s.tab[i];
+        fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\"", i ? "," : "", t->name,
+                t->kind == TRACE_WAIT ? "wait" : "op");
+        if (t->parent)
+            fprintf(f, ",\"op\":\"%s\"", t->parent);
+        if (t->type != GGML_TYPE_COUNT)
+            fprintf(f, ",\"type\":\"%s\",\"shape\":[%d,%d,%d,%d]", ggml_type_name(t->type),
+                    t->ne[0], t->ne[1], t->ne[2], t->ne[3]);
+        if (t->layer != -1)
+            fprintf(f, ",\"layer\":%d", t->layer);
+        fprintf(f,
+                ",\"count\":%llu,\"total_us\":%.3f,\"mean_us\":%.3f,\"max_us\":%.3f,"
+                "\"percent\":%.2f}",
+                t->count, t->total * 1e6 / hz, t->total * 1e6 / hz / t->count, t->max * 1e6 / hz,
+                s.total ? t->total * 100. / s.total : 0.);
+    }
+    fputs("\n]}\n", f);
+    fclose(f);
+    free(s.tab);
+    return res;
 }
 
 static void llamafile_trace_save(const char *filename) {
-    int count = atomic_load_explicit(&g_count, memory_order_relaxed);
-    if (!count)
+    if (!atomic_load_explicit(&g_count, memory_order_acquire))
         return;
     tinylog("saving trace to ", filename, "...\n", NULL);
     FILE *file = fopen(filename, "w");
@@ -112,23 +459,7 @@ static void llamafile_trace_save(const char *filename) {
         perror(filename);
         return;
     }
-    fprintf(file, "[\n");
-    bool once = false;
-    for (int i = 0; i < count; i++) {
-        if (!g_events[i].name)
-            continue;
-        if (!once) {
-            once = true;
-        } else {
-            fputs(",\n", file);
-        }
-        fprintf(file,
-                "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"%c\", "
-                "\"ts\": %.3f, \"pid\": %d, \"tid\": %d}",
-                g_events[i].name, g_events[i].cat, g_events[i].ph,
-                (g_events[i].ts - kStartTsc) / 3000., g_events[i].pid, g_events[i].tid);
-    }
-    fprintf(file, "\n]\n");
+    llamafile_trace_write(file, 0);
     fclose(file);
 }
 
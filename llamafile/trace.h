@@ -1,12 +1,20 @@
 #pragma once
+#include <stddef.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct ggml_tensor;
+
 void llamafile_trace_set_pid(int);
 void llamafile_trace_set_tid(int);
 void llamafile_trace_begin(const char *);
+void llamafile_trace_begin_tensor(const char *, const struct ggml_tensor *);
 void llamafile_trace_end(const char *);
+unsigned long long llamafile_trace_now(void);
+void llamafile_trace_wait(const char *, unsigned long long);
+char *llamafile_trace_json(double, size_t *);
+char *llamafile_trace_summary(double, size_t *);
 
 #ifdef __cplusplus
 }
@@ -16,40 +16,44 @@
 // limitations under the License.
 
 #include "float.h"
+#include "micros.h"
 #include "numba.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <cosmo.h>
+#include <float.h>
+#include <limits.h>
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include <sys/auxv.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
 #include "llama.cpp/ggml-vector.h"
 
-extern "C" void ggml_vec_gelu_f32_amd_avx512bf16(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_amd_avx512vl(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_amd_avx512(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_amd_avx2(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_amd_f16c(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_amd_fma(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_amd_avx(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_amd_ssse3(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_amd_k8(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_arm82(const int n, float *y, const float *x);
-extern "C" void ggml_vec_gelu_f32_arm80(const int n, float *y, const float *x);
-
-extern "C" void ggml_vec_silu_f32_amd_avx512bf16(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_amd_avx512vl(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_amd_avx512(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_amd_avx2(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_amd_f16c(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_amd_fma(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_amd_avx(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_amd_ssse3(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_amd_k8(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_arm82(const int n, float *y, const float *x);
-extern "C" void ggml_vec_silu_f32_arm80(const int n, float *y, const float *x);
+#define VMATHF(F) \
+    extern "C" void F##_amd_avx512bf16(const int n, float *y, const float *x); \
+    extern "C" void F##_amd_avx512vl(const int n, float *y, const float *x); \
+    extern "C" void F##_amd_avx512(const int n, float *y, const float *x); \
+    extern "C" void F##_amd_avx2(const int n, float *y, const float *x); \
+    extern "C" void F##_amd_f16c(const int n, float *y, const float *x); \
+    extern "C" void F##_amd_fma(const int n, float *y, const float *x); \
+    extern "C" void F##_amd_avx(const int n, float *y, const float *x); \
+    extern "C" void F##_amd_ssse3(const int n, float *y, const float *x); \
+    extern "C" void F##_amd_k8(const int n, float *y, const float *x); \
+    extern "C" void F##_arm82(const int n, float *y, const float *x); \
+    extern "C" void F##_arm80(const int n, float *y, const float *x);
+
+VMATHF(ggml_vec_gelu_f32)
+VMATHF(ggml_vec_silu_f32)
+VMATHF(ggml_vec_sqrt_f32)
+VMATHF(ggml_vec_log_f32)
+VMATHF(ggml_vec_abs_f32)
+VMATHF(ggml_vec_sgn_f32)
+
+#define ITERATIONS 1000
 
 #define N 256
 
@@ -107,71 +111,213 @@ void test_vmathf(void vmathf(int, float *, const float *)) {
     npassert(!munmap(map1, greed + pagesz));
 }
 
+float sgnf(float x) {
+    return (x > 0.f) ? 1.f : ((x < 0.f) ? -1.f : 0.f);
+}
+
+// returns distance between two floats in units of least precision
+long long ulps(float x, float y) {
+    long long a = (int)flt::toint(x);
+    long long b = (int)flt::toint(y);
+    if (a < 0)
+        a = (long long)INT_MIN - a;
+    if (b < 0)
+        b = (long long)INT_MIN - b;
+    return a > b ? a - b : b - a;
+}
+
+// checks vectorized operation agrees with the c library to within
+// max_ulps, for ordinary numbers as well as the special ones.
+void test_accuracy(void vmathf(int, float *, const float *), float mathf(float), int max_ulps) {
+    static const float kSpecial[] = {
+        0.f, -0.f, 1.f, -1.f, INFINITY, -INFINITY, NAN, -NAN, FLT_MIN, -FLT_MIN, FLT_MAX,
+        -FLT_MAX, FLT_TRUE_MIN, -FLT_TRUE_MIN, FLT_MIN / 3, 1 + FLT_EPSILON, 1 - FLT_EPSILON / 2,
+    };
+    enum { M = 1024 };
+    float A[M], B[M];
+    for (int r = 0; r < 256; ++r) {
+        for (int i = 0; i < M; ++i) {
+            switch (rand32() % 4) {
+            case 0:
+                A[i] = numba();
+                break;
+            case 1:
+                A[i] = float01(rand32()) * 1000;
+                break;
+            case 2:
+                A[i] = kSpecial[rand32() % (sizeof(kSpecial) / sizeof(*kSpecial))];
+                break;
+            default:
+                A[i] = flt::tofloat(rand32());
+                break;
+            }
+        }
+        vmathf(M, B, A);
+        for (int i = 0; i < M; ++i) {
+            float want = mathf(A[i]);
+            if (flt::isnan(want) || flt::isnan(B[i])) {
+                npassert(flt::isnan(want) && flt::isnan(B[i]));
+            } else if (ulps(want, B[i]) > max_ulps) {
+                fprintf(stderr, "f(%.9g) = %.9g but want %.9g\n", A[i], B[i], want);
+                npassert(!"inaccurate");
+            }
+        }
+    }
+}
+
+// compares throughput of vectorized operation with the c library
+void test_throughput(const char *name, void vmathf(int, float *, const float *),
+                     float mathf(float)) {
+    enum { M = 4096 };
+    static float A[M], B[M];
+    for (int i = 0; i < M; ++i)
+        A[i] = float01(rand32()) * 100;
+    long long t0 = micros();
+    for (int r = 0; r < ITERATIONS; ++r) {
+        vmathf(M, B, A);
+        __asm__ volatile("" ::: "memory");
+    }
+    long long t1 = micros();
+    for (int r = 0; r < ITERATIONS; ++r) {
+        for (int i = 0; i < M; ++i)
+            B[i] = mathf(A[i]);
+        __asm__ volatile("" ::: "memory");
+    }
+    long long t2 = micros();
+    printf("%-6s %8.3f ns/elem vectorized %8.3f ns/elem scalar\n", name,
+           (t1 - t0) * 1e3 / ITERATIONS / M, (t2 - t1) * 1e3 / ITERATIONS / M);
+}
+
+void test_div(void) {
+    enum { M = 300 };
+    float X[M], Y[M], Z[M];
+    for (int n = 0; n < M; ++n) {
+        for (int i = 0; i < n; ++i) {
+            X[i] = flt::tofloat(rand32());
+            Y[i] = rand32() % 2 ? numba() : flt::tofloat(rand32());
+        }
+        ggml_vec_div_f32(n, Z, X, Y);
+        for (int i = 0; i < n; ++i)
+            npassert(flt::toint(Z[i]) == flt::toint(X[i] / Y[i]) ||
+                     (flt::isnan(Z[i]) && flt::isnan(X[i] / Y[i])));
+    }
+}
+
+void test_set(void) {
+    enum { M = 300 };
+    char buf[M * 4 + 8];
+    for (int n = 0; n < M; ++n) {
+        for (int skew = 0; skew < 4; skew += 2) {
+            memset(buf, 0x55, sizeof(buf));
+            ggml_vec_set_i16(n, (int16_t *)(buf + skew), -2);
+            for (int i = 0; i < n; ++i)
+                npassert(((int16_t *)(buf + skew))[i] == -2);
+            npassert(buf[skew + n * 2] == 0x55);
+            memset(buf, 0x55, sizeof(buf));
+            ggml_vec_set_f32(n, (float *)(buf + skew * 2), -0.f);
+            for (int i = 0; i < n; ++i)
+                npassert(flt::toint(((float *)(buf + skew * 2))[i]) == 0x80000000u);
+            npassert(buf[skew * 2 + n * 4] == 0x55);
+        }
+    }
+}
+
+void test_select(void) {
+    enum { M = 300 };
+    float X[M];
+    int ids[M];
+    for (int n = 0; n < M; ++n) {
+        float t = numba();
+        float max = -INFINITY;
+        for (int i = 0; i < n; ++i) {
+            X[i] = rand32() % 8 ? numba() : t;
+            max = std::max(max, X[i]);
+        }
+        int j = 0;
+        int m = ggml_vec_select_ge_f32(n, ids, X, t);
+        for (int i = 0; i < n; ++i)
+            if (X[i] >= t)
+                npassert(j < m && ids[j++] == i);
+        npassert(j == m);
+        float got;
+        ggml_vec_max_f32(n, &got, X);
+        npassert(flt::toint(got) == flt::toint(max));
+    }
+}
+
+#define TEST_VMATHF(ARCH) \
+    test_vmathf(ggml_vec_gelu_f32##ARCH); \
+    test_vmathf(ggml_vec_silu_f32##ARCH); \
+    test_vmathf(ggml_vec_sqrt_f32##ARCH); \
+    test_vmathf(ggml_vec_log_f32##ARCH); \
+    test_vmathf(ggml_vec_abs_f32##ARCH); \
+    test_vmathf(ggml_vec_sgn_f32##ARCH); \
+    test_accuracy(ggml_vec_sqrt_f32##ARCH, sqrtf, 0); \
+    test_accuracy(ggml_vec_log_f32##ARCH, logf, 4); \
+    test_accuracy(ggml_vec_abs_f32##ARCH, fabsf, 0); \
+    test_accuracy(ggml_vec_sgn_f32##ARCH, sgnf, 0)
+
 int main(int argc, char *argv[]) {
     ShowCrashReports();
 
-    test_vmathf(ggml_vec_gelu_f32);
-    test_vmathf(ggml_vec_silu_f32);
+    TEST_VMATHF();
+    test_div();
+    test_set();
+    test_select();
 
 #ifdef __x86_64__
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2) && X86_HAVE(AVX512F) &&
         X86_HAVE(AVX512BW) && X86_HAVE(AVX512DQ) && X86_HAVE(AVX512VL) && X86_HAVE(AVX512_BF16)) {
-        test_vmathf(ggml_vec_gelu_f32_amd_avx512bf16);
-        test_vmathf(ggml_vec_silu_f32_amd_avx512bf16);
+        TEST_VMATHF(_amd_avx512bf16);
     }
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2) && X86_HAVE(AVX512F) &&
         X86_HAVE(AVX512BW) && X86_HAVE(AVX512DQ) && X86_HAVE(AVX512VL)) {
-        test_vmathf(ggml_vec_gelu_f32_amd_avx512vl);
-        test_vmathf(ggml_vec_silu_f32_amd_avx512vl);
+        TEST_VMATHF(_amd_avx512vl);
     }
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2) && X86_HAVE(AVX512F)) {
-        test_vmathf(ggml_vec_gelu_f32_amd_avx512);
-        test_vmathf(ggml_vec_silu_f32_amd_avx512);
+        TEST_VMATHF(_amd_avx512);
     }
 
     if (X86_HAVE(FMA) && X86_HAVE(F16C) && X86_HAVE(AVX2)) {
-        test_vmathf(ggml_vec_gelu_f32_amd_avx2);
-        test_vmathf(ggml_vec_silu_f32_amd_avx2);
+        TEST_VMATHF(_amd_avx2);
     }
 
     if (X86_HAVE(AVX) && X86_HAVE(F16C)) {
-        test_vmathf(ggml_vec_gelu_f32_amd_f16c);
-        test_vmathf(ggml_vec_silu_f32_amd_f16c);
+        TEST_VMATHF(_amd_f16c);
     }
 
     if (X86_HAVE(AVX) && X86_HAVE(FMA)) {
-        test_vmathf(ggml_vec_gelu_f32_amd_fma);
-        test_vmathf(ggml_vec_silu_f32_amd_fma);
+        TEST_VMATHF(_amd_fma);
     }
 
     if (X86_HAVE(AVX)) {
-        test_vmathf(ggml_vec_gelu_f32_amd_avx);
-        test_vmathf(ggml_vec_silu_f32_amd_avx);
+        TEST_VMATHF(_amd_avx);
     }
 
     if (X86_HAVE(SSSE3)) {
-        test_vmathf(ggml_vec_gelu_f32_amd_ssse3);
-        test_vmathf(ggml_vec_silu_f32_amd_ssse3);
+        TEST_VMATHF(_amd_ssse3);
     }
 
-    test_vmathf(ggml_vec_gelu_f32_amd_k8);
-    test_vmathf(ggml_vec_silu_f32_amd_k8);
+    TEST_VMATHF(_amd_k8);
 
 #elif defined(__aarch64__)
 
     if ((getauxval(AT_HWCAP) & HWCAP_FPHP) && (getauxval(AT_HWCAP) & HWCAP_ASIMDHP)) {
-        test_vmathf(ggml_vec_gelu_f32_arm82);
-        test_vmathf(ggml_vec_silu_f32_arm82);
+        TEST_VMATHF(_arm82);
     }
 
-    test_vmathf(ggml_vec_gelu_f32_arm80);
-    test_vmathf(ggml_vec_silu_f32_arm80);
+    TEST_VMATHF(_arm80);
 
 #endif
 
+    test_throughput("sqrt", ggml_vec_sqrt_f32, sqrtf);
+    test_throughput("log", ggml_vec_log_f32, logf);
+    test_throughput("abs", ggml_vec_abs_f32, fabsf);
+    test_throughput("sgn", ggml_vec_sgn_f32, sgnf);
+
     CheckForMemoryLeaks();
     return 0;
 }
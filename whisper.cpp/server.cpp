@@ -18,6 +18,8 @@
 #include <cstring>
 #include <sstream>
 #include <chrono>
+#include <mutex>
+#include <shared_mutex>
 
 #if defined(_MSC_VER)
 #pragma warning(disable: 4244 4267) // possible loss of data
@@ -41,10 +43,18 @@ struct server_params
     std::string public_path = "examples/server/public";
     std::string request_path = "";
     std::string inference_path = "/inference";
+    std::string stream_path = "/stream";
 
     int32_t port          = 8080;
     int32_t read_timeout  = 600;
     int32_t write_timeout = 600;
+
+    // live transcription via the stream path
+    int32_t step_ms    = 500;   // how often the unconfirmed tail is decoded
+    int32_t length_ms  = 10000; // tail length that forces a commit
+    int32_t vad_ms     = 500;   // trailing quiet that ends an utterance
+    float   vad_thold  = 0.6f;
+    float   freq_thold = 100.0f;
 };
 
 struct whisper_params {
@@ -137,6 +147,12 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  --public PATH,                 [%-7s] Path to the public folder\n", sparams.public_path.c_str());
     fprintf(stderr, "  --request-path PATH,           [%-7s] Request path for all requests\n", sparams.request_path.c_str());
     fprintf(stderr, "  --inference-path PATH,         [%-7s] Inference path for all requests\n", sparams.inference_path.c_str());
+    fprintf(stderr, "  --stream-path PATH,            [%-7s] Path for live transcription of chunked uploads\n", sparams.stream_path.c_str());
+    fprintf(stderr, "  --step N,                      [%-7d] Stream decode interval in milliseconds\n", sparams.step_ms);
+    fprintf(stderr, "  --length N,                    [%-7d] Stream tail length that forces a commit in milliseconds\n", sparams.length_ms);
+    fprintf(stderr, "  --vad-ms N,                    [%-7d] Stream trailing quiet that ends an utterance in milliseconds\n", sparams.vad_ms);
+    fprintf(stderr, "  -vth N,    --vad-thold N       [%-7.2f] Stream voice activity detection threshold\n", sparams.vad_thold);
+    fprintf(stderr, "  -fth N,    --freq-thold N      [%-7.2f] Stream high-pass frequency cutoff\n", sparams.freq_thold);
     fprintf(stderr, "  --recompile                    [%-7s] Force GPU support to be recompiled at runtime if possible.\n", FLAG_recompile ? "true" : "false");
     fprintf(stderr, "  --nocompile                    [%-7s] Never compile GPU support at runtime.", FLAG_nocompile ? "true" : "false");
     fprintf(stderr, "\n");
@@ -222,6 +238,13 @@ bool whisper_params_parse(int argc, char ** argv, whisper_params & params, serve
         else if (                  arg == "--host")            { sparams.hostname    = argv[++i]; }
         else if (                  arg == "--public")          { sparams.public_path = argv[++i]; }
         else if (                  arg == "--request-path")    { sparams.request_path = argv[++i]; }
+        else if (                  arg == "--inference-path")  { sparams.inference_path = argv[++i]; }
+        else if (                  arg == "--stream-path")     { sparams.stream_path = argv[++i]; }
+        else if (                  arg == "--step")            { sparams.step_ms     = std::stoi(argv[++i]); }
+        else if (                  arg == "--length")          { sparams.length_ms   = std::stoi(argv[++i]); }
+        else if (                  arg == "--vad-ms")          { sparams.vad_ms      = std::stoi(argv[++i]); }
+        else if (arg == "-vth"  || arg == "--vad-thold")       { sparams.vad_thold   = std::stof(argv[++i]); }
+        else if (arg == "-fth"  || arg == "--freq-thold")      { sparams.freq_thold  = std::stof(argv[++i]); }
         else if (                  arg == "--recompile")       { FLAG_recompile = true; }
         else if (                  arg == "--nocompile")       { FLAG_nocompile = true; }
         else if (                  arg == "--tinyblas")        { FLAG_tinyblas = true; }
@@ -491,13 +514,209 @@ void get_req_parameters(const Request & req, whisper_params & params)
     }
 }
 
+// returns why the stream settings can't be used, or nullptr if they're ok
+const char * stream_params_error(const server_params & sparams) {
+    if (!(50 <= sparams.step_ms && sparams.step_ms <= 30000)) {
+        return "step must be 50 through 30000 ms";
+    }
+    if (!(1000 <= sparams.length_ms && sparams.length_ms <= 30000)) {
+        return "length must be 1000 through 30000 ms";
+    }
+    if (!(100 <= sparams.vad_ms && sparams.vad_ms <= 10000)) {
+        return "vad_ms must be 100 through 10000 ms";
+    }
+    if (!(0 <= sparams.vad_thold && sparams.vad_thold <= 1)) {
+        return "vad_thold must be 0 through 1";
+    }
+    if (!(0 <= sparams.freq_thold && sparams.freq_thold <= WHISPER_SAMPLE_RATE / 2)) {
+        return "freq_thold must be 0 through 8000";
+    }
+    return nullptr;
+}
+
+// [jart] live transcription of a chunked upload
+//
+// audio arrives as raw 16khz mono s16le pcm and is appended to a buffer
+// holding only the part of the conversation whose transcript hasn't been
+// confirmed yet. every step that tail gets decoded again, using encoder
+// context sized to its length rather than the full 30 second window. a
+// segment is confirmed once two consecutive decodes agree on its text,
+// or when vad_simple() notices the speaker paused. confirmed text gets
+// sent as a final event, its tokens become the prompt, and its audio is
+// dropped, so the work per step is bounded by the tail, not the call.
+struct stream_session {
+    whisper_context * ctx;
+    whisper_state * state;
+    const whisper_params & params;
+    const server_params & sparams;
+    DataSink & sink;
+
+    std::vector<float> pcm;             // unconfirmed audio
+    std::vector<whisper_token> prompt;  // confirmed tokens
+    std::vector<std::string> pending;   // unconfirmed segments last decode
+    int64_t n_dropped = 0;              // samples confirmed so far
+    size_t n_decoded = 0;               // size of pcm at last decode
+    std::string partial;
+    int n_final = 0;
+    int odd = -1;
+
+    bool send(const char * event, const json & data) {
+        std::string s = "event: ";
+        s += event;
+        s += "\ndata: ";
+        s += data.dump(-1, ' ', false, json::error_handler_t::replace);
+        s += "\n\n";
+        return sink.write(s.data(), s.size());
+    }
+
+    bool feed(const char * p, size_t n) {
+        if (odd != -1 && n) {
+            pcm.push_back(int16_t(odd | (uint8_t)*p++ << 8) / 32768.0f);
+            odd = -1;
+            --n;
+        }
+        for (; n >= 2; p += 2, n -= 2) {
+            pcm.push_back(int16_t((uint8_t)p[0] | (uint8_t)p[1] << 8) / 32768.0f);
+        }
+        if (n) {
+            odd = (uint8_t)*p;
+        }
+        if (pcm.size() - n_decoded < (size_t)sparams.step_ms * WHISPER_SAMPLE_RATE / 1000) {
+            return true;
+        }
+        return step(false);
+    }
+
+    // the encoder has 50 positions per second of audio
+    int audio_ctx(size_t n_samples) {
+        int n = (n_samples * 50 + WHISPER_SAMPLE_RATE - 1) / WHISPER_SAMPLE_RATE;
+        n = (n + 63) & -64;
+        return std::min(n, whisper_n_audio_ctx(ctx));
+    }
+
+    bool step(bool eof) {
+        n_decoded = pcm.size();
+        if (pcm.empty()) {
+            return true;
+        }
+
+        bool pause = false;
+        if (!eof) {
+            std::vector<float> tmp = pcm;
+            pause = vad_simple(tmp, WHISPER_SAMPLE_RATE, sparams.vad_ms,
+                               sparams.vad_thold, sparams.freq_thold, false);
+        }
+        bool commit = eof || pause ||
+                      pcm.size() >= (size_t)sparams.length_ms * WHISPER_SAMPLE_RATE / 1000;
+
+        // whisper_full() ignores anything shorter than a second
+        std::vector<float> padded;
+        const float * audio = pcm.data();
+        size_t n_audio = pcm.size();
+        if (n_audio < WHISPER_SAMPLE_RATE * 11 / 10) {
+            padded = pcm;
+            padded.resize(WHISPER_SAMPLE_RATE * 11 / 10);
+            audio = padded.data();
+            n_audio = padded.size();
+        }
+
+        whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+        wparams.print_progress   = false;
+        wparams.print_special    = false;
+        wparams.print_realtime   = false;
+        wparams.print_timestamps = false;
+        wparams.translate        = params.translate;
+        wparams.language         = params.language.c_str();
+        wparams.n_threads        = params.n_threads;
+        wparams.no_context       = true;
+        wparams.audio_ctx        = audio_ctx(n_audio);
+        wparams.temperature_inc  = params.no_fallback ? 0.0f : wparams.temperature_inc;
+        wparams.prompt_tokens    = prompt.empty() ? nullptr : prompt.data();
+        wparams.prompt_n_tokens  = prompt.size();
+
+        if (whisper_full_with_state(ctx, state, wparams, audio, n_audio) != 0) {
+            send("error", json{{"error", "failed to process audio"}});
+            return false;
+        }
+
+        // confirm segments that haven't changed since the last decode,
+        // except the final one, which is likely still being spoken
+        int n_segments = whisper_full_n_segments_from_state(state);
+        int n_commit = 0;
+        if (commit) {
+            n_commit = n_segments;
+        } else {
+            while (n_commit < n_segments - 1 &&
+                   n_commit < (int)pending.size() &&
+                   pending[n_commit] == whisper_full_get_segment_text_from_state(state, n_commit)) {
+                ++n_commit;
+            }
+        }
+
+        for (int i = 0; i < n_commit; ++i) {
+            int64_t t0 = whisper_full_get_segment_t0_from_state(state, i);
+            int64_t t1 = whisper_full_get_segment_t1_from_state(state, i);
+            int64_t offset = n_dropped * 100 / WHISPER_SAMPLE_RATE;
+            if (!send("final", json{{"id", n_final++},
+                                    {"start", (t0 + offset) * 0.01},
+                                    {"end", (t1 + offset) * 0.01},
+                                    {"text", whisper_full_get_segment_text_from_state(state, i)}})) {
+                return false;
+            }
+            int n_tokens = whisper_full_n_tokens_from_state(state, i);
+            for (int j = 0; j < n_tokens; ++j) {
+                whisper_token id = whisper_full_get_token_id_from_state(state, i, j);
+                if (id < whisper_token_eot(ctx)) {
+                    prompt.push_back(id);
+                }
+            }
+        }
+        int n_prompt_max = whisper_n_text_ctx(ctx) / 2;
+        if ((int)prompt.size() > n_prompt_max) {
+            prompt.erase(prompt.begin(), prompt.end() - n_prompt_max);
+        }
+
+        // drop the audio behind the confirmed text. if nothing was
+        // confirmed, keep it all, since it may hold the onset of a word
+        // that whisper couldn't recognize yet
+        size_t n_drop = 0;
+        if (commit) {
+            n_drop = pcm.size();
+        } else if (n_commit) {
+            int64_t t0 = whisper_full_get_segment_t0_from_state(state, n_commit);
+            n_drop = std::min(pcm.size(), (size_t)(t0 * WHISPER_SAMPLE_RATE / 100));
+        }
+        if (n_drop) {
+            pcm.erase(pcm.begin(), pcm.begin() + n_drop);
+            n_dropped += n_drop;
+            n_decoded -= n_drop;
+        }
+
+        std::string text;
+        pending.clear();
+        for (int i = n_commit; i < n_segments; ++i) {
+            pending.emplace_back(whisper_full_get_segment_text_from_state(state, i));
+            text += pending.back();
+        }
+        if (text != partial) {
+            partial = text;
+            if (!text.empty()) {
+                return send("partial", json{{"start", n_dropped * 1.0 / WHISPER_SAMPLE_RATE},
+                                            {"text", text}});
+            }
+        }
+        return true;
+    }
+};
+
 }  // namespace
 
 int whisper_server_main(int argc, char ** argv) {
     whisper_params params;
     server_params sparams;
 
-    std::mutex whisper_mutex;
+    std::mutex whisper_mutex;      // guards the context's own state
+    std::shared_mutex model_mutex; // held exclusively by /load
 
     if (whisper_params_parse(argc, argv, params, sparams) == false) {
         whisper_print_usage(argc, argv, params, sparams);
@@ -516,6 +735,11 @@ int whisper_server_main(int argc, char ** argv) {
         exit(0);
     }
 
+    if (const char * err = stream_params_error(sparams)) {
+        fprintf(stderr, "error: %s\n", err);
+        exit(1);
+    }
+
     // whisper init
     struct whisper_context_params cparams = whisper_context_default_params();
 
@@ -619,6 +843,13 @@ int whisper_server_main(int argc, char ** argv) {
     -F response_format="json"
         </pre>
 
+        <h2>/stream</h2>
+        <pre>
+    arecord -q -f S16_LE -r 16000 -c 1 -t raw | \
+    curl -N -X POST -T - 127.0.0.1:)" + std::to_string(sparams.port) + R"(/stream?language=en \
+    -H "Content-Type: application/octet-stream"
+        </pre>
+
         <h2>/load</h2>
         <pre>
     curl 127.0.0.1:)" + std::to_string(sparams.port) + R"(/load \
@@ -665,6 +896,7 @@ int whisper_server_main(int argc, char ** argv) {
 
     svr.Post(sparams.request_path + sparams.inference_path, [&](const Request &req, Response &res){
         // acquire whisper model mutex lock
+        std::shared_lock<std::shared_mutex> model_lock(model_mutex);
         std::lock_guard<std::mutex> lock(whisper_mutex);
 
         // first check user requested fields of the request
@@ -948,7 +1180,71 @@ int whisper_server_main(int argc, char ** argv) {
         // reset params to thier defaults
         params = default_params;
     });
+    svr.Options(sparams.request_path + sparams.stream_path, [&](const Request &, Response &){
+    });
+
+    svr.Post(sparams.request_path + sparams.stream_path, [&](const Request &req, Response &res,
+                                                             const ContentReader &content_reader){
+        if (req.is_multipart_form_data()) {
+            const std::string error_resp = "{\"error\":\"expected raw 16khz mono s16le pcm\"}";
+            res.set_content(error_resp, "application/json");
+            res.status = 400;
+            return;
+        }
+
+        // query parameters override the server defaults for this stream
+        whisper_params stream_params = default_params;
+        server_params stream_sparams = sparams;
+        const char * err = nullptr;
+        try {
+            if (req.has_param("language"))   stream_params.language    = req.get_param_value("language");
+            if (req.has_param("translate"))  stream_params.translate   = parse_str_to_bool(req.get_param_value("translate"));
+            if (req.has_param("step"))       stream_sparams.step_ms    = std::stoi(req.get_param_value("step"));
+            if (req.has_param("length"))     stream_sparams.length_ms  = std::stoi(req.get_param_value("length"));
+            if (req.has_param("vad_ms"))     stream_sparams.vad_ms     = std::stoi(req.get_param_value("vad_ms"));
+            if (req.has_param("vad_thold"))  stream_sparams.vad_thold  = std::stof(req.get_param_value("vad_thold"));
+            if (req.has_param("freq_thold")) stream_sparams.freq_thold = std::stof(req.get_param_value("freq_thold"));
+            err = stream_params_error(stream_sparams);
+        } catch (const std::exception &) {
+            err = "query parameter must be a number";
+        }
+        if (!err && stream_params.language != "auto" &&
+            whisper_lang_id(stream_params.language.c_str()) == -1) {
+            err = "unknown language";
+        }
+        if (err) {
+            res.set_content(json{{"error", err}}.dump(), "application/json");
+            res.status = 400;
+            return;
+        }
+
+        // the request body is read while the response is being written,
+        // so events go out as soon as each piece of audio is decoded.
+        // every stream gets its own whisper_state, which lets calls run
+        // concurrently with each other and with /inference requests.
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream",
+            [&, content_reader, stream_params, stream_sparams](size_t, DataSink &sink) {
+                std::shared_lock<std::shared_mutex> model_lock(model_mutex);
+                whisper_state * state = whisper_init_state(ctx);
+                if (!state) {
+                    return false;
+                }
+                stream_session session{ctx, state, stream_params, stream_sparams, sink};
+                bool ok = content_reader([&](const char * data, size_t size) {
+                    return session.feed(data, size);
+                });
+                if (ok && session.step(true)) {
+                    session.send("done", json{{"segments", session.n_final}});
+                }
+                whisper_free_state(state);
+                sink.done();
+                return true;
+            });
+    });
+
     svr.Post(sparams.request_path + "/load", [&](const Request &req, Response &res){
+        std::unique_lock<std::shared_mutex> model_lock(model_mutex);
         std::lock_guard<std::mutex> lock(whisper_mutex);
         if (!req.has_file("model"))
         {